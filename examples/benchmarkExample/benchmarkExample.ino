@@ -0,0 +1,264 @@
+#include "Networking.h"
+#include <Arduino.h>
+
+//-- Measures the output and loop() paths on the device. Results are printed as
+//-- "bench <name> ..." lines, easy to grep from a serial log or a telnet session.
+//-- Type "bench [lines|ntp|loop|reconnect|all]" in a telnet session to run them again.
+
+Networking* networking = nullptr;
+MultiStream* multi = nullptr;
+Stream* debug = nullptr;
+
+const uint16_t BENCH_LINES       = 200;     //-- Lines per MultiStream run
+const uint16_t BENCH_CALLS       = 1000;    //-- Calls per ntpGet*() and loop() run
+const uint32_t RECONNECT_TIMEOUT = 30000;   //-- Give up waiting for an IP after 30 seconds
+
+//-- What the next loop() runs, set by the "bench" command
+bool runLines     = true;
+bool runNtp       = true;
+bool runLoop      = true;
+bool runReconnect = false;    //-- Drops the telnet sessions, only on request
+
+uint32_t bootStarted     = 0;
+bool     bootReported    = false;
+uint32_t reconnectStart  = 0;
+bool     reconnectDown   = false;
+bool     reconnectActive = false;
+
+volatile uint32_t sink = 0;   //-- Keeps the measured calls from being optimized away
+
+struct LineStats
+{
+    uint32_t lines;
+    uint32_t bytes;
+    uint32_t totalUs;
+    uint32_t minUs;
+    uint32_t maxUs;
+    uint32_t overflow;        //-- Bytes the ring had no room for
+};
+
+//-- Prints BENCH_LINES lines of about 64 bytes, timing every print() and the run up to the last byte
+LineStats benchLines(const char* name, bool critical)
+{
+    LineStats stats = {};
+    stats.minUs = 0xFFFFFFFF;
+    uint32_t overflow = multi->getOverflowBytes();
+
+    uint32_t start = micros();
+    if (critical)
+    {
+        multi->beginCriticalSection();
+    }
+    for (uint16_t i = 0; i < BENCH_LINES; i++)
+    {
+        uint32_t lineStart = micros();
+        size_t length = multi->printf("bench %-10s line %3u of %3u, the quick brown fox\n", name, i + 1, BENCH_LINES);
+        uint32_t us = micros() - lineStart;
+
+        stats.lines++;
+        stats.bytes += length;
+        stats.minUs = (us < stats.minUs) ? us : stats.minUs;
+        stats.maxUs = (us > stats.maxUs) ? us : stats.maxUs;
+
+        //-- What Networking::loop() does in ring buffer mode
+        multi->drain();
+    }
+    if (critical)
+    {
+        multi->endCriticalSection();
+    }
+    multi->flush();
+    stats.totalUs  = micros() - start;
+    stats.overflow = multi->getOverflowBytes() - overflow;
+    return stats;
+}
+
+void printLines(const char* name, const LineStats& stats)
+{
+    uint32_t bytesPerSecond = stats.totalUs ? (uint32_t)((uint64_t)stats.bytes * 1000000 / stats.totalUs) : 0;
+    debug->printf("bench %-10s %u lines %u bytes in %lu us: %lu bytes/s, line min %lu avg %lu max %lu us, %lu bytes lost\n"
+                , name, (unsigned)stats.lines, (unsigned)stats.bytes, (unsigned long)stats.totalUs, (unsigned long)bytesPerSecond
+                , (unsigned long)stats.minUs, (unsigned long)(stats.totalUs / stats.lines), (unsigned long)stats.maxUs
+                , (unsigned long)stats.overflow);
+}
+
+//-- MultiStream: serial only or serial + telnet, direct, critical section and ring buffer mode
+void benchOutput()
+{
+    bool telnet = multi->getClientCount() > 0;
+    const char* sinks = telnet ? "serial+telnet" : "serial only";
+
+    LineStats direct = benchLines("direct", false);
+    LineStats critical = benchLines("critical", true);
+    multi->setRingBufferMode(true);
+    LineStats ring = benchLines("ring", false);
+    multi->setRingBufferMode(false);
+
+    debug->printf("bench output to %s, %u telnet session(s)\n", sinks, (unsigned)multi->getClientCount());
+    printLines("direct", direct);
+    printLines("critical", critical);
+    printLines("ring", ring);
+    if (!telnet)
+    {
+        debug->println("bench connect a telnet session and type \"bench lines\" for serial+telnet");
+    }
+}
+
+//-- Cost of one call, in cycles and microseconds
+template <typename Call>
+void benchCall(const char* name, Call call)
+{
+    uint32_t start = ESP.getCycleCount();
+    for (uint16_t i = 0; i < BENCH_CALLS; i++)
+    {
+        call();
+    }
+    uint32_t cycles = (ESP.getCycleCount() - start) / BENCH_CALLS;
+    debug->printf("bench %-22s %6lu cycles, %lu.%02lu us per call\n", name, (unsigned long)cycles
+                , (unsigned long)(cycles / ESP.getCpuFreqMHz()), (unsigned long)((cycles * 100 / ESP.getCpuFreqMHz()) % 100));
+}
+
+void benchNtp()
+{
+    #ifdef NETWORKING_NO_NTP
+    debug->println("bench ntp skipped, built with NETWORKING_NO_NTP");
+    #else
+    if (!networking->ntpIsValid())
+    {
+        debug->println("bench ntp: not synchronized yet, the numbers are for the unsynchronized paths");
+    }
+    char buffer[32];
+    benchCall("ntpGetEpoch", [] { sink += networking->ntpGetEpoch(); });
+    benchCall("ntpGetEpochMicros", [] { sink += (uint32_t)networking->ntpGetEpochMicros(); });
+    benchCall("ntpGetDateTime(buffer)", [&buffer] { sink += networking->ntpGetDateTime(buffer, sizeof(buffer))[0]; });
+    benchCall("ntpGetDateTime(posix)", [&buffer]
+    {
+        sink += networking->ntpGetDateTime(buffer, sizeof(buffer), "EST5EDT,M3.2.0,M11.1.0")[0];
+    });
+    benchCall("ntpCachedDateTime", [] { sink += networking->ntpCachedDateTime()[0]; });
+    #endif
+}
+
+//-- loop() when nothing is due: the cost every sketch pays on every pass
+void benchLoop()
+{
+    uint32_t minUs = 0xFFFFFFFF;
+    uint32_t maxUs = 0;
+    uint32_t start = micros();
+    for (uint16_t i = 0; i < BENCH_CALLS; i++)
+    {
+        uint32_t callStart = micros();
+        networking->loop();
+        uint32_t us = micros() - callStart;
+        minUs = (us < minUs) ? us : minUs;
+        maxUs = (us > maxUs) ? us : maxUs;
+    }
+    uint32_t totalUs = micros() - start;
+    debug->printf("bench %-10s %u calls: min %lu avg %lu.%02lu max %lu us\n", "loop", BENCH_CALLS, (unsigned long)minUs
+                , (unsigned long)(totalUs / BENCH_CALLS), (unsigned long)((totalUs * 100 / BENCH_CALLS) % 100)
+                , (unsigned long)maxUs);
+}
+
+//-- Drops WiFi and times the way back to an IP address, finished from loop()
+void startReconnect()
+{
+    debug->println("bench reconnect: dropping WiFi, the telnet sessions close");
+    multi->flush();
+    reconnectStart  = millis();
+    reconnectDown   = false;
+    reconnectActive = true;
+    networking->reconnectWiFi();
+}
+
+void checkReconnect()
+{
+    if (!networking->isConnected())
+    {
+        reconnectDown = true;
+    }
+    else if (reconnectDown)
+    {
+        debug->printf("bench %-10s time to IP %lu ms\n", "reconnect", (unsigned long)(millis() - reconnectStart));
+        reconnectActive = false;
+    }
+    if (reconnectActive && millis() - reconnectStart > RECONNECT_TIMEOUT)
+    {
+        debug->printf("bench reconnect: no IP after %lu ms\n", (unsigned long)RECONNECT_TIMEOUT);
+        reconnectActive = false;
+    }
+}
+
+//-- "bench [lines|ntp|loop|reconnect|all]", runs from the next loop()
+void commandBench(char* args, Print& out)
+{
+    bool all     = (args[0] == 0 || strcmp(args, "all") == 0);
+    runLines     = all || strcmp(args, "lines") == 0;
+    runNtp       = all || strcmp(args, "ntp") == 0;
+    runLoop      = all || strcmp(args, "loop") == 0;
+    runReconnect = strcmp(args, "reconnect") == 0;
+    if (!runLines && !runNtp && !runLoop && !runReconnect)
+    {
+        out.print("Usage: bench [lines|ntp|loop|reconnect|all]\r\n");
+        return;
+    }
+    out.print("Benchmark starts after this command\r\n");
+}
+
+void setup()
+{
+    networking = new Networking();
+    networking->addCommand("bench", "bench [lines|ntp|loop|reconnect|all]", commandBench);
+
+    //-- Non-blocking, so a reconnect can be timed from loop()
+    bootStarted = millis();
+    #ifdef ESP8266
+        debug = networking->beginAsync("esp8266-bench", 0, Serial, 115200);
+    #else
+        debug = networking->beginAsync("esp32-bench", 0, Serial, 115200);
+    #endif
+    multi = networking->getMultiStream();
+}
+
+void loop()
+{
+    networking->loop();
+
+    if (networking->getState() != Networking::SERVICES_UP)
+    {
+        return;
+    }
+    if (!bootReported)
+    {
+        debug->printf("bench %-10s time to services %lu ms\n", "boot", (unsigned long)(millis() - bootStarted));
+        #ifndef NETWORKING_NO_NTP
+        networking->ntpStart("CET-1CEST,M3.5.0,M10.5.0/3");
+        #endif
+        bootReported = true;
+    }
+    if (reconnectActive)
+    {
+        checkReconnect();
+        return;
+    }
+
+    if (runLines)
+    {
+        benchOutput();
+        runLines = false;
+    }
+    if (runNtp)
+    {
+        benchNtp();
+        runNtp = false;
+    }
+    if (runLoop)
+    {
+        benchLoop();
+        runLoop = false;
+    }
+    if (runReconnect)
+    {
+        startReconnect();
+        runReconnect = false;
+    }
+}
@@ -0,0 +1,49 @@
+#include "Networking.h"
+#include <Arduino.h>
+
+Networking* networking = nullptr;
+Stream* debug = nullptr;
+
+//-- Hold this pin LOW during wake-up for a maintenance wake (OTA, telnet, MDNS)
+const int MAINTENANCE_PIN = 0;
+const uint32_t SLEEP_TIME = 60000;    //-- 1 minute between readings
+const uint32_t MAX_AWAKE  = 5000;     //-- give up on WiFi after 5 seconds
+
+bool readingSent = false;
+
+void sendReading()
+{
+    //-- Replace with your own sensor reading and upload
+    debug->printf("Reading at %s: %d\n", networking->ntpGetDateTime(), analogRead(A0));
+}
+
+void setup() 
+{
+    networking = new Networking();
+
+    //-- Returns immediately, WiFi and the clock are restored from RTC memory
+    debug = networking->beginBurst("burstExample", MAINTENANCE_PIN, Serial, 115200);
+    
+    if (networking->isMaintenanceWake())
+    {
+        debug->println("Maintenance wake: OTA and telnet will be available");
+    }
+}
+
+void loop() 
+{
+    networking->loop();
+
+    if (networking->getState() == Networking::SERVICES_UP && !readingSent)
+    {
+        networking->ntpStart("CET-1CEST,M3.5.0,M10.5.0/3");
+        sendReading();
+        readingSent = true;
+    }
+
+    //-- A maintenance wake stays awake, a normal wake goes back to sleep
+    if (!networking->isMaintenanceWake() && (readingSent || millis() > MAX_AWAKE))
+    {
+        networking->sleepFor(SLEEP_TIME);
+    }
+}
@@ -41,6 +41,18 @@ void showTime()
     debug->print("\nNew York Time        : ");
     debug->println(networking->ntpGetDateTime("EST5EDT,M3.2.0,M11.1.0"));
 
+    //-- Caller provided buffers: safe to use twice in one printf()
+    char local[20], newYork[20];
+    debug->printf("Amsterdam / New York : %s / %s\n"
+                 , networking->ntpGetTime(local, sizeof(local))
+                 , networking->ntpGetTime(newYork, sizeof(newYork), "EST5EDT,M3.2.0,M11.1.0"));
+
+    //-- Precompiled format with milliseconds
+    static const NtpFormat logStamp("[%H:%M:%S.%L] ");
+    char stamp[20];
+    debug->print(networking->ntpFormat(stamp, sizeof(stamp), logStamp));
+    debug->println("log line with a timestamp");
+
 }
 
 
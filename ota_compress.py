@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+#
+# Compresses a firmware image for Networking::startPullOTA().
+#
+#   python3 ota_compress.py firmware.bin firmware.bin.hs [-w 11] [-l 4]
+#
+# The output is a 12 byte header followed by a heatshrink (LZSS) stream:
+#   "HSOT", window bits, lookahead bits, 2 reserved bytes, image size (uint32 LE)
+# The device decompresses it while it streams, with a 2^window byte buffer.
+# Prints the SHA-256 of the output, which is what startPullOTA() checks.
+
+import argparse
+import hashlib
+import struct
+import sys
+
+MAGIC = b"HSOT"
+
+
+class BitWriter:
+    def __init__(self):
+        self.out = bytearray()
+        self.byte = 0
+        self.count = 0
+
+    def put(self, value, bits):
+        for shift in range(bits - 1, -1, -1):
+            self.byte = (self.byte << 1) | ((value >> shift) & 1)
+            self.count += 1
+            if self.count == 8:
+                self.out.append(self.byte)
+                self.byte = 0
+                self.count = 0
+
+    def finish(self):
+        if self.count:
+            self.out.append(self.byte << (8 - self.count))
+        return bytes(self.out)
+
+
+def compress(data, window_bits, lookahead_bits):
+    window = 1 << window_bits
+    max_length = 1 << lookahead_bits
+    # A back-reference must be shorter than the literals it replaces
+    min_length = (1 + window_bits + lookahead_bits) // 9 + 1
+    chains = {}
+    writer = BitWriter()
+    i = 0
+    while i < len(data):
+        best_length = 0
+        best_distance = 0
+        key = data[i:i + 3]
+        if len(key) == 3:
+            for start in reversed(chains.get(key, [])[-32:]):
+                distance = i - start
+                if distance > window:
+                    break
+                length = 0
+                while length < max_length and i + length < len(data) and data[start + length] == data[i + length]:
+                    length += 1
+                if length > best_length:
+                    best_length = length
+                    best_distance = distance
+                    if length == max_length:
+                        break
+        step = best_length if best_length >= min_length else 1
+        if step > 1:
+            writer.put(0, 1)
+            writer.put(best_distance - 1, window_bits)
+            writer.put(best_length - 1, lookahead_bits)
+        else:
+            writer.put(1, 1)
+            writer.put(data[i], 8)
+        for position in range(i, i + step):
+            chains.setdefault(data[position:position + 3], []).append(position)
+        i += step
+    return writer.finish()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compress a firmware image for pull-mode OTA")
+    parser.add_argument("input")
+    parser.add_argument("output")
+    parser.add_argument("-w", "--window", type=int, default=11, help="window bits, 4..12 (default 11)")
+    parser.add_argument("-l", "--lookahead", type=int, default=4, help="lookahead bits, 3..window-1 (default 4)")
+    args = parser.parse_args()
+
+    if not 4 <= args.window <= 12 or not 3 <= args.lookahead < args.window:
+        sys.exit("window must be 4..12 and lookahead 3..window-1")
+
+    with open(args.input, "rb") as f:
+        image = f.read()
+    stream = compress(image, args.window, args.lookahead)
+    packed = MAGIC + struct.pack("<BBHI", args.window, args.lookahead, 0, len(image)) + stream
+    with open(args.output, "wb") as f:
+        f.write(packed)
+
+    print("%s: %d -> %d bytes (%.0f%%)" % (args.output, len(image), len(packed), 100.0 * len(packed) / max(len(image), 1)))
+    print("sha256 %s" % hashlib.sha256(packed).hexdigest())
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+#
+# Sends a firmware image to every device listening for multicast OTA
+# (Networking::enableMulticastOTA()) at once.
+#
+#   python3 ota_multicast.py firmware.bin [--key secret] [--rate 80] [--expect 60]
+#
+# The image is sent once to the group; afterwards each device reports the
+# blocks it missed (NACK) and gets those resent by unicast, until every
+# device that answered is done. See MulticastOTA.h for the packet layout.
+
+import argparse
+import hashlib
+import hmac
+import random
+import socket
+import struct
+import sys
+import time
+
+MAGIC = b"MOTA"
+VERSION = 1
+ANNOUNCE, DATA, END, NACK, DONE = 1, 2, 3, 4, 5
+STATUS = {0: "ok", 1: "SHA-256 mismatch", 2: "flash error", 3: "rejected"}
+
+
+class Sender:
+    def __init__(self, args, image):
+        self.args = args
+        self.image = image
+        self.session = random.randrange(1, 0x10000)
+        self.block_size = args.block_size
+        self.blocks = (len(image) + self.block_size - 1) // self.block_size
+        self.interval = self.block_size / (args.rate * 1024.0)
+        self.devices = {}       # address -> status (None while blocks are missing)
+        self.names = {}
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+        self.sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_TTL, args.ttl)
+        if args.interface:
+            self.sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_IF, socket.inet_aton(args.interface))
+        self.sock.bind(("", 0))
+        self.group = (args.group, args.port)
+
+    def header(self, kind):
+        return MAGIC + struct.pack("<BBH", kind, VERSION, self.session)
+
+    def announce(self):
+        body = self.header(ANNOUNCE) + struct.pack("<IHH", len(self.image), self.block_size, 0)
+        body += hashlib.sha256(self.image).digest()
+        key = self.args.key.encode() if self.args.key else None
+        return body + (hmac.new(key, body, hashlib.sha256).digest() if key else bytes(32))
+
+    def data(self, block):
+        start = block * self.block_size
+        return self.header(DATA) + struct.pack("<I", block) + self.image[start:start + self.block_size]
+
+    def send(self, packet, address):
+        self.sock.sendto(packet, address)
+        time.sleep(self.interval)
+
+    def receive(self, seconds, until=None):
+        # Collects answers for a while, or until all of `until` answered;
+        # returns {address: [(first, count), ...]} of the NACKs
+        nacks = {}
+        answered = set()
+        deadline = time.time() + seconds
+        while True:
+            left = deadline - time.time()
+            if left <= 0 or (until and until <= answered):
+                return nacks
+            self.sock.settimeout(left)
+            try:
+                packet, address = self.sock.recvfrom(1500)
+            except socket.timeout:
+                return nacks
+            if len(packet) < 8 or packet[:4] != MAGIC:
+                continue
+            kind, version, session = struct.unpack_from("<BBH", packet, 4)
+            if version != VERSION or session != self.session:
+                continue
+            if kind == NACK:
+                (count,) = struct.unpack_from("<H", packet, 8)
+                ranges = [struct.unpack_from("<IH", packet, 10 + 6 * i) for i in range(count)]
+                nacks[address] = ranges
+                answered.add(address)
+                self.devices.setdefault(address, None)
+            elif kind == DONE:
+                answered.add(address)
+                if self.devices.get(address) is None:
+                    self.names[address] = packet[9:].decode(errors="replace")
+                    self.devices[address] = packet[8]
+                    print("  %-15s %-24s %s" % (address[0], self.names[address], STATUS.get(packet[8], packet[8])))
+
+    def run(self):
+        started = time.time()
+        print("Session %04x: %d bytes in %d blocks to %s:%d" % (self.session, len(self.image), self.blocks, *self.group))
+
+        #-- Announce repeatedly, the devices erase flash meanwhile
+        for _ in range(int(self.args.announce / 0.2)):
+            self.sock.sendto(self.announce(), self.group)
+            time.sleep(0.2)
+
+        #-- One multicast pass, re-announced now and then for late joiners
+        for block in range(self.blocks):
+            if block % 256 == 255:
+                self.sock.sendto(self.announce(), self.group)
+            self.send(self.data(block), self.group)
+        print("Pass done in %.1f s" % (time.time() - started))
+
+        #-- Repair rounds: ask who misses what, resend that by unicast
+        self.sock.sendto(self.header(END), self.group)
+        nacks = self.receive(1.0)
+        waiting = set()
+        for _ in range(self.args.rounds):
+            for address, ranges in nacks.items():
+                for first, count in ranges:
+                    for block in range(first, min(first + count, self.blocks)):
+                        self.send(self.data(block), (address[0], self.args.port))
+            waiting = set(a for a, s in self.devices.items() if s is None)
+            if not waiting and len(self.devices) >= self.args.expect:
+                break
+            if waiting:
+                # Devices still verifying don't answer, they send DONE when they are
+                for address in waiting:
+                    self.sock.sendto(self.header(END), address)
+                nacks = self.receive(1.0, waiting)
+            else:
+                # Fewer devices than expected so far, ask the group again
+                self.sock.sendto(self.header(END), self.group)
+                nacks = self.receive(1.0)
+        ok = sum(1 for s in self.devices.values() if s == 0)
+        print("%d of %d devices updated in %.1f s" % (ok, len(self.devices), time.time() - started))
+        return ok == len(self.devices) and ok >= self.args.expect
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Multicast a firmware image to a fleet of devices")
+    parser.add_argument("image")
+    parser.add_argument("--group", default="239.255.77.1", help="multicast group (MULTICAST_OTA_GROUP)")
+    parser.add_argument("--port", type=int, default=8267, help="port (MULTICAST_OTA_PORT)")
+    parser.add_argument("--key", help="shared key, as passed to enableMulticastOTA()")
+    parser.add_argument("--rate", type=float, default=80, help="send rate in KB/s (default 80, flash erase speed)")
+    parser.add_argument("--block-size", type=int, default=1024, help="block size, 256..1024 and a power of two")
+    parser.add_argument("--announce", type=float, default=3, help="seconds to announce before sending")
+    parser.add_argument("--rounds", type=int, default=30, help="repair rounds at most")
+    parser.add_argument("--expect", type=int, default=1, help="devices that must report done")
+    parser.add_argument("--interface", help="local IP address of the interface to send on")
+    parser.add_argument("--ttl", type=int, default=1)
+    args = parser.parse_args()
+
+    with open(args.image, "rb") as f:
+        image = f.read()
+    sys.exit(0 if Sender(args, image).run() else 1)
+
+
+if __name__ == "__main__":
+    main()
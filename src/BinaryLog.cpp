@@ -0,0 +1,517 @@
+#include "BinaryLog.h"
+
+/**
+ * Constructor for the BinaryLog class.
+ *
+ * @param port The TCP port the collector connects to
+ */
+BinaryLog::BinaryLog(uint16_t port)
+    : _server(port), _started(false), _formatCount(0), _tagCount(0),
+      _formatSent(), _tagSent(), _txLength(0), _lastMillis(0),
+      _droppedRecords(0), _bytesSent(0)
+{
+}
+
+/**
+ * Starts listening for a collector. Call once WiFi is up.
+ */
+void BinaryLog::begin()
+{
+    _server.begin();
+    _server.setNoDelay(true);
+    _started = true;
+}
+
+/**
+ * Checks if a collector is connected.
+ *
+ * @return True if records are being sent
+ */
+bool BinaryLog::isConnected()
+{
+    return _client && _client.connected();
+}
+
+/**
+ * Accepts a collector and sends the pending records without blocking.
+ * Called from Networking::loop().
+ */
+void BinaryLog::handle()
+{
+    if (!_started)
+    {
+        return;
+    }
+
+    //-- One collector at a time, a new one gets every definition again
+    if (_server.hasClient())
+    {
+        WiFiClient newClient = _server.available();
+        if (isConnected())
+        {
+            newClient.stop();
+        }
+        else
+        {
+            _client   = newClient;
+            _txLength = 0;
+            memset(_formatSent, 0, sizeof(_formatSent));
+            memset(_tagSent, 0, sizeof(_tagSent));
+            sendHello();
+        }
+    }
+
+    if (!isConnected())
+    {
+        if (_client)
+        {
+            _client.stop();
+            _client = WiFiClient();
+        }
+        _txLength = 0;
+        return;
+    }
+
+    if (_txLength > 0)
+    {
+        int room = _client.availableForWrite();
+        #ifndef ESP8266
+        // ESP32 WiFiClient does not report its socket space
+        if (room <= 0)
+        {
+            room = _txLength;
+        }
+        #endif
+        if (room <= 0)
+        {
+            return;
+        }
+        size_t sent = _client.write(_tx, ((size_t)room < _txLength) ? room : _txLength);
+        memmove(_tx, _tx + sent, _txLength - sent);
+        _txLength  -= sent;
+        _bytesSent += sent;
+    }
+}
+
+/**
+ * Writes a LEB128 varint.
+ *
+ * @param p Destination, up to 10 bytes
+ * @param value The value
+ * @return The number of bytes written
+ */
+size_t BinaryLog::putVarint(uint8_t* p, uint64_t value)
+{
+    size_t length = 0;
+    while (value >= 0x80)
+    {
+        p[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    p[length++] = (uint8_t)value;
+    return length;
+}
+
+/**
+ * Prefixes a record body with its length.
+ *
+ * @param p Destination
+ * @param size Room at the destination
+ * @param body The record, starting with the type
+ * @param length Length of the record
+ * @return Bytes written, 0 if it does not fit
+ */
+size_t BinaryLog::putFrame(uint8_t* p, size_t size, const uint8_t* body, size_t length)
+{
+    uint8_t prefix[10];
+    size_t  prefixLength = putVarint(prefix, length);
+    if (prefixLength + length > size)
+    {
+        return 0;
+    }
+    memcpy(p, prefix, prefixLength);
+    memmove(p + prefixLength, body, length);
+    return prefixLength + length;
+}
+
+/**
+ * Adds a FORMAT or TAG definition to a record under construction.
+ *
+ * @param record The record buffer (RECORD_SIZE bytes)
+ * @param length Bytes used, updated
+ * @param type FORMAT or TAG
+ * @param id The interned id
+ * @param text The text
+ * @return False if it does not fit
+ */
+bool BinaryLog::appendDefinition(uint8_t* record, size_t& length, uint8_t type, uint8_t id, const char* text)
+{
+    uint8_t body[MAX_FORMAT_LEN + 16];
+    size_t  textLength = strlen(text);
+    if (textLength > MAX_FORMAT_LEN)
+    {
+        textLength = MAX_FORMAT_LEN;
+    }
+    size_t bodyLength = 0;
+    body[bodyLength++] = type;
+    bodyLength += putVarint(&body[bodyLength], id);
+    bodyLength += putVarint(&body[bodyLength], textLength);
+    memcpy(&body[bodyLength], text, textLength);
+    bodyLength += textLength;
+
+    size_t written = putFrame(&record[length], RECORD_SIZE - length, body, bodyLength);
+    length += written;
+    return written > 0;
+}
+
+/**
+ * Queues bytes for the collector; a record that does not fit is dropped whole.
+ *
+ * @param data The frames
+ * @param length Their length
+ * @return True if queued
+ */
+bool BinaryLog::append(const uint8_t* data, size_t length)
+{
+    if (length > BINLOG_BUFFER_SIZE - _txLength)
+    {
+        _droppedRecords++;
+        return false;
+    }
+    memcpy(&_tx[_txLength], data, length);
+    _txLength += length;
+    return true;
+}
+
+/**
+ * Sends the HELLO record that ties the millis() deltas to the wall clock.
+ */
+void BinaryLog::sendHello()
+{
+    uint8_t body[32];
+    uint8_t frame[40];
+    size_t  length = 0;
+    time_t  now    = time(nullptr);
+
+    _lastMillis = millis();
+    body[length++] = HELLO;
+    length += putVarint(&body[length], VERSION);
+    length += putVarint(&body[length], (now > 1000000) ? (uint64_t)now : 0);
+    length += putVarint(&body[length], _lastMillis);
+    append(frame, putFrame(frame, sizeof(frame), body, length));
+}
+
+/**
+ * Finds the argument types of a printf() format.
+ *
+ * @param format The format string
+ * @param entry Receives the argument types
+ * @return False for formats that can't be sent as arguments (%n, %Lf, too many arguments)
+ */
+bool BinaryLog::parseFormat(const char* format, FormatEntry& entry)
+{
+    entry.format   = format;
+    entry.argCount = 0;
+
+    for (const char* p = format; *p; p++)
+    {
+        if (*p != '%')
+        {
+            continue;
+        }
+        p++;
+        if (*p == '%')
+        {
+            continue;
+        }
+
+        //-- Flags, width and precision ('*' takes an int argument)
+        while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0')
+        {
+            p++;
+        }
+        for (int part = 0; part < 2; part++)
+        {
+            if (*p == '*')
+            {
+                if (entry.argCount >= MAX_ARGS)
+                {
+                    return false;
+                }
+                entry.argTypes[entry.argCount++] = ARG_INT;
+                p++;
+            }
+            while (*p >= '0' && *p <= '9')
+            {
+                p++;
+            }
+            if (part == 0 && *p == '.')
+            {
+                p++;
+                continue;
+            }
+            break;
+        }
+
+        //-- Length modifier decides the width of integer arguments
+        size_t  width = sizeof(int);
+        uint8_t longs = 0;
+        while (*p == 'h' || *p == 'l' || *p == 'L' || *p == 'z' || *p == 'j' || *p == 't' || *p == 'q')
+        {
+            if (*p == 'l')
+            {
+                width = (++longs == 1) ? sizeof(long) : sizeof(long long);
+            }
+            else if (*p == 'z' || *p == 't')
+            {
+                width = sizeof(size_t);
+            }
+            else if (*p == 'j' || *p == 'q')
+            {
+                width = sizeof(long long);
+            }
+            else if (*p == 'L')
+            {
+                return false;   // long double, sent as text
+            }
+            p++;
+        }
+
+        uint8_t type;
+        switch (*p)
+        {
+            case 'd': case 'i': case 'c':
+                type = (width > 4) ? ARG_INT64 : ARG_INT;
+                break;
+            case 'u': case 'x': case 'X': case 'o':
+                type = (width > 4) ? ARG_UINT64 : ARG_UINT;
+                break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                type = ARG_DOUBLE;
+                break;
+            case 's':
+                type = ARG_STRING;
+                break;
+            case 'p':
+                type = ARG_POINTER;
+                break;
+            default:
+                return false;
+        }
+        if (entry.argCount >= MAX_ARGS)
+        {
+            return false;
+        }
+        entry.argTypes[entry.argCount++] = type;
+    }
+    return true;
+}
+
+/**
+ * Gets the id of a format string, interning it the first time.
+ * Formats are matched by address, so pass string literals.
+ *
+ * @param format The format string
+ * @return The id, or -1 if it has to be sent as text
+ */
+int BinaryLog::internFormat(const char* format)
+{
+    for (uint8_t i = 0; i < _formatCount; i++)
+    {
+        if (_formats[i].format == format)
+        {
+            return (_formats[i].argCount == 0xFF) ? -1 : i;
+        }
+    }
+    if (_formatCount >= BINLOG_MAX_FORMATS)
+    {
+        return -1;
+    }
+
+    //-- Formats that can't be encoded stay in the table, marked as text only
+    FormatEntry& entry = _formats[_formatCount];
+    if (!parseFormat(format, entry) || strlen(format) > MAX_FORMAT_LEN)
+    {
+        entry.format   = format;
+        entry.argCount = 0xFF;
+        _formatCount++;
+        return -1;
+    }
+    return _formatCount++;
+}
+
+/**
+ * Gets the id of a tag, interning it the first time.
+ *
+ * @param tag The tag
+ * @return The id, or -1 if the table is full
+ */
+int BinaryLog::internTag(const char* tag)
+{
+    for (uint8_t i = 0; i < _tagCount; i++)
+    {
+        if (_tags[i] == tag || strcmp(_tags[i], tag) == 0)
+        {
+            return i;
+        }
+    }
+    if (_tagCount >= BINLOG_MAX_TAGS)
+    {
+        return -1;
+    }
+    _tags[_tagCount] = tag;
+    return _tagCount++;
+}
+
+/**
+ * Queues a log record for the collector. The arguments are encoded as
+ * they are; nothing is formatted unless the format has to go as text.
+ * Does nothing while no collector is connected.
+ *
+ * @param level The log level
+ * @param tag The tag (a string literal)
+ * @param format The printf() format (a string literal)
+ * @param args The arguments
+ */
+void BinaryLog::log(uint8_t level, const char* tag, const char* format, va_list args)
+{
+    if (!isConnected())
+    {
+        return;
+    }
+
+    uint8_t record[RECORD_SIZE];
+    size_t  length = 0;
+    int     tagId    = internTag(tag ? tag : "");
+    int     formatId = internFormat(format);
+
+    //-- Definitions go in front of the first record that uses them
+    bool newTag    = (tagId >= 0) && !(_tagSent[tagId / 32] & (1UL << (tagId % 32)));
+    bool newFormat = (formatId >= 0) && !(_formatSent[formatId / 32] & (1UL << (formatId % 32)));
+    if (newTag && !appendDefinition(record, length, TAG, tagId, tag ? tag : ""))
+    {
+        _droppedRecords++;
+        return;
+    }
+    if (newFormat && !appendDefinition(record, length, FORMAT, formatId, format))
+    {
+        _droppedRecords++;
+        return;
+    }
+
+    //-- The record body is built behind the definitions, then framed in place
+    uint32_t now   = millis();
+    size_t   start = length + 2;      // Room for a two byte length prefix
+    size_t   end   = start;
+    if (start + 24 > RECORD_SIZE)
+    {
+        _droppedRecords++;
+        return;
+    }
+    record[end++] = (formatId >= 0) ? LOG : TEXT;
+    end += putVarint(&record[end], now - _lastMillis);
+    record[end++] = level;
+    end += putVarint(&record[end], (tagId >= 0) ? tagId : 0x7F);
+
+    if (formatId < 0)
+    {
+        //-- Not encodable: send the formatted text
+        char   text[RECORD_SIZE];
+        int    textLength = vsnprintf(text, sizeof(text), format, args);
+        size_t room       = RECORD_SIZE - end - 2;
+        if (textLength < 0)
+        {
+            textLength = 0;
+        }
+        if ((size_t)textLength > room)
+        {
+            textLength = room;
+        }
+        end += putVarint(&record[end], textLength);
+        memcpy(&record[end], text, textLength);
+        end += textLength;
+    }
+    else
+    {
+        const FormatEntry& entry = _formats[formatId];
+        end += putVarint(&record[end], formatId);
+        for (uint8_t i = 0; i < entry.argCount; i++)
+        {
+            if (end + 10 > RECORD_SIZE)
+            {
+                _droppedRecords++;
+                return;
+            }
+            switch (entry.argTypes[i])
+            {
+                case ARG_INT:
+                {
+                    int32_t value = va_arg(args, int);
+                    end += putVarint(&record[end], ((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+                    break;
+                }
+                case ARG_UINT:
+                    end += putVarint(&record[end], va_arg(args, unsigned int));
+                    break;
+                case ARG_INT64:
+                {
+                    int64_t value = va_arg(args, long long);
+                    end += putVarint(&record[end], ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+                    break;
+                }
+                case ARG_UINT64:
+                    end += putVarint(&record[end], va_arg(args, unsigned long long));
+                    break;
+                case ARG_POINTER:
+                    end += putVarint(&record[end], (uintptr_t)va_arg(args, void*));
+                    break;
+                case ARG_DOUBLE:
+                {
+                    double value = va_arg(args, double);
+                    memcpy(&record[end], &value, sizeof(value));
+                    end += sizeof(value);
+                    break;
+                }
+                case ARG_STRING:
+                {
+                    const char* value = va_arg(args, const char*);
+                    if (!value)
+                    {
+                        value = "(null)";
+                    }
+                    //-- Long strings are cut to what is left of the record
+                    size_t valueLength = strlen(value);
+                    size_t room        = RECORD_SIZE - end - 2;
+                    if (valueLength > room)
+                    {
+                        valueLength = room;
+                    }
+                    end += putVarint(&record[end], valueLength);
+                    memcpy(&record[end], value, valueLength);
+                    end += valueLength;
+                    break;
+                }
+            }
+        }
+    }
+
+    //-- Two byte varint length (non-minimal for short records, still valid LEB128)
+    size_t bodyLength = end - start;
+    record[length]     = (uint8_t)(bodyLength | 0x80);
+    record[length + 1] = (uint8_t)(bodyLength >> 7);
+    if (!append(record, end))
+    {
+        return;
+    }
+
+    //-- Only now the collector has the definitions
+    _lastMillis = now;
+    if (newTag)
+    {
+        _tagSent[tagId / 32] |= (1UL << (tagId % 32));
+    }
+    if (newFormat)
+    {
+        _formatSent[formatId / 32] |= (1UL << (formatId % 32));
+    }
+}
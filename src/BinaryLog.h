@@ -0,0 +1,95 @@
+#pragma once
+
+#ifdef ESP8266
+    #include <ESP8266WiFi.h>
+#else
+    #include <WiFi.h>
+#endif
+#include <stdarg.h>
+
+#ifndef BINLOG_MAX_FORMATS
+  #define BINLOG_MAX_FORMATS 64      // Interned format strings (a full table falls back to text records)
+#endif
+#ifndef BINLOG_MAX_TAGS
+  #define BINLOG_MAX_TAGS 32         // Interned tags
+#endif
+#ifndef BINLOG_BUFFER_SIZE
+  #define BINLOG_BUFFER_SIZE 1024    // Records waiting for the collector
+#endif
+
+/**
+ * Compact binary log records for a collector on a TCP port next to telnet.
+ * Format strings and tags are interned: the text is sent once per
+ * connection (FORMAT and TAG records), after that a log record only
+ * carries their ids and the varint-encoded arguments.
+ *
+ * Every frame is [varint length][type][body], integers are LEB128
+ * varints, signed ones zigzag encoded:
+ *   HELLO  0x01  version, epoch seconds (0 if unknown), millis
+ *   FORMAT 0x02  id, length, text
+ *   TAG    0x03  id, length, text
+ *   LOG    0x04  millis delta, level, tag id, format id, arguments
+ *   TEXT   0x05  millis delta, level, tag id, length, formatted text
+ * Arguments: integers as (zigzag) varint, double as 8 byte IEEE little
+ * endian, strings as length + bytes.
+ */
+class BinaryLog
+{
+  public:
+    enum RecordType : uint8_t { HELLO = 1, FORMAT = 2, TAG = 3, LOG = 4, TEXT = 5 };
+
+  private:
+    static const uint8_t VERSION        = 1;
+    static const uint8_t MAX_ARGS       = 8;
+    static const size_t  MAX_FORMAT_LEN = 160;  // Longer formats are sent as TEXT
+    static const size_t  RECORD_SIZE    = 384;  // Definitions plus one record
+
+    //-- Argument types, parsed once when a format is interned
+    enum ArgType : uint8_t { ARG_INT, ARG_UINT, ARG_INT64, ARG_UINT64, ARG_DOUBLE, ARG_STRING, ARG_POINTER };
+
+    struct FormatEntry
+    {
+      const char* format;
+      uint8_t     argCount;
+      uint8_t     argTypes[MAX_ARGS];
+    };
+
+    WiFiServer  _server;
+    WiFiClient  _client;
+    bool        _started;
+
+    FormatEntry _formats[BINLOG_MAX_FORMATS];
+    uint8_t     _formatCount;
+    const char* _tags[BINLOG_MAX_TAGS];
+    uint8_t     _tagCount;
+
+    //-- Definitions already sent on the current connection
+    uint32_t    _formatSent[(BINLOG_MAX_FORMATS + 31) / 32];
+    uint32_t    _tagSent[(BINLOG_MAX_TAGS + 31) / 32];
+
+    uint8_t     _tx[BINLOG_BUFFER_SIZE];
+    size_t      _txLength;
+    uint32_t    _lastMillis;
+    uint32_t    _droppedRecords;
+    uint32_t    _bytesSent;
+
+    int  internFormat(const char* format);
+    int  internTag(const char* tag);
+    static bool parseFormat(const char* format, FormatEntry& entry);
+    static size_t putVarint(uint8_t* p, uint64_t value);
+    static size_t putFrame(uint8_t* p, size_t size, const uint8_t* body, size_t length);
+    bool appendDefinition(uint8_t* record, size_t& length, uint8_t type, uint8_t id, const char* text);
+    bool append(const uint8_t* data, size_t length);
+    void sendHello();
+
+  public:
+    explicit BinaryLog(uint16_t port);
+
+    void begin();
+    void handle();
+    bool isConnected();
+    void log(uint8_t level, const char* tag, const char* format, va_list args);
+
+    uint32_t getDroppedRecords() const { return _droppedRecords; }
+    uint32_t getBytesSent() const { return _bytesSent; }
+};
@@ -0,0 +1,206 @@
+#include "BootLog.h"
+
+#ifndef ESP8266
+  #include <esp_system.h>
+
+  //-- Magic, length, ~length and the ring; not cleared at boot
+  RTC_NOINIT_ATTR static uint32_t _bootLogStorage[3 + BOOTLOG_SIZE / 4];
+#endif
+
+/**
+ * Constructor for the BootLog class.
+ */
+BootLog::BootLog()
+    : _running(false), _head(0), _word(0), _previous(nullptr), _previousLength(0), _resetReason()
+{
+}
+
+/**
+ * Destructor, frees the copy of the previous boot's output.
+ */
+BootLog::~BootLog()
+{
+    clearPrevious();
+}
+
+/**
+ * Stores one word of the log in RTC memory.
+ *
+ * @param index The word, 0..HEADER_WORDS - 1 for the header
+ * @param value The value
+ */
+void BootLog::storeWord(uint32_t index, uint32_t value)
+{
+    #ifdef ESP8266
+    ESP.rtcUserMemoryWrite(BOOTLOG_RTC_OFFSET + index, &value, sizeof(value));
+    #else
+    _bootLogStorage[index] = value;
+    #endif
+}
+
+/**
+ * Loads one word of the log from RTC memory.
+ *
+ * @param index The word
+ * @return The value
+ */
+uint32_t BootLog::loadWord(uint32_t index)
+{
+    uint32_t value;
+    #ifdef ESP8266
+    ESP.rtcUserMemoryRead(BOOTLOG_RTC_OFFSET + index, &value, sizeof(value));
+    #else
+    value = _bootLogStorage[index];
+    #endif
+    return value;
+}
+
+/**
+ * Stores the length, with its inverse so a torn update or random memory
+ * after a power-on is not taken for a log.
+ */
+void BootLog::storeLength()
+{
+    storeWord(1, _head);
+    storeWord(2, ~_head);
+}
+
+/**
+ * Gets why the previous boot ended.
+ */
+void BootLog::readResetReason()
+{
+    #ifdef ESP8266
+    strncpy(_resetReason, ESP.getResetReason().c_str(), sizeof(_resetReason) - 1);
+    #else
+    const char* reason;
+    switch (esp_reset_reason())
+    {
+        case ESP_RST_POWERON:   reason = "Power on"; break;
+        case ESP_RST_EXT:       reason = "External reset"; break;
+        case ESP_RST_SW:        reason = "Software restart"; break;
+        case ESP_RST_PANIC:     reason = "Exception/panic"; break;
+        case ESP_RST_INT_WDT:   reason = "Interrupt watchdog"; break;
+        case ESP_RST_TASK_WDT:  reason = "Task watchdog"; break;
+        case ESP_RST_WDT:       reason = "Other watchdog"; break;
+        case ESP_RST_DEEPSLEEP: reason = "Deep sleep wake"; break;
+        case ESP_RST_BROWNOUT:  reason = "Brownout"; break;
+        case ESP_RST_SDIO:      reason = "SDIO reset"; break;
+        default:                reason = "Unknown"; break;
+    }
+    strncpy(_resetReason, reason, sizeof(_resetReason) - 1);
+    #endif
+}
+
+/**
+ * Takes the previous boot's output out of RTC memory, if there is a
+ * valid log, and starts mirroring this boot's output. If the ring had
+ * wrapped, the cut off first line is left out.
+ */
+void BootLog::begin()
+{
+    readResetReason();
+    clearPrevious();
+
+    uint32_t head = loadWord(1);
+    if (loadWord(0) == MAGIC && loadWord(2) == ~head && head > 0)
+    {
+        size_t length = (head < BOOTLOG_SIZE) ? head : BOOTLOG_SIZE;
+        _previous = (char*)malloc(length + 1);
+        if (_previous)
+        {
+            uint32_t position = head - length;
+            uint32_t word     = loadWord(HEADER_WORDS + (position & MASK) / 4);
+            for (size_t i = 0; i < length; i++, position++)
+            {
+                if ((position & 3) == 0)
+                {
+                    word = loadWord(HEADER_WORDS + (position & MASK) / 4);
+                }
+                _previous[i] = (char)(word >> (8 * (position & 3)));
+            }
+            _previous[length] = 0;
+
+            size_t skip = 0;
+            if (head > BOOTLOG_SIZE)
+            {
+                const char* newline = strchr(_previous, '\n');
+                skip = newline ? newline + 1 - _previous : 0;
+            }
+            memmove(_previous, _previous + skip, length - skip + 1);
+            _previousLength = length - skip;
+        }
+    }
+
+    _head = 0;
+    _word = 0;
+    storeWord(0, MAGIC);
+    storeLength();
+    _running = true;
+
+} //  BootLog::begin()
+
+/**
+ * Mirrors output into RTC memory: every completed word is stored once,
+ * the unfinished last word and the length after each call.
+ *
+ * @param data The bytes
+ * @param size Their number
+ */
+void BootLog::write(const uint8_t* data, size_t size)
+{
+    if (!_running || size == 0)
+    {
+        return;
+    }
+    for (size_t i = 0; i < size; i++)
+    {
+        _word |= (uint32_t)data[i] << (8 * (_head & 3));
+        _head++;
+        if ((_head & 3) == 0)
+        {
+            storeWord(HEADER_WORDS + ((_head - 4) & MASK) / 4, _word);
+            _word = 0;
+        }
+    }
+    if (_head & 3)
+    {
+        storeWord(HEADER_WORDS + (_head & MASK) / 4, _word);
+    }
+    storeLength();
+}
+
+/**
+ * Prints the previous boot's output, after the reason it ended.
+ *
+ * @param out Where the output goes
+ */
+void BootLog::printPrevious(Print& out) const
+{
+    out.print("Reset reason: ");
+    out.print(_resetReason);
+    out.print("\r\n");
+    if (!_previous)
+    {
+        out.print("No output of the previous boot\r\n");
+        return;
+    }
+    out.write((const uint8_t*)_previous, _previousLength);
+    if (_previousLength > 0 && _previous[_previousLength - 1] != '\n')
+    {
+        out.print("\r\n");
+    }
+}
+
+/**
+ * Frees the copy of the previous boot's output.
+ */
+void BootLog::clearPrevious()
+{
+    if (_previous)
+    {
+        free(_previous);
+        _previous = nullptr;
+    }
+    _previousLength = 0;
+}
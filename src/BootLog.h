@@ -0,0 +1,62 @@
+#pragma once
+
+#include <Arduino.h>
+
+#ifndef BOOTLOG_SIZE
+  #ifdef ESP8266
+    #define BOOTLOG_SIZE 256           // Bytes kept in RTC user memory (512 in all, shared with OTA and the WiFi cache)
+  #else
+    #define BOOTLOG_SIZE 2048          // Bytes kept in RTC slow memory
+  #endif
+#endif
+#ifdef ESP8266
+  #ifndef BOOTLOG_RTC_OFFSET
+    #define BOOTLOG_RTC_OFFSET 60      // In 4-byte blocks, after the Networking RTC state
+  #endif
+#endif
+
+/**
+ * Keeps the last BOOTLOG_SIZE bytes of output in RTC memory, which
+ * survives software resets, watchdog resets and crashes, so the lines
+ * before a reset can be read on the next boot. MultiStream mirrors its
+ * output here as it goes: a few 32-bit stores per write, cheap enough to
+ * leave on. begin() takes the previous boot's output (and the reason it
+ * ended) out of RTC memory and starts over. After a power-on the memory
+ * holds no valid log and there is nothing to show.
+ */
+class BootLog
+{
+  private:
+    static const uint32_t MAGIC        = 0x424C4F47;   // "BLOG"
+    static const uint32_t HEADER_WORDS = 3;            // Magic, length, ~length
+    static const uint32_t MASK         = BOOTLOG_SIZE - 1;
+    static_assert((BOOTLOG_SIZE & MASK) == 0 && BOOTLOG_SIZE >= 64, "BOOTLOG_SIZE must be a power of two, 64 or more");
+    #ifdef ESP8266
+    static_assert(BOOTLOG_RTC_OFFSET + HEADER_WORDS + BOOTLOG_SIZE / 4 <= 128, "The boot log doesn't fit the RTC user memory");
+    #endif
+
+    bool     _running;
+    uint32_t _head;              // Bytes written this boot
+    uint32_t _word;              // The word being filled
+    char*    _previous;          // Output of the previous boot, nullptr if none
+    size_t   _previousLength;
+    char     _resetReason[32];
+
+    static void storeWord(uint32_t index, uint32_t value);
+    static uint32_t loadWord(uint32_t index);
+    void storeLength();
+    void readResetReason();
+
+  public:
+    BootLog();
+    ~BootLog();
+
+    void begin();
+    void write(const uint8_t* data, size_t size);
+
+    bool isRunning() const { return _running; }
+    bool hasPrevious() const { return _previous != nullptr; }
+    const char* getResetReason() const { return _resetReason; }
+    void printPrevious(Print& out) const;
+    void clearPrevious();
+};
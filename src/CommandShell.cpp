@@ -0,0 +1,253 @@
+#include "CommandShell.h"
+
+/**
+ * Constructor for the CommandShell class.
+ */
+CommandShell::CommandShell()
+    : _sources(), _commands(), _commandCount(0)
+{
+}
+
+/**
+ * Registers a command. Names and help texts are not copied, pass literals.
+ *
+ * @param name The command name, e.g. "stats"
+ * @param help One line shown by "help"
+ * @param handler Called with the arguments and the stream to reply on
+ * @return False if the table (SHELL_MAX_COMMANDS) is full
+ */
+bool CommandShell::addCommand(const char* name, const char* help, Handler handler)
+{
+    //-- Registering a name again replaces its handler
+    for (uint8_t i = 0; i < _commandCount; i++)
+    {
+        if (strcmp(_commands[i].name, name) == 0)
+        {
+            _commands[i].help    = help;
+            _commands[i].handler = handler;
+            return true;
+        }
+    }
+    if (_commandCount >= SHELL_MAX_COMMANDS)
+    {
+        return false;
+    }
+    _commands[_commandCount].name    = name;
+    _commands[_commandCount].help    = help;
+    _commands[_commandCount].handler = handler;
+    _commandCount++;
+    return true;
+}
+
+/**
+ * Forgets a partly typed line, e.g. when a telnet session closed.
+ *
+ * @param source The input source
+ */
+void CommandShell::reset(uint8_t source)
+{
+    if (source < SHELL_MAX_SOURCES)
+    {
+        _sources[source].length = 0;
+        _sources[source].state  = TEXT;
+    }
+}
+
+/**
+ * Reads what an input stream has available, never waits for more, and
+ * runs every line that is complete.
+ *
+ * @param source The input source (its own line buffer), 0..SHELL_MAX_SOURCES-1
+ * @param in The stream to read from
+ * @param out Where replies and telnet negotiation answers go
+ */
+void CommandShell::process(uint8_t source, Stream& in, Print& out)
+{
+    if (source >= SHELL_MAX_SOURCES)
+    {
+        return;
+    }
+    Source& state = _sources[source];
+
+    //-- Bounded, so a flood of input can't stall loop()
+    for (int budget = 2 * SHELL_LINE_SIZE; budget > 0 && in.available() > 0; budget--)
+    {
+        int c = in.read();
+        if (c < 0)
+        {
+            break;
+        }
+        if (feed(state, (uint8_t)c, out))
+        {
+            state.line[state.length] = 0;
+            state.length = 0;
+            execute(state.line, out);
+        }
+    }
+}
+
+/**
+ * Feeds one byte to the line parser of a source.
+ *
+ * @param source The parser state
+ * @param c The byte
+ * @param out Where telnet negotiation answers go
+ * @return True when a non-empty line is complete
+ */
+bool CommandShell::feed(Source& source, uint8_t c, Print& out)
+{
+    switch (source.state)
+    {
+        case GOT_IAC:
+            if (c == WILL || c == WONT || c == DO || c == DONT)
+            {
+                source.verb  = c;
+                source.state = GOT_OPTION;
+            }
+            else if (c == SB)
+            {
+                source.state = IN_SB;
+            }
+            else
+            {
+                //-- IAC IAC is a data byte 255, never part of a command; IAC IP drops the line
+                if (c == IP)
+                {
+                    source.length = 0;
+                }
+                source.state = TEXT;
+            }
+            return false;
+
+        case GOT_OPTION:
+        {
+            //-- Refuse every option, the session stays a plain NVT
+            if (source.verb == WILL || source.verb == DO)
+            {
+                uint8_t answer[3] = { IAC, (uint8_t)(source.verb == WILL ? DONT : WONT), c };
+                out.write(answer, sizeof(answer));
+            }
+            source.state = TEXT;
+            return false;
+        }
+
+        case IN_SB:
+            if (c == IAC)
+            {
+                source.state = IN_SB_IAC;
+            }
+            return false;
+
+        case IN_SB_IAC:
+            source.state = (c == SE) ? TEXT : IN_SB;
+            return false;
+
+        case GOT_CR:
+            //-- CR LF and CR NUL end a line only once
+            source.state = TEXT;
+            if (c == '\n' || c == 0)
+            {
+                return false;
+            }
+            break;
+
+        case TEXT:
+        default:
+            break;
+    }
+
+    if (c == IAC)
+    {
+        source.state = GOT_IAC;
+        return false;
+    }
+    if (c == '\r' || c == '\n')
+    {
+        if (c == '\r')
+        {
+            source.state = GOT_CR;
+        }
+        return source.length > 0;
+    }
+    if (c == 0x08 || c == 0x7F)
+    {
+        if (source.length > 0)
+        {
+            source.length--;
+        }
+        return false;
+    }
+    if (c >= ' ' && c <= '~' && source.length < SHELL_LINE_SIZE - 1)
+    {
+        source.line[source.length++] = (char)c;
+    }
+    return false;
+}
+
+/**
+ * Runs a command line: the first word selects the command, the rest
+ * is passed as its arguments.
+ *
+ * @param line The command line, modified while parsing
+ * @param out Where the reply goes
+ * @return False if the command is unknown
+ */
+bool CommandShell::execute(char* line, Print& out)
+{
+    while (*line == ' ')
+    {
+        line++;
+    }
+    if (*line == 0)
+    {
+        return true;
+    }
+    char* args = line;
+    while (*args && *args != ' ')
+    {
+        args++;
+    }
+    if (*args)
+    {
+        *args++ = 0;
+        while (*args == ' ')
+        {
+            args++;
+        }
+    }
+
+    if (strcmp(line, "help") == 0)
+    {
+        printHelp(out);
+        return true;
+    }
+    for (uint8_t i = 0; i < _commandCount; i++)
+    {
+        if (strcmp(_commands[i].name, line) == 0)
+        {
+            _commands[i].handler(args, out);
+            return true;
+        }
+    }
+    out.print("Unknown command: ");
+    out.print(line);
+    out.print(" (try help)\r\n");
+    return false;
+}
+
+/**
+ * Lists the registered commands.
+ *
+ * @param out Where the list goes
+ */
+void CommandShell::printHelp(Print& out) const
+{
+    out.print("help\r\n");
+    for (uint8_t i = 0; i < _commandCount; i++)
+    {
+        out.print(_commands[i].name);
+        out.print(" - ");
+        out.print(_commands[i].help);
+        out.print("\r\n");
+    }
+}
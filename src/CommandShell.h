@@ -0,0 +1,71 @@
+#pragma once
+
+#include <Arduino.h>
+#include <functional>
+
+#ifndef SHELL_MAX_COMMANDS
+  #define SHELL_MAX_COMMANDS 16        // Registered commands, built-in ones included
+#endif
+#ifndef SHELL_LINE_SIZE
+  #define SHELL_LINE_SIZE 80           // Longest command line, longer input is cut off
+#endif
+#ifndef SHELL_MAX_SOURCES
+  #define SHELL_MAX_SOURCES 5          // Input streams with their own line (telnet sessions + serial)
+#endif
+
+/**
+ * A small command shell. Every input source (a telnet session, the serial
+ * port) has its own incremental line parser that consumes what is available
+ * without blocking, strips telnet IAC negotiation and handles backspace.
+ * Complete lines are split in a command name and arguments and dispatched
+ * through a statically sized table; nothing is allocated per line.
+ */
+class CommandShell
+{
+  public:
+    //-- Gets the arguments (modifiable, may be empty) and where the reply goes
+    typedef std::function<void(char* args, Print& out)> Handler;
+
+  private:
+    //-- Telnet protocol bytes (RFC 854)
+    static const uint8_t IAC  = 255;
+    static const uint8_t DONT = 254;
+    static const uint8_t DO   = 253;
+    static const uint8_t WONT = 252;
+    static const uint8_t WILL = 251;
+    static const uint8_t SB   = 250;
+    static const uint8_t IP   = 244;
+    static const uint8_t SE   = 240;
+
+    enum ParseState : uint8_t { TEXT, GOT_CR, GOT_IAC, GOT_OPTION, IN_SB, IN_SB_IAC };
+
+    struct Source
+    {
+      char       line[SHELL_LINE_SIZE];
+      uint8_t    length;
+      ParseState state;
+      uint8_t    verb;          // WILL/WONT/DO/DONT waiting for its option byte
+    };
+
+    struct Command
+    {
+      const char* name;
+      const char* help;
+      Handler     handler;
+    };
+
+    Source  _sources[SHELL_MAX_SOURCES];
+    Command _commands[SHELL_MAX_COMMANDS];
+    uint8_t _commandCount;
+
+    bool feed(Source& source, uint8_t c, Print& out);
+
+  public:
+    CommandShell();
+
+    bool addCommand(const char* name, const char* help, Handler handler);
+    void process(uint8_t source, Stream& in, Print& out);
+    void reset(uint8_t source);
+    bool execute(char* line, Print& out);
+    void printHelp(Print& out) const;
+};
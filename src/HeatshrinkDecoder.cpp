@@ -0,0 +1,135 @@
+#include "HeatshrinkDecoder.h"
+#include <string.h>
+
+/**
+ * Constructor for the HeatshrinkDecoder class.
+ */
+HeatshrinkDecoder::HeatshrinkDecoder()
+    : _window(), _mask(0), _head(0), _windowBits(0), _lookaheadBits(0),
+      _state(TAG), _need(1), _value(0), _index(0), _output(), _outputLength(0), _sink(nullptr)
+{
+}
+
+/**
+ * Starts decoding a new stream.
+ *
+ * @param windowBits The encoder's window size (-w), 4..HEATSHRINK_MAX_WINDOW_BITS
+ * @param lookaheadBits The encoder's lookahead size (-l), 3..windowBits-1
+ * @param sink Gets the decoded data
+ * @return False if the parameters are not supported
+ */
+bool HeatshrinkDecoder::begin(uint8_t windowBits, uint8_t lookaheadBits, Sink sink)
+{
+    if (windowBits < 4 || windowBits > HEATSHRINK_MAX_WINDOW_BITS || lookaheadBits < 3 || lookaheadBits >= windowBits)
+    {
+        return false;
+    }
+    _windowBits    = windowBits;
+    _lookaheadBits = lookaheadBits;
+    _mask          = (1 << windowBits) - 1;
+    _head          = 0;
+    _state         = TAG;
+    _need          = 1;
+    _value         = 0;
+    _outputLength  = 0;
+    _sink          = sink;
+    memset(_window, 0, sizeof(_window));
+    return true;
+}
+
+/**
+ * Decodes the next piece of the stream. Padding bits at the end of the
+ * stream never complete a field, so they are simply left over.
+ *
+ * @param data The compressed bytes
+ * @param size The number of bytes
+ * @return False if the sink stopped the decoding
+ */
+bool HeatshrinkDecoder::decode(const uint8_t* data, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        uint8_t byte = data[i];
+        for (uint8_t bit = 0; bit < 8; bit++, byte <<= 1)
+        {
+            _value = (_value << 1) | (byte >> 7);
+            if (--_need > 0)
+            {
+                continue;
+            }
+
+            switch (_state)
+            {
+                case TAG:
+                    _state = _value ? LITERAL : INDEX;
+                    _need  = _value ? 8 : _windowBits;
+                    break;
+
+                case LITERAL:
+                    if (!emit((uint8_t)_value))
+                    {
+                        return false;
+                    }
+                    _state = TAG;
+                    _need  = 1;
+                    break;
+
+                case INDEX:
+                    _index = _value + 1;
+                    _state = COUNT;
+                    _need  = _lookaheadBits;
+                    break;
+
+                case COUNT:
+                    //-- Copy from the window, a reference may overlap what it produces
+                    for (uint16_t count = _value + 1; count > 0; count--)
+                    {
+                        if (!emit(_window[(_head - _index) & _mask]))
+                        {
+                            return false;
+                        }
+                    }
+                    _state = TAG;
+                    _need  = 1;
+                    break;
+            }
+            _value = 0;
+        }
+    }
+    return flushOutput();
+
+} //  HeatshrinkDecoder::decode()
+
+/**
+ * Adds a decoded byte to the window and the output.
+ *
+ * @param c The byte
+ * @return False if the sink stopped the decoding
+ */
+bool HeatshrinkDecoder::emit(uint8_t c)
+{
+    _window[_head & _mask] = c;
+    _head++;
+    _output[_outputLength++] = c;
+    if (_outputLength == OUTPUT_SIZE)
+    {
+        return flushOutput();
+    }
+    return true;
+}
+
+/**
+ * Hands the collected output to the sink.
+ *
+ * @return False if the sink stopped the decoding
+ */
+bool HeatshrinkDecoder::flushOutput()
+{
+    if (_outputLength == 0)
+    {
+        return true;
+    }
+    size_t length = _outputLength;
+    _outputLength = 0;
+    return _sink ? _sink(_output, length) : true;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+
+#ifndef HEATSHRINK_MAX_WINDOW_BITS
+  #define HEATSHRINK_MAX_WINDOW_BITS 12  // Largest window accepted (2^12 = 4 KB of RAM)
+#endif
+
+/**
+ * Streaming decoder for heatshrink (LZSS) compressed data. The bit stream
+ * is MSB first: a 1 bit is followed by an 8 bit literal, a 0 bit by a
+ * back-reference of windowBits (distance - 1) and lookaheadBits
+ * (length - 1). Input can be fed in pieces of any size, output goes to
+ * the sink in pieces of up to OUTPUT_SIZE bytes. The only memory is the
+ * 2^windowBits byte window.
+ */
+class HeatshrinkDecoder
+{
+  public:
+    //-- Gets decoded data, returns false to stop decoding
+    typedef std::function<bool(const uint8_t* data, size_t size)> Sink;
+
+  private:
+    static const size_t OUTPUT_SIZE = 256;
+
+    enum State : uint8_t { TAG, LITERAL, INDEX, COUNT };
+
+    uint8_t  _window[1 << HEATSHRINK_MAX_WINDOW_BITS];
+    uint16_t _mask;
+    uint16_t _head;
+    uint8_t  _windowBits;
+    uint8_t  _lookaheadBits;
+
+    State    _state;
+    uint8_t  _need;          // Bits still missing from the current field
+    uint16_t _value;
+    uint16_t _index;
+
+    uint8_t  _output[OUTPUT_SIZE];
+    size_t   _outputLength;
+    Sink     _sink;
+
+    bool emit(uint8_t c);
+    bool flushOutput();
+
+  public:
+    HeatshrinkDecoder();
+
+    bool begin(uint8_t windowBits, uint8_t lookaheadBits, Sink sink);
+    bool decode(const uint8_t* data, size_t size);
+};
@@ -0,0 +1,362 @@
+#include "HttpStatus.h"
+#include "Networking.h"
+
+static const char* METRICS_TYPE = "text/plain; version=0.0.4";
+
+/**
+ * Constructor for the HttpStatus class.
+ *
+ * @param metrics The registry served on /metrics
+ * @param port The TCP port of the raw server (not used with USE_ASYNC_WIFIMANAGER)
+ */
+HttpStatus::HttpStatus(Metrics* metrics, uint16_t port)
+    : _stream(nullptr), _metrics(metrics), _requests(0), _onScrape(nullptr)
+      #ifndef USE_ASYNC_WIFIMANAGER
+      , _server(port), _client(), _started(false), _phase(IDLE), _lastActivity(0)
+      , _line(), _lineLength(0), _atLineStart(false), _text(), _textLength(0), _textSent(0)
+      , _entry(0), _position(0), _end(0)
+      #endif
+{
+    (void)port;
+}
+
+/**
+ * Checks if the log tail can be read from here. The ring must be kept;
+ * a reader in another task than drain() (the async_tcp task on ESP32)
+ * also needs the reservations of multi-producer mode to see what is
+ * being overwritten.
+ *
+ * @return True if /log/tail can be answered
+ */
+bool HttpStatus::canTail() const
+{
+    #if defined(USE_ASYNC_WIFIMANAGER) && !defined(ESP8266)
+    return _stream->isMultiProducer();
+    #else
+    return _stream->isRingBufferMode();
+    #endif
+}
+
+/**
+ * Gets the body of the answer when the log tail can't be read.
+ *
+ * @return The hint
+ */
+static const char* tailUnavailable()
+{
+    #if defined(USE_ASYNC_WIFIMANAGER) && !defined(ESP8266)
+    return "The log tail needs multi-producer mode (setMultiProducer(true))\n";
+    #else
+    return "The log tail needs ring buffer mode (setRingBufferMode(true))\n";
+    #endif
+}
+
+#ifdef USE_ASYNC_WIFIMANAGER
+
+/**
+ * Adds /metrics and /log/tail to a web server. The server is started by
+ * the caller; the routes keep no state beyond their response.
+ *
+ * @param stream The log output, /log/tail reads its ring buffer
+ * @param server The web server of the configuration portal
+ */
+void HttpStatus::begin(MultiStream* stream, AsyncWebServer* server)
+{
+    _stream = stream;
+    server->on("/metrics", HTTP_GET, [this](AsyncWebServerRequest* request)
+    {
+        _requests++;
+        if (_onScrape)
+        {
+            _onScrape();
+        }
+        uint8_t entry  = 0;
+        size_t  offset = 0;    // Part of an entry sent in an earlier chunk
+        request->send(request->beginChunkedResponse(METRICS_TYPE
+                    , [this, entry, offset](uint8_t* buffer, size_t maxLen, size_t) mutable -> size_t
+        {
+            //-- Whole entries while they fit, a chunk too small for one gets it in pieces
+            char   text[TEXT_SIZE];
+            size_t length = 0;
+            while (entry < _metrics->getCount() && length < maxLen)
+            {
+                size_t textLength = _metrics->formatPrometheus(entry, text, sizeof(text));
+                if (offset >= textLength)
+                {
+                    offset = 0;
+                    entry++;
+                    continue;
+                }
+                if (offset == 0 && length > 0 && textLength > maxLen - length)
+                {
+                    break;
+                }
+                size_t chunk = textLength - offset;
+                if (chunk > maxLen - length)
+                {
+                    chunk = maxLen - length;
+                }
+                memcpy(buffer + length, text + offset, chunk);
+                length += chunk;
+                offset += chunk;
+            }
+            return length;
+        }));
+    });
+
+    server->on("/log/tail", HTTP_GET, [this](AsyncWebServerRequest* request)
+    {
+        _requests++;
+        if (!canTail())
+        {
+            request->send(503, "text/plain", tailUnavailable());
+            return;
+        }
+        size_t bytes = HTTP_STATUS_TAIL_BYTES;
+        if (request->hasParam("bytes"))
+        {
+            long value = request->getParam("bytes")->value().toInt();
+            if (value > 0)
+            {
+                bytes = value;
+            }
+        }
+        uint32_t end      = _stream->getHistoryEnd();
+        uint32_t position = _stream->getHistoryStart(bytes);
+        request->send(request->beginChunkedResponse("text/plain"
+                    , [this, position, end](uint8_t* buffer, size_t maxLen, size_t) mutable -> size_t
+        {
+            return _stream->copyHistory(position, end, buffer, maxLen);
+        }));
+    });
+
+} //  HttpStatus::begin()
+
+#else
+
+/**
+ * Starts listening. Call once WiFi is up.
+ *
+ * @param stream The log output, /log/tail reads its ring buffer
+ */
+void HttpStatus::begin(MultiStream* stream)
+{
+    _stream = stream;
+    _server.begin();
+    _server.setNoDelay(true);
+    _started = true;
+}
+
+/**
+ * Accepts a request, reads it and sends the answer, as far as it goes
+ * without blocking. Called from Networking::loop(); one request at a
+ * time, the next one waits in the listen queue.
+ */
+void HttpStatus::handle()
+{
+    if (!_started)
+    {
+        return;
+    }
+    if (_phase == IDLE)
+    {
+        if (!_server.hasClient())
+        {
+            return;
+        }
+        _client       = _server.available();
+        _phase        = REQUEST_LINE;
+        _lineLength   = 0;
+        _textLength   = 0;
+        _textSent     = 0;
+        _lastActivity = millis();
+    }
+    if (!_client.connected() || (uint32_t)(millis() - _lastActivity) > HTTP_STATUS_TIMEOUT)
+    {
+        close();
+        return;
+    }
+
+    //-- Keep the request line, skip the headers up to the blank line
+    while ((_phase == REQUEST_LINE || _phase == HEADERS) && _client.available() > 0)
+    {
+        char c = _client.read();
+        _lastActivity = millis();
+        if (_phase == REQUEST_LINE)
+        {
+            if (c == '\n')
+            {
+                _line[_lineLength] = '\0';
+                _phase       = HEADERS;
+                _atLineStart = true;
+            }
+            else if (c != '\r' && _lineLength < sizeof(_line) - 1)
+            {
+                _line[_lineLength++] = c;
+            }
+        }
+        else if (c == '\n')
+        {
+            if (_atLineStart)
+            {
+                route();
+            }
+            _atLineStart = true;
+        }
+        else if (c != '\r')
+        {
+            _atLineStart = false;
+        }
+    }
+    if (_phase == REQUEST_LINE || _phase == HEADERS)
+    {
+        return;
+    }
+
+    //-- The header (or a short answer) first, then the body
+    if (!sendText())
+    {
+        return;
+    }
+    if (_phase == SEND_METRICS)
+    {
+        while (_entry < _metrics->getCount())
+        {
+            _textLength = _metrics->formatPrometheus(_entry++, _text, sizeof(_text));
+            _textSent   = 0;
+            if (!sendText())
+            {
+                return;
+            }
+        }
+    }
+    else if (_phase == SEND_TAIL)
+    {
+        uint32_t position = _stream->writeHistory(&_client, _position, _end, true);
+        if (position != _position)
+        {
+            _position     = position;
+            _lastActivity = millis();
+        }
+        if (_position != _end)
+        {
+            return;
+        }
+    }
+    close();
+
+} //  HttpStatus::handle()
+
+/**
+ * Puts a response header (and an optional short body) up for sending.
+ *
+ * @param status Status code and reason, e.g. "200 OK"
+ * @param type The content type
+ * @param body Text after the header, nullptr for none
+ */
+void HttpStatus::startResponse(const char* status, const char* type, const char* body)
+{
+    int length = snprintf(_text, sizeof(_text), "HTTP/1.1 %s\r\nContent-Type: %s\r\nConnection: close\r\n\r\n%s"
+                        , status, type, body ? body : "");
+    _textLength = (length > 0) ? ((size_t)length < sizeof(_text) ? length : sizeof(_text) - 1) : 0;
+    _textSent   = 0;
+}
+
+/**
+ * Picks the answer for the request line, called after the headers.
+ */
+void HttpStatus::route()
+{
+    _requests++;
+    _phase = SEND_TEXT;
+    if (strncmp(_line, "GET ", 4) != 0)
+    {
+        startResponse("405 Method Not Allowed", "text/plain", "Only GET is supported\n");
+        return;
+    }
+    const char* path   = _line + 4;
+    size_t      length = strcspn(path, " ?");
+    const char* query  = (path[length] == '?') ? path + length + 1 : nullptr;
+
+    if (length == 8 && strncmp(path, "/metrics", 8) == 0)
+    {
+        if (_onScrape)
+        {
+            _onScrape();
+        }
+        startResponse("200 OK", METRICS_TYPE, nullptr);
+        _entry = 0;
+        _phase = SEND_METRICS;
+    }
+    else if (length == 9 && strncmp(path, "/log/tail", 9) == 0)
+    {
+        if (!canTail())
+        {
+            startResponse("503 Service Unavailable", "text/plain", tailUnavailable());
+            return;
+        }
+        size_t bytes = HTTP_STATUS_TAIL_BYTES;
+        const char* param = query ? strstr(query, "bytes=") : nullptr;
+        if (param && atol(param + 6) > 0)
+        {
+            bytes = atol(param + 6);
+        }
+        startResponse("200 OK", "text/plain", nullptr);
+        _end      = _stream->getHistoryEnd();
+        _position = _stream->getHistoryStart(bytes);
+        _phase    = SEND_TAIL;
+    }
+    else
+    {
+        startResponse("404 Not Found", "text/plain", "Try /metrics or /log/tail?bytes=N\n");
+    }
+}
+
+/**
+ * Sends what is left of the text buffer, as much as the socket takes.
+ *
+ * @return True once all of it is sent
+ */
+bool HttpStatus::sendText()
+{
+    if (_textSent >= _textLength)
+    {
+        return true;
+    }
+    int room = _client.availableForWrite();
+    #ifndef ESP8266
+    // ESP32 WiFiClient does not report its socket space
+    if (room <= 0)
+    {
+        room = _textLength - _textSent;
+    }
+    #endif
+    if (room <= 0)
+    {
+        return false;
+    }
+    size_t chunk = _textLength - _textSent;
+    if (chunk > (size_t)room)
+    {
+        chunk = room;
+    }
+    size_t sent = _client.write((const uint8_t*)_text + _textSent, chunk);
+    if (sent > 0)
+    {
+        _textSent    += sent;
+        _lastActivity = millis();
+    }
+    return _textSent >= _textLength;
+}
+
+/**
+ * Ends the current request, the answer is delimited by closing.
+ */
+void HttpStatus::close()
+{
+    _client.stop();
+    _client = WiFiClient();
+    _phase  = IDLE;
+}
+
+#endif
@@ -0,0 +1,89 @@
+#pragma once
+
+#ifdef ESP8266
+    #include <ESP8266WiFi.h>
+#else
+    #include <WiFi.h>
+#endif
+#ifdef USE_ASYNC_WIFIMANAGER
+    #include <ESPAsyncWebServer.h>
+#endif
+#include <functional>
+#include "Metrics.h"
+
+#ifndef HTTP_STATUS_PORT
+  #define HTTP_STATUS_PORT 80          // Raw socket server (sync builds), async builds use the portal's server
+#endif
+#ifndef HTTP_STATUS_TAIL_BYTES
+  #define HTTP_STATUS_TAIL_BYTES 1024  // Default length of /log/tail, ?bytes=N asks for another
+#endif
+#ifndef HTTP_STATUS_TIMEOUT
+  #define HTTP_STATUS_TIMEOUT 3000     // ms without progress before a request is dropped
+#endif
+
+class MultiStream;
+
+/**
+ * A small HTTP endpoint for scrapers:
+ *   GET /metrics              the metrics registry in the Prometheus text format
+ *   GET /log/tail[?bytes=N]   the last N bytes of log output
+ * Nothing is buffered for it: metrics are formatted one entry at a time
+ * into a fixed buffer, the tail is read from the MultiStream ring (ring
+ * buffer mode), so a scrape costs no heap and no second log path.
+ *
+ * With USE_ASYNC_WIFIMANAGER the routes are added to the AsyncWebServer
+ * of the configuration portal and answered with chunked responses.
+ * Otherwise a raw WiFiServer answers one request at a time from
+ * Networking::loop(), sending only what the socket takes.
+ */
+class HttpStatus
+{
+  private:
+    MultiStream* _stream;
+    Metrics*     _metrics;
+    uint32_t     _requests;
+    std::function<void()> _onScrape;
+
+    static const size_t TEXT_SIZE = 320;   // One metric (Metrics::formatPrometheus()) or a response header
+
+    #ifndef USE_ASYNC_WIFIMANAGER
+    enum Phase : uint8_t { IDLE, REQUEST_LINE, HEADERS, SEND_METRICS, SEND_TAIL, SEND_TEXT };
+
+    WiFiServer   _server;
+    WiFiClient   _client;
+    bool         _started;
+    Phase        _phase;
+    uint32_t     _lastActivity;
+    char         _line[96];        // Request line, the rest is cut off
+    uint8_t      _lineLength;
+    bool         _atLineStart;     // A blank line ends the headers
+    char         _text[TEXT_SIZE];
+    size_t       _textLength;
+    size_t       _textSent;
+    uint8_t      _entry;           // Next metric to send
+    uint32_t     _position;        // Log tail cursor
+    uint32_t     _end;
+
+    void startResponse(const char* status, const char* type, const char* body);
+    void route();
+    bool sendText();
+    void close();
+    #endif
+
+    bool canTail() const;
+
+  public:
+    HttpStatus(Metrics* metrics, uint16_t port = HTTP_STATUS_PORT);
+
+    #ifdef USE_ASYNC_WIFIMANAGER
+    void begin(MultiStream* stream, AsyncWebServer* server);
+    bool isBusy() const { return false; }
+    #else
+    void begin(MultiStream* stream);
+    void handle();
+    bool isBusy() const { return _phase != IDLE; }
+    #endif
+
+    void onScrape(std::function<void()> callback) { _onScrape = callback; }
+    uint32_t getRequests() const { return _requests; }
+};
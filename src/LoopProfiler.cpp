@@ -0,0 +1,200 @@
+#include "LoopProfiler.h"
+
+/**
+ * Constructor for the LoopProfiler class.
+ */
+LoopProfiler::LoopProfiler()
+    : _stages(), _stageCount(0), _mark(0)
+{
+}
+
+/**
+ * Adds a stage. Names are not copied, pass literals.
+ *
+ * @param name The stage name, e.g. "ota"
+ * @return The stage id, -1 if LOOP_PROFILER_MAX_STAGES are in use
+ */
+int LoopProfiler::addStage(const char* name)
+{
+    if (_stageCount >= LOOP_PROFILER_MAX_STAGES)
+    {
+        return -1;
+    }
+    _stages[_stageCount].name = name;
+    _stages[_stageCount].min  = 0xFFFFFFFF;
+    return _stageCount++;
+}
+
+/**
+ * Charges the cycles since begin() or the previous mark() to a stage.
+ *
+ * @param stage The stage id
+ */
+void LoopProfiler::mark(uint8_t stage)
+{
+    uint32_t now = ESP.getCycleCount();
+    if (stage < _stageCount)
+    {
+        record(_stages[stage], now - _mark);
+    }
+    _mark = now;
+}
+
+/**
+ * Adds a measurement that wasn't taken with mark(), e.g. a whole loop.
+ *
+ * @param stage The stage id
+ * @param cycles The cycles it took
+ */
+void LoopProfiler::recordCycles(uint8_t stage, uint32_t cycles)
+{
+    if (stage < _stageCount)
+    {
+        record(_stages[stage], cycles);
+    }
+}
+
+/**
+ * Adds a measurement to a stage.
+ *
+ * @param stage The stage
+ * @param cycles The cycles it took
+ */
+void LoopProfiler::record(Stage& stage, uint32_t cycles)
+{
+    uint8_t bucket = bucketOf(cycles);
+
+    //-- A full bucket halves all of them, the shape of the distribution stays
+    if (stage.buckets[bucket] == 0xFFFF)
+    {
+        for (uint8_t i = 0; i < BUCKETS; i++)
+        {
+            stage.buckets[i] >>= 1;
+        }
+    }
+    stage.buckets[bucket]++;
+    stage.count++;
+    stage.sum += cycles;
+    if (cycles < stage.min)
+    {
+        stage.min = cycles;
+    }
+    if (cycles > stage.max)
+    {
+        stage.max = cycles;
+    }
+}
+
+/**
+ * Maps a cycle count to its bucket: 0..3 as is, above that four buckets
+ * per power of two.
+ *
+ * @param cycles The cycle count
+ * @return The bucket, 0..BUCKETS-1
+ */
+uint8_t LoopProfiler::bucketOf(uint32_t cycles)
+{
+    if (cycles < 4)
+    {
+        return cycles;
+    }
+    uint8_t octave = 31 - __builtin_clz(cycles);
+    return octave * 4 + ((cycles >> (octave - 2)) & 3) - 4;
+}
+
+/**
+ * Returns the highest cycle count that falls in a bucket.
+ *
+ * @param bucket The bucket
+ * @return Its upper bound
+ */
+uint32_t LoopProfiler::bucketBound(uint8_t bucket)
+{
+    if (bucket < 4)
+    {
+        return bucket;
+    }
+    uint8_t octave = (bucket + 4) / 4;
+    uint8_t sub    = (bucket + 4) % 4;
+    return (uint32_t)((((uint64_t)5 + sub) << (octave - 2)) - 1);
+}
+
+/**
+ * Estimates a percentile of a stage from its buckets.
+ *
+ * @param stage The stage
+ * @param percent The percentile, e.g. 99
+ * @return Upper bound of the bucket that holds it (never above the maximum)
+ */
+uint32_t LoopProfiler::percentile(const Stage& stage, uint8_t percent) const
+{
+    uint32_t total = 0;
+    for (uint8_t i = 0; i < BUCKETS; i++)
+    {
+        total += stage.buckets[i];
+    }
+    uint32_t wanted = (uint32_t)(((uint64_t)total * percent + 99) / 100);
+    uint32_t seen   = 0;
+    for (uint8_t i = 0; i < BUCKETS && wanted > 0; i++)
+    {
+        seen += stage.buckets[i];
+        if (seen >= wanted)
+        {
+            uint32_t bound = bucketBound(i);
+            return bound > stage.max ? stage.max : bound;
+        }
+    }
+    return stage.max;
+}
+
+/**
+ * Clears the measurements, the stages stay.
+ */
+void LoopProfiler::reset()
+{
+    for (uint8_t i = 0; i < _stageCount; i++)
+    {
+        Stage& stage = _stages[i];
+        stage.count = 0;
+        stage.sum   = 0;
+        stage.min   = 0xFFFFFFFF;
+        stage.max   = 0;
+        memset(stage.buckets, 0, sizeof(stage.buckets));
+    }
+}
+
+/**
+ * Prints min/avg/p99/max per stage, in cycles and in microseconds.
+ *
+ * @param out Where the table goes
+ */
+void LoopProfiler::print(Print& out) const
+{
+    char line[112];
+    uint32_t mhz = ESP.getCpuFreqMHz();
+    if (mhz == 0)
+    {
+        mhz = 1;
+    }
+
+    snprintf(line, sizeof(line), "%-10s %10s %10s %10s %10s %10s  (cycles @ %lu MHz)\r\n"
+                               , "stage", "count", "min", "avg", "p99", "max", (unsigned long)mhz);
+    out.print(line);
+    for (uint8_t i = 0; i < _stageCount; i++)
+    {
+        const Stage& stage = _stages[i];
+        if (stage.count == 0)
+        {
+            snprintf(line, sizeof(line), "%-10s %10d\r\n", stage.name, 0);
+            out.print(line);
+            continue;
+        }
+        uint32_t avg = (uint32_t)(stage.sum / stage.count);
+        uint32_t p99 = percentile(stage, 99);
+        snprintf(line, sizeof(line), "%-10s %10lu %10lu %10lu %10lu %10lu  (max %lu us, p99 %lu us)\r\n"
+                                   , stage.name, (unsigned long)stage.count, (unsigned long)stage.min
+                                   , (unsigned long)avg, (unsigned long)p99, (unsigned long)stage.max
+                                   , (unsigned long)(stage.max / mhz), (unsigned long)(p99 / mhz));
+        out.print(line);
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <Arduino.h>
+
+#ifndef LOOP_PROFILER_MAX_STAGES
+  #define LOOP_PROFILER_MAX_STAGES 12  // Profiled stages, the whole loop included
+#endif
+
+/**
+ * Measures how many CPU cycles the stages of a loop take, with
+ * ESP.getCycleCount(). mark(stage) charges the cycles since the previous
+ * mark to a stage, so a loop is profiled by calling begin() once and
+ * mark() after every stage. Per stage it keeps min, max, average and a
+ * log-linear histogram (four buckets per power of two) for percentiles.
+ * The cycle counter wraps after some seconds, a stage must be shorter.
+ */
+class LoopProfiler
+{
+  private:
+    static const uint8_t BUCKETS = 124;  // 0..3, then 4 buckets for every power of two up to 2^31
+
+    struct Stage
+    {
+      const char* name;
+      uint32_t    count;
+      uint64_t    sum;
+      uint32_t    min;
+      uint32_t    max;
+      uint16_t    buckets[BUCKETS];
+    };
+
+    Stage    _stages[LOOP_PROFILER_MAX_STAGES];
+    uint8_t  _stageCount;
+    uint32_t _mark;
+
+    static uint8_t bucketOf(uint32_t cycles);
+    static uint32_t bucketBound(uint8_t bucket);
+    uint32_t percentile(const Stage& stage, uint8_t percent) const;
+    void record(Stage& stage, uint32_t cycles);
+
+  public:
+    LoopProfiler();
+
+    int  addStage(const char* name);
+    void begin() { _mark = ESP.getCycleCount(); }
+    void mark(uint8_t stage);
+    void recordCycles(uint8_t stage, uint32_t cycles);
+    void reset();
+    void print(Print& out) const;
+};
@@ -0,0 +1,402 @@
+#include "MdnsServices.h"
+
+#ifndef ESP8266
+    #include <esp_idf_version.h>
+#endif
+
+/**
+ * Constructor for the MdnsServices class.
+ */
+MdnsServices::MdnsServices()
+    : _services(), _serviceCount(0), _txt(), _txtCount(0), _changed(false), _lastAnnounce(0),
+      _running(false), _browse(), _browseCount(0), _querying(-1), _queryStarted(0), _query(nullptr),
+      _peers(), _peerCount(0)
+{
+}
+
+/**
+ * Adds the registered services and TXT records to the responder, call
+ * after MDNS.begin() succeeded.
+ */
+void MdnsServices::begin()
+{
+    for (uint8_t i = 0; i < _serviceCount; i++)
+    {
+        MDNS.addService(_services[i].service, _services[i].proto, _services[i].port);
+    }
+    for (uint8_t i = 0; i < _txtCount; i++)
+    {
+        MDNS.addServiceTxt(_txt[i].service, _txt[i].proto, _txt[i].key, _txt[i].value);
+        _txt[i].changed = false;
+    }
+    _changed      = false;
+    _lastAnnounce = millis();
+    _running      = true;
+}
+
+/**
+ * Announces changed TXT records and runs the background browse queries.
+ * Call it regularly from loop(), it never blocks.
+ */
+void MdnsServices::handle()
+{
+    if (!_running)
+    {
+        return;
+    }
+    uint32_t now = millis();
+    if (_changed && now - _lastAnnounce >= MDNS_ANNOUNCE_MS)
+    {
+        announce();
+    }
+
+    if (_querying >= 0)
+    {
+        if (now - _queryStarted >= MDNS_QUERY_MS)
+        {
+            collectQuery();
+        }
+        return;
+    }
+    for (uint8_t i = 0; i < _browseCount; i++)
+    {
+        if ((int32_t)(now - _browse[i].next) >= 0)
+        {
+            startQuery(i);
+            return;
+        }
+    }
+}
+
+/**
+ * Registers a service, e.g. addService("http", "tcp", 80). Names are not
+ * copied, pass literals.
+ *
+ * @param service Service type without the underscore
+ * @param proto "tcp" or "udp"
+ * @param port The port it listens on
+ * @return False if the table (MDNS_MAX_SERVICES) is full
+ */
+bool MdnsServices::addService(const char* service, const char* proto, uint16_t port)
+{
+    if (_serviceCount >= MDNS_MAX_SERVICES)
+    {
+        return false;
+    }
+    _services[_serviceCount].service = service;
+    _services[_serviceCount].proto   = proto;
+    _services[_serviceCount].port    = port;
+    _serviceCount++;
+    if (_running)
+    {
+        MDNS.addService(service, proto, port);
+    }
+    return true;
+}
+
+/**
+ * Sets a TXT record of a service (also of the built-in "telnet" and
+ * "arduino" ones). The value is copied; nothing is sent if it didn't
+ * change, otherwise it goes out with the next announcement.
+ *
+ * @param service Service type as passed to addService()
+ * @param proto "tcp" or "udp"
+ * @param key The key, not copied
+ * @param value The value, at most MDNS_TXT_VALUE_SIZE - 1 characters are kept
+ * @return False if the table (MDNS_MAX_TXT) is full
+ */
+bool MdnsServices::setTxt(const char* service, const char* proto, const char* key, const char* value)
+{
+    Txt* txt = nullptr;
+    for (uint8_t i = 0; i < _txtCount; i++)
+    {
+        if (strcmp(_txt[i].key, key) == 0 && strcmp(_txt[i].service, service) == 0 && strcmp(_txt[i].proto, proto) == 0)
+        {
+            txt = &_txt[i];
+            break;
+        }
+    }
+    if (!txt)
+    {
+        if (_txtCount >= MDNS_MAX_TXT)
+        {
+            return false;
+        }
+        txt          = &_txt[_txtCount++];
+        txt->service = service;
+        txt->proto   = proto;
+        txt->key     = key;
+        txt->value[0] = 0;
+        txt->changed = true;
+    }
+    else if (strncmp(txt->value, value, sizeof(txt->value) - 1) == 0)
+    {
+        return true;
+    }
+    snprintf(txt->value, sizeof(txt->value), "%s", value);
+    txt->changed = true;
+    _changed     = true;
+    return true;
+}
+
+/**
+ * Sets a numeric TXT record, see setTxt().
+ *
+ * @param service Service type
+ * @param proto "tcp" or "udp"
+ * @param key The key, not copied
+ * @param value The value
+ * @return False if the table is full
+ */
+bool MdnsServices::setTxt(const char* service, const char* proto, const char* key, int32_t value)
+{
+    char text[12];
+    snprintf(text, sizeof(text), "%ld", (long)value);
+    return setTxt(service, proto, key, text);
+}
+
+/**
+ * Pushes the changed TXT records to the responder, which announces them.
+ */
+void MdnsServices::announce()
+{
+    for (uint8_t i = 0; i < _txtCount; i++)
+    {
+        if (_txt[i].changed)
+        {
+            MDNS.addServiceTxt(_txt[i].service, _txt[i].proto, _txt[i].key, _txt[i].value);
+            _txt[i].changed = false;
+        }
+    }
+    #ifdef ESP8266
+        //-- The ESP32 responder announces a changed TXT record by itself
+        MDNS.announce();
+    #endif
+    _changed      = false;
+    _lastAnnounce = millis();
+}
+
+/**
+ * Browses for a service type in the background every intervalMs; the
+ * peers found are kept by getPeerCount()/getPeer(). Names are not copied.
+ *
+ * @param service Service type, e.g. "http"
+ * @param proto "tcp" or "udp"
+ * @param intervalMs Time between queries, a peer not seen for three is dropped
+ * @return False if the table (MDNS_MAX_BROWSE) is full
+ */
+bool MdnsServices::browse(const char* service, const char* proto, uint32_t intervalMs)
+{
+    for (uint8_t i = 0; i < _browseCount; i++)
+    {
+        if (strcmp(_browse[i].service, service) == 0 && strcmp(_browse[i].proto, proto) == 0)
+        {
+            _browse[i].interval = intervalMs;
+            return true;
+        }
+    }
+    if (_browseCount >= MDNS_MAX_BROWSE)
+    {
+        return false;
+    }
+    _browse[_browseCount].service  = service;
+    _browse[_browseCount].proto    = proto;
+    _browse[_browseCount].interval = intervalMs;
+    _browse[_browseCount].next     = millis();
+    _browseCount++;
+    return true;
+}
+
+/**
+ * Starts an asynchronous query for a browse entry.
+ *
+ * @param browse The entry
+ */
+void MdnsServices::startQuery(uint8_t browse)
+{
+    _browse[browse].next = millis() + _browse[browse].interval;
+    #ifdef ESP8266
+        //-- Answers are collected by MDNS.update()
+        _query = MDNS.installServiceQuery(_browse[browse].service, _browse[browse].proto, nullptr);
+    #else
+        char service[24];
+        char proto[8];
+        snprintf(service, sizeof(service), "%s%s", _browse[browse].service[0] == '_' ? "" : "_", _browse[browse].service);
+        snprintf(proto, sizeof(proto), "%s%s", _browse[browse].proto[0] == '_' ? "" : "_", _browse[browse].proto);
+        #if ESP_IDF_VERSION_MAJOR >= 5
+            _query = mdns_query_async_new(nullptr, service, proto, MDNS_TYPE_PTR, MDNS_QUERY_MS, MDNS_MAX_PEERS, nullptr);
+        #else
+            _query = mdns_query_async_new(nullptr, service, proto, MDNS_TYPE_PTR, MDNS_QUERY_MS, MDNS_MAX_PEERS);
+        #endif
+    #endif
+    if (_query)
+    {
+        _querying     = browse;
+        _queryStarted = millis();
+    }
+}
+
+/**
+ * Copies the answers of the running query into the peer cache and ends it.
+ */
+void MdnsServices::collectQuery()
+{
+    uint8_t browse = (uint8_t)_querying;
+    #ifdef ESP8266
+        uint32_t answers = MDNS.answerCount(_query);
+        for (uint32_t i = 0; i < answers; i++)
+        {
+            if (!MDNS.hasAnswerHostDomain(_query, i) || !MDNS.hasAnswerIP4Address(_query, i) || !MDNS.hasAnswerPort(_query, i))
+            {
+                continue;
+            }
+            //-- "name.local" -> "name"
+            char        hostname[sizeof(_peers[0].hostname)];
+            const char* domain = MDNS.answerHostDomain(_query, i);
+            size_t      length = strcspn(domain, ".");
+            if (length >= sizeof(hostname))
+            {
+                length = sizeof(hostname) - 1;
+            }
+            memcpy(hostname, domain, length);
+            hostname[length] = 0;
+            addPeer(browse, hostname, MDNS.answerIP4Address(_query, i, 0), MDNS.answerPort(_query, i));
+        }
+        MDNS.removeServiceQuery(_query);
+    #else
+        mdns_result_t* results = nullptr;
+        #if ESP_IDF_VERSION_MAJOR >= 5
+            uint8_t count = 0;
+            bool    done  = mdns_query_async_get_results(_query, 0, &results, &count);
+        #else
+            bool    done  = mdns_query_async_get_results(_query, 0, &results);
+        #endif
+        if (!done)
+        {
+            return;   // Ends after its own timeout, which is MDNS_QUERY_MS as well
+        }
+        for (mdns_result_t* result = results; result; result = result->next)
+        {
+            for (mdns_ip_addr_t* address = result->addr; address; address = address->next)
+            {
+                if (address->addr.type == ESP_IPADDR_TYPE_V4 && result->hostname)
+                {
+                    addPeer(browse, result->hostname, IPAddress(address->addr.u_addr.ip4.addr), result->port);
+                    break;
+                }
+            }
+        }
+        mdns_query_results_free(results);
+        mdns_query_async_delete(_query);
+    #endif
+    _query    = nullptr;
+    _querying = -1;
+    expirePeers(browse);
+
+} //  MdnsServices::collectQuery()
+
+/**
+ * Adds a peer to the cache, or refreshes it. A full cache replaces the
+ * peer that wasn't seen for the longest time.
+ *
+ * @param browse The browse entry that found it
+ * @param hostname Its hostname, copied
+ * @param ip Its address
+ * @param port The port of the service
+ */
+void MdnsServices::addPeer(uint8_t browse, const char* hostname, IPAddress ip, uint16_t port)
+{
+    Peer* peer = nullptr;
+    for (uint8_t i = 0; i < _peerCount; i++)
+    {
+        if (_peers[i].service == _browse[browse].service && _peers[i].proto == _browse[browse].proto
+            && strcmp(_peers[i].hostname, hostname) == 0)
+        {
+            peer = &_peers[i];
+            break;
+        }
+    }
+    if (!peer && _peerCount < MDNS_MAX_PEERS)
+    {
+        peer = &_peers[_peerCount++];
+    }
+    if (!peer)
+    {
+        peer = &_peers[0];
+        for (uint8_t i = 1; i < _peerCount; i++)
+        {
+            if ((int32_t)(_peers[i].seen - peer->seen) < 0)
+            {
+                peer = &_peers[i];
+            }
+        }
+    }
+    peer->service = _browse[browse].service;
+    peer->proto   = _browse[browse].proto;
+    snprintf(peer->hostname, sizeof(peer->hostname), "%s", hostname);
+    peer->ip      = ip;
+    peer->port    = port;
+    peer->seen    = millis();
+}
+
+/**
+ * Drops the peers of a browse entry that didn't answer three queries.
+ *
+ * @param browse The browse entry
+ */
+void MdnsServices::expirePeers(uint8_t browse)
+{
+    uint32_t now = millis();
+    uint8_t  kept = 0;
+    for (uint8_t i = 0; i < _peerCount; i++)
+    {
+        bool stale = _peers[i].service == _browse[browse].service && _peers[i].proto == _browse[browse].proto
+                  && now - _peers[i].seen > 3 * _browse[browse].interval;
+        if (!stale)
+        {
+            _peers[kept++] = _peers[i];
+        }
+    }
+    _peerCount = kept;
+}
+
+/**
+ * Looks up a cached peer by hostname.
+ *
+ * @param hostname The hostname (without .local)
+ * @return Its index for getPeer(), -1 if not known
+ */
+int MdnsServices::findPeer(const char* hostname) const
+{
+    for (uint8_t i = 0; i < _peerCount; i++)
+    {
+        if (strcmp(_peers[i].hostname, hostname) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Lists the cached peers, one per line.
+ *
+ * @param out Where the list goes
+ */
+void MdnsServices::printPeers(Print& out) const
+{
+    char     line[96];
+    uint32_t now = millis();
+    for (uint8_t i = 0; i < _peerCount; i++)
+    {
+        const Peer& peer = _peers[i];
+        snprintf(line, sizeof(line), "%-24s %u.%u.%u.%u:%u _%s._%s %lus ago\r\n", peer.hostname
+               , peer.ip[0], peer.ip[1], peer.ip[2], peer.ip[3], peer.port, peer.service, peer.proto
+               , (unsigned long)((now - peer.seen) / 1000));
+        out.print(line);
+    }
+    if (_peerCount == 0)
+    {
+        out.print(_browseCount ? "No peers found (yet)\r\n" : "Not browsing, see browseMDNS()\r\n");
+    }
+}
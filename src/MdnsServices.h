@@ -0,0 +1,125 @@
+#pragma once
+
+#ifdef ESP8266
+    #include <ESP8266WiFi.h>
+    #include <ESP8266mDNS.h>
+#else
+    #include <WiFi.h>
+    #include <ESPmDNS.h>
+    #include <mdns.h>
+#endif
+
+#ifndef MDNS_MAX_SERVICES
+  #define MDNS_MAX_SERVICES 4          // Services added next to telnet and arduino
+#endif
+#ifndef MDNS_MAX_TXT
+  #define MDNS_MAX_TXT 8               // TXT records of all services together
+#endif
+#ifndef MDNS_TXT_VALUE_SIZE
+  #define MDNS_TXT_VALUE_SIZE 32       // Longest TXT value, longer ones are cut off
+#endif
+#ifndef MDNS_ANNOUNCE_MS
+  #define MDNS_ANNOUNCE_MS 1000        // Changed TXT records are announced at most this often
+#endif
+#ifndef MDNS_MAX_BROWSE
+  #define MDNS_MAX_BROWSE 2            // Service types browsed for in the background
+#endif
+#ifndef MDNS_MAX_PEERS
+  #define MDNS_MAX_PEERS 8             // Cached browse results
+#endif
+#ifndef MDNS_BROWSE_MS
+  #define MDNS_BROWSE_MS 60000         // Default time between background queries
+#endif
+#ifndef MDNS_QUERY_MS
+  #define MDNS_QUERY_MS 2000           // How long a background query collects answers
+#endif
+
+/**
+ * Custom mDNS services with TXT records, and a cache of peers found by
+ * browsing in the background. Services and records are kept here and
+ * (re)applied when the responder starts. A changed TXT value is only
+ * marked; handle() pushes the changes in one go, at most every
+ * MDNS_ANNOUNCE_MS, so updating a value from loop() doesn't flood the
+ * network. Browsing runs one asynchronous query at a time; the blocking
+ * MDNS.queryService() is never used, getPeer() reads the cache.
+ */
+class MdnsServices
+{
+  public:
+    struct Peer
+    {
+      const char* service;      // As passed to browse()
+      const char* proto;
+      char        hostname[32];
+      IPAddress   ip;
+      uint16_t    port;
+      uint32_t    seen;         // millis() of the last answer
+    };
+
+  private:
+    struct Service
+    {
+      const char* service;
+      const char* proto;
+      uint16_t    port;
+    };
+
+    struct Txt
+    {
+      const char* service;
+      const char* proto;
+      const char* key;
+      char        value[MDNS_TXT_VALUE_SIZE];
+      bool        changed;
+    };
+
+    struct Browse
+    {
+      const char* service;
+      const char* proto;
+      uint32_t    interval;
+      uint32_t    next;
+    };
+
+    Service  _services[MDNS_MAX_SERVICES];
+    uint8_t  _serviceCount;
+    Txt      _txt[MDNS_MAX_TXT];
+    uint8_t  _txtCount;
+    bool     _changed;          // Some TXT record waits to be announced
+    uint32_t _lastAnnounce;
+    bool     _running;          // The responder is up
+
+    Browse   _browse[MDNS_MAX_BROWSE];
+    uint8_t  _browseCount;
+    int8_t   _querying;         // Browse entry with a query running, -1 none
+    uint32_t _queryStarted;
+    #ifdef ESP8266
+    MDNSResponder::hMDNSServiceQuery _query;
+    #else
+    mdns_search_once_t* _query;
+    #endif
+    Peer     _peers[MDNS_MAX_PEERS];
+    uint8_t  _peerCount;
+
+    void announce();
+    void startQuery(uint8_t browse);
+    void collectQuery();
+    void addPeer(uint8_t browse, const char* hostname, IPAddress ip, uint16_t port);
+    void expirePeers(uint8_t browse);
+
+  public:
+    MdnsServices();
+
+    void begin();
+    void handle();
+
+    bool addService(const char* service, const char* proto, uint16_t port);
+    bool setTxt(const char* service, const char* proto, const char* key, const char* value);
+    bool setTxt(const char* service, const char* proto, const char* key, int32_t value);
+    bool browse(const char* service, const char* proto, uint32_t intervalMs);
+
+    uint8_t getPeerCount() const { return _peerCount; }
+    const Peer* getPeer(uint8_t index) const { return index < _peerCount ? &_peers[index] : nullptr; }
+    int findPeer(const char* hostname) const;
+    void printPeers(Print& out) const;
+};
@@ -0,0 +1,303 @@
+#include "Metrics.h"
+
+/**
+ * Adds a value to the histogram.
+ *
+ * @param value The value, e.g. a duration in microseconds
+ */
+void Metrics::Histogram::record(uint32_t value)
+{
+    uint8_t bucket = (value == 0) ? 0 : 32 - __builtin_clz(value);
+    if (bucket >= BUCKETS)
+    {
+        bucket = BUCKETS - 1;
+    }
+    buckets[bucket]++;
+    count++;
+    sum += value;
+    if (value > max)
+    {
+        max = value;
+    }
+}
+
+/**
+ * Estimates a percentile from the buckets.
+ *
+ * @param percent The percentile, e.g. 99
+ * @return Upper bound of the bucket that holds it (never above the maximum)
+ */
+uint32_t Metrics::Histogram::percentile(uint8_t percent) const
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+    uint32_t wanted = (uint32_t)(((uint64_t)count * percent + 99) / 100);
+    uint32_t seen   = 0;
+    for (uint8_t i = 0; i < BUCKETS; i++)
+    {
+        seen += buckets[i];
+        if (seen >= wanted)
+        {
+            uint32_t bound = (i == 0) ? 0 : (i >= 32 ? 0xFFFFFFFF : (uint32_t)((1ULL << i) - 1));
+            return (i == BUCKETS - 1 || bound > max) ? max : bound;
+        }
+    }
+    return max;
+}
+
+/**
+ * Clears the histogram.
+ */
+void Metrics::Histogram::reset()
+{
+    count = 0;
+    sum   = 0;
+    max   = 0;
+    memset(buckets, 0, sizeof(buckets));
+}
+
+/**
+ * Constructor for the Metrics class.
+ */
+Metrics::Metrics()
+    : _entries(), _count(0), _histograms(), _histogramCount(0)
+{
+}
+
+/**
+ * Adds a metric to the registry. Names are not copied, pass literals.
+ *
+ * @param name The name, e.g. "loop_us"
+ * @param type COUNTER, GAUGE or HISTOGRAM
+ * @return The id, -1 if the registry is full
+ */
+int Metrics::add(const char* name, Type type)
+{
+    if (_count >= METRICS_MAX_ENTRIES || (type == HISTOGRAM && _histogramCount >= METRICS_MAX_HISTOGRAMS))
+    {
+        return -1;
+    }
+    Entry& entry = _entries[_count];
+    entry.name = name;
+    entry.type = type;
+    if (type == HISTOGRAM)
+    {
+        entry.histogram = &_histograms[_histogramCount++];
+        entry.histogram->reset();
+    }
+    else
+    {
+        entry.counter = 0;
+    }
+    return _count++;
+}
+
+/**
+ * Adds a counter (only goes up, reset by reset()).
+ *
+ * @param name The name
+ * @return The id, -1 if the registry is full
+ */
+int Metrics::addCounter(const char* name)
+{
+    return add(name, COUNTER);
+}
+
+/**
+ * Adds a gauge (a value that is set, e.g. RSSI).
+ *
+ * @param name The name
+ * @return The id, -1 if the registry is full
+ */
+int Metrics::addGauge(const char* name)
+{
+    return add(name, GAUGE);
+}
+
+/**
+ * Adds a histogram (e.g. a latency in microseconds).
+ *
+ * @param name The name
+ * @return The id, -1 if the registry or the histogram pool is full
+ */
+int Metrics::addHistogram(const char* name)
+{
+    return add(name, HISTOGRAM);
+}
+
+/**
+ * Gets the histogram of a metric, e.g. to record into it from a class
+ * that doesn't know the registry.
+ *
+ * @param id The metric id
+ * @return The histogram, nullptr if the metric is not a histogram
+ */
+Metrics::Histogram* Metrics::getHistogram(uint8_t id)
+{
+    return (id < _count && _entries[id].type == HISTOGRAM) ? _entries[id].histogram : nullptr;
+}
+
+/**
+ * Gets the value of a counter or gauge (the count of a histogram).
+ *
+ * @param id The metric id
+ * @return The value, 0 for an unknown id
+ */
+int32_t Metrics::get(uint8_t id) const
+{
+    if (id >= _count)
+    {
+        return 0;
+    }
+    return (_entries[id].type == HISTOGRAM) ? (int32_t)_entries[id].histogram->count : _entries[id].gauge;
+}
+
+/**
+ * Finds a metric by name.
+ *
+ * @param name The name
+ * @return The id, -1 if there is no such metric
+ */
+int Metrics::find(const char* name) const
+{
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        if (strcmp(_entries[i].name, name) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Clears the counters and histograms; gauges keep their value.
+ */
+void Metrics::reset()
+{
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        if (_entries[i].type == COUNTER)
+        {
+            _entries[i].counter = 0;
+        }
+        else if (_entries[i].type == HISTOGRAM)
+        {
+            _entries[i].histogram->reset();
+        }
+    }
+}
+
+/**
+ * Prints one metric per line, histograms with their percentiles and the
+ * non-empty buckets ("<64:12" = 12 values below 64).
+ *
+ * @param out Where the metrics go
+ */
+void Metrics::print(Print& out) const
+{
+    char line[96];
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        const Entry& entry = _entries[i];
+        if (entry.type == HISTOGRAM)
+        {
+            const Histogram& h = *entry.histogram;
+            snprintf(line, sizeof(line), "%-16s n=%lu avg=%lu p50=%lu p99=%lu max=%lu\r\n", entry.name
+                   , (unsigned long)h.count, (unsigned long)(h.count ? h.sum / h.count : 0)
+                   , (unsigned long)h.percentile(50), (unsigned long)h.percentile(99), (unsigned long)h.max);
+            out.print(line);
+            out.print("                ");
+            for (uint8_t b = 0; b < Histogram::BUCKETS; b++)
+            {
+                if (h.buckets[b])
+                {
+                    snprintf(line, sizeof(line), (b < Histogram::BUCKETS - 1) ? " <%lu:%lu" : " >=%lu:%lu"
+                           , (unsigned long)(1UL << ((b < Histogram::BUCKETS - 1) ? b : b - 1)), (unsigned long)h.buckets[b]);
+                    out.print(line);
+                }
+            }
+            out.print("\r\n");
+        }
+        else
+        {
+            snprintf(line, sizeof(line), (entry.type == COUNTER) ? "%-16s %lu\r\n" : "%-16s %ld\r\n"
+                   , entry.name, (entry.type == COUNTER) ? (unsigned long)entry.counter : (long)entry.gauge);
+            out.print(line);
+        }
+    }
+}
+
+/**
+ * Prints all metrics on one line for a collector:
+ * "name=value ..." and "name=count/avg/p50/p99/max" for histograms.
+ *
+ * @param out Where the line goes
+ */
+void Metrics::printCompact(Print& out) const
+{
+    char item[72];
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        const Entry& entry = _entries[i];
+        if (entry.type == HISTOGRAM)
+        {
+            const Histogram& h = *entry.histogram;
+            snprintf(item, sizeof(item), "%s%s=%lu/%lu/%lu/%lu/%lu", i ? " " : "", entry.name
+                   , (unsigned long)h.count, (unsigned long)(h.count ? h.sum / h.count : 0)
+                   , (unsigned long)h.percentile(50), (unsigned long)h.percentile(99), (unsigned long)h.max);
+        }
+        else if (entry.type == COUNTER)
+        {
+            snprintf(item, sizeof(item), "%s%s=%lu", i ? " " : "", entry.name, (unsigned long)entry.counter);
+        }
+        else
+        {
+            snprintf(item, sizeof(item), "%s%s=%ld", i ? " " : "", entry.name, (long)entry.gauge);
+        }
+        out.print(item);
+    }
+    out.print("\r\n");
+}
+
+/**
+ * Formats one metric in the Prometheus text format, so a scrape can be
+ * answered entry by entry from a small buffer. Counters and gauges give
+ * a "# TYPE" line and the value; histograms are exposed as a summary with
+ * the 50/90/99th percentiles, the sum and the count.
+ *
+ * @param index The metric, 0..getCount() - 1
+ * @param out Where the text goes, 320 bytes fit any metric
+ * @param size The size of out
+ * @return The length of the text, 0 for an unknown index (or if out is too small)
+ */
+size_t Metrics::formatPrometheus(uint8_t index, char* out, size_t size) const
+{
+    if (index >= _count || size == 0)
+    {
+        return 0;
+    }
+    const Entry& entry = _entries[index];
+    int length;
+    if (entry.type == HISTOGRAM)
+    {
+        const Histogram& h = *entry.histogram;
+        length = snprintf(out, size, "# TYPE %s summary\n"
+                          "%s{quantile=\"0.5\"} %lu\n%s{quantile=\"0.9\"} %lu\n%s{quantile=\"0.99\"} %lu\n"
+                          "%s_sum %llu\n%s_count %lu\n", entry.name
+                        , entry.name, (unsigned long)h.percentile(50), entry.name, (unsigned long)h.percentile(90)
+                        , entry.name, (unsigned long)h.percentile(99)
+                        , entry.name, (unsigned long long)h.sum, entry.name, (unsigned long)h.count);
+    }
+    else if (entry.type == COUNTER)
+    {
+        length = snprintf(out, size, "# TYPE %s counter\n%s %lu\n", entry.name, entry.name, (unsigned long)entry.counter);
+    }
+    else
+    {
+        length = snprintf(out, size, "# TYPE %s gauge\n%s %ld\n", entry.name, entry.name, (long)entry.gauge);
+    }
+    return (length > 0 && (size_t)length < size) ? (size_t)length : 0;
+}
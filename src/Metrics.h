@@ -0,0 +1,77 @@
+#pragma once
+
+#include <Arduino.h>
+
+#ifndef METRICS_MAX_ENTRIES
+  #define METRICS_MAX_ENTRIES 32       // Counters, gauges and histograms together
+#endif
+#ifndef METRICS_MAX_HISTOGRAMS
+  #define METRICS_MAX_HISTOGRAMS 6
+#endif
+
+/**
+ * A fixed-memory registry of named counters, gauges and histograms.
+ * Updating a metric is an array access, so it can be done on hot paths;
+ * names are only used when the metrics are printed. Histograms count
+ * values in power-of-two buckets (bucket n holds values below 2^n).
+ */
+class Metrics
+{
+  public:
+    enum Type : uint8_t { COUNTER, GAUGE, HISTOGRAM };
+
+    struct Histogram
+    {
+      static const uint8_t BUCKETS = 20;     // Values of 2^18 and above share the last bucket
+
+      uint32_t count;
+      uint64_t sum;
+      uint32_t max;
+      uint32_t buckets[BUCKETS];
+
+      void record(uint32_t value);
+      uint32_t percentile(uint8_t percent) const;
+      void reset();
+    };
+
+  private:
+    struct Entry
+    {
+      const char* name;
+      Type        type;
+      union
+      {
+        uint32_t   counter;
+        int32_t    gauge;
+        Histogram* histogram;
+      };
+    };
+
+    Entry     _entries[METRICS_MAX_ENTRIES];
+    uint8_t   _count;
+    Histogram _histograms[METRICS_MAX_HISTOGRAMS];
+    uint8_t   _histogramCount;
+
+    int add(const char* name, Type type);
+
+  public:
+    Metrics();
+
+    int addCounter(const char* name);
+    int addGauge(const char* name);
+    int addHistogram(const char* name);
+
+    void increment(uint8_t id, uint32_t amount = 1) { if (id < _count) _entries[id].counter += amount; }
+    void set(uint8_t id, int32_t value) { if (id < _count) _entries[id].gauge = value; }
+    void record(uint8_t id, uint32_t value) { if (id < _count && _entries[id].type == HISTOGRAM) _entries[id].histogram->record(value); }
+    Histogram* getHistogram(uint8_t id);
+    int32_t get(uint8_t id) const;
+    int find(const char* name) const;
+
+    void reset();
+    void print(Print& out) const;
+    void printCompact(Print& out) const;
+
+    uint8_t getCount() const { return _count; }
+    size_t formatPrometheus(uint8_t index, char* out, size_t size) const;
+};
@@ -0,0 +1,1496 @@
+#include "MultiStream.h"
+
+/**
+ * Constructor for the MultiStream class.
+ * Initializes the serial pointer, the telnet client table and buffer index.
+ * 
+ * @param serial Pointer to the serial stream
+ */
+MultiStream::MultiStream(Stream* serial)
+    : _serial(serial), _bufferIndex(0), _inCriticalSection(0),
+      _flushPolicy(), _pendingSince(0), _hasPending(false),
+      _ringMode(false), _ringHead(0), _ringTail(0), _releaseHead(0), _serialTail(0),
+      _overflowBytes(0), _droppedBytes(0), _truncatedPrints(0),
+      _serialBytes(0), _telnetBytes(0), _flushHistogram(nullptr),
+      _multiProducer(false), _ringReserve(0), _ringCommitted(0), _flushRequested(false),
+      _deferredWrite(0), _deferredRead(0), _deferredDropped(0), _udpLog(nullptr), _udpTail(0),
+      _bootLog(nullptr), _bootLogTail(0), _skips(), _skipWrite(0), _skipRead(0)
+{
+  for (uint8_t i = 0; i < MAX_CLIENTS; i++)
+  {
+    _clients[i].tail    = 0;
+    _clients[i].dropped = 0;
+  }
+  for (uint8_t i = 0; i < MULTISTREAM_PRODUCERS; i++)
+  {
+    _lines[i].owner.store(nullptr);
+    _lines[i].length = 0;
+  }
+  for (uint32_t i = 0; i < MULTISTREAM_DEFERRED_RECORDS; i++)
+  {
+    _deferred[i].sequence.store(i);
+  }
+}
+
+/**
+ * Writes a single byte to the buffer.
+ * Flushes the buffer if it's full, if a newline character is encountered
+ * (IMMEDIATE policy) or when the coalescing policy says it is due.
+ * 
+ * @param c The byte to write
+ * @return The number of bytes written
+ */
+size_t MultiStream::write(uint8_t c)
+{
+  if (_ringMode)
+  {
+    return _multiProducer ? produce(&c, 1) : ringAppend(&c, 1);
+  }
+
+  // Add the byte to the buffer
+  if (_bufferIndex == 0)
+  {
+    _pendingSince = millis();
+  }
+  _buffer[_bufferIndex++] = c;
+  
+  // If the buffer is full or we encounter a newline, flush it
+  if (_flushPolicy.mode == FlushPolicy::IMMEDIATE)
+  {
+    if (_bufferIndex >= BUFFER_SIZE - 1 || c == '\n')
+    {
+      flushBuffer();
+    }
+  }
+  else if (flushDue(_bufferIndex, BUFFER_SIZE - 1))
+  {
+    flushBuffer();
+  }
+  
+  return 1;
+}
+
+/**
+ * Writes a buffer of bytes directly to both streams.
+ * This is more efficient than writing byte-by-byte.
+ * 
+ * @param buffer The buffer to write
+ * @param size The number of bytes to write
+ * @return The number of bytes written
+ */
+size_t MultiStream::write(const uint8_t* buffer, size_t size)
+{
+  if (_ringMode)
+  {
+    return _multiProducer ? produce(buffer, size) : ringAppend(buffer, size);
+  }
+
+  // Coalescing policies collect the bytes in the line buffer instead
+  if (_flushPolicy.mode != FlushPolicy::IMMEDIATE)
+  {
+    size_t done = 0;
+    while (done < size)
+    {
+      if (_bufferIndex == 0)
+      {
+        _pendingSince = millis();
+      }
+      size_t chunk = BUFFER_SIZE - 1 - _bufferIndex;
+      if (chunk > size - done)
+      {
+        chunk = size - done;
+      }
+      memcpy(&_buffer[_bufferIndex], buffer + done, chunk);
+      _bufferIndex += chunk;
+      done += chunk;
+      if (flushDue(_bufferIndex, BUFFER_SIZE - 1))
+      {
+        flushBuffer();
+      }
+    }
+    return size;
+  }
+
+  // First, flush any pending bytes in our internal buffer
+  if (_bufferIndex > 0)
+  {
+    flushBuffer();
+  }
+  
+  // Write the new buffer directly to serial, the boot log and all telnet clients
+  _serial->write(buffer, size);
+  _serialBytes += size;
+  if (_bootLog)
+  {
+    _bootLog->write(buffer, size);
+  }
+  writeClients(buffer, size);
+  
+  // Ensure the data is sent immediately if not in a critical section
+  if (!_inCriticalSection)
+  {
+    flushSinks(SINK_ALL);
+  }
+  
+  return size;
+}
+
+/**
+ * Writes a buffer to Serial only, Telnet only, or both.
+ * In ring buffer mode the bytes go straight to the selected sinks when all
+ * of them have caught up and have room. Otherwise they are queued in the
+ * ring like any output, with a skip range so the other sinks pass over
+ * them; the order per sink is kept and the caller never blocks. Without a
+ * free range (MULTISTREAM_SINK_RANGES) or room in the ring they are
+ * counted in getOverflowBytes().
+ * 
+ * @param sinks SINK_SERIAL, SINK_TELNET or both
+ * @param buffer The buffer to write
+ * @param size The number of bytes to write
+ * @return The number of bytes written
+ */
+size_t MultiStream::writeTo(uint8_t sinks, const uint8_t* buffer, size_t size)
+{
+  // Only the draining task may touch the sinks, other producers share the ring with both
+  if ((sinks & SINK_ALL) == SINK_ALL || _multiProducer)
+  {
+    return write(buffer, size);
+  }
+
+  if (!_ringMode)
+  {
+    // Send what is in the line buffer first
+    flushBuffer();
+    if (_bootLog)
+    {
+      _bootLog->write(buffer, size);
+    }
+    bool flushNow = !_inCriticalSection && _flushPolicy.mode == FlushPolicy::IMMEDIATE;
+    if (sinks & SINK_SERIAL)
+    {
+      _serial->write(buffer, size);
+      _serialBytes += size;
+      if (flushNow)
+      {
+        flushSinks(SINK_SERIAL);
+      }
+    }
+    if (sinks & SINK_TELNET)
+    {
+      writeClients(buffer, size);
+      if (flushNow)
+      {
+        flushSinks(SINK_TELNET);
+      }
+    }
+    return size;
+  }
+
+  uint32_t head = _ringHead.load(std::memory_order_acquire);
+  if (caughtUp(sinks, head, size))
+  {
+    if (_bootLog)
+    {
+      _bootLog->write(buffer, size);
+    }
+    if (sinks & SINK_SERIAL)
+    {
+      _serial->write(buffer, size);
+      _serialBytes += size;
+    }
+    if (sinks & SINK_TELNET)
+    {
+      for (uint8_t i = 0; i < MAX_CLIENTS; i++)
+      {
+        ClientSlot& slot = _clients[i];
+        if (slot.client && slot.client.connected())
+        {
+          _telnetBytes += slot.client.write(buffer, size);
+        }
+      }
+      if (_udpLog)
+      {
+        _udpLog->write(buffer, size);
+      }
+    }
+    return size;
+  }
+
+  //-- Queue it, the other sinks skip the range
+  uint32_t write = _skipWrite.load(std::memory_order_relaxed);
+  if (write - _skipRead.load(std::memory_order_acquire) >= MULTISTREAM_SINK_RANGES
+   || size > RING_SIZE - (head - _ringTail.load(std::memory_order_acquire)))
+  {
+    _overflowBytes += size;
+    return 0;
+  }
+  SkipRange& range = _skips[write & SKIP_MASK];
+  range.start = head;
+  range.end   = head + size;
+  range.sinks = SINK_ALL & ~sinks;
+  _skipWrite.store(write + 1, std::memory_order_release);
+  return ringAppend(buffer, size);
+}
+
+/**
+ * Checks if writeTo() can bypass the ring: every selected sink (and the
+ * boot log mirror) has sent all of the ring and has room for the bytes.
+ * 
+ * @param sinks SINK_SERIAL, SINK_TELNET or both
+ * @param head The producer cursor
+ * @param size The number of bytes to write
+ * @return True if the bytes can be written directly
+ */
+bool MultiStream::caughtUp(uint8_t sinks, uint32_t head, size_t size)
+{
+  if (_bootLog && _bootLogTail != head)
+  {
+    return false;
+  }
+  if ((sinks & SINK_SERIAL) && (_serialTail != head || _serial->availableForWrite() < (int)size))
+  {
+    return false;
+  }
+  if (sinks & SINK_TELNET)
+  {
+    for (uint8_t i = 0; i < MAX_CLIENTS; i++)
+    {
+      ClientSlot& slot = _clients[i];
+      if (!(slot.client && slot.client.connected()))
+      {
+        continue;
+      }
+      int room = slot.client.availableForWrite();
+      #ifndef ESP8266
+      // ESP32 WiFiClient does not report its socket space
+      if (room <= 0)
+      {
+        room = size;
+      }
+      #endif
+      if (slot.tail != head || room < (int)size)
+      {
+        return false;
+      }
+    }
+    if (_udpLog && _udpTail != head)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Formats output like Print::printf(), but without a heap buffer.
+ * 
+ * @param format printf() style format string
+ * @return The number of bytes written
+ */
+size_t MultiStream::printf(const char* format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  size_t written = vprintf(format, args);
+  va_end(args);
+  return written;
+}
+
+/**
+ * Formats output with a bounded vsnprintf() directly into the line buffer,
+ * or into the free part of the ring in ring buffer mode when more than
+ * MULTISTREAM_PRINTF_SIZE bytes are free before the end of the ring. Other
+ * output, and all output in multi-producer mode, is formatted on the stack
+ * and copied.
+ * Output longer than the free part, the buffer or MULTISTREAM_PRINTF_SIZE
+ * is cut off and counted in getTruncatedPrints().
+ * 
+ * @param format printf() style format string
+ * @param args The arguments
+ * @return The number of bytes written
+ */
+size_t MultiStream::vprintf(const char* format, va_list args)
+{
+  if (_ringMode && !_multiProducer)
+  {
+    uint32_t head   = _ringHead.load(std::memory_order_relaxed);
+    uint32_t tail   = _ringTail.load(std::memory_order_acquire);
+    size_t   offset = head & RING_MASK;
+    size_t   room   = RING_SIZE - (head - tail);
+    if (room > RING_SIZE - offset)
+    {
+      room = RING_SIZE - offset;
+    }
+    
+    // The free space is still log history: only format in place when the
+    // output is sure to be kept, so a line that doesn't fit can't overwrite it
+    if (room <= MULTISTREAM_PRINTF_SIZE)
+    {
+      return vprintfScratch(format, args);
+    }
+    int len = vsnprintf((char*)&_ring[offset], room, format, args);
+    if (len < 0)
+    {
+      return 0;
+    }
+    if ((size_t)len >= room)
+    {
+      len = room - 1;
+      _truncatedPrints++;
+    }
+    _ringHead.store(head + len, std::memory_order_release);
+    return len;
+  }
+  if (_ringMode)
+  {
+    return vprintfScratch(format, args);
+  }
+
+  // Make room for a typical line, then format after the pending bytes
+  if (_bufferIndex > 0 && BUFFER_SIZE - 1 - _bufferIndex < MULTISTREAM_PRINTF_SIZE)
+  {
+    flushBuffer();
+  }
+  if (_bufferIndex == 0)
+  {
+    _pendingSince = millis();
+  }
+  size_t room = BUFFER_SIZE - _bufferIndex;
+  int len = vsnprintf((char*)&_buffer[_bufferIndex], room, format, args);
+  if (len < 0)
+  {
+    return 0;
+  }
+  if ((size_t)len >= room)
+  {
+    len = room - 1;
+    _truncatedPrints++;
+  }
+  _bufferIndex += len;
+  
+  // IMMEDIATE sends every printf() right away, like write(buffer, size)
+  if (_flushPolicy.mode == FlushPolicy::IMMEDIATE || flushDue(_bufferIndex, BUFFER_SIZE - 1))
+  {
+    flushBuffer();
+  }
+  return len;
+}
+
+/**
+ * Formats on the stack and writes the result to the ring as one chunk.
+ * 
+ * @param format printf() style format string
+ * @param args The arguments
+ * @return The number of bytes written
+ */
+size_t MultiStream::vprintfScratch(const char* format, va_list args)
+{
+  char scratch[MULTISTREAM_PRINTF_SIZE];
+  int len = vsnprintf(scratch, sizeof(scratch), format, args);
+  if (len < 0)
+  {
+    return 0;
+  }
+  if ((size_t)len >= sizeof(scratch))
+  {
+    len = sizeof(scratch) - 1;
+    __atomic_fetch_add(&_truncatedPrints, 1, __ATOMIC_RELAXED);
+  }
+  return write((const uint8_t*)scratch, len);
+}
+
+/**
+ * Flushes the internal buffer by writing its contents to both streams.
+ */
+void MultiStream::flushBuffer()
+{
+  if (_bufferIndex > 0)
+  {
+    // Ensure null termination for safety
+    _buffer[_bufferIndex] = 0;
+    
+    // Write the buffer to the serial port
+    _serial->write(_buffer, _bufferIndex);
+    _serialBytes += _bufferIndex;
+    if (_bootLog)
+    {
+      _bootLog->write(_buffer, _bufferIndex);
+    }
+    
+    // Write the buffer to every connected telnet client
+    writeClients(_buffer, _bufferIndex);
+    
+    // Ensure the data is sent immediately if not in a critical section,
+    // coalescing policies never wait on the sinks
+    if (!_inCriticalSection && _flushPolicy.mode == FlushPolicy::IMMEDIATE)
+    {
+      flushSinks(SINK_ALL);
+    }
+    
+    // Reset the buffer index
+    _bufferIndex = 0;
+  }
+}
+
+/**
+ * Flushes both streams and the internal buffer.
+ */
+void MultiStream::flush()
+{
+  // Producers in other tasks commit their own line and leave the sending to the draining task
+  if (_multiProducer)
+  {
+    ProducerLine* slot = producerLine(false);
+    if (slot)
+    {
+      commitLine(slot);
+      slot->owner.store(nullptr, std::memory_order_release);
+    }
+    _flushRequested.store(true, std::memory_order_relaxed);
+    return;
+  }
+
+  // In ring buffer mode never wait on the sinks, just release all and send what fits
+  if (_ringMode)
+  {
+    _releaseHead = _ringHead.load(std::memory_order_acquire);
+    _hasPending  = false;
+    drain();
+    return;
+  }
+
+  // Flush our internal buffer first
+  flushBuffer();
+  
+  // Then flush serial and the telnet clients
+  if (_flushPolicy.mode == FlushPolicy::IMMEDIATE)
+  {
+    flushSinks(SINK_ALL);
+  }
+}
+
+/**
+ * Checks the flush policy against the amount of pending output.
+ * 
+ * @param pending Bytes written but not yet handed to the sinks
+ * @param limit Bytes at which output is released regardless of the policy
+ * @return True if the pending bytes should be sent now
+ */
+bool MultiStream::flushDue(size_t pending, size_t limit)
+{
+  if (pending == 0)
+  {
+    return false;
+  }
+  if (pending >= limit)
+  {
+    return true;
+  }
+  
+  switch (_flushPolicy.mode)
+  {
+    case FlushPolicy::IMMEDIATE:
+      return true;
+    case FlushPolicy::COALESCE_BYTES:
+      return pending >= _flushPolicy.bytes;
+    case FlushPolicy::COALESCE_TIME:
+      return (pending >= _flushPolicy.bytes) || (millis() - _pendingSince >= _flushPolicy.ms);
+    case FlushPolicy::MANUAL:
+    default:
+      return false;
+  }
+}
+
+/**
+ * Selects when buffered output is handed to Serial and Telnet.
+ * Output still pending under the old policy is sent first.
+ * 
+ * @param policy The new flush policy
+ */
+void MultiStream::setFlushPolicy(const FlushPolicy& policy)
+{
+  flush();
+  _flushPolicy = policy;
+}
+
+/**
+ * Writes the same buffer to every connected telnet client, and to the
+ * UDP log sink if there is one.
+ * 
+ * @param buffer The buffer to write
+ * @param size The number of bytes to write
+ */
+void MultiStream::writeClients(const uint8_t* buffer, size_t size)
+{
+  for (uint8_t i = 0; i < MAX_CLIENTS; i++)
+  {
+    if (_clients[i].client && _clients[i].client.connected())
+    {
+      _telnetBytes += _clients[i].client.write(buffer, size);
+    }
+  }
+  if (_udpLog)
+  {
+    _udpLog->write(buffer, size);
+  }
+}
+
+/**
+ * Waits until Serial and/or the telnet clients have sent their output,
+ * timing it in the flush histogram if one is set.
+ * 
+ * @param sinks SINK_SERIAL, SINK_TELNET or both
+ */
+void MultiStream::flushSinks(uint8_t sinks)
+{
+  uint32_t start = _flushHistogram ? micros() : 0;
+  if (sinks & SINK_SERIAL)
+  {
+    _serial->flush();
+  }
+  if (sinks & SINK_TELNET)
+  {
+    flushClients();
+  }
+  if (_flushHistogram)
+  {
+    _flushHistogram->record(micros() - start);
+  }
+}
+
+/**
+ * Flushes every connected telnet client.
+ */
+void MultiStream::flushClients()
+{
+  for (uint8_t i = 0; i < MAX_CLIENTS; i++)
+  {
+    if (_clients[i].client && _clients[i].client.connected())
+    {
+      _clients[i].client.flush();
+    }
+  }
+}
+
+/**
+ * Adds a telnet client to the first free slot of the client table.
+ * In ring buffer mode the new client starts at the current write position.
+ * 
+ * @param client The newly accepted client
+ * @return The slot number, or -1 if the table is full
+ */
+int MultiStream::addClient(const WiFiClient& client)
+{
+  for (uint8_t i = 0; i < MAX_CLIENTS; i++)
+  {
+    if (!(_clients[i].client && _clients[i].client.connected()))
+    {
+      _clients[i].client  = client;
+      _clients[i].tail    = _releaseHead;
+      _clients[i].dropped = 0;
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Sets the UDP log sink, nullptr for none. In ring buffer mode it starts
+ * at the current write position.
+ * 
+ * @param sink The sink, owned by the caller
+ */
+void MultiStream::setUdpLog(UdpLog* sink)
+{
+  _udpTail = _releaseHead;
+  _udpLog  = sink;
+}
+
+/**
+ * Sets the boot log that gets a copy of all output, nullptr for none.
+ * 
+ * @param log The boot log, started and owned by the caller
+ */
+void MultiStream::setBootLog(BootLog* log)
+{
+  _bootLogTail = _ringHead.load(std::memory_order_acquire);
+  _bootLog     = log;
+}
+
+/**
+ * Copies what was added to the ring since the last call to the boot log;
+ * it takes everything at once, so it never holds the ring back.
+ * 
+ * @param head The producer cursor
+ */
+void MultiStream::mirrorRing(uint32_t head)
+{
+  if (!_bootLog || _bootLogTail == head)
+  {
+    _bootLogTail = head;
+    return;
+  }
+  size_t offset = _bootLogTail & RING_MASK;
+  size_t length = head - _bootLogTail;
+  size_t first  = (length < RING_SIZE - offset) ? length : RING_SIZE - offset;
+  _bootLog->write(&_ring[offset], first);
+  _bootLog->write(_ring, length - first);
+  _bootLogTail = head;
+}
+
+/**
+ * Stops and releases telnet clients that have disconnected.
+ */
+void MultiStream::pruneClients()
+{
+  for (uint8_t i = 0; i < MAX_CLIENTS; i++)
+  {
+    if (_clients[i].client && !_clients[i].client.connected())
+    {
+      _clients[i].client.stop();
+      _clients[i].client = WiFiClient();
+    }
+  }
+}
+
+/**
+ * Counts the connected telnet clients.
+ * 
+ * @return The number of occupied slots
+ */
+uint8_t MultiStream::getClientCount()
+{
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < MAX_CLIENTS; i++)
+  {
+    if (_clients[i].client && _clients[i].client.connected())
+    {
+      count++;
+    }
+  }
+  return count;
+}
+
+/**
+ * Gets the client in a slot of the telnet client table.
+ * 
+ * @param slot The slot number (0 .. MULTISTREAM_MAX_CLIENTS-1)
+ * @return Pointer to the client, or nullptr if the slot is free
+ */
+WiFiClient* MultiStream::getClient(uint8_t slot)
+{
+  if (slot >= MAX_CLIENTS || !(_clients[slot].client && _clients[slot].client.connected()))
+  {
+    return nullptr;
+  }
+  return &_clients[slot].client;
+}
+
+/**
+ * Gets the number of bytes skipped for one telnet client.
+ * 
+ * @param slot The slot number
+ * @return Bytes dropped since the client connected
+ */
+uint32_t MultiStream::getDroppedBytes(uint8_t slot) const
+{
+  return (slot < MAX_CLIENTS) ? _clients[slot].dropped : 0;
+}
+
+/**
+ * Begin a critical section where flush is deferred until the end.
+ * This is useful for high-frequency writes where you want to batch flushes.
+ */
+void MultiStream::beginCriticalSection()
+{
+  _inCriticalSection.fetch_add(1);
+}
+
+/**
+ * End a critical section and flush any pending data.
+ * Sections of several tasks may overlap, the flush waits for the last one.
+ */
+void MultiStream::endCriticalSection()
+{
+  uint8_t open = _inCriticalSection.load();
+  while (open > 0 && !_inCriticalSection.compare_exchange_weak(open, open - 1))
+  {
+  }
+  if (open == 1)
+  {
+    flush();
+  }
+}
+
+/**
+ * Switches between direct (blocking) output and the non-blocking ring buffer.
+ * In ring buffer mode write() only copies into a fixed-size buffer and
+ * drain() (called from Networking::loop()) sends what the sinks accept.
+ * 
+ * @param enable True to use the ring buffer, false for direct output
+ */
+void MultiStream::setRingBufferMode(bool enable)
+{
+  if (enable == _ringMode)
+  {
+    return;
+  }
+  
+  if (enable)
+  {
+    // Send whatever is still in the line buffer before switching
+    flushBuffer();
+    uint32_t head = _ringHead.load(std::memory_order_relaxed);
+    _releaseHead = head;
+    _hasPending  = false;
+    _serialTail = head;
+    for (uint8_t i = 0; i < MAX_CLIENTS; i++)
+    {
+      _clients[i].tail = head;
+    }
+    _udpTail = head;
+    _bootLogTail = head;
+    _skipRead.store(_skipWrite.load());
+    _ringTail.store(head, std::memory_order_relaxed);
+    _ringMode = true;
+  }
+  else
+  {
+    setMultiProducer(false);
+    _ringMode = false;
+    // Push out the remainder while blocking is allowed again
+    uint32_t head = _ringHead.load(std::memory_order_acquire);
+    _releaseHead = head;
+    mirrorRing(head);
+    while (_serialTail != head)
+    {
+      _serialTail = drainSinkFor(SINK_SERIAL, _serial, _serialTail, head, false);
+      yield();
+    }
+    for (uint8_t i = 0; i < MAX_CLIENTS; i++)
+    {
+      _clients[i].tail = head;
+    }
+    _udpTail = head;
+    _skipRead.store(_skipWrite.load());
+    _ringTail.store(head, std::memory_order_release);
+  }
+}
+
+/**
+ * Appends bytes to the ring buffer (producer side).
+ * Never blocks: if there is not enough room the whole chunk is rejected
+ * and counted as overflow, so lines are never torn in half.
+ * 
+ * @param data The bytes to append
+ * @param size The number of bytes to append
+ * @return The number of bytes accepted (size or 0)
+ */
+size_t MultiStream::ringAppend(const uint8_t* data, size_t size)
+{
+  if (_multiProducer)
+  {
+    return ringAppendShared(data, size);
+  }
+
+  uint32_t head = _ringHead.load(std::memory_order_relaxed);
+  uint32_t tail = _ringTail.load(std::memory_order_acquire);
+  
+  if (size > RING_SIZE - (head - tail))
+  {
+    _overflowBytes += size;
+    return 0;
+  }
+  
+  size_t offset = head & RING_MASK;
+  size_t first  = RING_SIZE - offset;
+  if (first > size)
+  {
+    first = size;
+  }
+  memcpy(&_ring[offset], data, first);
+  if (size > first)
+  {
+    memcpy(_ring, data + first, size - first);
+  }
+  
+  // Publish the bytes only after they have been copied
+  _ringHead.store(head + size, std::memory_order_release);
+  return size;
+}
+
+/**
+ * Appends bytes to the ring from any task (multi-producer side).
+ * A producer claims its space by advancing _ringReserve with a
+ * compare-and-swap, copies its bytes and adds their count to
+ * _ringCommitted; nobody waits for anybody else. drain() publishes the
+ * reserved space once every reservation has been committed.
+ * 
+ * @param data The bytes to append
+ * @param size The number of bytes to append
+ * @return The number of bytes accepted (size or 0)
+ */
+size_t MultiStream::ringAppendShared(const uint8_t* data, size_t size)
+{
+  uint32_t tail  = _ringTail.load(std::memory_order_acquire);
+  uint32_t start = _ringReserve.load(std::memory_order_relaxed);
+  do
+  {
+    if (size > RING_SIZE - (start - tail))
+    {
+      __atomic_fetch_add(&_overflowBytes, size, __ATOMIC_RELAXED);
+      return 0;
+    }
+  } while (!_ringReserve.compare_exchange_weak(start, start + size));
+
+  size_t offset = start & RING_MASK;
+  size_t first  = RING_SIZE - offset;
+  if (first > size)
+  {
+    first = size;
+  }
+  memcpy(&_ring[offset], data, first);
+  if (size > first)
+  {
+    memcpy(_ring, data + first, size - first);
+  }
+  _ringCommitted.fetch_add(size);
+  return size;
+}
+
+/**
+ * Identifies the task that is writing, nullptr in an interrupt handler.
+ * 
+ * @return The producer
+ */
+static void* currentProducer()
+{
+  #ifdef ESP8266
+    return (void*)1;    // One context, interrupt handlers use logFromISR()
+  #else
+    return xPortInIsrContext() ? nullptr : (void*)xTaskGetCurrentTaskHandle();
+  #endif
+}
+
+/**
+ * Finds the line buffer of the calling task.
+ * 
+ * @param claim Claim a free one if the task has none
+ * @return The line buffer, nullptr if none (all MULTISTREAM_PRODUCERS busy)
+ */
+MultiStream::ProducerLine* MultiStream::producerLine(bool claim)
+{
+  void* self = currentProducer();
+  if (!self)
+  {
+    return nullptr;
+  }
+  for (uint8_t i = 0; i < MULTISTREAM_PRODUCERS; i++)
+  {
+    if (_lines[i].owner.load(std::memory_order_acquire) == self)
+    {
+      return &_lines[i];
+    }
+  }
+  if (!claim)
+  {
+    return nullptr;
+  }
+  for (uint8_t i = 0; i < MULTISTREAM_PRODUCERS; i++)
+  {
+    void* expected = nullptr;
+    if (_lines[i].owner.compare_exchange_strong(expected, self))
+    {
+      return &_lines[i];
+    }
+  }
+  return nullptr;
+}
+
+/**
+ * Moves an assembled (part of a) line into the ring.
+ * 
+ * @param slot The line buffer, owned by the caller
+ */
+void MultiStream::commitLine(ProducerLine* slot)
+{
+  if (slot->length > 0)
+  {
+    ringAppendShared(slot->line, slot->length);
+    slot->length = 0;
+  }
+}
+
+/**
+ * Multi-producer write: collects the bytes in the task's own line buffer
+ * and commits every complete line ('\n' or '\r') to the ring in one
+ * reservation, so lines of different tasks never mix. The buffer is freed
+ * as soon as no partial line is left. Without a free buffer (or in an
+ * interrupt handler) the bytes go to the ring as they are.
+ * 
+ * @param data The bytes to write
+ * @param size The number of bytes
+ * @return The number of bytes accepted
+ */
+size_t MultiStream::produce(const uint8_t* data, size_t size)
+{
+  ProducerLine* slot = producerLine(true);
+  if (!slot)
+  {
+    return ringAppendShared(data, size);
+  }
+  for (size_t i = 0; i < size; i++)
+  {
+    uint8_t c = data[i];
+    slot->line[slot->length++] = c;
+    if (c == '\n' || c == '\r' || slot->length >= MULTISTREAM_LINE_SIZE)
+    {
+      commitLine(slot);
+    }
+  }
+  if (slot->length == 0)
+  {
+    slot->owner.store(nullptr, std::memory_order_release);
+  }
+  return size;
+}
+
+/**
+ * Queues a log line from an interrupt handler. Only the format pointer and
+ * four 32 bit arguments are copied into a fixed record, drain() formats it
+ * later (with a newline added). Never blocks; a full queue drops the
+ * record and counts it in getDeferredDropped().
+ * 
+ * @param format printf() style format string, must stay valid (a literal)
+ * @param arg1 First argument, e.g. %u, %d, %x or %p
+ * @param arg2 Second argument
+ * @param arg3 Third argument
+ * @param arg4 Fourth argument
+ * @return False if the record was dropped
+ */
+bool IRAM_ATTR MultiStream::logFromISR(const char* format, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4)
+{
+  uint32_t position = _deferredWrite.load(std::memory_order_relaxed);
+  for (;;)
+  {
+    DeferredRecord& record = _deferred[position & DEFERRED_MASK];
+    int32_t diff = (int32_t)(record.sequence.load(std::memory_order_acquire) - position);
+    if (diff == 0)
+    {
+      // Free for this position, claim it (a failed claim reloads the position)
+      if (_deferredWrite.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+      {
+        record.format  = format;
+        record.args[0] = arg1;
+        record.args[1] = arg2;
+        record.args[2] = arg3;
+        record.args[3] = arg4;
+        record.sequence.store(position + 1, std::memory_order_release);
+        return true;
+      }
+    }
+    else if (diff < 0)
+    {
+      __atomic_fetch_add(&_deferredDropped, 1, __ATOMIC_RELAXED);
+      return false;
+    }
+    else
+    {
+      position = _deferredWrite.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+/**
+ * Formats the queued logFromISR() records and writes them like any other
+ * output, called by drain().
+ */
+void MultiStream::drainDeferred()
+{
+  for (;;)
+  {
+    DeferredRecord& record = _deferred[_deferredRead & DEFERRED_MASK];
+    if (record.sequence.load(std::memory_order_acquire) != _deferredRead + 1)
+    {
+      return;
+    }
+    char line[MULTISTREAM_PRINTF_SIZE];
+    int len = snprintf(line, sizeof(line) - 1, record.format
+                     , record.args[0], record.args[1], record.args[2], record.args[3]);
+    record.sequence.store(_deferredRead + MULTISTREAM_DEFERRED_RECORDS, std::memory_order_release);
+    _deferredRead++;
+    if (len < 0)
+    {
+      continue;
+    }
+    if ((size_t)len >= sizeof(line) - 1)
+    {
+      len = sizeof(line) - 2;
+    }
+    line[len++] = '\n';
+    write((const uint8_t*)line, len);
+  }
+}
+
+/**
+ * Makes the committed part of the ring visible to the sinks (drain side).
+ * The committed total is read before the reservation end: if they match,
+ * no reservation was open at that moment and everything up to it is
+ * copied in. Otherwise the head stays where it is until the next drain().
+ */
+void MultiStream::publishCommitted()
+{
+  uint32_t committed = _ringCommitted.load();
+  uint32_t reserved  = _ringReserve.load();
+  if (committed == reserved)
+  {
+    _ringHead.store(committed, std::memory_order_release);
+  }
+}
+
+/**
+ * Lets any task (and the WiFi event handlers) write while one task, the
+ * one that calls drain(), sends to Serial and Telnet. Switches to ring
+ * buffer mode. Each write() or printf() is kept together; flush() from a
+ * producer only asks drain() to send everything, and writeTo() goes to
+ * both sinks. Switch it on from the draining task, and off only once the
+ * other tasks have stopped writing.
+ * 
+ * @param enable True for several producers, false for one
+ */
+void MultiStream::setMultiProducer(bool enable)
+{
+  if (enable == _multiProducer)
+  {
+    return;
+  }
+  if (enable)
+  {
+    setRingBufferMode(true);
+    uint32_t head = _ringHead.load(std::memory_order_relaxed);
+    _ringCommitted.store(head);
+    _ringReserve.store(head);
+    _multiProducer = true;
+  }
+  else
+  {
+    // Single producer again: partial lines and whatever is reserved now belong to the ring
+    for (uint8_t i = 0; i < MULTISTREAM_PRODUCERS; i++)
+    {
+      commitLine(&_lines[i]);
+      _lines[i].owner.store(nullptr);
+    }
+    _multiProducer = false;
+    uint32_t reserved = _ringReserve.load();
+    while (_ringCommitted.load() != reserved)
+    {
+      yield();
+    }
+    _ringHead.store(reserved, std::memory_order_release);
+  }
+}
+
+/**
+ * Sends as much of the ring as a sink accepts without blocking.
+ * 
+ * @param sink The stream to write to
+ * @param tail The sink's read cursor
+ * @param head The producer cursor
+ * @param isClient True if the sink is a WiFiClient
+ * @return The updated read cursor
+ */
+uint32_t MultiStream::drainSink(Print* sink, uint32_t tail, uint32_t head, bool isClient)
+{
+  // At most two passes: up to the end of the ring, then from the start
+  for (int pass = 0; pass < 2 && tail != head; pass++)
+  {
+    int room = sink->availableForWrite();
+    #ifndef ESP8266
+    // ESP32 WiFiClient does not report its socket space
+    if (isClient && room <= 0)
+    {
+      room = MULTISTREAM_DRAIN_CHUNK;
+    }
+    #endif
+    if (room <= 0)
+    {
+      break;
+    }
+    
+    size_t offset = tail & RING_MASK;
+    size_t chunk  = head - tail;
+    if (chunk > RING_SIZE - offset)
+    {
+      chunk = RING_SIZE - offset;
+    }
+    if (chunk > (size_t)room)
+    {
+      chunk = room;
+    }
+    
+    size_t written = sink->write(&_ring[offset], chunk);
+    tail += written;
+    if (isClient)
+    {
+      _telnetBytes += written;
+    }
+    else
+    {
+      _serialBytes += written;
+    }
+    if (written < chunk)
+    {
+      break;
+    }
+  }
+  return tail;
+}
+
+/**
+ * Finds how far a sink may send: up to the next writeTo() range it skips.
+ * A range it is at is passed over first.
+ * 
+ * @param tail The sink's read cursor, moved past skipped ranges
+ * @param head Where sending stops
+ * @param sink SINK_SERIAL or SINK_TELNET
+ * @return Where the sink has to stop
+ */
+uint32_t MultiStream::skipLimit(uint32_t& tail, uint32_t head, uint8_t sink) const
+{
+  uint32_t write = _skipWrite.load(std::memory_order_acquire);
+  for (uint32_t i = _skipRead.load(std::memory_order_relaxed); i != write; i++)
+  {
+    const SkipRange& range = _skips[i & SKIP_MASK];
+    if (!(range.sinks & sink) || (int32_t)(range.end - tail) <= 0)
+    {
+      continue;
+    }
+    if ((int32_t)(range.start - tail) > 0)
+    {
+      return ((int32_t)(range.start - head) < 0) ? range.start : head;
+    }
+    if ((int32_t)(range.end - head) > 0)
+    {
+      return tail;    // Not (all) released yet
+    }
+    tail = range.end;
+  }
+  return head;
+}
+
+/**
+ * Sends a sink's share of the ring, passing over the ranges it skips.
+ * 
+ * @param sink SINK_SERIAL or SINK_TELNET
+ * @param out The stream to write to
+ * @param tail The sink's read cursor
+ * @param head The producer cursor
+ * @param isClient True if the sink is a WiFiClient
+ * @return The updated read cursor
+ */
+uint32_t MultiStream::drainSinkFor(uint8_t sink, Print* out, uint32_t tail, uint32_t head, bool isClient)
+{
+  for (uint32_t i = 0; i <= MULTISTREAM_SINK_RANGES && tail != head; i++)
+  {
+    uint32_t limit = skipLimit(tail, head, sink);
+    if (limit == tail)
+    {
+      break;
+    }
+    uint32_t sent = drainSink(out, tail, limit, isClient);
+    bool stalled  = (sent != limit);
+    tail = sent;
+    if (stalled)
+    {
+      break;
+    }
+  }
+  return tail;
+}
+
+/**
+ * Drains the ring buffer into serial and the telnet clients without blocking.
+ * Every client has its own cursor into the shared ring, so a slow client
+ * only delays itself. A client that falls more than half the ring behind
+ * is skipped forward so it can't stall the others; the skipped bytes are
+ * counted in getDroppedBytes().
+ */
+void MultiStream::drain()
+{
+  drainDeferred();
+
+  if (!_ringMode)
+  {
+    // Direct mode: only a time based policy can have output waiting
+    if (_flushPolicy.mode != FlushPolicy::IMMEDIATE && flushDue(_bufferIndex, BUFFER_SIZE - 1))
+    {
+      flushBuffer();
+    }
+    return;
+  }
+  
+  //-- Let the flush policy decide how much of the ring the sinks may send
+  bool releaseAll = false;
+  if (_multiProducer)
+  {
+    publishCommitted();
+    releaseAll = _flushRequested.exchange(false);
+  }
+  uint32_t head = _ringHead.load(std::memory_order_acquire);
+  mirrorRing(head);
+  if (releaseAll)
+  {
+    _releaseHead = head;
+    _hasPending  = false;
+  }
+  else if (head != _releaseHead)
+  {
+    if (!_hasPending)
+    {
+      _hasPending   = true;
+      _pendingSince = millis();
+    }
+    if (flushDue(head - _releaseHead, RING_SIZE / 2))
+    {
+      _releaseHead = head;
+      _hasPending  = false;
+    }
+  }
+  head = _releaseHead;
+  
+  _serialTail = drainSinkFor(SINK_SERIAL, _serial, _serialTail, head, false);
+  uint32_t oldest = _serialTail;
+  
+  for (uint8_t i = 0; i < MAX_CLIENTS; i++)
+  {
+    ClientSlot& slot = _clients[i];
+    if (!(slot.client && slot.client.connected()))
+    {
+      // Free slot, a new client starts at the current position
+      slot.tail = head;
+      continue;
+    }
+    if (head - slot.tail > RING_SIZE / 2)
+    {
+      slot.dropped  += head - slot.tail;
+      _droppedBytes += head - slot.tail;
+      slot.tail = head;
+    }
+    slot.tail = drainSinkFor(SINK_TELNET, &slot.client, slot.tail, head, true);
+    if (head - slot.tail > head - oldest)
+    {
+      oldest = slot.tail;
+    }
+  }
+
+  //-- UDP log sink: complete lines, a few datagrams per call, never waits
+  if (_udpLog)
+  {
+    if (head - _udpTail > RING_SIZE / 2)
+    {
+      _udpLog->addDropped(head - _udpTail);
+      _udpTail = head;
+    }
+    for (int i = 0; i < MULTISTREAM_UDP_BURST && _udpTail != head; i++)
+    {
+      //-- Bytes before a skipped range end there, also without a line end
+      uint32_t limit = skipLimit(_udpTail, head, SINK_TELNET);
+      if (limit == _udpTail)
+      {
+        break;
+      }
+      size_t offset = _udpTail & RING_MASK;
+      size_t length = limit - _udpTail;
+      size_t first  = (length < RING_SIZE - offset) ? length : RING_SIZE - offset;
+      size_t used   = _udpLog->sendLines(&_ring[offset], first, _ring, length - first, limit != head);
+      if (used == 0)
+      {
+        break;
+      }
+      _udpTail += used;
+    }
+    if (head - _udpTail > head - oldest)
+    {
+      oldest = _udpTail;
+    }
+  }
+  
+  // Release the space that all sinks are done with, and the ranges they all passed
+  uint32_t read  = _skipRead.load(std::memory_order_relaxed);
+  uint32_t write = _skipWrite.load(std::memory_order_acquire);
+  while (read != write && (int32_t)(_skips[read & SKIP_MASK].end - oldest) <= 0)
+  {
+    read++;
+  }
+  _skipRead.store(read, std::memory_order_release);
+  _ringTail.store(oldest, std::memory_order_release);
+}
+
+/**
+ * Finds the oldest byte of the ring that is still intact. Drained bytes
+ * stay in the ring until a write needs their space again; in
+ * multi-producer mode a write may already be under way up to the
+ * reservation end. The byte after the head may hold the terminator of
+ * an in-place printf().
+ * 
+ * @param head The producer cursor
+ * @return The position of the oldest intact byte
+ */
+uint32_t MultiStream::historyOldest(uint32_t head) const
+{
+  uint32_t end      = _multiProducer ? _ringReserve.load() : head;
+  uint32_t inFlight = end - head;
+  uint32_t keep     = (inFlight < RING_SIZE) ? RING_SIZE - 1 - inFlight : 0;
+  return (head < keep) ? 0 : head - keep;
+}
+
+/**
+ * Gets where a read of the log history starts: at most maxBytes before
+ * the end, and never before the oldest byte still in the ring.
+ * 
+ * @param maxBytes How much history is wanted
+ * @return The start position for writeHistory() or copyHistory()
+ */
+uint32_t MultiStream::getHistoryStart(size_t maxBytes) const
+{
+  uint32_t head   = _ringHead.load(std::memory_order_acquire);
+  uint32_t oldest = historyOldest(head);
+  return (head - oldest > maxBytes) ? head - maxBytes : oldest;
+}
+
+/**
+ * Sends log history straight from the ring, as much as the sink accepts
+ * without blocking. Bytes overwritten meanwhile are skipped. Call it from
+ * the task that calls drain(); in multi-producer mode a line written by
+ * another task while it is being sent can come out torn.
+ * 
+ * @param sink The stream to write to
+ * @param position Where to continue, from getHistoryStart()
+ * @param end Where to stop, from getHistoryEnd()
+ * @param isClient True if the sink is a WiFiClient
+ * @return The updated position, end when done
+ */
+uint32_t MultiStream::writeHistory(Print* sink, uint32_t position, uint32_t end, bool isClient)
+{
+  (void)isClient;  // only used on ESP32
+  uint32_t oldest = historyOldest(_ringHead.load(std::memory_order_acquire));
+  if ((int32_t)(end - oldest) <= 0)
+  {
+    return end;
+  }
+  if ((int32_t)(position - oldest) < 0)
+  {
+    position = oldest;
+  }
+
+  for (int pass = 0; pass < 2 && position != end; pass++)
+  {
+    int room = sink->availableForWrite();
+    #ifndef ESP8266
+    // ESP32 WiFiClient does not report its socket space
+    if (isClient && room <= 0)
+    {
+      room = MULTISTREAM_DRAIN_CHUNK;
+    }
+    #endif
+    if (room <= 0)
+    {
+      break;
+    }
+
+    size_t offset = position & RING_MASK;
+    size_t chunk  = end - position;
+    if (chunk > RING_SIZE - offset)
+    {
+      chunk = RING_SIZE - offset;
+    }
+    if (chunk > (size_t)room)
+    {
+      chunk = room;
+    }
+
+    size_t written = sink->write(&_ring[offset], chunk);
+    position += written;
+    if (written < chunk)
+    {
+      break;
+    }
+  }
+  return position;
+}
+
+/**
+ * Copies log history out of the ring, for a reader running in another
+ * task (a web server callback). Safe while the ring is read by drain()
+ * in the same task, or in multi-producer mode from any task: bytes that
+ * were overwritten during the copy are dropped from its front.
+ * 
+ * @param position Where to continue, advanced past the copied bytes
+ * @param end Where to stop, from getHistoryEnd()
+ * @param buffer Destination
+ * @param size Room at the destination
+ * @return The number of bytes copied, 0 when done
+ */
+size_t MultiStream::copyHistory(uint32_t& position, uint32_t end, uint8_t* buffer, size_t size)
+{
+  // A copy lapped by the producers entirely is tried again, a few times
+  for (int attempt = 0; attempt < 3; attempt++)
+  {
+    uint32_t oldest = historyOldest(_ringHead.load(std::memory_order_acquire));
+    if ((int32_t)(position - oldest) < 0)
+    {
+      position = oldest;
+    }
+    if ((int32_t)(end - position) <= 0)
+    {
+      position = end;
+      return 0;
+    }
+
+    size_t length = end - position;
+    if (length > size)
+    {
+      length = size;
+    }
+    size_t offset = position & RING_MASK;
+    size_t first  = RING_SIZE - offset;
+    if (first > length)
+    {
+      first = length;
+    }
+    memcpy(buffer, &_ring[offset], first);
+    if (length > first)
+    {
+      memcpy(buffer + first, _ring, length - first);
+    }
+
+    //-- Keep only what no write has reached since
+    std::atomic_thread_fence(std::memory_order_acquire);
+    oldest = historyOldest(_ringHead.load(std::memory_order_acquire));
+    size_t lost = ((int32_t)(oldest - position) > 0) ? oldest - position : 0;
+    if (lost < length)
+    {
+      memmove(buffer, buffer + lost, length - lost);
+      position += length;
+      return length - lost;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Resets the byte, overflow, dropped and truncation counters.
+ */
+void MultiStream::resetCounters()
+{
+  _overflowBytes   = 0;
+  _droppedBytes    = 0;
+  _truncatedPrints = 0;
+  _serialBytes     = 0;
+  _telnetBytes     = 0;
+  _deferredDropped = 0;
+  for (uint8_t i = 0; i < MAX_CLIENTS; i++)
+  {
+    _clients[i].dropped = 0;
+  }
+}
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <atomic>
+#include "UdpLog.h"
+#include "BootLog.h"
+#include "Metrics.h"
+
+#ifndef MULTISTREAM_RING_SIZE
+  #define MULTISTREAM_RING_SIZE 2048   // Ring buffer size in bytes (must be a power of two)
+#endif
+#ifndef MULTISTREAM_MAX_CLIENTS
+  #define MULTISTREAM_MAX_CLIENTS 4    // Number of simultaneous telnet sessions
+#endif
+#ifndef MULTISTREAM_DRAIN_CHUNK
+  #define MULTISTREAM_DRAIN_CHUNK 256  // Max bytes per drain() when a sink can't report free space
+#endif
+#ifndef MULTISTREAM_SEGMENT_SIZE
+  #ifdef TCP_MSS
+    #define MULTISTREAM_SEGMENT_SIZE TCP_MSS
+  #else
+    #define MULTISTREAM_SEGMENT_SIZE 1460
+  #endif
+#endif
+#ifndef MULTISTREAM_BUFFER_SIZE
+  #define MULTISTREAM_BUFFER_SIZE (MULTISTREAM_SEGMENT_SIZE + 1)  // Line buffer for direct (non ring) output, holds one segment
+#endif
+#ifndef MULTISTREAM_PRINTF_SIZE
+  #define MULTISTREAM_PRINTF_SIZE 256  // Longest printf() output, formatted on the stack when it can't go in place
+#endif
+#ifndef MULTISTREAM_PRODUCERS
+  #define MULTISTREAM_PRODUCERS 4      // Tasks that can assemble a line at the same time (multi-producer mode)
+#endif
+#ifndef MULTISTREAM_LINE_SIZE
+  #define MULTISTREAM_LINE_SIZE 128    // Per-task line buffer, a longer line is committed in pieces
+#endif
+#ifndef MULTISTREAM_DEFERRED_RECORDS
+  #define MULTISTREAM_DEFERRED_RECORDS 16  // logFromISR() records waiting for drain() (power of two)
+#endif
+#ifndef MULTISTREAM_UDP_BURST
+  #define MULTISTREAM_UDP_BURST 4      // Datagrams the UDP log sink sends per drain() at most
+#endif
+#ifndef MULTISTREAM_SINK_RANGES
+  #define MULTISTREAM_SINK_RANGES 16   // writeTo() chunks queued in the ring for one sink only (power of two)
+#endif
+
+/**
+ * Decides when MultiStream hands buffered output to Serial and Telnet.
+ * IMMEDIATE      - send and flush every line (default, original behaviour)
+ * COALESCE_BYTES - send once 'bytes' are pending, never wait on the sinks
+ * COALESCE_TIME  - send once the oldest pending byte is 'ms' old or a full
+ *                  segment is pending, never wait on the sinks
+ * MANUAL         - send only on flush() or when the buffer fills up
+ */
+struct FlushPolicy
+{
+  enum Mode : uint8_t { IMMEDIATE, COALESCE_BYTES, COALESCE_TIME, MANUAL };
+
+  Mode     mode;
+  size_t   bytes;
+  uint32_t ms;
+
+  FlushPolicy(Mode mode = IMMEDIATE, size_t bytes = MULTISTREAM_SEGMENT_SIZE, uint32_t ms = 20)
+    : mode(mode), bytes(bytes), ms(ms) {}
+
+  static FlushPolicy immediate() { return FlushPolicy(IMMEDIATE); }
+  static FlushPolicy coalesceBytes(size_t bytes = MULTISTREAM_SEGMENT_SIZE) { return FlushPolicy(COALESCE_BYTES, bytes); }
+  static FlushPolicy coalesceTime(uint32_t ms) { return FlushPolicy(COALESCE_TIME, MULTISTREAM_SEGMENT_SIZE, ms); }
+  static FlushPolicy manual() { return FlushPolicy(MANUAL); }
+};
+
+class MultiStream : public Stream
+{
+  private:
+    Stream* _serial;
+    //-- In direct mode a coalescing policy collects at most BUFFER_SIZE - 1 bytes
+    static const size_t BUFFER_SIZE = MULTISTREAM_BUFFER_SIZE;
+    uint8_t _buffer[BUFFER_SIZE];
+    size_t _bufferIndex;
+    
+    // Open critical sections (any task), flushing waits for the last one to end
+    std::atomic<uint8_t> _inCriticalSection;
+
+    //-- When buffered output is handed to the sinks
+    FlushPolicy _flushPolicy;
+    uint32_t _pendingSince;            // millis() of the oldest byte not yet released
+    bool _hasPending;
+
+    //-- Non-blocking ring buffer mode (single producer, drained from Networking::loop())
+    static const size_t RING_SIZE = MULTISTREAM_RING_SIZE;
+    static const size_t RING_MASK = RING_SIZE - 1;
+    static_assert((RING_SIZE & RING_MASK) == 0, "MULTISTREAM_RING_SIZE must be a power of two");
+    bool _ringMode;
+    uint8_t _ring[RING_SIZE];
+    std::atomic<uint32_t> _ringHead;   // Written by the producer only
+    std::atomic<uint32_t> _ringTail;   // Oldest byte still needed by a sink, written by drain() only
+    uint32_t _releaseHead;             // Sinks may send up to here, advanced by the flush policy
+    uint32_t _serialTail;
+    uint32_t _overflowBytes;           // Bytes rejected because the ring was full
+    uint32_t _droppedBytes;            // Bytes skipped for telnet clients that fell too far behind
+    uint32_t _truncatedPrints;         // printf() calls cut off at the buffer or MULTISTREAM_PRINTF_SIZE
+    uint32_t _serialBytes;             // Bytes handed to Serial
+    uint32_t _telnetBytes;             // Bytes handed to the telnet clients (all sessions)
+    Metrics::Histogram* _flushHistogram;
+
+    //-- Multi-producer ring: any task appends, one task drains
+    bool _multiProducer;
+    std::atomic<uint32_t> _ringReserve;    // End of the claimed space, advanced with compare-and-swap
+    std::atomic<uint32_t> _ringCommitted;  // Reserved bytes the producers have copied in (a running total)
+    std::atomic<bool> _flushRequested;     // flush() from a producer, handled by drain()
+
+    //-- Per-task line assembly: a line goes into the ring in one piece
+    struct ProducerLine
+    {
+      std::atomic<void*> owner;            // Task assembling a line here, nullptr when free
+      uint16_t           length;
+      uint8_t            line[MULTISTREAM_LINE_SIZE];
+    };
+    ProducerLine _lines[MULTISTREAM_PRODUCERS];
+
+    //-- Fixed records from interrupt handlers (bounded multi-producer queue)
+    static const uint32_t DEFERRED_MASK = MULTISTREAM_DEFERRED_RECORDS - 1;
+    static_assert((MULTISTREAM_DEFERRED_RECORDS & DEFERRED_MASK) == 0, "MULTISTREAM_DEFERRED_RECORDS must be a power of two");
+    struct DeferredRecord
+    {
+      std::atomic<uint32_t> sequence;      // Equals the write position when free, position + 1 when filled
+      const char*           format;
+      uint32_t              args[4];
+    };
+    DeferredRecord _deferred[MULTISTREAM_DEFERRED_RECORDS];
+    std::atomic<uint32_t> _deferredWrite;
+    uint32_t _deferredRead;                // drain() only
+    uint32_t _deferredDropped;
+
+    //-- Telnet client table, each slot has its own cursor into the ring
+    static const uint8_t MAX_CLIENTS = MULTISTREAM_MAX_CLIENTS;
+    struct ClientSlot
+    {
+      WiFiClient client;
+      uint32_t   tail;
+      uint32_t   dropped;
+    };
+    ClientSlot _clients[MAX_CLIENTS];
+
+    //-- UDP log sink, gets what the telnet clients get; its own cursor in ring buffer mode
+    UdpLog*  _udpLog;
+    uint32_t _udpTail;
+
+    //-- Mirror of the output in RTC memory, read after a reset
+    BootLog* _bootLog;
+    uint32_t _bootLogTail;
+
+    //-- Ring ranges written by writeTo() for one sink, the others skip them;
+    //-- queued by the producer, retired by drain() once every sink is past them
+    static const uint32_t SKIP_MASK = MULTISTREAM_SINK_RANGES - 1;
+    static_assert((MULTISTREAM_SINK_RANGES & SKIP_MASK) == 0, "MULTISTREAM_SINK_RANGES must be a power of two");
+    struct SkipRange
+    {
+      uint32_t start;
+      uint32_t end;
+      uint8_t  sinks;                      // The sinks that skip it
+    };
+    SkipRange _skips[MULTISTREAM_SINK_RANGES];
+    std::atomic<uint32_t> _skipWrite;      // Producer only
+    std::atomic<uint32_t> _skipRead;       // drain() only
+
+    void flushBuffer();
+    bool flushDue(size_t pending, size_t limit);
+    void writeClients(const uint8_t* buffer, size_t size);
+    void flushClients();
+    void flushSinks(uint8_t sinks);
+    size_t ringAppend(const uint8_t* data, size_t size);
+    size_t ringAppendShared(const uint8_t* data, size_t size);
+    size_t vprintfScratch(const char* format, va_list args);
+    size_t produce(const uint8_t* data, size_t size);
+    ProducerLine* producerLine(bool claim);
+    void commitLine(ProducerLine* slot);
+    void drainDeferred();
+    void publishCommitted();
+    uint32_t drainSink(Print* sink, uint32_t tail, uint32_t head, bool isClient);
+    uint32_t drainSinkFor(uint8_t sink, Print* out, uint32_t tail, uint32_t head, bool isClient);
+    uint32_t skipLimit(uint32_t& tail, uint32_t head, uint8_t sink) const;
+    bool caughtUp(uint8_t sinks, uint32_t head, size_t size);
+    uint32_t historyOldest(uint32_t head) const;
+    void mirrorRing(uint32_t head);
+
+  public:
+    //-- Sinks for writeTo()
+    enum Sink : uint8_t { SINK_SERIAL = 1, SINK_TELNET = 2, SINK_ALL = 3 };
+
+    MultiStream(Stream* serial);
+    
+    virtual size_t write(uint8_t c) override;
+    virtual size_t write(const uint8_t* buffer, size_t size) override;
+    
+    virtual int available() override { return _serial->available(); }
+    virtual int read() override { return _serial->read(); }
+    virtual int peek() override { return _serial->peek(); }
+    virtual void flush() override;
+    size_t writeTo(uint8_t sinks, const uint8_t* buffer, size_t size);
+
+    // Formats straight into the line buffer or the ring, never allocates
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+    size_t vprintf(const char* format, va_list args);
+    
+    // Add methods to control critical sections
+    void beginCriticalSection();
+    void endCriticalSection();
+
+    // Ring buffer mode: write() only appends, drain() sends what fits without blocking
+    void setRingBufferMode(bool enable);
+    bool isRingBufferMode() const { return _ringMode; }
+    void drain();
+    void setMultiProducer(bool enable);
+    bool isMultiProducer() const { return _multiProducer; }
+    bool logFromISR(const char* format, uint32_t arg1 = 0, uint32_t arg2 = 0, uint32_t arg3 = 0, uint32_t arg4 = 0);
+    uint32_t getDeferredDropped() const { return _deferredDropped; }
+    void setFlushPolicy(const FlushPolicy& policy);
+    const FlushPolicy& getFlushPolicy() const { return _flushPolicy; }
+    uint32_t getOverflowBytes() const { return _overflowBytes; }
+    uint32_t getDroppedBytes() const { return _droppedBytes; }
+    uint32_t getDroppedBytes(uint8_t slot) const;
+    uint32_t getTruncatedPrints() const { return _truncatedPrints; }
+    uint32_t getSerialBytes() const { return _serialBytes; }
+    uint32_t getTelnetBytes() const { return _telnetBytes; }
+    void setFlushHistogram(Metrics::Histogram* histogram) { _flushHistogram = histogram; }
+    void resetCounters();
+
+    // Log history: what was written last, read in place from the ring (ring buffer mode)
+    uint32_t getHistoryStart(size_t maxBytes) const;
+    uint32_t getHistoryEnd() const { return _ringHead.load(std::memory_order_acquire); }
+    uint32_t writeHistory(Print* sink, uint32_t position, uint32_t end, bool isClient);
+    size_t copyHistory(uint32_t& position, uint32_t end, uint8_t* buffer, size_t size);
+
+    // Telnet client table
+    int addClient(const WiFiClient& client);
+    void pruneClients();
+    uint8_t getClientCount();
+    WiFiClient* getClient(uint8_t slot);
+
+    // UDP log sink (syslog or raw datagrams), fed like the telnet clients
+    void setUdpLog(UdpLog* sink);
+    UdpLog* getUdpLog() { return _udpLog; }
+
+    // Boot log: the output mirrored into RTC memory, to read it after a reset
+    void setBootLog(BootLog* log);
+
+    using Print::write;
+};
@@ -0,0 +1,540 @@
+#include "MulticastOTA.h"
+
+#ifdef ESP8266
+    #include <flash_hal.h>
+    #include <eboot_command.h>
+#else
+    #include <esp_ota_ops.h>
+#endif
+
+static inline uint16_t get16(const uint8_t* p)
+{
+    return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+}
+
+static inline uint32_t get32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void put16(uint8_t* p, uint16_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+}
+
+static inline void put32(uint8_t* p, uint32_t value)
+{
+    put16(p, (uint16_t)value);
+    put16(p + 2, (uint16_t)(value >> 16));
+}
+
+/**
+ * Constructor for the MulticastOTA class.
+ */
+MulticastOTA::MulticastOTA()
+    : _udp(), _listening(false), _state(IDLE), _result(DONE_OK), _hostname(""), _key(nullptr),
+      _session(0), _size(0), _blockSize(0), _blockCount(0), _blocksReceived(0), _expected(),
+      _sender(), _senderPort(0), _lastPacket(0), _error(nullptr),
+      #ifdef ESP8266
+      _address(0),
+      #else
+      _partition(nullptr),
+      #endif
+      _received(), _erased(), _eraseNext(0), _verifyNext(0), _sha(), _packet(),
+      _onStart(nullptr), _onProgress(nullptr), _onEnd(nullptr)
+{
+}
+
+/**
+ * Joins the multicast group and waits for an announcement. Call again
+ * after the IP address changed, the membership belongs to the interface.
+ *
+ * @param hostname Sent back to the sender in the DONE answer
+ * @return False if the group can't be joined
+ */
+bool MulticastOTA::begin(const char* hostname)
+{
+    _hostname = hostname;
+    if (_listening)
+    {
+        _udp.stop();
+    }
+    #ifdef ESP8266
+        _listening = _udp.beginMulticast(WiFi.localIP(), IPAddress(MULTICAST_OTA_GROUP), MULTICAST_OTA_PORT);
+    #else
+        _listening = _udp.beginMulticast(IPAddress(MULTICAST_OTA_GROUP), MULTICAST_OTA_PORT);
+    #endif
+    return _listening;
+}
+
+/**
+ * Leaves the group, a running update is dropped.
+ */
+void MulticastOTA::end()
+{
+    cancel();
+    _udp.stop();
+    _listening = false;
+}
+
+/**
+ * Drops a running update, nothing gets activated.
+ */
+void MulticastOTA::cancel()
+{
+    if (isActive())
+    {
+        fail("Cancelled", DONE_REJECTED);
+    }
+}
+
+/**
+ * Reads the waiting datagrams, erases flash ahead while there are none
+ * and verifies a complete image. Returns after MULTICAST_OTA_BUDGET_MS at
+ * the latest. Call it from loop().
+ */
+void MulticastOTA::handle()
+{
+    if (!_listening)
+    {
+        return;
+    }
+    uint32_t start = millis();
+    int      length;
+    while (millis() - start < MULTICAST_OTA_BUDGET_MS && (length = _udp.parsePacket()) > 0)
+    {
+        //-- Too large for any packet of the protocol; parsePacket() drops the rest
+        if ((size_t)length > sizeof(_packet))
+        {
+            continue;
+        }
+        _udp.read((uint8_t*)_packet, length);
+        handlePacket(length);
+    }
+
+    if (_state == RECEIVING)
+    {
+        if (millis() - _lastPacket > MULTICAST_OTA_TIMEOUT)
+        {
+            fail("Sender timed out", DONE_REJECTED);
+            return;
+        }
+        //-- Erasing takes tens of ms per sector, do it before the blocks for it arrive
+        uint32_t sectors = (_size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+        while (_eraseNext < sectors && testBit(_erased, _eraseNext))
+        {
+            _eraseNext++;
+        }
+        if (_eraseNext < sectors && millis() - start < MULTICAST_OTA_BUDGET_MS && !eraseSector(_eraseNext))
+        {
+            fail("Flash erase failed", DONE_FLASH_ERROR);
+        }
+    }
+    else if (_state == VERIFYING)
+    {
+        verify();
+    }
+
+} //  MulticastOTA::handle()
+
+/**
+ * Checks the header of a datagram and dispatches it.
+ *
+ * @param length Its length in bytes (in _packet)
+ */
+void MulticastOTA::handlePacket(size_t length)
+{
+    const uint8_t* packet = (const uint8_t*)_packet;
+    if (length < HEADER_SIZE || memcmp(packet, "MOTA", 4) != 0 || packet[5] != VERSION)
+    {
+        return;
+    }
+    uint8_t type = packet[4];
+    if (type == ANNOUNCE)
+    {
+        handleAnnounce(packet, length);
+        return;
+    }
+    if (_state == IDLE || get16(packet + 6) != _session)
+    {
+        return;
+    }
+    _lastPacket = millis();
+
+    switch (type)
+    {
+        case DATA:
+            if (_state == RECEIVING)
+            {
+                handleData((uint8_t*)_packet, length);
+            }
+            break;
+
+        case END:
+            //-- Answer where the question came from, repairs are unicast
+            _sender     = _udp.remoteIP();
+            _senderPort = _udp.remotePort();
+            if (_state == RECEIVING)
+            {
+                sendNack();
+            }
+            else if (_state != VERIFYING)
+            {
+                sendDone(_result);
+            }
+            break;
+
+        default:
+            break;
+    }
+
+} //  MulticastOTA::handlePacket()
+
+/**
+ * Starts receiving an announced image, unless busy with another one.
+ *
+ * @param packet The ANNOUNCE datagram
+ * @param length Its length in bytes
+ */
+void MulticastOTA::handleAnnounce(const uint8_t* packet, size_t length)
+{
+    uint16_t session = get16(packet + 6);
+    if (length < ANNOUNCE_SIZE || (_state != IDLE && session == _session))
+    {
+        return;
+    }
+    if (isActive())
+    {
+        return;
+    }
+    if (_key)
+    {
+        uint8_t mac[Sha256::DIGEST_SIZE];
+        Sha256::hmac((const uint8_t*)_key, strlen(_key), packet, ANNOUNCE_SIZE - sizeof(mac), mac);
+        if (memcmp(mac, packet + ANNOUNCE_SIZE - sizeof(mac), sizeof(mac)) != 0)
+        {
+            return;
+        }
+    }
+
+    _session    = session;
+    _sender     = _udp.remoteIP();
+    _senderPort = _udp.remotePort();
+    _size       = get32(packet + 8);
+    _blockSize  = get16(packet + 12);
+    _blockCount = (_blockSize > 0) ? (_size + _blockSize - 1) / _blockSize : 0;
+    memcpy(_expected, packet + 16, sizeof(_expected));
+
+    //-- Blocks must not straddle a flash sector
+    bool supported = _blockSize >= 256 && _blockSize <= MULTICAST_OTA_BLOCK_SIZE
+                  && (_blockSize & (_blockSize - 1)) == 0
+                  && _size > 0 && _blockCount <= MULTICAST_OTA_MAX_BLOCKS;
+    if (!supported || !prepareFlash())
+    {
+        _state  = FAILED;
+        _result = DONE_REJECTED;
+        _error  = supported ? "Not enough space for the image" : "Unsupported block size or image size";
+        sendDone(_result);
+        return;
+    }
+
+    memset(_received, 0, sizeof(_received));
+    memset(_erased, 0, sizeof(_erased));
+    _blocksReceived = 0;
+    _eraseNext      = 0;
+    _error          = nullptr;
+    _lastPacket     = millis();
+    _state          = RECEIVING;
+    if (_onStart)
+    {
+        _onStart();
+    }
+
+} //  MulticastOTA::handleAnnounce()
+
+/**
+ * Writes a block that wasn't received yet to its place in flash.
+ *
+ * @param packet The DATA datagram, its data is padded in place
+ * @param length Its length in bytes
+ */
+void MulticastOTA::handleData(uint8_t* packet, size_t length)
+{
+    if (length < HEADER_SIZE + 4)
+    {
+        return;
+    }
+    uint32_t block = get32(packet + HEADER_SIZE);
+    if (block >= _blockCount || testBit(_received, block))
+    {
+        return;
+    }
+    uint8_t* data       = packet + HEADER_SIZE + 4;
+    size_t   dataLength = length - HEADER_SIZE - 4;
+    size_t   expected   = (block == _blockCount - 1) ? _size - block * _blockSize : _blockSize;
+    if (dataLength != expected)
+    {
+        return;
+    }
+
+    //-- An application image starts with 0xE9 (the ESP8266 bootloader also unpacks gzip)
+    #ifdef ESP8266
+    if (block == 0 && data[0] != 0xE9 && data[0] != 0x1F)
+    #else
+    if (block == 0 && data[0] != 0xE9)
+    #endif
+    {
+        fail("Not a firmware image", DONE_REJECTED);
+        return;
+    }
+    if (!writeBlock(block, data, dataLength))
+    {
+        fail("Flash write failed", DONE_FLASH_ERROR);
+        return;
+    }
+    setBit(_received, block);
+    _blocksReceived++;
+    if (_onProgress)
+    {
+        uint32_t bytes = _blocksReceived * _blockSize;
+        _onProgress(bytes < _size ? bytes : _size, _size);
+    }
+    if (_blocksReceived == _blockCount)
+    {
+        _sha.reset();
+        _verifyNext = 0;
+        _state      = VERIFYING;
+    }
+
+} //  MulticastOTA::handleData()
+
+/**
+ * Starts an answer datagram to the sender with the protocol header.
+ *
+ * @param type The packet type
+ */
+void MulticastOTA::sendHeader(PacketType type)
+{
+    uint8_t header[HEADER_SIZE] = { 'M', 'O', 'T', 'A', type, VERSION, 0, 0 };
+    put16(header + 6, _session);
+    _udp.beginPacket(_sender, _senderPort);
+    _udp.write(header, sizeof(header));
+}
+
+/**
+ * Tells the sender which blocks are missing, as up to MAX_NACK_RANGES
+ * ranges; what doesn't fit is asked for after the repairs.
+ */
+void MulticastOTA::sendNack()
+{
+    uint8_t  ranges[2 + MAX_NACK_RANGES * 6];
+    uint16_t count = 0;
+    uint32_t block = 0;
+    while (block < _blockCount && count < MAX_NACK_RANGES)
+    {
+        if (_received[block / 32] == 0xFFFFFFFF && block % 32 == 0)
+        {
+            block += 32;
+            continue;
+        }
+        if (testBit(_received, block))
+        {
+            block++;
+            continue;
+        }
+        uint32_t first = block;
+        while (block < _blockCount && !testBit(_received, block) && block - first < 0xFFFF)
+        {
+            block++;
+        }
+        put32(ranges + 2 + count * 6, first);
+        put16(ranges + 2 + count * 6 + 4, (uint16_t)(block - first));
+        count++;
+    }
+    put16(ranges, count);
+
+    sendHeader(NACK);
+    _udp.write(ranges, 2 + count * 6);
+    _udp.endPacket();
+}
+
+/**
+ * Tells the sender how the update ended for this device.
+ *
+ * @param status The result
+ */
+void MulticastOTA::sendDone(Status status)
+{
+    sendHeader(DONE);
+    _udp.write((uint8_t)status);
+    _udp.write((const uint8_t*)_hostname, strnlen(_hostname, 32));
+    _udp.endPacket();
+}
+
+/**
+ * Finds the flash area for the announced image: the next OTA partition on
+ * the ESP32, on the ESP8266 the top of the free space below the file
+ * system (where Updater puts it too).
+ *
+ * @return False if the image doesn't fit
+ */
+bool MulticastOTA::prepareFlash()
+{
+    #ifdef ESP8266
+        uint32_t rounded = (_size + SECTOR_SIZE - 1) & ~(SECTOR_SIZE - 1);
+        uint32_t sketch  = (ESP.getSketchSize() + SECTOR_SIZE - 1) & ~(SECTOR_SIZE - 1);
+        uint32_t top     = FS_PHYS_ADDR;
+        if (top < rounded || top - rounded < sketch)
+        {
+            return false;
+        }
+        _address = top - rounded;
+        return true;
+    #else
+        _partition = esp_ota_get_next_update_partition(nullptr);
+        return _partition && _size <= _partition->size;
+    #endif
+}
+
+/**
+ * Erases one sector of the image area.
+ *
+ * @param sector Sector number, counted from the start of the image
+ * @return False if erasing failed
+ */
+bool MulticastOTA::eraseSector(uint32_t sector)
+{
+    #ifdef ESP8266
+        bool erased = ESP.flashEraseSector(_address / SECTOR_SIZE + sector);
+    #else
+        bool erased = (esp_partition_erase_range(_partition, sector * SECTOR_SIZE, SECTOR_SIZE) == ESP_OK);
+    #endif
+    if (erased)
+    {
+        setBit(_erased, sector);
+    }
+    return erased;
+}
+
+/**
+ * Writes a block, erasing its sector first if that wasn't done yet.
+ *
+ * @param block The block number
+ * @param data Its data, word aligned, with room to pad it to a multiple of 4
+ * @param length Its length in bytes
+ * @return False if flashing failed
+ */
+bool MulticastOTA::writeBlock(uint32_t block, uint8_t* data, size_t length)
+{
+    uint32_t offset = block * _blockSize;
+    uint32_t sector = offset / SECTOR_SIZE;
+    if (!testBit(_erased, sector) && !eraseSector(sector))
+    {
+        return false;
+    }
+    //-- Flash is written in words, the last block is padded with erased bytes
+    size_t padded = (length + 3) & ~3;
+    memset(data + length, 0xFF, padded - length);
+    #ifdef ESP8266
+        return ESP.flashWrite(_address + offset, (uint32_t*)data, padded);
+    #else
+        return esp_partition_write(_partition, offset, data, padded) == ESP_OK;
+    #endif
+}
+
+/**
+ * Reads the complete image back in pieces and hashes it; when done checks
+ * the SHA-256 and activates the image.
+ */
+void MulticastOTA::verify()
+{
+    uint32_t start  = millis();
+    uint8_t* buffer = (uint8_t*)_packet;   // Datagrams are handled before verify() runs
+    while (_verifyNext < _size && millis() - start < MULTICAST_OTA_BUDGET_MS)
+    {
+        size_t length = _size - _verifyNext;
+        if (length > MULTICAST_OTA_BLOCK_SIZE)
+        {
+            length = MULTICAST_OTA_BLOCK_SIZE;
+        }
+        size_t padded = (length + 3) & ~3;
+        #ifdef ESP8266
+            bool read = ESP.flashRead(_address + _verifyNext, (uint32_t*)buffer, padded);
+        #else
+            bool read = (esp_partition_read(_partition, _verifyNext, buffer, padded) == ESP_OK);
+        #endif
+        if (!read)
+        {
+            fail("Flash read failed", DONE_FLASH_ERROR);
+            return;
+        }
+        _sha.update(buffer, length);
+        _verifyNext += length;
+    }
+    if (_verifyNext < _size)
+    {
+        return;
+    }
+
+    uint8_t digest[Sha256::DIGEST_SIZE];
+    _sha.finish(digest);
+    if (memcmp(digest, _expected, sizeof(digest)) != 0)
+    {
+        fail("SHA-256 mismatch", DONE_SHA_MISMATCH);
+        return;
+    }
+    if (!activate())
+    {
+        fail("Image not accepted", DONE_FLASH_ERROR);
+        return;
+    }
+    _state  = FINISHED;
+    _result = DONE_OK;
+    sendDone(DONE_OK);
+    if (_onEnd)
+    {
+        _onEnd(true);
+    }
+
+} //  MulticastOTA::verify()
+
+/**
+ * Makes the bootloader start the new image after the next reset.
+ *
+ * @return False if the image was refused
+ */
+bool MulticastOTA::activate()
+{
+    #ifdef ESP8266
+        //-- Same command Updater::end() leaves for eboot: copy the image over the sketch
+        eboot_command command;
+        command.action  = ACTION_COPY_RAW;
+        command.args[0] = _address;
+        command.args[1] = 0x00000;
+        command.args[2] = _size;
+        eboot_command_write(&command);
+        return true;
+    #else
+        //-- Checks the image (header, segments, checksum) before switching
+        return esp_ota_set_boot_partition(_partition) == ESP_OK;
+    #endif
+}
+
+/**
+ * Ends the update without activating anything and tells the sender.
+ *
+ * @param error What went wrong
+ * @param status The status sent back
+ */
+void MulticastOTA::fail(const char* error, Status status)
+{
+    _error  = error;
+    _result = status;
+    _state  = FAILED;
+    sendDone(status);
+    if (_onEnd)
+    {
+        _onEnd(false);
+    }
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#ifdef ESP8266
+    #include <ESP8266WiFi.h>
+#else
+    #include <WiFi.h>
+    #include <esp_partition.h>
+#endif
+#include <WiFiUdp.h>
+#include <functional>
+#include "Sha256.h"
+
+#ifndef MULTICAST_OTA_GROUP
+  #define MULTICAST_OTA_GROUP 239, 255, 77, 1   // Multicast group the sender transmits to
+#endif
+#ifndef MULTICAST_OTA_PORT
+  #define MULTICAST_OTA_PORT 8267
+#endif
+#ifndef MULTICAST_OTA_BLOCK_SIZE
+  #define MULTICAST_OTA_BLOCK_SIZE 1024         // Largest block (one datagram) accepted
+#endif
+#ifndef MULTICAST_OTA_MAX_BLOCKS
+  #define MULTICAST_OTA_MAX_BLOCKS 4096         // Bitmap size: 4 MB images with 1 KB blocks
+#endif
+#ifndef MULTICAST_OTA_TIMEOUT
+  #define MULTICAST_OTA_TIMEOUT 30000           // ms without a packet before an update is dropped
+#endif
+#ifndef MULTICAST_OTA_BUDGET_MS
+  #define MULTICAST_OTA_BUDGET_MS 20            // Longest time handle() spends per call
+#endif
+
+/**
+ * Fleet-wide firmware update: a sender (ota_multicast.py) transmits the
+ * image once to a multicast group, every listening device writes the
+ * blocks it receives straight to their place in the update partition and
+ * marks them in a bitmap. After the pass the sender asks who is missing
+ * what; devices answer with a unicast NACK listing the missing ranges and
+ * get those blocks resent to them. When the bitmap is full the image is
+ * read back, checked against the announced SHA-256 and activated.
+ *
+ * Datagrams start with "MOTA", type, version 1 and a 16 bit session id;
+ * numbers are little endian:
+ *   ANNOUNCE 1  size u32, block size u16, flags u16, SHA-256, HMAC-SHA256
+ *   DATA     2  block u32, data
+ *   END      3  (the pass is over, answer with NACK or DONE)
+ *   NACK     4  count u16, count x (first block u32, blocks u16)
+ *   DONE     5  status u8, hostname
+ * With a key set, the HMAC of the announcement up to the HMAC itself must
+ * match; as it covers the SHA-256, the whole image is authenticated.
+ */
+class MulticastOTA
+{
+  public:
+    enum State : uint8_t { IDLE, RECEIVING, VERIFYING, FINISHED, FAILED };
+    enum Status : uint8_t { DONE_OK, DONE_SHA_MISMATCH, DONE_FLASH_ERROR, DONE_REJECTED };
+
+  private:
+    enum PacketType : uint8_t { ANNOUNCE = 1, DATA = 2, END = 3, NACK = 4, DONE = 5 };
+
+    static const uint8_t  VERSION          = 1;
+    static const size_t   HEADER_SIZE      = 8;
+    static const size_t   ANNOUNCE_SIZE    = HEADER_SIZE + 8 + 2 * Sha256::DIGEST_SIZE;
+    static const size_t   MAX_NACK_RANGES  = 64;
+    static const uint32_t SECTOR_SIZE      = 4096;
+    static const uint32_t MAX_SECTORS      = (uint32_t)MULTICAST_OTA_MAX_BLOCKS * MULTICAST_OTA_BLOCK_SIZE / SECTOR_SIZE;
+
+    WiFiUDP     _udp;
+    bool        _listening;
+    State       _state;
+    Status      _result;         // Sent in DONE once the update ended
+    const char* _hostname;
+    const char* _key;
+
+    uint16_t    _session;
+    uint32_t    _size;
+    uint16_t    _blockSize;
+    uint32_t    _blockCount;
+    uint32_t    _blocksReceived;
+    uint8_t     _expected[Sha256::DIGEST_SIZE];
+    IPAddress   _sender;
+    uint16_t    _senderPort;
+    uint32_t    _lastPacket;
+    const char* _error;
+
+    //-- Where the image goes: the next OTA partition, or the free space below the file system
+    #ifdef ESP8266
+    uint32_t    _address;
+    #else
+    const esp_partition_t* _partition;
+    #endif
+
+    uint32_t    _received[(MULTICAST_OTA_MAX_BLOCKS + 31) / 32];
+    uint32_t    _erased[(MAX_SECTORS + 31) / 32];
+    uint32_t    _eraseNext;      // Next sector erased ahead while the link is idle
+    uint32_t    _verifyNext;     // Offset read back next while verifying
+    Sha256      _sha;
+
+    //-- uint32_t so the block data (after the 12 byte DATA header) is word aligned for flash writes
+    uint32_t    _packet[(HEADER_SIZE + 4 + MULTICAST_OTA_BLOCK_SIZE + 3) / 4];
+
+    std::function<void()> _onStart;
+    std::function<void(uint32_t, uint32_t)> _onProgress;
+    std::function<void(bool)> _onEnd;
+
+    static bool testBit(const uint32_t* bits, uint32_t n) { return bits[n / 32] & (1UL << (n % 32)); }
+    static void setBit(uint32_t* bits, uint32_t n) { bits[n / 32] |= (1UL << (n % 32)); }
+
+    void handlePacket(size_t length);
+    void handleAnnounce(const uint8_t* packet, size_t length);
+    void handleData(uint8_t* packet, size_t length);
+    void sendHeader(PacketType type);
+    void sendNack();
+    void sendDone(Status status);
+    bool prepareFlash();
+    bool eraseSector(uint32_t sector);
+    bool writeBlock(uint32_t block, uint8_t* data, size_t length);
+    void verify();
+    bool activate();
+    void fail(const char* error, Status status);
+
+  public:
+    MulticastOTA();
+
+    bool begin(const char* hostname);
+    void end();
+    void handle();
+    void cancel();
+    void setKey(const char* key) { _key = key; }
+
+    void onStart(std::function<void()> callback) { _onStart = callback; }
+    void onProgress(std::function<void(uint32_t, uint32_t)> callback) { _onProgress = callback; }
+    void onEnd(std::function<void(bool)> callback) { _onEnd = callback; }
+
+    State getState() const { return _state; }
+    bool isListening() const { return _listening; }
+    bool isActive() const { return _state == RECEIVING || _state == VERIFYING; }
+    uint32_t getBlocksReceived() const { return _blocksReceived; }
+    uint32_t getBlockCount() const { return _blockCount; }
+    uint32_t getSize() const { return _size; }
+    const char* getError() const { return _error; }
+};
@@ -1,149 +1,69 @@
 #include "Networking.h"
 
-//-- MultiStream implementation
-/**
- * Constructor for the MultiStream class.
- * Initializes the serial and telnet client pointers and buffer index.
- * 
- * @param serial Pointer to the serial stream
- * @param telnetClient Pointer to the telnet client
- */
-MultiStream::MultiStream(Stream* serial, WiFiClient* telnetClient)
-    : _serial(serial), _telnetClient(telnetClient), _bufferIndex(0), _inCriticalSection(false)
+#ifdef ESP8266
+  #include <coredecls.h>
+#else
+  #include <esp_sleep.h>
+  #include <esp_sntp.h>
+  #include <esp_timer.h>
+  #include <esp_wifi.h>
+#endif
+
+//-- Static instance pointer for the WiFi event and SNTP callbacks
+Networking* Networking::_instance = nullptr;
+
+#ifndef NETWORKING_NO_NTP
+#ifdef ESP8266
+//-- SNTP poll period, read by the override below
+static uint32_t _sntpInterval = NTP_SYNC_MIN_INTERVAL;
+
+//-- Overrides the core's weak poll period (1 hour), SNTP asks for it
+//-- every time it schedules the next request
+extern "C" uint32_t sntp_update_delay_MS_rfc_not_less_than_15000()
 {
+  return _sntpInterval;
 }
+#endif
 
-/**
- * Writes a single byte to the buffer.
- * Flushes the buffer if it's full or if a newline character is encountered.
- * 
- * @param c The byte to write
- * @return The number of bytes written
- */
-size_t MultiStream::write(uint8_t c)
+//-- Makes the SDK poll at the adaptive interval instead of its own (1 hour)
+static void ntpSetPollInterval(uint32_t interval)
 {
-  // Add the byte to the buffer
-  _buffer[_bufferIndex++] = c;
-  
-  // If the buffer is full or we encounter a newline, flush it
-  if (_bufferIndex >= BUFFER_SIZE - 1 || c == '\n')
-  {
-    flushBuffer();
-  }
-  
-  return 1;
+  #ifdef ESP8266
+    _sntpInterval = interval;
+  #else
+    sntp_set_sync_interval(interval);
+  #endif
 }
+#endif
 
-/**
- * Writes a buffer of bytes directly to both streams.
- * This is more efficient than writing byte-by-byte.
- * 
- * @param buffer The buffer to write
- * @param size The number of bytes to write
- * @return The number of bytes written
- */
-size_t MultiStream::write(const uint8_t* buffer, size_t size)
+#ifdef NETWORKING_COUNT_ALLOCS
+//-- Allocation counter, the linker redirects malloc() and friends here (--wrap)
+static std::atomic<uint32_t> _allocationCount(0);
+
+extern "C"
 {
-  // First, flush any pending bytes in our internal buffer
-  if (_bufferIndex > 0)
-  {
-    flushBuffer();
-  }
-  
-  // Write the new buffer directly to both streams
-  _serial->write(buffer, size);
-  
-  if (_telnetClient && _telnetClient->connected())
-  {
-    _telnetClient->write(buffer, size);
-  }
-  
-  // Ensure the data is sent immediately if not in a critical section
-  if (!_inCriticalSection)
+  void* __real_malloc(size_t size);
+  void* __real_calloc(size_t count, size_t size);
+  void* __real_realloc(void* ptr, size_t size);
+
+  void* __wrap_malloc(size_t size)
   {
-    _serial->flush();
-    if (_telnetClient && _telnetClient->connected())
-    {
-      _telnetClient->flush();
-    }
+    _allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return __real_malloc(size);
   }
-  
-  return size;
-}
 
-/**
- * Flushes the internal buffer by writing its contents to both streams.
- */
-void MultiStream::flushBuffer()
-{
-  if (_bufferIndex > 0)
+  void* __wrap_calloc(size_t count, size_t size)
   {
-    // Ensure null termination for safety
-    _buffer[_bufferIndex] = 0;
-    
-    // Write the buffer to the serial port
-    _serial->write(_buffer, _bufferIndex);
-    
-    // Write the buffer to the telnet client if connected
-    if (_telnetClient && _telnetClient->connected())
-    {
-      _telnetClient->write(_buffer, _bufferIndex);
-    }
-    
-    // Ensure the data is sent immediately if not in a critical section
-    if (!_inCriticalSection)
-    {
-      _serial->flush();
-      if (_telnetClient && _telnetClient->connected())
-      {
-        _telnetClient->flush();
-      }
-    }
-    
-    // Reset the buffer index
-    _bufferIndex = 0;
+    _allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return __real_calloc(count, size);
   }
-}
 
-/**
- * Flushes both streams and the internal buffer.
- */
-void MultiStream::flush()
-{
-  // Flush our internal buffer first
-  flushBuffer();
-  
-  // Then flush both streams
-  _serial->flush();
-  
-  if (_telnetClient && _telnetClient->connected())
+  void* __wrap_realloc(void* ptr, size_t size)
   {
-    _telnetClient->flush();
+    _allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return __real_realloc(ptr, size);
   }
 }
-
-/**
- * Begin a critical section where flush is deferred until the end.
- * This is useful for high-frequency writes where you want to batch flushes.
- */
-void MultiStream::beginCriticalSection()
-{
-  _inCriticalSection = true;
-}
-
-/**
- * End a critical section and flush any pending data.
- */
-void MultiStream::endCriticalSection()
-{
-  _inCriticalSection = false;
-  flush();
-}
-
-
-//-- Static instance pointer for ESP8266 callbacks
-#ifdef ESP8266
-Networking* Networking::_instance = nullptr;
 #endif
 
 //-- Networking implementation
@@ -152,33 +72,106 @@ Networking* Networking::_instance = nullptr;
  * Initializes all member variables to their default values.
  */
 Networking::Networking() 
-    : _hostname(nullptr), _resetWiFiPin(-1), _serial(nullptr),
-      _telnetServer(nullptr), _multiStream(nullptr),
-      _onStartOTA(nullptr), _onProgressOTA(nullptr), _onEndOTA(nullptr),
-      _onWiFiPortalStart(nullptr), _posixString(nullptr), _lastNtpSync(0),
-      _isReconnecting(false), _reconnectAttempts(0), _lastReconnectAttempt(0)
+    : _hostname(nullptr), _resetWiFiPin(-1), _serial(nullptr), _multiStream(nullptr),
+      #ifndef NETWORKING_NO_TELNET
+      _telnetServer(nullptr),
+      #endif
+      _onStartOTA(nullptr), _onProgressOTA(nullptr), _onProgressBytesOTA(nullptr), _onEndOTA(nullptr),
+      _onWiFiPortalStart(nullptr), _binaryLog(nullptr), _httpStatus(nullptr), _udpLog(nullptr), _bootLog(nullptr),
+      _pullOTA(nullptr), _pullCACert(nullptr), _pullReboot(true),
+      _otaStep(NETWORKING_OTA_PROGRESS_PERCENT), _otaInterval(NETWORKING_OTA_PROGRESS_MS), _otaPercent(0),
+      _otaMilestone(0), _otaStarted(0), _otaReported(0), _otaBytes(0), _otaElapsed(0),
+      _multicastOTA(nullptr), _multicastReboot(true),
+      _logLevel((LogLevel)NETWORKING_LOG_LEVEL), _serialLogLevel(LEVEL_VERBOSE), _telnetLogLevel(LEVEL_VERBOSE),
+      _binaryLogLevel(LEVEL_VERBOSE), _logMaxLevel((LogLevel)NETWORKING_LOG_LEVEL), _logTags(), _logTagCount(0),
+      _shell(), _serialCommands(false), _metrics(), _rssiHistory(), _rssiCount(0), _rssiNext(0),
+      _lastRssiSample(0), _polls(), _nextPollDue(0),
+      #ifndef NETWORKING_NO_NTP
+      _posixString(nullptr), _lastNtpSync(0),
+      _ntpServers(), _ntpSyncInterval(NTP_SYNC_MIN_INTERVAL), _ntpClock(),
+      _ntpSampleReady(false), _ntpSampleLocal(0), _ntpSampleEpoch(0),
+      #endif
+      _isReconnecting(false), _reconnectAttempts(0), _lastReconnectAttempt(0),
+      _manualReconnect(false), _wifiLost(false), _reconnectActive(false), _wifiLostAt(0),
+      _reconnectDelay(0), _maxReconnectAttempts(WIFI_RECONNECT_MAX_ATTEMPTS),
+      _reconnectBaseDelay(1000), _reconnectMaxDelay(60000), _onReconnectFailed(nullptr),
+      _fastReconnect(false), _fastAttempt(false),
+      _wifiCacheDirty(false), _connectStarted(0), _rtc(),
+      _burst(false), _maintenance(false), _timeRestored(false), _servicesEnabled(false),
+      #ifndef NETWORKING_NO_NTP
+      _tzCacheNext(0), _clock(),
+      #endif
+      _state(IDLE), _async(false), _stateSince(0),
+      _onStateChange(nullptr), _wifiManager(nullptr)
       #ifdef USE_ASYNC_WIFIMANAGER
       , _webServer(nullptr), _dnsServer(nullptr)
       #endif
+      #ifndef ESP8266
+      , _wifiEvents(0), _task(nullptr)
+      #endif
 {
-    #ifdef ESP8266
     _instance = this;  // Set static instance pointer for callbacks
+    setupMetrics();
+    _polls[POLL_OTA].interval    = NETWORKING_POLL_OTA_MS;
+    _polls[POLL_MDNS].interval   = NETWORKING_POLL_MDNS_MS;
+    _polls[POLL_TELNET].interval = NETWORKING_POLL_TELNET_MS;
+    _polls[POLL_BINLOG].interval = NETWORKING_POLL_BINLOG_MS;
+    #ifdef NETWORKING_PROFILE_LOOP
+        setupProfiler();
     #endif
+    setupCommands();
 }
 
 /**
  * Destructor for the Networking class.
- * Cleans up dynamically allocated resources.
+ * Cleans up dynamically allocated resources and the objects constructed
+ * in the member storage.
  */
 Networking::~Networking() 
 {
+    #ifndef ESP8266
+    if (_task)
+    {
+        vTaskDelete(_task);
+    }
+    #endif
+    #ifndef NETWORKING_NO_TELNET
     if (_telnetServer) 
     {
-        delete _telnetServer;
+        _telnetServer->~WiFiServer();
     }
+    #endif
     if (_multiStream) 
     {
-        delete _multiStream;
+        _multiStream->~MultiStream();
+    }
+    if (_wifiManager)
+    {
+        delete _wifiManager;
+    }
+    if (_binaryLog)
+    {
+        delete _binaryLog;
+    }
+    if (_httpStatus)
+    {
+        delete _httpStatus;
+    }
+    if (_udpLog)
+    {
+        delete _udpLog;
+    }
+    if (_bootLog)
+    {
+        delete _bootLog;
+    }
+    if (_pullOTA)
+    {
+        delete _pullOTA;
+    }
+    if (_multicastOTA)
+    {
+        delete _multicastOTA;
     }
     #ifdef USE_ASYNC_WIFIMANAGER
     if (_webServer)
@@ -191,14 +184,13 @@ Networking::~Networking()
     }
     #endif
     
-    #ifdef ESP8266
     if (_instance == this)
     {
         _instance = nullptr;
     }
-    #endif
 }
 
+#ifndef NETWORKING_NO_MDNS
 /**
  * Sets up Multicast DNS (mDNS) for the device.
  * Enables service discovery for telnet and OTA updates.
@@ -208,11 +200,15 @@ void Networking::setupMDNS()
     _multiStream->printf("Start MDNS with hostname [%s.local]\n", _hostname);
     if (MDNS.begin(_hostname)) 
     {
+        #ifndef NETWORKING_NO_TELNET
         // Add Telnet service
         _multiStream->printf("addService(\"telnet\", \"tcp\", %d)\n", TELNET_PORT);
         MDNS.addService("telnet", "tcp", TELNET_PORT);
+        #endif
 
-        #ifdef ESP32
+        #if defined(NETWORKING_NO_OTA)
+            // No ArduinoOTA, nothing to announce for the IDE
+        #elif defined(ESP32)
             // Enable the Arduino OTA service (this automatically registers the Arduino service)
             _multiStream->printf("enableArduino(%d) - this may show \"Failed adding Arduino service\"!\n", OTA_PORT);
             MDNS.enableArduino(OTA_PORT); // This should handle Arduino OTA automatically
@@ -221,6 +217,9 @@ void Networking::setupMDNS()
             _multiStream->printf("addService(\"arduino\", \"tcp\", %d)\n", OTA_PORT);
             MDNS.addService("arduino", "tcp", OTA_PORT);
         #endif
+
+        //-- Services and TXT records of addMDNSService()/setMDNSTxt()
+        _mdns.begin();
     } 
     else 
     {
@@ -228,6 +227,7 @@ void Networking::setupMDNS()
     }
 
 } //  Networking::setupMDNS()
+#endif
 
 /**
  * Sets a callback function to be executed when OTA update starts.
@@ -240,7 +240,8 @@ void Networking::doAtStartOTA(std::function<void()> callback)
 }
 
 /**
- * Sets a callback function to be executed during OTA update progress.
+ * Sets a callback function to be executed during OTA update progress,
+ * at every 20% of the image.
  * 
  * @param callback Function to be called during OTA update progress
  */
@@ -249,6 +250,45 @@ void Networking::doAtProgressOTA(std::function<void()> callback)
     _onProgressOTA = callback;
 }
 
+/**
+ * Sets a callback function that gets the OTA progress in bytes, called
+ * whenever progress is reported (see setOTAProgressGranularity()) and at
+ * the end of the image.
+ * 
+ * @param callback Called with the bytes written and the image size (0 if unknown)
+ */
+void Networking::doAtProgressOTA(std::function<void(uint32_t, uint32_t)> callback)
+{
+    _onProgressBytesOTA = callback;
+}
+
+/**
+ * Sets how often OTA progress is printed and passed to the progress
+ * callback: every `percent` percent, or after `intervalMs` without a
+ * report, whichever comes first. 0 switches a trigger off. Printing on
+ * every received chunk slows the flash writes down.
+ * 
+ * @param percent Percentage step (default NETWORKING_OTA_PROGRESS_PERCENT, 10)
+ * @param intervalMs Longest time between reports (default NETWORKING_OTA_PROGRESS_MS, 1000)
+ */
+void Networking::setOTAProgressGranularity(uint8_t percent, uint16_t intervalMs)
+{
+    _otaStep     = percent;
+    _otaInterval = intervalMs;
+}
+
+/**
+ * Returns the throughput of the running update, or of the last one when
+ * none is running, from the first to the last byte written.
+ * 
+ * @return Bytes per second, 0 before the first update
+ */
+uint32_t Networking::getOTABytesPerSecond() const
+{
+    uint32_t elapsed = _otaElapsed ? _otaElapsed : millis() - _otaStarted;
+    return (_otaBytes && elapsed) ? (uint32_t)((uint64_t)_otaBytes * 1000 / elapsed) : 0;
+}
+
 /**
  * Sets a callback function to be executed when OTA update completes.
  * 
@@ -259,6 +299,270 @@ void Networking::doAtEndOTA(std::function<void()> callback)
     _onEndOTA = callback;
 }
 
+/**
+ * Downloads a firmware image over HTTP(S) and flashes it while it streams,
+ * without buffering the image. A dropped connection is resumed with a
+ * Range request; the SHA-256 (when given) is checked before the image is
+ * activated. Runs from loop(); the doAtStartOTA, doAtProgressOTA and
+ * doAtEndOTA callbacks fire like for an ArduinoOTA push.
+ * 
+ * @param url http:// or https:// URL of the image
+ * @param sha256 Its SHA-256 as 64 hex digits, nullptr to skip the check
+ * @param reboot Restart into the new image when it is activated
+ * @return False if an update is running or the URL or hash is invalid
+ */
+bool Networking::startPullOTA(const char* url, const char* sha256, bool reboot)
+{
+    if (!_pullOTA)
+    {
+        setupPullOTA();
+    }
+    _pullReboot    = reboot;
+    if (!_pullOTA->begin(url, sha256))
+    {
+        _multiStream->println("Networking:: Pull OTA not started (busy or invalid URL/SHA-256)");
+        return false;
+    }
+    _multiStream->printf("Networking:: Pull OTA from %s\n", url);
+    return true;
+}
+
+/**
+ * Sets the CA certificate (PEM) used to check an https:// update server.
+ * Without it the server isn't authenticated and only the SHA-256 protects
+ * the image. The text is not copied.
+ * 
+ * @param pem The CA certificate
+ */
+void Networking::setPullOTACACert(const char* pem)
+{
+    _pullCACert = pem;
+    if (_pullOTA)
+    {
+        _pullOTA->setCACert(pem);
+    }
+}
+
+/**
+ * Stops a running pull-mode update, nothing gets activated.
+ */
+void Networking::cancelPullOTA()
+{
+    if (_pullOTA)
+    {
+        _pullOTA->cancel();
+    }
+}
+
+/**
+ * Creates the pull-mode updater and connects it to the OTA callbacks.
+ */
+void Networking::setupPullOTA()
+{
+    _pullOTA = new PullOTA();
+    _pullOTA->setCACert(_pullCACert);
+
+    _pullOTA->onStart([this]()
+    {
+        _multiStream->println("Start updating firmware");
+        startOTAProgress();
+        if (_onStartOTA)
+        {
+            _onStartOTA();
+        }
+    });
+
+    _pullOTA->onProgress([this](uint32_t received, uint32_t total) { reportOTAProgress(received, total); });
+
+    _pullOTA->onEnd([this](bool success)
+    {
+        if (!success)
+        {
+            _multiStream->printf("Networking:: Pull OTA failed: %s\n", _pullOTA->getError());
+            return;
+        }
+        endOTAProgress();
+        if (_onEndOTA)
+        {
+            _onEndOTA();
+        }
+        if (_pullReboot)
+        {
+            _multiStream->println("Networking:: Restarting into the new firmware");
+            _multiStream->flush();
+            delay(100);
+            ESP.restart();
+        }
+    });
+}
+
+/**
+ * Listens for fleet-wide updates: ota_multicast.py sends an image once to
+ * a multicast group and every listening device flashes it, missing blocks
+ * are resent by unicast. Can be called before the WiFi connection is up,
+ * the group is joined (again) whenever the device gets an IP address.
+ * The doAtStartOTA, doAtProgressOTA and doAtEndOTA callbacks fire like
+ * for an ArduinoOTA push.
+ * 
+ * @param key Shared key the announcement must be signed with, nullptr to accept any sender
+ * @param reboot Restart into the new image when it is activated
+ * @return False if the group can't be joined now (it is tried again on the next connect)
+ */
+bool Networking::enableMulticastOTA(const char* key, bool reboot)
+{
+    if (!_multicastOTA)
+    {
+        setupMulticastOTA();
+    }
+    _multicastOTA->setKey(key);
+    _multicastReboot = reboot;
+    if (!isConnected() || !_multicastOTA->begin(_hostname))
+    {
+        _multiStream->println("Networking:: Multicast OTA waits for the WiFi connection");
+        return false;
+    }
+    _multiStream->printf("Networking:: Multicast OTA listening on port %u\n", MULTICAST_OTA_PORT);
+    return true;
+}
+
+/**
+ * Stops listening for multicast updates, a running one is dropped.
+ */
+void Networking::disableMulticastOTA()
+{
+    if (_multicastOTA)
+    {
+        delete _multicastOTA;
+        _multicastOTA = nullptr;
+    }
+}
+
+/**
+ * Creates the multicast receiver and connects it to the OTA callbacks.
+ */
+void Networking::setupMulticastOTA()
+{
+    _multicastOTA = new MulticastOTA();
+
+    _multicastOTA->onStart([this]()
+    {
+        _multiStream->println("Start updating firmware (multicast)");
+        startOTAProgress();
+        boostPoll(POLL_OTA, 0xFFFFFFFF / 2);
+        if (_onStartOTA)
+        {
+            _onStartOTA();
+        }
+    });
+
+    _multicastOTA->onProgress([this](uint32_t received, uint32_t total) { reportOTAProgress(received, total); });
+
+    _multicastOTA->onEnd([this](bool success)
+    {
+        boostPoll(POLL_OTA, 0);
+        if (!success)
+        {
+            _multiStream->printf("Networking:: Multicast OTA failed: %s\n", _multicastOTA->getError());
+            return;
+        }
+        endOTAProgress();
+        if (_onEndOTA)
+        {
+            _onEndOTA();
+        }
+        if (_multicastReboot)
+        {
+            _multiStream->println("Networking:: Restarting into the new firmware");
+            _multiStream->flush();
+            delay(100);
+            ESP.restart();
+        }
+    });
+}
+
+/**
+ * Starts measuring the progress of an update.
+ */
+void Networking::startOTAProgress()
+{
+    _otaStarted   = millis();
+    _otaReported  = _otaStarted;
+    _otaPercent   = 0;
+    _otaMilestone = 0;
+    _otaBytes     = 0;
+    _otaElapsed   = 0;
+}
+
+/**
+ * Called for every piece of an update that was written; prints the
+ * progress and throughput and calls the byte progress callback at the
+ * granularity of setOTAProgressGranularity(), the plain doAtProgressOTA()
+ * callback at every 20%.
+ * 
+ * @param done Bytes of the image written
+ * @param total Size of the image, 0 if unknown
+ */
+void Networking::reportOTAProgress(uint32_t done, uint32_t total)
+{
+    uint32_t now     = millis();
+    uint8_t  percent = total ? (uint8_t)((uint64_t)done * 100 / total) : 0;
+    _otaBytes = done;
+
+    //-- One call per 20% step, also for the steps a large write skipped
+    while (total && percent / 20 > _otaMilestone)
+    {
+        _otaMilestone++;
+        if (_onProgressOTA)
+        {
+            _onProgressOTA();
+        }
+    }
+
+    //-- Reporting is what costs: a printf flushes serial and every telnet session
+    bool complete = (total && done >= total);
+    bool step     = (total && _otaStep && percent >= _otaPercent + _otaStep);
+    bool overdue  = (_otaInterval && now - _otaReported >= _otaInterval);
+    if (complete ? _otaPercent == 100 : !(step || overdue))
+    {
+        return;
+    }
+    _otaPercent  = complete ? 100 : percent;
+    _otaReported = now;
+
+    unsigned long kbps = getOTABytesPerSecond() / 1024;
+    if (total)
+    {
+        _multiStream->printf("Progress: %u%% (%lu KB/s)\r", _otaPercent, kbps);
+    }
+    else
+    {
+        _multiStream->printf("Progress: %lu KB (%lu KB/s)\r", (unsigned long)(done / 1024), kbps);
+    }
+    if (_onProgressBytesOTA)
+    {
+        _onProgressBytesOTA(done, total);
+    }
+
+} //  Networking::reportOTAProgress()
+
+/**
+ * Prints the summary of a completed update and keeps its throughput for
+ * getOTABytesPerSecond() and the ota_bytes_per_s metric.
+ */
+void Networking::endOTAProgress()
+{
+    _otaElapsed = millis() - _otaStarted;
+    if (_otaElapsed == 0)
+    {
+        _otaElapsed = 1;
+    }
+    uint32_t rate = getOTABytesPerSecond();
+    _metrics.set(METRIC_OTA_BYTES_PER_S, rate);
+    _multiStream->printf("\nUpdate complete! %lu KB in %lu.%lu s (%lu KB/s)\n"
+                       , (unsigned long)(_otaBytes / 1024), (unsigned long)(_otaElapsed / 1000)
+                       , (unsigned long)(_otaElapsed % 1000 / 100), (unsigned long)(rate / 1024));
+}
+
 /**
  * Sets a callback function to be executed when WiFi configuration portal starts.
  * 
@@ -269,6 +573,7 @@ void Networking::doAtWiFiPortalStart(std::function<void()> callback)
     _onWiFiPortalStart = callback;
 }
 
+#ifndef NETWORKING_NO_OTA
 /**
  * Configures Over-The-Air (OTA) update functionality.
  * Sets up callbacks for different OTA events and initializes the OTA system.
@@ -280,8 +585,10 @@ void Networking::setupOTA()
     
     ArduinoOTA.onStart([this]() 
     {
-        String type = (ArduinoOTA.getCommand() == U_FLASH) ? "firmware" : "filesystem";
-        _multiStream->printf("Start updating %s\n", type.c_str());
+        const char* type = (ArduinoOTA.getCommand() == U_FLASH) ? "firmware" : "filesystem";
+        _multiStream->printf("Start updating %s\n", type);
+        startOTAProgress();
+        boostPoll(POLL_OTA, 0xFFFFFFFF / 2);
         if (_onStartOTA)
         {
             _onStartOTA();
@@ -290,16 +597,13 @@ void Networking::setupOTA()
     
     ArduinoOTA.onProgress([this](unsigned int progress, unsigned int total) 
     {
-        _multiStream->printf("Progress: %u%%\r", (progress / (total / 100)));
-        if (_onProgressOTA && (progress % (total / 5) < (total / 100)))
-        {
-            _onProgressOTA();
-        }
+        reportOTAProgress(progress, total);
     });
     
     ArduinoOTA.onEnd([this]() 
     {
-        _multiStream->println("\nUpdate complete!");
+        endOTAProgress();
+        boostPoll(POLL_OTA, 0);
         if (_onEndOTA)
         {
             _onEndOTA();
@@ -309,6 +613,7 @@ void Networking::setupOTA()
     ArduinoOTA.onError([this](ota_error_t error) 
     {
         _multiStream->printf("Error[%u]: ", error);
+        boostPoll(POLL_OTA, 0);
         switch (error) {
             case OTA_AUTH_ERROR:
                 _multiStream->println("Auth Failed");
@@ -331,6 +636,7 @@ void Networking::setupOTA()
     ArduinoOTA.begin();
     _multiStream->println("OTA ready");
 }
+#endif
 
 /**
  * Sets up WiFi event handlers for both ESP8266 and ESP32.
@@ -340,57 +646,39 @@ void Networking::setupWiFiEvents()
 {
     #ifdef ESP8266
     // For ESP8266, we use the specific event handlers
-    WiFi.onStationModeConnected(&Networking::_onStationModeConnected);
-    WiFi.onStationModeDisconnected(&Networking::_onStationModeDisconnected);
-    WiFi.onStationModeGotIP(&Networking::_onStationModeGotIP);
+    // (the handler objects must be kept, they unregister when destroyed)
+    _connectedHandler    = WiFi.onStationModeConnected(&Networking::_onStationModeConnected);
+    _disconnectedHandler = WiFi.onStationModeDisconnected(&Networking::_onStationModeDisconnected);
+    _gotIPHandler        = WiFi.onStationModeGotIP(&Networking::_onStationModeGotIP);
     
     #else
-    // For ESP32, we use the generic event handler
+    // For ESP32, we use the generic event handler. It runs in the system
+    // event task, which must not print: only loop() may write to the ring
+    // (outside multi-producer mode), so the events are flagged for it
     WiFi.onEvent([this](WiFiEvent_t event, WiFiEventInfo_t info) {
         switch (event) {
             case SYSTEM_EVENT_STA_START:
-                _multiStream->println("Networking:: WiFi station started");
+                _wifiEvents.fetch_or(WIFI_FLAG_STARTED);
                 break;
                 
             case SYSTEM_EVENT_STA_CONNECTED:
-                _multiStream->println("Networking:: WiFi connected");
+                _wifiEvents.fetch_or(WIFI_FLAG_CONNECTED);
                 break;
                 
             case SYSTEM_EVENT_STA_DISCONNECTED:
-                _multiStream->println("Networking:: WiFi disconnected");
+                _wifiEvents.fetch_or(WIFI_FLAG_DISCONNECTED);
                 
-                // Only attempt reconnection if we're not already trying
-                if (!_isReconnecting) 
-                {
-                    _isReconnecting = true;
-                    
-                    if (_reconnectAttempts < WIFI_RECONNECT_MAX_ATTEMPTS) 
-                    {
-                        _multiStream->printf("Networking:: Attempting to reconnect (attempt %d of %d)...\n", 
-                                            _reconnectAttempts + 1, WIFI_RECONNECT_MAX_ATTEMPTS);
-                        
-                        WiFi.disconnect();
-                        delay(500);
-                        WiFi.begin();
-                        
-                        _reconnectAttempts++;
-                    } 
-                    else 
-                    {
-                        _multiStream->println("Networking:: Max WiFi reconnect attempts reached! Restarting...");
-                        delay(1000);
-                        ESP.restart();  // Restart if unable to reconnect
-                    }
-                }
+                // Reconnecting is scheduled from loop(), never blocks the event task
+                _wifiLost = true;
                 break;
                 
             case SYSTEM_EVENT_STA_GOT_IP:
-                _multiStream->print("Networking:: WiFi got IP: ");
-                _multiStream->println(WiFi.localIP().toString());
+                _wifiEvents.fetch_or(WIFI_FLAG_GOT_IP);
                 
                 // Reset reconnection variables on successful connection
                 _isReconnecting = false;
-                _reconnectAttempts = 0;
+                _wifiLost = false;
+                _wifiCacheDirty = true;  // Saved from loop(), not from the event task
                 break;
                 
             default:
@@ -400,26 +688,57 @@ void Networking::setupWiFiEvents()
     #endif
 }
 
-#ifdef ESP8266
+#ifndef ESP8266
 /**
- * Static event handler for ESP8266 station mode connected event.
- * 
- * @param event The WiFi event information
+ * Prints the WiFi events flagged by the event task, called from loop().
  */
-void Networking::_onStationModeConnected(const WiFiEventStationModeConnected& event)
+void Networking::reportWiFiEvents()
 {
-    if (_instance && _instance->_multiStream)
+    uint8_t events = _wifiEvents.exchange(0);
+    if (events == 0)
     {
-        _instance->_multiStream->printf("Networking:: WiFi connected to SSID: %s, channel: %d\n", 
-                                       event.ssid.c_str(), event.channel);
+        return;
     }
-}
-
-/**
- * Static event handler for ESP8266 station mode disconnected event.
- * 
- * @param event The WiFi event information
- */
+    if (events & WIFI_FLAG_STARTED)
+    {
+        _multiStream->println("Networking:: WiFi station started");
+    }
+    if (events & WIFI_FLAG_CONNECTED)
+    {
+        _multiStream->println("Networking:: WiFi connected");
+    }
+    if (events & WIFI_FLAG_DISCONNECTED)
+    {
+        _multiStream->println("Networking:: WiFi disconnected");
+    }
+    if (events & WIFI_FLAG_GOT_IP)
+    {
+        char ip[16];
+        _multiStream->printf("Networking:: WiFi got IP: %s\n", getIPAddressString(ip, sizeof(ip)));
+    }
+}
+#endif
+
+#ifdef ESP8266
+/**
+ * Static event handler for ESP8266 station mode connected event.
+ * 
+ * @param event The WiFi event information
+ */
+void Networking::_onStationModeConnected(const WiFiEventStationModeConnected& event)
+{
+    if (_instance && _instance->_multiStream)
+    {
+        _instance->_multiStream->printf("Networking:: WiFi connected to SSID: %s, channel: %d\n", 
+                                       event.ssid.c_str(), event.channel);
+    }
+}
+
+/**
+ * Static event handler for ESP8266 station mode disconnected event.
+ * 
+ * @param event The WiFi event information
+ */
 void Networking::_onStationModeDisconnected(const WiFiEventStationModeDisconnected& event)
 {
     if (_instance && _instance->_multiStream)
@@ -427,29 +746,8 @@ void Networking::_onStationModeDisconnected(const WiFiEventStationModeDisconnect
         _instance->_multiStream->printf("Networking:: WiFi disconnected from SSID: %s, reason: %d\n", 
                                        event.ssid.c_str(), event.reason);
         
-        // Only attempt reconnection if we're not already trying
-        if (!_instance->_isReconnecting) 
-        {
-            _instance->_isReconnecting = true;
-            
-            if (_instance->_reconnectAttempts < WIFI_RECONNECT_MAX_ATTEMPTS) 
-            {
-                _instance->_multiStream->printf("Networking:: Attempting to reconnect (attempt %d of %d)...\n", 
-                                              _instance->_reconnectAttempts + 1, WIFI_RECONNECT_MAX_ATTEMPTS);
-                
-                WiFi.disconnect();
-                delay(500);
-                WiFi.begin();
-                
-                _instance->_reconnectAttempts++;
-            } 
-            else 
-            {
-                _instance->_multiStream->println("Networking:: Max WiFi reconnect attempts reached! Restarting...");
-                delay(1000);
-                ESP.restart();  // Restart if unable to reconnect
-            }
-        }
+        // Reconnecting is scheduled from loop(), never from the event handler
+        _instance->_wifiLost = true;
     }
 }
 
@@ -462,50 +760,76 @@ void Networking::_onStationModeGotIP(const WiFiEventStationModeGotIP& event)
 {
     if (_instance && _instance->_multiStream)
     {
-        _instance->_multiStream->print("Networking:: WiFi got IP: ");
-        _instance->_multiStream->println(event.ip.toString());
+        char ip[16];
+        _instance->_multiStream->printf("Networking:: WiFi got IP: %s\n", formatIP(event.ip, ip, sizeof(ip)));
         
         // Reset reconnection variables on successful connection
         _instance->_isReconnecting = false;
-        _instance->_reconnectAttempts = 0;
+        _instance->_wifiLost = false;
+        _instance->_wifiCacheDirty = true;  // Saved from loop(), not from the event handler
     }
 }
 #endif
 
 /**
- * Initializes the networking functionality.
- * Sets up WiFi, MDNS, OTA updates, and telnet server.
+ * Common part of begin() and beginAsync(): serial, telnet server,
+ * MultiStream, reset pin and WiFi event handlers. Never blocks.
  * 
  * @param hostname Device hostname for network identification
  * @param resetWiFiPin GPIO pin for WiFi settings reset
  * @param serial Hardware serial interface for debugging
  * @param serialSpeed Baud rate for serial communication
  * @param wifiCallback Optional callback for WiFi portal events
- * @return Pointer to Stream object for debug output, nullptr if initialization fails
+ * @param flushPolicy When debug output is handed to Serial and Telnet
  */
-Stream* Networking::begin(const char* hostname, int resetWiFiPin
+void Networking::setupCommon(const char* hostname, int resetWiFiPin
   , HardwareSerial& serial, long serialSpeed
-  , std::function<void()> wifiCallback) 
+  , std::function<void()> wifiCallback
+  , const FlushPolicy& flushPolicy)
 {
     _hostname = hostname;
     _resetWiFiPin = resetWiFiPin;
     _serial = &serial;
+    if (wifiCallback)
+    {
+        _onWiFiPortalStart = wifiCallback;
+    }
 
     //-- Initialize Serial
     serial.begin(serialSpeed);
-    delay(100);
-
-    //-- Initialize telnet server
-    _telnetServer = new WiFiServer(TELNET_PORT);
 
-    //-- Initialize MultiStream
-    _multiStream = new MultiStream(&serial, &_telnetClient);
+    //-- Telnet server and MultiStream live in the Networking object, nothing is allocated for them
+    #ifndef NETWORKING_NO_TELNET
+    if (!_telnetServer)
+    {
+        _telnetServer = new (_telnetStorage) WiFiServer(TELNET_PORT);
+    }
+    #endif
+    if (_multiStream)
+    {
+        _multiStream->~MultiStream();
+    }
+    _multiStream = new (_streamStorage) MultiStream(&serial);
+    _multiStream->setFlushPolicy(flushPolicy);
+    _multiStream->setFlushHistogram(_metrics.getHistogram(METRIC_FLUSH_US));
+    if (_udpLog)
+    {
+        _udpLog->setHostname(_hostname);
+        _multiStream->setUdpLog(_udpLog);
+    }
+    if (_bootLog)
+    {
+        startBootLog();
+    }
 
     //-- Initialize reset pin
-    pinMode(_resetWiFiPin, INPUT_PULLUP);
+    if (_resetWiFiPin >= 0)
+    {
+        pinMode(_resetWiFiPin, INPUT_PULLUP);
+    }
 
     //-- Check if reset is requested
-    if (digitalRead(_resetWiFiPin) == LOW) 
+    if (_resetWiFiPin >= 0 && digitalRead(_resetWiFiPin) == LOW) 
     {
         _multiStream->println("Networking:: Reset button pressed, clearing WiFi settings...");
         #ifdef USE_ASYNC_WIFIMANAGER
@@ -521,316 +845,2555 @@ Stream* Networking::begin(const char* hostname, int resetWiFiPin
     //-- Setup WiFi event handlers
     setupWiFiEvents();
 
-    //-- Try connecting to WiFi
-    _multiStream->println("Networking:: Connecting to WiFi...");
-    WiFi.mode(WIFI_STA);
-    WiFi.begin();
+    //-- Restore the cached connection details (fast reconnect)
+    loadRtcState();
 
-    int retries = 20;
-    while (!isConnected() && retries-- > 0) 
-    {
-        delay(500);
-        _multiStream->print(".");
-    }
+} //  Networking::setupCommon()
 
-    if (!isConnected()) 
+/**
+ * Starts MDNS, OTA and the telnet server once WiFi is connected.
+ */
+void Networking::startServices()
+{
+    //-- A burst wake only needs WiFi, skip MDNS, OTA and telnet
+    if (_burst && !_maintenance)
     {
-        _multiStream->println("\nWiFi connection failed. Starting configuration portal...");
-
-        #ifdef USE_ASYNC_WIFIMANAGER
-        _webServer = new AsyncWebServer(80);
-        _dnsServer = new DNSServer();
-        AsyncWiFiManager wifiManager(_webServer, _dnsServer);
-        #else
-        ::WiFiManager wifiManager;
-        #endif
-
-        if (wifiCallback)
-        {
-            _onWiFiPortalStart = wifiCallback;
-            wifiManager.setAPCallback([this](::WiFiManager* mgr) 
-            {
-                _onWiFiPortalStart();
-            });
-        }
-
-        wifiManager.setTimeout(240); // Set timeout for the portal
-        if (!wifiManager.autoConnect(_hostname)) 
-        {
-            _multiStream->println("Networking:: Failed to connect to WiFi. Restarting...");
-            delay(3000);
-            ESP.restart();
-            return nullptr;
-        }
+        char ip[16];
+        _multiStream->printf("Networking:: Burst wake, IP %s after %lu ms\n"
+                           , getIPAddressString(ip, sizeof(ip)), millis() - _connectStarted);
+        _fastAttempt = false;
+        saveWiFiCache();
+        _servicesEnabled = false;
+        setState(SERVICES_UP);
+        return;
     }
 
+    char ip[16];
     _multiStream->println("\nNetworking:: Connected to WiFi!");
-    _multiStream->print("IP address: ");
-    _multiStream->println(getIPAddressString());
+    _multiStream->printf("IP address: %s\n", getIPAddressString(ip, sizeof(ip)));
+    _multiStream->printf("Networking:: Time to IP: %lu ms%s\n", millis() - _connectStarted
+                                                            , _fastAttempt ? " (fast reconnect)" : "");
+    _fastAttempt = false;
+    saveWiFiCache();
 
+    #ifndef NETWORKING_NO_MDNS
     //-- Setup MDNS
     setupMDNS();
+    #endif
 
+    #ifndef NETWORKING_NO_OTA
     //-- Setup OTA
     setupOTA();
+    #endif
 
+    #ifndef NETWORKING_NO_TELNET
     //-- Start telnet server
     _telnetServer->begin();
     _telnetServer->setNoDelay(true);
     _multiStream->println("Networking:: Telnet server started");
-
-    return _multiStream;
-
-} //  Networking::begin()
-
-/**
- * Main loop function for handling network events.
- * Manages OTA updates, MDNS, telnet connections, and NTP synchronization.
- * WiFi reconnection is now handled by event handlers instead of polling.
- */
-void Networking::loop() 
-{
-    //-- Handle OTA
-    ArduinoOTA.handle();
-    
-    //-- Handle MDNS
-    #ifdef ESP8266
-        MDNS.update();
     #endif
 
-    //-- Handle incoming telnet connections
-    if (_telnetServer->hasClient()) 
+    //-- Start the binary log channel if enabled
+    if (_binaryLog)
     {
-        WiFiClient newClient = _telnetServer->available();
-
-        //-- If an existing client is connected, notify and disconnect it
-        if (_telnetClient && _telnetClient.connected()) 
-        {
-            _telnetClient.println("Networking:: Telnet disconnected due to new client.");
-            _telnetClient.stop();
-        }
-
-        //-- Assign the new client
-        _telnetClient = newClient;
-        _telnetClient.printf("Welcome to [%s] Telnet Server!\r\n", _hostname);
+        _binaryLog->begin();
+        _multiStream->println("Networking:: Binary log server started");
     }
 
-    //-- Handle disconnections
-    if (_telnetClient && !_telnetClient.connected()) 
+    //-- Start the HTTP status endpoint if enabled
+    if (_httpStatus)
     {
-        _telnetClient.stop();
+        startHttpStatus();
     }
 
-    //-- Periodic NTP sync
-    if (_posixString && (millis() - _lastNtpSync >= NTP_SYNC_INTERVAL))
-    {
-        #ifdef ESP8266
-            configTime(0, 0, "pool.ntp.org", "time.nist.gov");
-        #else
-            configTzTime(_posixString, "pool.ntp.org", "time.nist.gov");
-        #endif
-        _lastNtpSync = millis();
-    }
+    _servicesEnabled = true;
+    setState(SERVICES_UP);
 
-} //  Networking::loop()
+} //  Networking::startServices()
+
+//-- RTC memory state
+#ifdef ESP8266
+  //-- The first 128 bytes of the RTC user memory are used by the OTA bootloader
+  #ifndef NETWORKING_RTC_OFFSET
+    #define NETWORKING_RTC_OFFSET 32   // In 4-byte blocks
+  #endif
+  static_assert(NETWORKING_RTC_OFFSET + (sizeof(Networking::RtcState) + 3) / 4 <= BOOTLOG_RTC_OFFSET
+              , "The boot log (BOOTLOG_RTC_OFFSET) overlaps the RTC state");
+#else
+  //-- Survives deep sleep and software resets, validated by the CRC
+  RTC_NOINIT_ATTR static Networking::RtcState _rtcStorage;
+#endif
 
 /**
- * Manually triggers a WiFi reconnection.
- * This is now primarily used for manual reconnection requests,
- * as automatic reconnection is handled by event handlers.
+ * Calculates a CRC32 (IEEE 802.3) checksum.
+ * 
+ * @param data The bytes to checksum
+ * @param length The number of bytes
+ * @return The CRC32 value
  */
-void Networking::reconnectWiFi() 
+static uint32_t crc32(const uint8_t* data, size_t length)
 {
-    if (!_isReconnecting)
+    uint32_t crc = 0xFFFFFFFF;
+    while (length--)
     {
-        _multiStream->println("Networking:: Manually reconnecting to WiFi...");
-        
-        _isReconnecting = true;
-        WiFi.disconnect();
-        delay(500);
-        WiFi.begin();
-        
-        // Wait for connection
-        int retries = 20; // Try for 10 seconds (20 x 500ms)
-        while (!isConnected() && retries-- > 0) 
-        {
-            delay(500);
-            _multiStream->print(".");
-        }
-        
-        if (isConnected()) 
-        {
-            _multiStream->println("\nNetworking:: WiFi reconnected successfully!");
-            _multiStream->print("Networking:: New IP: ");
-            _multiStream->println(getIPAddressString());
-            _isReconnecting = false;
-        } 
-        else 
+        crc ^= *data++;
+        for (int bit = 0; bit < 8; bit++)
         {
-            _multiStream->println("\nNetworking:: WiFi reconnection failed.");
-            // The event handlers will continue trying to reconnect
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
         }
     }
-    else
-    {
-        _multiStream->println("Networking:: Reconnection already in progress...");
-    }
-} //  Networking::reconnectWiFi()
-
+    return ~crc;
+}
 
 /**
- * Get the local IP address of the device.
- *
- * @return The local IP address as an IPAddress object.
+ * Loads the RTC memory state and checks that it is valid.
+ * 
+ * @return True if the stored state has a valid checksum
  */
-IPAddress Networking::getIPAddress() const 
+bool Networking::loadRtcState()
 {
-    return WiFi.localIP();
+    #ifdef ESP8266
+    ESP.rtcUserMemoryRead(NETWORKING_RTC_OFFSET, (uint32_t*)&_rtc, sizeof(_rtc));
+    #else
+    memcpy(&_rtc, &_rtcStorage, sizeof(_rtc));
+    #endif
+    
+    uint32_t crc = crc32((const uint8_t*)&_rtc + sizeof(_rtc.crc), sizeof(_rtc) - sizeof(_rtc.crc));
+    if (_rtc.crc != crc || _rtc.magic != RTC_MAGIC)
+    {
+        memset(&_rtc, 0, sizeof(_rtc));
+        _rtc.magic = RTC_MAGIC;
+        return false;
+    }
+    return true;
 }
 
 /**
- * Get the local IP address of the device as a string.
- *
- * @return The local IP address as a String object.
+ * Stores the RTC memory state with a fresh checksum.
  */
-String Networking::getIPAddressString() const 
+void Networking::saveRtcState()
 {
-    return WiFi.localIP().toString();
+    _rtc.magic = RTC_MAGIC;
+    _rtc.crc = crc32((const uint8_t*)&_rtc + sizeof(_rtc.crc), sizeof(_rtc) - sizeof(_rtc.crc));
+    #ifdef ESP8266
+    ESP.rtcUserMemoryWrite(NETWORKING_RTC_OFFSET, (uint32_t*)&_rtc, sizeof(_rtc));
+    #else
+    memcpy(&_rtcStorage, &_rtc, sizeof(_rtc));
+    #endif
 }
 
 /**
- * Check if the device is connected to a WiFi network.
- *
- * @return True if the device is connected to a WiFi network, false otherwise.
+ * Enables reconnecting with the cached BSSID, channel and IP lease.
+ * Must be called before begin() or beginAsync().
+ * 
+ * @param enable True to use the cache, false for a full scan + DHCP every time
  */
-bool Networking::isConnected() const 
+void Networking::setFastReconnect(bool enable)
 {
-    return WiFi.status() == WL_CONNECTED;
+    _fastReconnect = enable;
 }
 
 /**
- * Checks if the current NTP time is valid.
- * 
- * @return True if NTP time is valid, false otherwise
+ * Starts a WiFi connection. When fast reconnect is enabled and a valid
+ * cache exists it connects straight to the cached BSSID and channel with
+ * the cached lease as static IP, skipping the channel scan and DHCP.
  */
-bool Networking::ntpIsValid() const
+void Networking::connectWiFi()
 {
-    return time(nullptr) > 1000000;
+    _connectStarted = millis();
+    _fastAttempt = false;
+
+    char ssid[33];
+    char psk[65];
+    if (_fastReconnect && (_rtc.flags & RTC_WIFI_VALID) && loadCredentials(ssid, psk))
+    {
+        _fastAttempt = true;
+        WiFi.config(IPAddress(_rtc.ip), IPAddress(_rtc.gateway), IPAddress(_rtc.subnet)
+                  , IPAddress(_rtc.dns1), IPAddress(_rtc.dns2));
+        WiFi.begin(ssid, psk, _rtc.channel, _rtc.bssid);
+        return;
+    }
+    WiFi.begin();
 }
 
 /**
- * Initializes NTP time synchronization.
+ * Reads the stored station credentials. WiFi.SSID() can't be used for
+ * this: on ESP32 it is the SSID of the current connection, empty before
+ * the station connects.
  * 
- * @param posixString POSIX timezone string
- * @param ntpServers Array of NTP server addresses (optional)
- * @return True if NTP initialization successful, false otherwise
+ * @param ssid Destination, 33 bytes
+ * @param psk Destination, 65 bytes
+ * @return False if no network is stored
  */
-bool Networking::ntpStart(const char* posixString, const char** ntpServers)
+bool Networking::loadCredentials(char* ssid, char* psk)
 {
-    if (!isConnected())
+    #ifdef ESP8266
+    struct station_config config;
+    if (!wifi_station_get_config(&config))
     {
         return false;
     }
-
-    _posixString = posixString;
-    
-    #ifdef ESP8266
-        if (ntpServers == nullptr)
-        {
-            configTime(0, 0, "pool.ntp.org", "time.nist.gov");
-        }
-        else
-        {
-            configTime(0, 0, "pool.ntp.org", ntpServers[0]);
-        }
+    memcpy(ssid, config.ssid, 32);
+    memcpy(psk, config.password, 64);
     #else
-        // ESP32 uses configTzTime
-        configTzTime(posixString, "pool.ntp.org", ntpServers ? ntpServers[0] : "time.nist.gov");
-    #endif
-    
-    setenv("TZ", posixString, 1);
-    tzset();
-
-    // Wait up to 5 seconds for time sync
-    int retries = 50;
-    while (time(nullptr) < 1000000 && retries-- > 0)
-    {
-        delay(100);
-    }
-
-    if (time(nullptr) > 1000000)
+    wifi_config_t config;
+    if (esp_wifi_get_config(WIFI_IF_STA, &config) != ESP_OK)
     {
-        _lastNtpSync = millis();
-        return true;
+        return false;
     }
-    return false;
+    memcpy(ssid, config.sta.ssid, 32);
+    memcpy(psk, config.sta.password, 64);
+    #endif
+    //-- A 32 character SSID or a 64 character key fills the field without a terminator
+    ssid[32] = 0;
+    psk[64]  = 0;
+    return ssid[0] != 0;
 }
 
 /**
- * Gets current epoch time with optional timezone override.
- * 
- * @param posixString Optional POSIX timezone string for temporary timezone change
- * @return Current epoch time
+ * Falls back to a full scan with DHCP when a fast reconnect did not
+ * get a connection within FAST_CONNECT_TIMEOUT. The cache is dropped.
  */
-time_t Networking::ntpGetEpoch(const char* posixString)
+void Networking::checkFastConnect()
 {
-    if (posixString)
+    if (!_fastAttempt || isConnected() || (millis() - _connectStarted < FAST_CONNECT_TIMEOUT))
     {
-        setenv("TZ", posixString, 1);
-        tzset();
+        return;
     }
-    else if (!_posixString)
+    
+    _multiStream->println("Networking:: Fast reconnect failed, falling back to scan + DHCP");
+    _rtc.flags &= ~RTC_WIFI_VALID;
+    saveRtcState();
+    
+    //-- On ESP8266 disconnect() would also erase the stored credentials
+    char ssid[33];
+    char psk[65];
+    bool stored = loadCredentials(ssid, psk);
+    #ifndef ESP8266
+    WiFi.disconnect();
+    #endif
+    WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0));
+    _fastAttempt = false;
+    if (stored)
     {
-        return 0;
+        WiFi.begin(ssid, psk);
     }
     else
     {
-        setenv("TZ", _posixString, 1); // Reset to default timezone
-        tzset();
+        WiFi.begin();
     }
-
-    return time(nullptr);
 }
 
 /**
- * Gets current date in YYYY-MM-DD format.
- * 
- * @param posixString Optional POSIX timezone string
- * @return Current date string or nullptr if time not available
+ * Remembers the BSSID, channel and DHCP lease of the current connection.
  */
-const char* Networking::ntpGetDate(const char* posixString)
+void Networking::saveWiFiCache()
 {
-    static char buffer[32];
-    time_t now = ntpGetEpoch(posixString);
-    if (now == 0)
+    _wifiCacheDirty = false;
+    if (!_fastReconnect || !isConnected())
     {
-        return nullptr;
+        return;
     }
     
-    strftime(buffer, sizeof(buffer), "%Y-%m-%d", localtime(&now));
-    return buffer;
-} // ntpGetDate()
+    uint8_t* bssid = WiFi.BSSID();
+    if (bssid)
+    {
+        memcpy(_rtc.bssid, bssid, sizeof(_rtc.bssid));
+    }
+    _rtc.channel = WiFi.channel();
+    _rtc.ip      = (uint32_t)WiFi.localIP();
+    _rtc.gateway = (uint32_t)WiFi.gatewayIP();
+    _rtc.subnet  = (uint32_t)WiFi.subnetMask();
+    _rtc.dns1    = (uint32_t)WiFi.dnsIP(0);
+    _rtc.dns2    = (uint32_t)WiFi.dnsIP(1);
+    _rtc.flags  |= RTC_WIFI_VALID;
+    saveRtcState();
+}
+
+/**
+ * Initializes the networking functionality.
+ * Sets up WiFi, MDNS, OTA updates, and telnet server.
+ * Blocks until WiFi is connected or the configuration portal times out,
+ * use beginAsync() to return immediately.
+ * 
+ * @param hostname Device hostname for network identification
+ * @param resetWiFiPin GPIO pin for WiFi settings reset
+ * @param serial Hardware serial interface for debugging
+ * @param serialSpeed Baud rate for serial communication
+ * @param wifiCallback Optional callback for WiFi portal events
+ * @param flushPolicy When debug output is handed to Serial and Telnet (default: every line)
+ * @return Pointer to Stream object for debug output, nullptr if initialization fails
+ */
+Stream* Networking::begin(const char* hostname, int resetWiFiPin
+  , HardwareSerial& serial, long serialSpeed
+  , std::function<void()> wifiCallback
+  , const FlushPolicy& flushPolicy) 
+{
+    _async = false;
+    setupCommon(hostname, resetWiFiPin, serial, serialSpeed, wifiCallback, flushPolicy);
+    delay(100);
+
+    //-- Try connecting to WiFi
+    _multiStream->println("Networking:: Connecting to WiFi...");
+    WiFi.mode(WIFI_STA);
+    connectWiFi();
+    setState(CONNECTING);
+
+    int retries = 20;
+    while (!isConnected() && retries-- > 0) 
+    {
+        delay(500);
+        _multiStream->print(".");
+        checkFastConnect();
+    }
+
+    if (!isConnected()) 
+    {
+        _multiStream->println("\nWiFi connection failed. Starting configuration portal...");
+        setState(PORTAL);
+
+        #ifdef USE_ASYNC_WIFIMANAGER
+        _webServer = new AsyncWebServer(80);
+        _dnsServer = new DNSServer();
+        AsyncWiFiManager wifiManager(_webServer, _dnsServer);
+        if (_onWiFiPortalStart)
+        {
+            wifiManager.setAPCallback([this](AsyncWiFiManager* mgr) 
+            {
+                _onWiFiPortalStart();
+            });
+        }
+        #else
+        ::WiFiManager wifiManager;
+        if (_onWiFiPortalStart)
+        {
+            wifiManager.setAPCallback([this](::WiFiManager* mgr) 
+            {
+                _onWiFiPortalStart();
+            });
+        }
+        #endif
+
+        wifiManager.setTimeout(WIFI_PORTAL_TIMEOUT / 1000); // Set timeout for the portal
+        if (!wifiManager.autoConnect(_hostname)) 
+        {
+            _multiStream->println("Networking:: Failed to connect to WiFi. Restarting...");
+            delay(3000);
+            ESP.restart();
+            return nullptr;
+        }
+    }
+
+    setState(CONNECTED);
+    startServices();
+
+    return _multiStream;
+
+} //  Networking::begin()
+
+/**
+ * Initializes the networking functionality without blocking.
+ * Returns the debug stream immediately; loop() then moves through
+ * CONNECTING -> CONNECTED -> SERVICES_UP (or PORTAL when no WiFi
+ * connection can be made) and calls the doAtStateChange() callback
+ * on every transition.
+ * 
+ * @param hostname Device hostname for network identification
+ * @param resetWiFiPin GPIO pin for WiFi settings reset
+ * @param serial Hardware serial interface for debugging
+ * @param serialSpeed Baud rate for serial communication
+ * @param wifiCallback Optional callback for WiFi portal events
+ * @param flushPolicy When debug output is handed to Serial and Telnet (default: every line)
+ * @return Pointer to Stream object for debug output
+ */
+Stream* Networking::beginAsync(const char* hostname, int resetWiFiPin
+  , HardwareSerial& serial, long serialSpeed
+  , std::function<void()> wifiCallback
+  , const FlushPolicy& flushPolicy) 
+{
+    _async = true;
+    setupCommon(hostname, resetWiFiPin, serial, serialSpeed, wifiCallback, flushPolicy);
+
+    //-- Start connecting, loop() takes it from here
+    _multiStream->println("Networking:: Connecting to WiFi (async)...");
+    WiFi.mode(WIFI_STA);
+    connectWiFi();
+    setState(CONNECTING);
+
+    return _multiStream;
+
+} //  Networking::beginAsync()
+
+/**
+ * Lightweight start for battery powered nodes waking from deep sleep.
+ * Restores the WiFi cache and the wall clock from RTC memory, connects
+ * with fast reconnect and skips MDNS, OTA, telnet and the configuration
+ * portal, unless this is a maintenance wake (maintenancePin held LOW or
+ * requestMaintenanceWake() called before the last sleep).
+ * Returns immediately, loop() moves through the connection states.
+ * 
+ * @param hostname Device hostname for network identification
+ * @param maintenancePin GPIO pin that requests a maintenance wake when LOW (-1 for none)
+ * @param serial Hardware serial interface for debugging
+ * @param serialSpeed Baud rate for serial communication
+ * @return Pointer to Stream object for debug output
+ */
+Stream* Networking::beginBurst(const char* hostname, int maintenancePin
+  , HardwareSerial& serial, long serialSpeed)
+{
+    _async = true;
+    _burst = true;
+    _fastReconnect = true;
+    setupCommon(hostname, -1, serial, serialSpeed, nullptr, FlushPolicy());
+
+    //-- Maintenance: full services for this wake
+    if (_rtc.flags & RTC_MAINTENANCE)
+    {
+        _maintenance = true;
+        _rtc.flags &= ~RTC_MAINTENANCE;
+        saveRtcState();
+    }
+    if (maintenancePin >= 0)
+    {
+        pinMode(maintenancePin, INPUT_PULLUP);
+        if (digitalRead(maintenancePin) == LOW)
+        {
+            _maintenance = true;
+        }
+    }
+
+    restoreTime();
+
+    _multiStream->printf("Networking:: Burst wake%s, connecting...\n", _maintenance ? " (maintenance)" : "");
+    WiFi.mode(WIFI_STA);
+    connectWiFi();
+    setState(CONNECTING);
+
+    return _multiStream;
+
+} //  Networking::beginBurst()
+
+/**
+ * Sets the system clock from the time saved by sleepFor().
+ * The clock continues from the moment the node went to sleep plus
+ * the requested sleep time and the time since boot.
+ */
+void Networking::restoreTime()
+{
+    if (!(_rtc.flags & RTC_TIME_VALID))
+    {
+        return;
+    }
+    
+    uint64_t ms = (uint64_t)_rtc.epoch * 1000 + _rtc.epochMillis + _rtc.sleepMs + millis();
+    struct timeval tv;
+    tv.tv_sec  = (time_t)(ms / 1000);
+    tv.tv_usec = (suseconds_t)((ms % 1000) * 1000);
+    settimeofday(&tv, nullptr);
+    _timeRestored = true;
+
+    #ifndef NETWORKING_NO_NTP
+    if (_rtc.posix[0])
+    {
+        _posixString = _rtc.posix;
+        setenv("TZ", _posixString, 1);
+        tzset();
+    }
+    #endif
+
+    //-- Only valid once, a reset without sleepFor() must not apply it again
+    _rtc.flags &= ~RTC_TIME_VALID;
+    saveRtcState();
+}
+
+/**
+ * Requests full services (MDNS, OTA, telnet, portal) on the next beginBurst().
+ */
+void Networking::requestMaintenanceWake()
+{
+    _rtc.flags |= RTC_MAINTENANCE;
+    saveRtcState();
+}
+
+/**
+ * Saves the WiFi cache and the wall clock to RTC memory, shuts down
+ * the radio and enters deep sleep. Does not return; the node restarts
+ * after the sleep time and should call beginBurst() again.
+ * 
+ * @param ms Sleep time in milliseconds
+ */
+void Networking::sleepFor(uint32_t ms)
+{
+    if (isConnected())
+    {
+        saveWiFiCache();
+    }
+    
+    if (ntpIsValid())
+    {
+        struct timeval tv;
+        gettimeofday(&tv, nullptr);
+        _rtc.epoch = tv.tv_sec;
+        _rtc.epochMillis = tv.tv_usec / 1000;
+        _rtc.flags |= RTC_TIME_VALID;
+    }
+    _rtc.sleepMs = ms;
+    saveRtcState();
+
+    if (_multiStream)
+    {
+        _multiStream->printf("Networking:: Sleeping for %lu ms after %lu ms awake\n", (unsigned long)ms, millis());
+        _multiStream->setRingBufferMode(false);
+        _multiStream->flush();
+    }
+
+    #ifdef ESP8266
+    WiFi.mode(WIFI_OFF);
+    ESP.deepSleep((uint64_t)ms * 1000ULL, WAKE_RF_DEFAULT);
+    #else
+    WiFi.disconnect(true);
+    WiFi.mode(WIFI_OFF);
+    esp_sleep_enable_timer_wakeup((uint64_t)ms * 1000ULL);
+    esp_deep_sleep_start();
+    #endif
+}
+
+/**
+ * Starts the WiFiManager configuration portal in non-blocking mode.
+ */
+void Networking::startPortal()
+{
+    _multiStream->println("Networking:: WiFi connection failed. Starting configuration portal...");
+
+    #ifdef USE_ASYNC_WIFIMANAGER
+    if (!_webServer)
+    {
+        _webServer = new AsyncWebServer(80);
+        _dnsServer = new DNSServer();
+    }
+    _wifiManager = new AsyncWiFiManager(_webServer, _dnsServer);
+    if (_onWiFiPortalStart)
+    {
+        _wifiManager->setAPCallback([this](AsyncWiFiManager* mgr) 
+        {
+            _onWiFiPortalStart();
+        });
+    }
+    _wifiManager->startConfigPortalModeless(_hostname, nullptr);
+    #else
+    _wifiManager = new ::WiFiManager();
+    if (_onWiFiPortalStart)
+    {
+        _wifiManager->setAPCallback([this](::WiFiManager* mgr) 
+        {
+            _onWiFiPortalStart();
+        });
+    }
+    //-- Straight to the portal: autoConnect() would first wait for the saved network,
+    //-- connecting is up to handleState()
+    _wifiManager->setConfigPortalBlocking(false);
+    _wifiManager->setConfigPortalTimeout(WIFI_PORTAL_TIMEOUT / 1000);
+    _wifiManager->startConfigPortal(_hostname);
+    #endif
+
+    setState(PORTAL);
+
+} //  Networking::startPortal()
+
+/**
+ * Advances the beginAsync() state machine, called from loop().
+ * Every state only polls, nothing in here waits.
+ */
+void Networking::handleState()
+{
+    switch (_state)
+    {
+        case CONNECTING:
+            checkFastConnect();
+            if (isConnected())
+            {
+                setState(CONNECTED);
+            }
+            else if (millis() - _stateSince >= WIFI_CONNECT_TIMEOUT && !(_burst && !_maintenance))
+            {
+                //-- A burst wake never opens the portal, the sketch decides when to sleep again
+                startPortal();
+            }
+            break;
+
+        case PORTAL:
+            #ifdef USE_ASYNC_WIFIMANAGER
+            _wifiManager->loop();
+            #else
+            _wifiManager->process();
+            #endif
+            if (isConnected())
+            {
+                delete _wifiManager;
+                _wifiManager = nullptr;
+                setState(CONNECTED);
+            }
+            else if (millis() - _stateSince >= WIFI_PORTAL_TIMEOUT)
+            {
+                _multiStream->println("Networking:: Failed to connect to WiFi. Restarting...");
+                _multiStream->flush();
+                ESP.restart();
+            }
+            break;
+
+        case CONNECTED:
+            startServices();
+            break;
+
+        default:
+            break;
+    }
+
+} //  Networking::handleState()
+
+/**
+ * Changes the connection state and calls the doAtStateChange() callback.
+ * 
+ * @param state The new state
+ */
+void Networking::setState(State state)
+{
+    if (state == _state)
+    {
+        return;
+    }
+    State previous = _state;
+    _state = state;
+    _stateSince = millis();
+    if (_onStateChange)
+    {
+        _onStateChange(previous, state);
+    }
+}
+
+/**
+ * Sets a callback function to be executed on every connection state change.
+ * 
+ * @param callback Function called with the previous and the new state
+ */
+void Networking::doAtStateChange(std::function<void(State, State)> callback)
+{
+    _onStateChange = callback;
+}
+
+/**
+ * Gets a printable name for a connection state.
+ * 
+ * @param state The state
+ * @return The state name
+ */
+const char* Networking::getStateName(State state)
+{
+    switch (state)
+    {
+        case IDLE:        return "IDLE";
+        case CONNECTING:  return "CONNECTING";
+        case PORTAL:      return "PORTAL";
+        case CONNECTED:   return "CONNECTED";
+        case SERVICES_UP: return "SERVICES_UP";
+    }
+    return "UNKNOWN";
+}
+
+/**
+ * Main loop function for handling network events.
+ * Manages OTA updates, MDNS, telnet connections, and NTP synchronization.
+ * WiFi reconnection is now handled by event handlers instead of polling.
+ */
+void Networking::loop() 
+{
+    if (!_multiStream)
+    {
+        return;
+    }
+    #ifndef ESP8266
+        //-- After runInTask() the sketch's own loop() calls return right away
+        if (_task && xTaskGetCurrentTaskHandle() != _task)
+        {
+            return;
+        }
+    #endif
+    uint32_t loopStart = micros();
+    #ifdef NETWORKING_PROFILE_LOOP
+        uint32_t loopCycles = ESP.getCycleCount();
+        _profiler.begin();
+    #endif
+    #ifndef ESP8266
+        reportWiFiEvents();
+    #endif
+
+    //-- Until the services are up only the async state machine runs
+    if (_state != SERVICES_UP)
+    {
+        handleState();
+        NETWORKING_PROFILE_MARK(PROFILE_STATE);
+        handleCommands(false);
+        NETWORKING_PROFILE_MARK(PROFILE_COMMANDS);
+        _multiStream->drain();
+        NETWORKING_PROFILE_MARK(PROFILE_DRAIN);
+        #ifdef NETWORKING_PROFILE_LOOP
+            _profiler.recordCycles(PROFILE_LOOP, ESP.getCycleCount() - loopCycles);
+        #endif
+        _metrics.record(METRIC_LOOP_US, micros() - loopStart);
+        return;
+    }
+
+    //-- Fall back to a full scan if a fast reconnect stalls, remember a new lease
+    checkFastConnect();
+    if (_wifiCacheDirty && isConnected())
+    {
+        _fastAttempt = false;
+        saveWiFiCache();
+
+        //-- The multicast membership belongs to the interface address
+        if (_multicastOTA)
+        {
+            _multicastOTA->begin(_hostname);
+        }
+    }
+
+    //-- Scheduled (backoff) reconnects after a lost connection
+    handleReconnect();
+
+    //-- Finish a non-blocking manual reconnect
+    if (_manualReconnect)
+    {
+        if (isConnected())
+        {
+            char ip[16];
+            _multiStream->println("Networking:: WiFi reconnected successfully!");
+            _multiStream->printf("Networking:: New IP: %s\n", getIPAddressString(ip, sizeof(ip)));
+            _manualReconnect = false;
+            _isReconnecting = false;
+        }
+        else if (millis() - _lastReconnectAttempt >= WIFI_CONNECT_TIMEOUT)
+        {
+            _multiStream->println("Networking:: WiFi reconnection failed.");
+            _manualReconnect = false;
+            _isReconnecting = false;
+        }
+    }
+    NETWORKING_PROFILE_MARK(PROFILE_WIFI);
+
+    //-- OTA, MDNS and telnet (not started in a burst wake)
+    if (_servicesEnabled)
+    {
+        handleServices();
+    }
+    else
+    {
+        handleCommands(false);
+        NETWORKING_PROFILE_MARK(PROFILE_COMMANDS);
+    }
+
+    //-- A running pull-mode update gets every loop()
+    if (_pullOTA && _pullOTA->isActive())
+    {
+        _pullOTA->handle();
+    }
+
+    #ifndef NETWORKING_NO_NTP
+    //-- SNTP polls at _ntpSyncInterval itself, restart it when it missed two polls
+    ntpHandleSample();
+    if (_posixString && (millis() - _lastNtpSync >= 2 * _ntpSyncInterval))
+    {
+        ntpConfigure();
+        _lastNtpSync = millis();
+    }
+    #endif
+
+    //-- RSSI history for the "stats" command
+    if (millis() - _lastRssiSample >= RSSI_SAMPLE_INTERVAL)
+    {
+        sampleRssi();
+    }
+    NETWORKING_PROFILE_MARK(PROFILE_NTP);
+
+    //-- Send buffered output (no-op unless ring buffer mode is enabled)
+    _multiStream->drain();
+    NETWORKING_PROFILE_MARK(PROFILE_DRAIN);
+    #ifdef NETWORKING_PROFILE_LOOP
+        _profiler.recordCycles(PROFILE_LOOP, ESP.getCycleCount() - loopCycles);
+    #endif
+    _metrics.record(METRIC_LOOP_US, micros() - loopStart);
+
+} //  Networking::loop()
+
+#ifndef ESP8266
+/**
+ * Moves loop() into its own FreeRTOS task pinned to a core (ESP32 only),
+ * so OTA, telnet, the reconnect scheduler and NTP no longer run between
+ * the sketch's realtime work. Call after begin()/beginAsync(); loop() calls
+ * from the sketch return immediately from then on. MultiStream switches to
+ * multi-producer mode: any task may print, the networking task sends.
+ * Callbacks (doAtXxx, commands) run in the networking task.
+ * 
+ * @param core The core to pin the task to (default 0, loopTask runs on 1)
+ * @param priority FreeRTOS priority (default 1, like loopTask)
+ * @param stackSize Stack size in bytes
+ * @return False if not begun, already running or the task can't be created
+ */
+bool Networking::runInTask(BaseType_t core, UBaseType_t priority, uint32_t stackSize)
+{
+    if (!_multiStream || _task)
+    {
+        return false;
+    }
+    _multiStream->setMultiProducer(true);
+    if (xTaskCreatePinnedToCore(taskLoop, "networking", stackSize, this, priority, &_task, core) != pdPASS)
+    {
+        _task = nullptr;
+        _multiStream->println("Networking:: Failed to create the networking task");
+        return false;
+    }
+    _multiStream->printf("Networking:: Running in a task on core %d\n", (int)core);
+    return true;
+}
+
+/**
+ * Body of the networking task: loop(), then give the core away for a tick
+ * so the idle task (and its watchdog) get their turn.
+ * 
+ * @param parameter The Networking instance
+ */
+void Networking::taskLoop(void* parameter)
+{
+    Networking* network = static_cast<Networking*>(parameter);
+    for (;;)
+    {
+        network->loop();
+        vTaskDelay(1);
+    }
+}
+#endif
+
+/**
+ * Handles OTA, MDNS and telnet connections, called from loop().
+ */
+void Networking::handleServices()
+{
+    //-- Fast path, most loops have nothing due
+    uint32_t now = millis();
+    if ((int32_t)(now - _nextPollDue) < 0)
+    {
+        return;
+    }
+
+    //-- Handle OTA
+    if (pollDue(POLL_OTA, now))
+    {
+        #ifndef NETWORKING_NO_OTA
+        ArduinoOTA.handle();
+        #endif
+        if (_multicastOTA)
+        {
+            _multicastOTA->handle();
+        }
+        NETWORKING_PROFILE_MARK(PROFILE_OTA);
+    }
+    
+    //-- Handle MDNS (the ESP32 responder runs in its own task)
+    #ifndef NETWORKING_NO_MDNS
+    if (pollDue(POLL_MDNS, now))
+    {
+        #ifdef ESP8266
+            MDNS.update();
+        #endif
+        _mdns.handle();
+        NETWORKING_PROFILE_MARK(PROFILE_MDNS);
+    }
+    #endif
+
+    if (pollDue(POLL_TELNET, now))
+    {
+        #ifndef NETWORKING_NO_TELNET
+        //-- Handle incoming telnet connections
+        if (_telnetServer->hasClient()) 
+        {
+            WiFiClient newClient = _telnetServer->available();
+
+            //-- Give the new client a free slot, existing sessions stay connected
+            if (_multiStream->addClient(newClient) >= 0) 
+            {
+                newClient.printf("Welcome to [%s] Telnet Server!\r\n", _hostname);
+                if (_bootLog && _bootLog->hasPrevious())
+                {
+                    newClient.printf("Last reset: %s, 'bootlog' shows the output before it\r\n", _bootLog->getResetReason());
+                }
+                boostPoll(POLL_TELNET);
+            }
+            else
+            {
+                newClient.println("Networking:: All telnet sessions in use, try again later.");
+                newClient.stop();
+            }
+        }
+        #endif
+
+        //-- Handle disconnections
+        _multiStream->pruneClients();
+
+        //-- HTTP status requests (the async web server answers on its own)
+        #ifndef USE_ASYNC_WIFIMANAGER
+        if (_httpStatus)
+        {
+            _httpStatus->handle();
+            if (_httpStatus->isBusy())
+            {
+                boostPoll(POLL_TELNET);
+            }
+        }
+        #endif
+        NETWORKING_PROFILE_MARK(PROFILE_TELNET);
+
+        //-- Commands typed in a telnet session
+        handleCommands(true);
+        NETWORKING_PROFILE_MARK(PROFILE_COMMANDS);
+    }
+
+    //-- Send queued binary log records
+    if (pollDue(POLL_BINLOG, now) && _binaryLog)
+    {
+        _binaryLog->handle();
+        NETWORKING_PROFILE_MARK(PROFILE_BINLOG);
+    }
+
+    updateNextPoll(now);
+
+} //  Networking::handleServices()
+
+/**
+ * Checks whether a service is due and, if so, schedules its next poll.
+ * 
+ * @param service The service
+ * @param now The current millis()
+ * @return True if the service should be polled now
+ */
+bool Networking::pollDue(PollService service, uint32_t now)
+{
+    ServicePoll& poll = _polls[service];
+    if ((int32_t)(now - poll.next) < 0)
+    {
+        return false;
+    }
+    if (poll.boosted && (int32_t)(now - poll.boostUntil) >= 0)
+    {
+        poll.boosted = false;
+    }
+    poll.next = now + (poll.boosted ? 0 : poll.interval);
+    return true;
+}
+
+/**
+ * Recomputes when the first service is due again.
+ * 
+ * @param now The current millis()
+ */
+void Networking::updateNextPoll(uint32_t now)
+{
+    uint32_t earliest = 0xFFFFFFFF;
+    for (uint8_t i = 0; i < POLL_COUNT; i++)
+    {
+        uint32_t wait = ((int32_t)(_polls[i].next - now) > 0) ? _polls[i].next - now : 0;
+        if (wait < earliest)
+        {
+            earliest = wait;
+        }
+    }
+    _nextPollDue = now + earliest;
+}
+
+/**
+ * Sets how often loop() polls a service. Longer intervals save CPU time in
+ * sketches that loop fast; polling is never skipped for longer than this.
+ * 
+ * @param service POLL_OTA, POLL_MDNS, POLL_TELNET or POLL_BINLOG
+ * @param intervalMs Milliseconds between polls, 0 polls on every loop()
+ */
+void Networking::setPollInterval(PollService service, uint16_t intervalMs)
+{
+    if (service >= POLL_COUNT)
+    {
+        return;
+    }
+    _polls[service].interval = intervalMs;
+    _polls[service].next     = millis();
+    _nextPollDue             = _polls[service].next;
+}
+
+/**
+ * Returns the poll interval of a service.
+ * 
+ * @param service The service
+ * @return Milliseconds between polls
+ */
+uint16_t Networking::getPollInterval(PollService service) const
+{
+    return (service < POLL_COUNT) ? _polls[service].interval : 0;
+}
+
+/**
+ * Polls a service on every loop() for a while, e.g. during an OTA session
+ * or while someone types in a telnet session. Done automatically for OTA
+ * (until the update ends) and for telnet (after input).
+ * 
+ * @param service The service
+ * @param durationMs How long, 0 ends a boost
+ */
+void Networking::boostPoll(PollService service, uint32_t durationMs)
+{
+    if (service >= POLL_COUNT)
+    {
+        return;
+    }
+    uint32_t now = millis();
+    _polls[service].boostUntil = now + durationMs;
+    _polls[service].boosted    = durationMs > 0;
+    if (durationMs > 0)
+    {
+        _polls[service].next = now;
+        _nextPollDue         = now;
+    }
+}
+
+/**
+ * Enables the binary log channel: log() records are also sent, compact and
+ * with interned format strings, to a collector on this TCP port.
+ * Call before or after begin(); the server starts with the other services.
+ * 
+ * @param port The TCP port (default NETWORKING_BINLOG_PORT, 24)
+ */
+void Networking::enableBinaryLog(uint16_t port)
+{
+    if (_binaryLog)
+    {
+        return;
+    }
+    _binaryLog = new BinaryLog(port);
+    updateLogMaxLevel();
+    if (_servicesEnabled)
+    {
+        _binaryLog->begin();
+    }
+}
+
+/**
+ * Sends the log output also as UDP datagrams, fire and forget: RFC 5424
+ * syslog messages or raw datagrams packed with lines. The sink gets what
+ * the telnet clients get (the same buffer, setTelnetLogLevel() filters
+ * both). Call before or after begin().
+ * 
+ * @param host The collector
+ * @param port Its UDP port (default NETWORKING_UDPLOG_PORT, 514)
+ * @param format UdpLog::SYSLOG or UdpLog::RAW
+ */
+void Networking::enableUdpLog(const IPAddress& host, uint16_t port, UdpLog::Format format)
+{
+    disableUdpLog();
+    _udpLog = new UdpLog(host, port, format);
+    if (_multiStream)
+    {
+        _udpLog->setHostname(_hostname);
+        _multiStream->setUdpLog(_udpLog);
+    }
+}
+
+/**
+ * Enables the boot log: all output is mirrored into RTC memory (the last
+ * BOOTLOG_SIZE bytes), so after a crash, watchdog or ESP.restart() the
+ * lines before it can be read with the "bootlog" telnet command, together
+ * with the reset reason. Call before begin() to keep the boot messages.
+ */
+void Networking::enableBootLog()
+{
+    if (_bootLog)
+    {
+        return;
+    }
+    _bootLog = new BootLog();
+    if (_multiStream)
+    {
+        startBootLog();
+    }
+}
+
+/**
+ * Takes over the previous boot's log and starts mirroring the output.
+ */
+void Networking::startBootLog()
+{
+    _bootLog->begin();
+    _multiStream->setBootLog(_bootLog);
+    if (_bootLog->hasPrevious())
+    {
+        _multiStream->printf("Networking:: Last reset: %s, 'bootlog' shows the output before it\n", _bootLog->getResetReason());
+    }
+}
+
+/**
+ * Stops sending log output over UDP.
+ */
+void Networking::disableUdpLog()
+{
+    if (!_udpLog)
+    {
+        return;
+    }
+    if (_multiStream)
+    {
+        _multiStream->setUdpLog(nullptr);
+    }
+    delete _udpLog;
+    _udpLog = nullptr;
+}
+
+/**
+ * Logs a message with a level and tag. The text ("[I][tag] message") goes
+ * to the sinks whose threshold allows the level, formatted on the stack in
+ * one write; a connected binary log collector gets the message as a record
+ * with the raw arguments. A newline is added.
+ * Disabled messages return before anything is formatted.
+ * 
+ * @param level The log level
+ * @param tag Short tag (a string literal), e.g. "wifi"
+ * @param format printf() style format string (a string literal)
+ */
+void Networking::log(LogLevel level, const char* tag, const char* format, ...)
+{
+    static const char LEVEL_CHARS[] = "-EWIDV";
+
+    if (!isLogEnabled(level) || level > getLogLevel(tag))
+    {
+        return;
+    }
+    uint8_t sinks = 0;
+    if (level <= _serialLogLevel)
+    {
+        sinks |= MultiStream::SINK_SERIAL;
+    }
+    if (level <= _telnetLogLevel)
+    {
+        sinks |= MultiStream::SINK_TELNET;
+    }
+
+    va_list args;
+    if (_binaryLog && level <= _binaryLogLevel)
+    {
+        va_start(args, format);
+        _binaryLog->log(level, tag, format, args);
+        va_end(args);
+    }
+
+    if (!_multiStream || sinks == 0)
+    {
+        return;
+    }
+    char line[MULTISTREAM_PRINTF_SIZE];
+    int  length = snprintf(line, sizeof(line), "[%c][%s] ", LEVEL_CHARS[level <= LEVEL_VERBOSE ? level : 0], tag ? tag : "");
+    //-- A long tag is truncated, keep room for the newline
+    if (length < 0 || (size_t)length > sizeof(line) - 2)
+    {
+        length = (length < 0) ? 0 : sizeof(line) - 2;
+    }
+    va_start(args, format);
+    int  text = vsnprintf(line + length, sizeof(line) - length - 1, format, args);
+    va_end(args);
+    if (text > 0)
+    {
+        length += ((size_t)text < sizeof(line) - length - 1) ? text : sizeof(line) - length - 2;
+    }
+    line[length++] = '\n';
+    _multiStream->writeTo(sinks, (const uint8_t*)line, length);
+
+} //  Networking::log()
+
+/**
+ * Recalculates the highest level any message can have to be shown.
+ */
+void Networking::updateLogMaxLevel()
+{
+    LogLevel tagMax = _logLevel;
+    for (uint8_t i = 0; i < _logTagCount; i++)
+    {
+        if (_logTags[i].level > tagMax)
+        {
+            tagMax = _logTags[i].level;
+        }
+    }
+    LogLevel sinkMax = (_serialLogLevel > _telnetLogLevel) ? _serialLogLevel : _telnetLogLevel;
+    if (_binaryLog && _binaryLogLevel > sinkMax)
+    {
+        sinkMax = _binaryLogLevel;
+    }
+    _logMaxLevel = (tagMax < sinkMax) ? tagMax : sinkMax;
+}
+
+/**
+ * Sets the log level of all tags that have no level of their own.
+ * 
+ * @param level Messages above this level are not logged
+ */
+void Networking::setLogLevel(LogLevel level)
+{
+    _logLevel = level;
+    updateLogMaxLevel();
+}
+
+/**
+ * Sets the log level of one tag, e.g. verbose for "wifi" only.
+ * 
+ * @param tag The tag (copied, up to 11 characters)
+ * @param level Messages of this tag above this level are not logged
+ * @return False if NETWORKING_LOG_TAGS tags have a level already
+ */
+bool Networking::setLogLevel(const char* tag, LogLevel level)
+{
+    uint8_t i = 0;
+    while (i < _logTagCount && strcmp(_logTags[i].tag, tag) != 0)
+    {
+        i++;
+    }
+    if (i == _logTagCount)
+    {
+        if (_logTagCount >= NETWORKING_LOG_TAGS)
+        {
+            return false;
+        }
+        strncpy(_logTags[i].tag, tag, sizeof(_logTags[i].tag) - 1);
+        _logTags[i].tag[sizeof(_logTags[i].tag) - 1] = 0;
+        _logTagCount++;
+    }
+    _logTags[i].level = level;
+    updateLogMaxLevel();
+    return true;
+}
+
+/**
+ * Gets the log level that applies to a tag.
+ * 
+ * @param tag The tag, nullptr for the default level
+ * @return The tag's own level, or the default level
+ */
+Networking::LogLevel Networking::getLogLevel(const char* tag) const
+{
+    if (tag)
+    {
+        for (uint8_t i = 0; i < _logTagCount; i++)
+        {
+            if (strcmp(_logTags[i].tag, tag) == 0)
+            {
+                return _logTags[i].level;
+            }
+        }
+    }
+    return _logLevel;
+}
+
+/**
+ * Sets the highest level shown on Serial.
+ * 
+ * @param level The threshold
+ */
+void Networking::setSerialLogLevel(LogLevel level)
+{
+    _serialLogLevel = level;
+    updateLogMaxLevel();
+}
+
+/**
+ * Sets the highest level shown on Telnet.
+ * 
+ * @param level The threshold
+ */
+void Networking::setTelnetLogLevel(LogLevel level)
+{
+    _telnetLogLevel = level;
+    updateLogMaxLevel();
+}
+
+/**
+ * Sets the highest level sent to the binary log collector.
+ * 
+ * @param level The threshold
+ */
+void Networking::setBinaryLogLevel(LogLevel level)
+{
+    _binaryLogLevel = level;
+    updateLogMaxLevel();
+}
+
+/**
+ * Gets the name of a log level.
+ * 
+ * @param level The level
+ * @return "none", "error", "warn", "info", "debug" or "verbose"
+ */
+const char* Networking::getLogLevelName(LogLevel level)
+{
+    static const char* const NAMES[] = { "none", "error", "warn", "info", "debug", "verbose" };
+    return (level <= LEVEL_VERBOSE) ? NAMES[level] : "unknown";
+}
+
+/**
+ * Parses a log level name or number (0..5).
+ * 
+ * @param name The text
+ * @param level Receives the level
+ * @return False if the text is not a level
+ */
+bool Networking::parseLogLevel(const char* name, LogLevel& level)
+{
+    if (name[0] >= '0' && name[0] <= '5' && name[1] == 0)
+    {
+        level = (LogLevel)(name[0] - '0');
+        return true;
+    }
+    for (uint8_t i = LEVEL_NONE; i <= LEVEL_VERBOSE; i++)
+    {
+        if (strcmp(name, getLogLevelName((LogLevel)i)) == 0)
+        {
+            level = (LogLevel)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Registers the built-in metrics, in MetricId order.
+ */
+void Networking::setupMetrics()
+{
+    _metrics.addCounter("serial_bytes");
+    _metrics.addCounter("telnet_bytes");
+    _metrics.addCounter("overflow_bytes");
+    _metrics.addCounter("dropped_bytes");
+    _metrics.addHistogram("flush_us");
+    _metrics.addHistogram("loop_us");
+    _metrics.addCounter("wifi_lost");
+    _metrics.addCounter("reconnects");
+    _metrics.addHistogram("reconnect_ms");
+    _metrics.addGauge("rssi");
+    _metrics.addGauge("ntp_offset_us");
+    _metrics.addCounter("ntp_syncs");
+    _metrics.addGauge("free_heap");
+    _metrics.addGauge("uptime_s");
+    _metrics.addGauge("ota_bytes_per_s");
+}
+
+/**
+ * Copies the values kept elsewhere (MultiStream counters, heap) into the
+ * registry, just before it is printed.
+ */
+void Networking::updateMetrics()
+{
+    if (_multiStream)
+    {
+        _metrics.set(METRIC_SERIAL_BYTES, _multiStream->getSerialBytes());
+        _metrics.set(METRIC_TELNET_BYTES, _multiStream->getTelnetBytes());
+        _metrics.set(METRIC_OVERFLOW_BYTES, _multiStream->getOverflowBytes());
+        _metrics.set(METRIC_DROPPED_BYTES, _multiStream->getDroppedBytes());
+    }
+    _metrics.set(METRIC_FREE_HEAP, ESP.getFreeHeap());
+    _metrics.set(METRIC_UPTIME_S, millis() / 1000);
+}
+
+/**
+ * Adds the current RSSI to the history, called every RSSI_SAMPLE_INTERVAL.
+ */
+void Networking::sampleRssi()
+{
+    _lastRssiSample = millis();
+    if (!isConnected())
+    {
+        return;
+    }
+    int8_t rssi = WiFi.RSSI();
+    _metrics.set(METRIC_RSSI, rssi);
+    _rssiHistory[_rssiNext] = rssi;
+    _rssiNext = (_rssiNext + 1) % NETWORKING_RSSI_HISTORY;
+    if (_rssiCount < NETWORKING_RSSI_HISTORY)
+    {
+        _rssiCount++;
+    }
+}
+
+/**
+ * Prints all metrics.
+ * 
+ * @param out Where the metrics go
+ * @param compact True for the single line "name=value ..." pull format
+ */
+void Networking::printStats(Print& out, bool compact)
+{
+    updateMetrics();
+    if (compact)
+    {
+        _metrics.printCompact(out);
+        return;
+    }
+    _metrics.print(out);
+
+    //-- Oldest RSSI sample first
+    char sample[8];
+    out.print("rssi history    ");
+    for (uint8_t i = 0; i < _rssiCount; i++)
+    {
+        uint8_t index = (_rssiNext + NETWORKING_RSSI_HISTORY - _rssiCount + i) % NETWORKING_RSSI_HISTORY;
+        snprintf(sample, sizeof(sample), " %d", _rssiHistory[index]);
+        out.print(sample);
+    }
+    out.print("\r\n");
+}
+
+/**
+ * Enables the HTTP status endpoint: GET /metrics gives the metrics in the
+ * Prometheus text format, GET /log/tail?bytes=N the last log output,
+ * read from the ring buffer (setRingBufferMode()). With
+ * USE_ASYNC_WIFIMANAGER the routes go on the portal's web server (port
+ * 80, the port argument is not used); there /log/tail needs
+ * multi-producer mode on ESP32, as the answer is read in the async_tcp
+ * task. Call before or after begin(); it starts with the other services.
+ * 
+ * @param port The TCP port (default HTTP_STATUS_PORT, 80)
+ */
+void Networking::enableHttpStatus(uint16_t port)
+{
+    if (_httpStatus)
+    {
+        return;
+    }
+    _httpStatus = new HttpStatus(&_metrics, port);
+    _httpStatus->onScrape([this]() { updateMetrics(); });
+    if (_servicesEnabled)
+    {
+        startHttpStatus();
+    }
+}
+
+/**
+ * Starts the HTTP status endpoint, on the portal's web server if there is
+ * one (created here when the portal never ran).
+ */
+void Networking::startHttpStatus()
+{
+    #ifdef USE_ASYNC_WIFIMANAGER
+    if (!_webServer)
+    {
+        _webServer = new AsyncWebServer(80);
+    }
+    _httpStatus->begin(_multiStream, _webServer);
+    _webServer->begin();
+    #else
+    _httpStatus->begin(_multiStream);
+    #endif
+    _multiStream->println("Networking:: HTTP status server started (/metrics, /log/tail)");
+}
+
+/**
+ * The "stats" command:
+ *   stats           all metrics, histograms with percentiles
+ *   stats compact   one line for a collector
+ *   stats reset     clear the counters and histograms
+ * 
+ * @param args The arguments
+ * @param out Where the reply goes
+ */
+void Networking::commandStats(char* args, Print& out)
+{
+    if (strcmp(args, "reset") == 0)
+    {
+        _metrics.reset();
+        if (_multiStream)
+        {
+            _multiStream->resetCounters();
+        }
+        out.print("Statistics cleared\r\n");
+        return;
+    }
+    printStats(out, strcmp(args, "compact") == 0);
+}
+
+#ifdef NETWORKING_PROFILE_LOOP
+/**
+ * Adds the stages of loop() to the profiler, in ProfileStage order.
+ */
+void Networking::setupProfiler()
+{
+    _profiler.addStage("state");
+    _profiler.addStage("wifi");
+    _profiler.addStage("ota");
+    _profiler.addStage("mdns");
+    _profiler.addStage("telnet");
+    _profiler.addStage("commands");
+    _profiler.addStage("binlog");
+    _profiler.addStage("ntp");
+    _profiler.addStage("drain");
+    _profiler.addStage("loop");
+}
+#endif
+
+/**
+ * Prints the cycles spent per loop() stage (min/avg/p99/max).
+ * Needs -DNETWORKING_PROFILE_LOOP, without it only a hint is printed.
+ * 
+ * @param out Where the table goes, e.g. the MultiStream
+ */
+void Networking::printProfile(Print& out)
+{
+    #ifdef NETWORKING_PROFILE_LOOP
+        _profiler.print(out);
+    #else
+        out.print("Networking:: Loop profiler not compiled in (-DNETWORKING_PROFILE_LOOP)\r\n");
+    #endif
+}
+
+/**
+ * Clears the loop() profile.
+ */
+void Networking::resetProfile()
+{
+    #ifdef NETWORKING_PROFILE_LOOP
+        _profiler.reset();
+    #endif
+}
+
+/**
+ * Registers the built-in commands of the shell.
+ */
+void Networking::setupCommands()
+{
+    _shell.addCommand("log", "log [<tag>|serial|telnet|binary] [none|error|warn|info|debug|verbose]"
+                    , [this](char* args, Print& out) { commandLog(args, out); });
+    #ifdef NETWORKING_PROFILE_LOOP
+        _shell.addCommand("profile", "profile [reset]"
+                        , [this](char* args, Print& out)
+                        {
+                            if (strcmp(args, "reset") == 0)
+                            {
+                                resetProfile();
+                                out.print("Profile cleared\r\n");
+                                return;
+                            }
+                            printProfile(out);
+                        });
+    #endif
+    _shell.addCommand("update", "update <url> [sha256] | update cancel"
+                    , [this](char* args, Print& out)
+                    {
+                        if (strcmp(args, "cancel") == 0)
+                        {
+                            cancelPullOTA();
+                            if (_multicastOTA)
+                            {
+                                _multicastOTA->cancel();
+                            }
+                            return;
+                        }
+                        char* sha256 = strchr(args, ' ');
+                        if (sha256)
+                        {
+                            *sha256++ = 0;
+                        }
+                        if (!startPullOTA(args, sha256))
+                        {
+                            out.print("Usage: update <http(s)://host/firmware.bin> [sha256]\r\n");
+                        }
+                    });
+    #ifndef NETWORKING_NO_MDNS
+    _shell.addCommand("peers", "devices found by browseMDNS()"
+                    , [this](char*, Print& out) { _mdns.printPeers(out); });
+    #endif
+    _shell.addCommand("bootlog", "bootlog [clear]"
+                    , [this](char* args, Print& out)
+                    {
+                        if (!_bootLog)
+                        {
+                            out.print("Boot log not enabled, see enableBootLog()\r\n");
+                        }
+                        else if (strcmp(args, "clear") == 0)
+                        {
+                            _bootLog->clearPrevious();
+                        }
+                        else
+                        {
+                            _bootLog->printPrevious(out);
+                        }
+                    });
+    _shell.addCommand("stats", "stats [compact|reset]"
+                    , [this](char* args, Print& out) { commandStats(args, out); });
+    _shell.addCommand("status", "state, IP, RSSI, channel, free heap and uptime"
+                    , [this](char*, Print& out)
+    {
+        char status[96];
+        getStatusString(status, sizeof(status));
+        out.print(status);
+        out.print("\r\n");
+    });
+    _shell.addCommand("reconnect", "reconnect WiFi (drops the telnet sessions)"
+                    , [this](char*, Print&) { reconnectWiFi(); });
+    _shell.addCommand("restart", "restart the device"
+                    , [](char*, Print& out)
+    {
+        out.print("Restarting...\r\n");
+        delay(100);
+        ESP.restart();
+    });
+}
+
+/**
+ * Feeds the input of the telnet sessions and (if enabled) the serial port
+ * to the command shell. Only what is available is read, nothing waits.
+ * 
+ * @param telnet Also read the telnet sessions (services are up)
+ */
+void Networking::handleCommands(bool telnet)
+{
+    if (telnet)
+    {
+        for (uint8_t i = 0; i < MULTISTREAM_MAX_CLIENTS; i++)
+        {
+            WiFiClient* client = _multiStream->getClient(i);
+            if (client)
+            {
+                if (client->available() > 0)
+                {
+                    boostPoll(POLL_TELNET);
+                    _shell.process(i, *client, *client);
+                }
+            }
+            else
+            {
+                _shell.reset(i);
+            }
+        }
+    }
+    if (_serialCommands)
+    {
+        _shell.process(SERIAL_SOURCE, *_serial, *_serial);
+    }
+}
+
+#ifndef NETWORKING_NO_MDNS
+/**
+ * Advertises a service next to telnet and arduino, e.g.
+ * addMDNSService("http", "tcp", 80). Names are not copied, pass literals.
+ * Can be called before or after begin().
+ * 
+ * @param service Service type without the underscore
+ * @param proto "tcp" or "udp"
+ * @param port The port of the service
+ * @return False if MDNS_MAX_SERVICES services are registered already
+ */
+bool Networking::addMDNSService(const char* service, const char* proto, uint16_t port)
+{
+    return _mdns.addService(service, proto, port);
+}
+
+/**
+ * Sets a TXT record of an advertised service, e.g. the firmware version
+ * or a metrics port. Cheap to call from loop(): nothing is sent unless
+ * the value changed, and changes go out together at most every
+ * MDNS_ANNOUNCE_MS. The key is not copied, the value is.
+ * 
+ * @param service Service type, also "telnet" or "arduino"
+ * @param proto "tcp" or "udp"
+ * @param key The key
+ * @param value The value (at most MDNS_TXT_VALUE_SIZE - 1 characters)
+ * @return False if MDNS_MAX_TXT records are set already
+ */
+bool Networking::setMDNSTxt(const char* service, const char* proto, const char* key, const char* value)
+{
+    return _mdns.setTxt(service, proto, key, value);
+}
+
+/**
+ * Sets a numeric TXT record, see setMDNSTxt().
+ * 
+ * @param service Service type
+ * @param proto "tcp" or "udp"
+ * @param key The key
+ * @param value The value
+ * @return False if MDNS_MAX_TXT records are set already
+ */
+bool Networking::setMDNSTxt(const char* service, const char* proto, const char* key, int32_t value)
+{
+    return _mdns.setTxt(service, proto, key, value);
+}
+
+/**
+ * Looks for other devices with a service in the background, with a non
+ * blocking query every intervalMs. Read the results with
+ * getMDNS().getPeer() or the "peers" command; a peer that stops
+ * answering is dropped after three queries.
+ * 
+ * @param service Service type, e.g. "telnet"
+ * @param proto "tcp" or "udp"
+ * @param intervalMs Time between queries (default MDNS_BROWSE_MS, a minute)
+ * @return False if MDNS_MAX_BROWSE service types are browsed already
+ */
+bool Networking::browseMDNS(const char* service, const char* proto, uint32_t intervalMs)
+{
+    return _mdns.browse(service, proto, intervalMs);
+}
+#endif
+
+/**
+ * Registers a command for the telnet (and serial) shell. Type "help" in a
+ * session for the list. Names and help texts are not copied, pass literals.
+ * 
+ * @param name The command name
+ * @param help One line of help
+ * @param handler Called with the arguments and the stream to reply on
+ * @return False if SHELL_MAX_COMMANDS commands are registered already
+ */
+bool Networking::addCommand(const char* name, const char* help, CommandShell::Handler handler)
+{
+    return _shell.addCommand(name, help, handler);
+}
+
+/**
+ * Also reads commands from the serial port. Off by default, because the
+ * shell then consumes everything the sketch would read from Serial.
+ * 
+ * @param enable True to read commands from serial
+ */
+void Networking::setSerialCommands(bool enable)
+{
+    _serialCommands = enable;
+    _shell.reset(SERIAL_SOURCE);
+}
+
+/**
+ * The "log" command:
+ *   log                          show the levels
+ *   log <level>                  level of tags without their own level
+ *   log <tag> <level>            level of one tag
+ *   log serial|telnet|binary <level>   threshold of a sink
+ * 
+ * @param args The arguments, modified while parsing
+ * @param out Where the reply goes
+ */
+void Networking::commandLog(char* args, Print& out)
+{
+    char* words[2] = { nullptr, nullptr };
+    uint8_t count = 0;
+    for (char* p = strtok(args, " "); p && count < 2; p = strtok(nullptr, " "))
+    {
+        words[count++] = p;
+    }
+
+    LogLevel level;
+    bool     valid = true;
+    if (count == 1)
+    {
+        valid = parseLogLevel(words[0], level);
+        if (valid)
+        {
+            setLogLevel(level);
+        }
+    }
+    else if (count == 2)
+    {
+        valid = parseLogLevel(words[1], level);
+        if (valid)
+        {
+            if (strcmp(words[0], "serial") == 0)
+            {
+                setSerialLogLevel(level);
+            }
+            else if (strcmp(words[0], "telnet") == 0)
+            {
+                setTelnetLogLevel(level);
+            }
+            else if (strcmp(words[0], "binary") == 0)
+            {
+                setBinaryLogLevel(level);
+            }
+            else
+            {
+                valid = setLogLevel(words[0], level);
+            }
+        }
+    }
+    if (!valid)
+    {
+        out.println("Usage: log [<tag>|serial|telnet|binary] [none|error|warn|info|debug|verbose]");
+        return;
+    }
+
+    char reply[80];
+    snprintf(reply, sizeof(reply), "log level %s, serial %s, telnet %s, binary %s\r\n"
+           , getLogLevelName(_logLevel), getLogLevelName(_serialLogLevel)
+           , getLogLevelName(_telnetLogLevel), getLogLevelName(_binaryLogLevel));
+    out.print(reply);
+    for (uint8_t i = 0; i < _logTagCount; i++)
+    {
+        snprintf(reply, sizeof(reply), "  %s %s\r\n", _logTags[i].tag, getLogLevelName(_logTags[i].level));
+        out.print(reply);
+    }
+}
+
+/**
+ * Sets how a lost WiFi connection is retried.
+ * Attempts are spaced with jittered exponential backoff: the n-th wait is
+ * between half and all of baseDelayMs * 2^n (capped at maxDelayMs), so a
+ * fleet of nodes does not hit a rebooted access point in lockstep.
+ * 
+ * @param maxAttempts Attempts before doAtReconnectFailed() is asked (0 = never give up)
+ * @param baseDelayMs Backoff for the first attempt
+ * @param maxDelayMs Upper limit of the backoff
+ */
+void Networking::setReconnectPolicy(uint16_t maxAttempts, uint32_t baseDelayMs, uint32_t maxDelayMs)
+{
+    _maxReconnectAttempts = maxAttempts;
+    _reconnectBaseDelay   = baseDelayMs ? baseDelayMs : 1;
+    _reconnectMaxDelay    = (maxDelayMs > _reconnectBaseDelay) ? maxDelayMs : _reconnectBaseDelay;
+}
+
+/**
+ * Sets a callback that decides what happens when the maximum number of
+ * reconnect attempts is reached. Without a callback the device restarts.
+ * 
+ * @param callback Function called with the attempts so far and the time
+ *                 without WiFi (ms), returns RECONNECT_RESTART or
+ *                 RECONNECT_KEEP_TRYING (continue at the maximum backoff)
+ */
+void Networking::doAtReconnectFailed(std::function<ReconnectAction(uint16_t, uint32_t)> callback)
+{
+    _onReconnectFailed = callback;
+}
+
+/**
+ * Calculates the jittered exponential backoff for an attempt.
+ * 
+ * @param attempt The number of attempts made so far
+ * @return The time to wait before the next attempt (ms)
+ */
+uint32_t Networking::nextReconnectDelay(uint16_t attempt) const
+{
+    uint32_t delayMs = _reconnectBaseDelay;
+    for (uint16_t i = 0; i < attempt && delayMs < _reconnectMaxDelay; i++)
+    {
+        delayMs *= 2;
+    }
+    if (delayMs > _reconnectMaxDelay)
+    {
+        delayMs = _reconnectMaxDelay;
+    }
+    //-- Half fixed, half random
+    return delayMs / 2 + random(delayMs / 2 + 1);
+}
+
+/**
+ * Reconnect scheduler, called from loop().
+ * Event handlers only flag a lost connection; the attempts are made
+ * here, spaced by nextReconnectDelay(), without ever blocking.
+ */
+void Networking::handleReconnect()
+{
+    if (!_wifiLost && !_reconnectActive)
+    {
+        return;
+    }
+    
+    if (isConnected())
+    {
+        if (_reconnectActive)
+        {
+            _multiStream->printf("Networking:: WiFi back after %lu ms, %u attempt(s)\n"
+                               , millis() - _wifiLostAt, _reconnectAttempts);
+            _metrics.record(METRIC_RECONNECT_MS, millis() - _wifiLostAt);
+        }
+        _wifiLost = false;
+        _reconnectActive = false;
+        _reconnectAttempts = 0;
+        return;
+    }
+    
+    if (_manualReconnect)
+    {
+        return;
+    }
+    
+    //-- First notice of the loss, wait a random first backoff
+    if (!_reconnectActive)
+    {
+        _reconnectActive = true;
+        _reconnectAttempts = 0;
+        _metrics.increment(METRIC_WIFI_LOST);
+        _wifiLostAt = millis();
+        _lastReconnectAttempt = millis();
+        _reconnectDelay = nextReconnectDelay(0);
+        return;
+    }
+    
+    if (millis() - _lastReconnectAttempt < _reconnectDelay)
+    {
+        return;
+    }
+    
+    if (_maxReconnectAttempts > 0 && _reconnectAttempts >= _maxReconnectAttempts)
+    {
+        ReconnectAction action = RECONNECT_RESTART;
+        if (_onReconnectFailed)
+        {
+            action = _onReconnectFailed(_reconnectAttempts, millis() - _wifiLostAt);
+        }
+        if (action == RECONNECT_RESTART)
+        {
+            _multiStream->println("Networking:: Max WiFi reconnect attempts reached! Restarting...");
+            _multiStream->flush();
+            ESP.restart();  // Restart if unable to reconnect
+            return;
+        }
+    }
+    
+    _reconnectAttempts++;
+    _metrics.increment(METRIC_RECONNECT_ATTEMPTS);
+    if (_maxReconnectAttempts > 0)
+    {
+        _multiStream->printf("Networking:: Attempting to reconnect (attempt %u of %u)...\n"
+                           , _reconnectAttempts, _maxReconnectAttempts);
+    }
+    else
+    {
+        _multiStream->printf("Networking:: Attempting to reconnect (attempt %u)...\n", _reconnectAttempts);
+    }
+    
+    //-- On ESP8266 disconnect() would also erase the stored credentials
+    #ifndef ESP8266
+    WiFi.disconnect();
+    #endif
+    connectWiFi();
+    
+    _lastReconnectAttempt = millis();
+    _reconnectDelay = nextReconnectDelay(_reconnectAttempts);
+
+} //  Networking::handleReconnect()
+
+/**
+ * Drops the WiFi connection but keeps the stored credentials, so
+ * connectWiFi() can use them again. On ESP8266 WiFi.disconnect() would
+ * clear the station config (in flash when persistent).
+ */
+void Networking::dropWiFi()
+{
+    #ifdef ESP8266
+    wifi_station_disconnect();
+    #else
+    WiFi.disconnect();
+    #endif
+
+} //  Networking::dropWiFi()
+
+/**
+ * Manually triggers a WiFi reconnection.
+ * This is now primarily used for manual reconnection requests,
+ * as automatic reconnection is handled by event handlers.
+ * After beginAsync() this returns immediately and loop() reports the result.
+ */
+void Networking::reconnectWiFi() 
+{
+    if (!_isReconnecting && _async)
+    {
+        _multiStream->println("Networking:: Manually reconnecting to WiFi...");
+        
+        _isReconnecting = true;
+        _manualReconnect = true;
+        _lastReconnectAttempt = millis();
+        dropWiFi();
+        connectWiFi();
+    }
+    else if (!_isReconnecting)
+    {
+        _multiStream->println("Networking:: Manually reconnecting to WiFi...");
+        
+        _isReconnecting = true;
+        dropWiFi();
+        delay(500);
+        connectWiFi();
+        
+        // Wait for connection
+        int retries = 20; // Try for 10 seconds (20 x 500ms)
+        while (!isConnected() && retries-- > 0) 
+        {
+            delay(500);
+            _multiStream->print(".");
+            checkFastConnect();
+        }
+        
+        if (isConnected()) 
+        {
+            char ip[16];
+            _multiStream->println("\nNetworking:: WiFi reconnected successfully!");
+            _multiStream->printf("Networking:: New IP: %s\n", getIPAddressString(ip, sizeof(ip)));
+            _isReconnecting = false;
+        } 
+        else 
+        {
+            _multiStream->println("\nNetworking:: WiFi reconnection failed.");
+            // The event handlers will continue trying to reconnect
+        }
+    }
+    else
+    {
+        _multiStream->println("Networking:: Reconnection already in progress...");
+    }
+} //  Networking::reconnectWiFi()
+
+
+/**
+ * Get the local IP address of the device.
+ *
+ * @return The local IP address as an IPAddress object.
+ */
+IPAddress Networking::getIPAddress() const 
+{
+    return WiFi.localIP();
+}
+
+/**
+ * Get the local IP address of the device as a string.
+ *
+ * @return The local IP address as a String object.
+ */
+String Networking::getIPAddressString() const 
+{
+    return WiFi.localIP().toString();
+}
+
+/**
+ * Formats an IP address as dotted decimal without a String.
+ *
+ * @param ip The address
+ * @param buffer Destination, 16 bytes fit any address
+ * @param size Size of the buffer
+ * @return The buffer
+ */
+const char* Networking::formatIP(const IPAddress& ip, char* buffer, size_t size)
+{
+    snprintf(buffer, size, "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+    return buffer;
+}
+
+/**
+ * Get the local IP address of the device into a caller provided buffer.
+ * Unlike the String version this never allocates.
+ *
+ * @param buffer Destination, 16 bytes fit any address
+ * @param size Size of the buffer
+ * @return The buffer
+ */
+const char* Networking::getIPAddressString(char* buffer, size_t size) const
+{
+    return formatIP(WiFi.localIP(), buffer, size);
+}
+
+/**
+ * Get a one line status (state, IP, RSSI, channel, free heap and uptime)
+ * into a caller provided buffer, without allocating.
+ *
+ * @param buffer Destination, 96 bytes is plenty
+ * @param size Size of the buffer
+ * @return The buffer
+ */
+const char* Networking::getStatusString(char* buffer, size_t size) const
+{
+    char ip[16];
+    snprintf(buffer, size, "%s ip %s rssi %d ch %d heap %u up %lu s"
+           , getStateName(_state), formatIP(WiFi.localIP(), ip, sizeof(ip))
+           , (int)WiFi.RSSI(), (int)WiFi.channel(), (unsigned)ESP.getFreeHeap(), millis() / 1000);
+    return buffer;
+}
+
+/**
+ * Get the number of heap allocations (malloc, calloc, realloc) since boot.
+ * Counting needs -DNETWORKING_COUNT_ALLOCS and the linker flags
+ * -Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc; without them it returns 0.
+ *
+ * @return The number of allocations
+ */
+uint32_t Networking::getAllocationCount()
+{
+    #ifdef NETWORKING_COUNT_ALLOCS
+    return _allocationCount.load(std::memory_order_relaxed);
+    #else
+    return 0;
+    #endif
+}
+
+/**
+ * Check if the device is connected to a WiFi network.
+ *
+ * @return True if the device is connected to a WiFi network, false otherwise.
+ */
+bool Networking::isConnected() const 
+{
+    return WiFi.status() == WL_CONNECTED;
+}
+
+/**
+ * Checks if the current NTP time is valid.
+ * 
+ * @return True if NTP time is valid, false otherwise
+ */
+bool Networking::ntpIsValid() const
+{
+    return time(nullptr) > 1000000;
+}
+
+#ifndef NETWORKING_NO_NTP
+/**
+ * Initializes NTP time synchronization.
+ * 
+ * @param posixString POSIX timezone string
+ * @param ntpServers Array of NTP server addresses (optional)
+ * @return True if NTP initialization successful, false otherwise
+ */
+bool Networking::ntpStart(const char* posixString, const char** ntpServers)
+{
+    //-- Remember the timezone for the next burst wake
+    strncpy(_rtc.posix, posixString, sizeof(_rtc.posix) - 1);
+    _rtc.posix[sizeof(_rtc.posix) - 1] = 0;
+
+    //-- Keep the whole server list, it is used again for every resync
+    for (uint8_t i = 0; i < NTP_MAX_SERVERS; i++)
+    {
+        _ntpServers[i] = nullptr;
+    }
+    if (ntpServers == nullptr || ntpServers[0] == nullptr)
+    {
+        _ntpServers[0] = "pool.ntp.org";
+        _ntpServers[1] = "time.nist.gov";
+    }
+    else
+    {
+        for (uint8_t i = 0; i < NTP_MAX_SERVERS && ntpServers[i]; i++)
+        {
+            _ntpServers[i] = ntpServers[i];
+        }
+    }
+
+    //-- Clock restored after deep sleep: no need to wait, resync only when due
+    if (_timeRestored)
+    {
+        _posixString = posixString;
+        setenv("TZ", posixString, 1);
+        tzset();
+        if ((uint32_t)time(nullptr) - _rtc.lastNtpSync < NTP_SYNC_INTERVAL / 1000)
+        {
+            _lastNtpSync = millis();
+            return true;
+        }
+    }
+
+    if (!isConnected())
+    {
+        return _timeRestored;
+    }
+
+    _posixString = posixString;
+    
+    ntpConfigure();
+    
+    setenv("TZ", posixString, 1);
+    tzset();
+
+    if (_timeRestored)
+    {
+        _rtc.lastNtpSync = time(nullptr);
+        _lastNtpSync = millis();
+        return true;
+    }
+
+    // Wait up to 5 seconds for time sync
+    int retries = 50;
+    while (time(nullptr) < 1000000 && retries-- > 0)
+    {
+        delay(100);
+    }
+
+    if (time(nullptr) > 1000000)
+    {
+        _lastNtpSync = millis();
+        _rtc.lastNtpSync = time(nullptr);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Gets current epoch time with optional timezone override.
+ * 
+ * @param posixString Optional POSIX timezone string for temporary timezone change
+ * @return Current epoch time
+ */
+time_t Networking::ntpGetEpoch(const char* posixString)
+{
+    //-- The epoch is UTC, the timezone only matters for the local time conversion
+    if (!posixString && !_posixString)
+    {
+        return 0;
+    }
+
+    return time(nullptr);
+}
 
 /**
- * Gets current date in DD-MM-YYYY format.
+ * Passes the timezone and the ntpStart() server list to SNTP, which
+ * (re)starts it and requests the time right away. Also installs the
+ * callback that feeds every NTP update to the microsecond clock.
+ */
+void Networking::ntpConfigure()
+{
+    ntpSetPollInterval(_ntpSyncInterval);
+    #ifdef ESP8266
+        settimeofday_cb([](bool fromSntp)
+        {
+            if (fromSntp && _instance)
+            {
+                struct timeval tv;
+                gettimeofday(&tv, nullptr);
+                _instance->ntpSample((int64_t)tv.tv_sec * 1000000 + tv.tv_usec);
+            }
+        });
+        //-- configTime(0, 0, ...) would set TZ to UTC on every resync
+        configTime(_posixString, _ntpServers[0], _ntpServers[1], _ntpServers[2]);
+    #else
+        sntp_set_time_sync_notification_cb([](struct timeval* tv)
+        {
+            if (_instance)
+            {
+                _instance->ntpSample((int64_t)tv->tv_sec * 1000000 + tv->tv_usec);
+            }
+        });
+        configTzTime(_posixString, _ntpServers[0], _ntpServers[1], _ntpServers[2]);
+    #endif
+
+} //  Networking::ntpConfigure()
+
+/**
+ * Records an NTP update. Called from the SNTP callback, so it only
+ * stores the sample; ntpHandleSample() processes it from loop().
+ * 
+ * @param epochMicros The time SNTP just set, in microseconds since the epoch
+ */
+void Networking::ntpSample(int64_t epochMicros)
+{
+    _ntpSampleLocal = ntpLocalMicros();
+    _ntpSampleEpoch = epochMicros;
+    _ntpSampleReady = true;
+}
+
+/**
+ * Gets the free running 64 bit microsecond timer.
+ * 
+ * @return Microseconds since boot
+ */
+int64_t Networking::ntpLocalMicros()
+{
+    #ifdef ESP8266
+        return (int64_t)micros64();
+    #else
+        return esp_timer_get_time();
+    #endif
+}
+
+/**
+ * Calculates the epoch time at a local timer value: the time at the last
+ * correction, plus the elapsed time corrected for the measured drift, plus
+ * the part of the last offset that has been slewed in so far.
+ * 
+ * @param local Local timer value in microseconds
+ * @return Microseconds since the epoch
+ */
+int64_t Networking::ntpExtrapolate(int64_t local) const
+{
+    int64_t elapsed = local - _ntpClock.baseLocal;
+    int64_t value   = _ntpClock.baseEpoch + elapsed + (elapsed * _ntpClock.driftPpb) / 1000000000LL;
+
+    //-- Slewing at NTP_SLEW_PPM keeps the clock monotonic
+    int64_t slewed = (elapsed * NTP_SLEW_PPM) / 1000000;
+    if (_ntpClock.slew >= 0)
+    {
+        value += (_ntpClock.slew < slewed) ? _ntpClock.slew : slewed;
+    }
+    else
+    {
+        value -= (-_ntpClock.slew < slewed) ? -_ntpClock.slew : slewed;
+    }
+    return value;
+}
+
+/**
+ * Processes an NTP update: measures the offset against the extrapolated
+ * clock, updates the drift estimate and adapts the resync interval.
+ * The clock continues from its own value and slews the offset in, only
+ * offsets above NTP_STEP_THRESHOLD (first sync, clock set) are stepped.
+ */
+void Networking::ntpHandleSample()
+{
+    if (!_ntpSampleReady)
+    {
+        return;
+    }
+    int64_t local = _ntpSampleLocal;
+    int64_t epoch = _ntpSampleEpoch;
+    _ntpSampleReady = false;
+    _lastNtpSync    = millis();
+    _rtc.lastNtpSync = (uint32_t)(epoch / 1000000);
+
+    int64_t predicted = ntpExtrapolate(local);
+    int64_t offset    = epoch - predicted;
+    if (!_ntpClock.valid || offset > NTP_STEP_THRESHOLD || offset < -NTP_STEP_THRESHOLD)
+    {
+        _ntpClock.baseLocal   = local;
+        _ntpClock.baseEpoch   = epoch;
+        _ntpClock.sampleLocal = local;
+        _ntpClock.sampleEpoch = epoch;
+        _ntpClock.slew        = 0;
+        _ntpClock.valid       = true;
+        _ntpSyncInterval      = NTP_SYNC_MIN_INTERVAL;
+        ntpSetPollInterval(_ntpSyncInterval);
+        _multiStream->println("Networking:: NTP clock set");
+        return;
+    }
+
+    //-- Drift from two NTP samples; short intervals are dominated by network jitter
+    int64_t interval = local - _ntpClock.sampleLocal;
+    if (interval >= (int64_t)NTP_SYNC_MIN_INTERVAL * 1000 / 2)
+    {
+        int64_t measured = ((epoch - _ntpClock.sampleEpoch) - interval) * 1000000000LL / interval;
+        if (_ntpClock.driftValid)
+        {
+            _ntpClock.driftPpb += (int32_t)((measured - _ntpClock.driftPpb) / 4);
+        }
+        else
+        {
+            _ntpClock.driftPpb   = (int32_t)measured;
+            _ntpClock.driftValid = true;
+        }
+        _ntpClock.sampleLocal = local;
+        _ntpClock.sampleEpoch = epoch;
+    }
+
+    _metrics.set(METRIC_NTP_OFFSET_US, (int32_t)offset);
+    _metrics.increment(METRIC_NTP_SYNCS);
+
+    //-- Continue from the clock's own value and slew the offset in
+    _ntpClock.baseLocal = local;
+    _ntpClock.baseEpoch = predicted;
+    _ntpClock.slew      = offset;
+
+    //-- Poll less when the clock holds the target accuracy, more when it doesn't
+    int64_t absOffset = (offset < 0) ? -offset : offset;
+    if (absOffset < NTP_TARGET_ACCURACY_US / 2 && _ntpSyncInterval < NTP_SYNC_MAX_INTERVAL)
+    {
+        _ntpSyncInterval = (_ntpSyncInterval * 2 > NTP_SYNC_MAX_INTERVAL) ? NTP_SYNC_MAX_INTERVAL : _ntpSyncInterval * 2;
+    }
+    else if (absOffset > NTP_TARGET_ACCURACY_US && _ntpSyncInterval > NTP_SYNC_MIN_INTERVAL)
+    {
+        _ntpSyncInterval = (_ntpSyncInterval / 2 < NTP_SYNC_MIN_INTERVAL) ? NTP_SYNC_MIN_INTERVAL : _ntpSyncInterval / 2;
+    }
+    ntpSetPollInterval(_ntpSyncInterval);
+    _multiStream->printf("Networking:: NTP offset %ld us, drift %ld ppb, next sync in %lu s\n",
+                        (long)offset, (long)_ntpClock.driftPpb, _ntpSyncInterval / 1000);
+
+} //  Networking::ntpHandleSample()
+
+/**
+ * Gets the current time with microsecond resolution. It is extrapolated
+ * from the local timer and disciplined by the NTP updates, so it never
+ * jumps back between syncs. Falls back to the system clock until the
+ * first NTP update arrived.
+ * 
+ * @return Microseconds since the epoch (UTC)
+ */
+int64_t Networking::ntpGetEpochMicros()
+{
+    if (!_ntpClock.valid)
+    {
+        struct timeval tv;
+        gettimeofday(&tv, nullptr);
+        return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+    }
+    return ntpExtrapolate(ntpLocalMicros());
+}
+
+/**
+ * Gets the measured frequency error of the local timer.
+ * 
+ * @return Drift in parts per billion (positive: the local timer runs slow)
+ */
+int32_t Networking::ntpGetDrift() const
+{
+    return _ntpClock.driftPpb;
+}
+
+/**
+ * Gets the current NTP resync interval; it doubles while the clock holds
+ * NTP_TARGET_ACCURACY_US and halves when it doesn't.
+ * 
+ * @return Interval in milliseconds
+ */
+unsigned long Networking::ntpGetSyncInterval() const
+{
+    return _ntpSyncInterval;
+}
+
+//-- The timezone cache is shared by all tasks; ESP8266 has only one
+#ifdef ESP8266
+  #define TZ_CACHE_LOCK()
+  #define TZ_CACHE_UNLOCK()
+#else
+  #define TZ_CACHE_LOCK()   portENTER_CRITICAL(&_tzLock)
+  #define TZ_CACHE_UNLOCK() portEXIT_CRITICAL(&_tzLock)
+#endif
+
+/**
+ * Finds the parsed timezone for a POSIX string, parsing it only the
+ * first time it is seen. Up to NTP_TZ_CACHE_SIZE zones are kept.
+ * Call it between TZ_CACHE_LOCK() and TZ_CACHE_UNLOCK(), the returned
+ * zone can be replaced as soon as the lock is released.
+ * 
+ * @param posixString POSIX timezone string
+ * @return The parsed timezone
+ */
+PosixTimeZone* Networking::ntpFindTimeZone(const char* posixString)
+{
+    for (uint8_t i = 0; i < NTP_TZ_CACHE_SIZE; i++)
+    {
+        if (_tzCache[i].zone.isValid() && strcmp(_tzCache[i].posix, posixString) == 0)
+        {
+            return &_tzCache[i].zone;
+        }
+    }
+    
+    //-- Strings that don't fit the cache entry are parsed every time
+    if (strlen(posixString) >= sizeof(_tzCache[0].posix))
+    {
+        _tzScratch.parse(posixString);
+        return &_tzScratch;
+    }
+    
+    //-- Replace the oldest entry
+    TzCacheEntry& entry = _tzCache[_tzCacheNext];
+    _tzCacheNext = (_tzCacheNext + 1) % NTP_TZ_CACHE_SIZE;
+    strcpy(entry.posix, posixString);
+    entry.zone.parse(posixString);
+    return &entry.zone;
+}
+
+/**
+ * Converts an epoch time to local time using the timezone cache.
+ * Unlike localtime() this never changes the TZ environment variable.
+ * 
+ * @param epoch The time to convert
+ * @param posixString POSIX timezone string (nullptr for the ntpStart() timezone)
+ * @param result The structure to fill
+ */
+void Networking::ntpLocalTime(time_t epoch, const char* posixString, struct tm* result)
+{
+    const char* zone = posixString ? posixString : _posixString;
+    if (!zone)
+    {
+        zone = "UTC0";
+    }
+    TZ_CACHE_LOCK();
+    ntpFindTimeZone(zone)->toLocal(epoch, result);
+    TZ_CACHE_UNLOCK();
+}
+
+//-- Precompiled formats for the ntpGet* methods
+static const NtpFormat FORMAT_DATE("%Y-%m-%d");
+static const NtpFormat FORMAT_DATE_DMY("%d-%m-%Y");
+static const NtpFormat FORMAT_TIME("%H:%M:%S");
+static const NtpFormat FORMAT_DATETIME("%Y-%m-%d %H:%M:%S");
+static const NtpFormat FORMAT_DATETIME_DMY("%d-%m-%Y %H:%M:%S");
+
+/**
+ * Formats the current local time into a caller provided buffer.
+ * Reentrant: no static buffers and no localtime().
  * 
+ * @param buffer The buffer to write to
+ * @param size The size of the buffer
+ * @param format A precompiled format
  * @param posixString Optional POSIX timezone string
- * @return Current date string or nullptr if time not available
+ * @return The buffer, or nullptr if time not available
  */
-const char* Networking::ntpGetDateDMY(const char* posixString)
+const char* Networking::ntpFormat(char* buffer, size_t size, const NtpFormat& format, const char* posixString)
 {
-    static char buffer[32];
-    time_t now = ntpGetEpoch(posixString);
-    if (now == 0)
+    if (!buffer || size == 0 || ntpGetEpoch(posixString) == 0)
     {
         return nullptr;
     }
     
-    strftime(buffer, sizeof(buffer), "%d-%m-%Y", localtime(&now));
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+    struct tm timeInfo;
+    ntpLocalTime(now.tv_sec, posixString, &timeInfo);
+    format.format(buffer, size, timeInfo, now.tv_usec / 1000);
     return buffer;
+}
+
+/**
+ * Gets current date in YYYY-MM-DD format.
+ * Not reentrant, use ntpGetDate(buffer, size) when called from more than one place at a time.
+ * 
+ * @param posixString Optional POSIX timezone string
+ * @return Current date string or nullptr if time not available
+ */
+const char* Networking::ntpGetDate(const char* posixString)
+{
+    static char buffer[32];
+    return ntpFormat(buffer, sizeof(buffer), FORMAT_DATE, posixString);
+} // ntpGetDate()
+
+/**
+ * Writes the current date in YYYY-MM-DD format to a caller provided buffer.
+ * 
+ * @param buffer The buffer to write to (at least 11 bytes)
+ * @param size The size of the buffer
+ * @param posixString Optional POSIX timezone string
+ * @return The buffer, or nullptr if time not available
+ */
+const char* Networking::ntpGetDate(char* buffer, size_t size, const char* posixString)
+{
+    return ntpFormat(buffer, size, FORMAT_DATE, posixString);
+}
+
+/**
+ * Gets current date in DD-MM-YYYY format.
+ * 
+ * @param posixString Optional POSIX timezone string
+ * @return Current date string or nullptr if time not available
+ */
+const char* Networking::ntpGetDateDMY(const char* posixString)
+{
+    static char buffer[32];
+    return ntpFormat(buffer, sizeof(buffer), FORMAT_DATE_DMY, posixString);
 
 } //  ntpGetDateDMY()
 
+/**
+ * Writes the current date in DD-MM-YYYY format to a caller provided buffer.
+ * 
+ * @param buffer The buffer to write to (at least 11 bytes)
+ * @param size The size of the buffer
+ * @param posixString Optional POSIX timezone string
+ * @return The buffer, or nullptr if time not available
+ */
+const char* Networking::ntpGetDateDMY(char* buffer, size_t size, const char* posixString)
+{
+    return ntpFormat(buffer, size, FORMAT_DATE_DMY, posixString);
+}
+
 /**
  * Gets current time in HH:MM:SS format.
  * 
@@ -840,14 +3403,20 @@ const char* Networking::ntpGetDateDMY(const char* posixString)
 const char* Networking::ntpGetTime(const char* posixString)
 {
     static char buffer[32];
-    time_t now = ntpGetEpoch(posixString);
-    if (now == 0)
-    {
-        return nullptr;
-    }
-    
-    strftime(buffer, sizeof(buffer), "%H:%M:%S", localtime(&now));
-    return buffer;
+    return ntpFormat(buffer, sizeof(buffer), FORMAT_TIME, posixString);
+}
+
+/**
+ * Writes the current time in HH:MM:SS format to a caller provided buffer.
+ * 
+ * @param buffer The buffer to write to (at least 9 bytes)
+ * @param size The size of the buffer
+ * @param posixString Optional POSIX timezone string
+ * @return The buffer, or nullptr if time not available
+ */
+const char* Networking::ntpGetTime(char* buffer, size_t size, const char* posixString)
+{
+    return ntpFormat(buffer, size, FORMAT_TIME, posixString);
 }
 
 /**
@@ -859,15 +3428,22 @@ const char* Networking::ntpGetTime(const char* posixString)
 const char* Networking::ntpGetDateTime(const char* posixString)
 {
     static char buffer[32];
-    time_t now = ntpGetEpoch(posixString);
-    if (now == 0)
-    {
-        return nullptr;
-    }
-    
-    strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", localtime(&now));
-    return buffer;
+    return ntpFormat(buffer, sizeof(buffer), FORMAT_DATETIME, posixString);
+}
+
+/**
+ * Writes the current date and time in YYYY-MM-DD HH:MM:SS format to a caller provided buffer.
+ * 
+ * @param buffer The buffer to write to (at least 20 bytes)
+ * @param size The size of the buffer
+ * @param posixString Optional POSIX timezone string
+ * @return The buffer, or nullptr if time not available
+ */
+const char* Networking::ntpGetDateTime(char* buffer, size_t size, const char* posixString)
+{
+    return ntpFormat(buffer, size, FORMAT_DATETIME, posixString);
 }
+
 /**
  * Gets current date and time in DD-MM-YYYY HH:MM:SS format.
  * 
@@ -877,14 +3453,144 @@ const char* Networking::ntpGetDateTime(const char* posixString)
 const char* Networking::ntpGetDateTimeDMY(const char* posixString)
 {
     static char buffer[32];
-    time_t now = ntpGetEpoch(posixString);
-    if (now == 0)
+    return ntpFormat(buffer, sizeof(buffer), FORMAT_DATETIME_DMY, posixString);
+}
+
+/**
+ * Writes the current date and time in DD-MM-YYYY HH:MM:SS format to a caller provided buffer.
+ * 
+ * @param buffer The buffer to write to (at least 20 bytes)
+ * @param size The size of the buffer
+ * @param posixString Optional POSIX timezone string
+ * @return The buffer, or nullptr if time not available
+ */
+const char* Networking::ntpGetDateTimeDMY(char* buffer, size_t size, const char* posixString)
+{
+    return ntpFormat(buffer, size, FORMAT_DATETIME_DMY, posixString);
+}
+
+/**
+ * Brings the per-second clock cache up to date.
+ * Within a day only the HH:MM:SS fields and characters are updated;
+ * at local midnight, at a DST transition or when the clock is set
+ * everything is recalculated. Calls within the same second only cost
+ * a millis() compare.
+ */
+void Networking::updateClockCache()
+{
+    if (_clock.zone == _posixString && (long)(_clock.validUntil - millis()) > 0)
     {
-        return nullptr;
+        return;
     }
     
-    strftime(buffer, sizeof(buffer), "%d-%m-%Y %H:%M:%S", localtime(&now));
-    return buffer;
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    time_t now = tv.tv_sec;
+    //-- Nothing to do until the next second boundary
+    _clock.validUntil = millis() + 1000 - (tv.tv_usec / 1000);
+    if (now == _clock.second && _clock.zone == _posixString)
+    {
+        return;
+    }
+    
+    time_t delta = now - _clock.second;
+    if (_clock.zone != _posixString || delta < 0 || now >= _clock.recomputeAt)
+    {
+        //-- Full recalculation
+        TZ_CACHE_LOCK();
+        PosixTimeZone* zone = ntpFindTimeZone(_posixString ? _posixString : "UTC0");
+        zone->toLocal(now, &_clock.timeInfo);
+        time_t transition = zone->getNextTransition(now);
+        TZ_CACHE_UNLOCK();
+        FORMAT_DATE.format(_clock.date, sizeof(_clock.date), _clock.timeInfo);
+        FORMAT_TIME.format(_clock.time, sizeof(_clock.time), _clock.timeInfo);
+        FORMAT_DATETIME.format(_clock.dateTime, sizeof(_clock.dateTime), _clock.timeInfo);
+        
+        //-- Next local midnight or DST transition, whatever comes first
+        int32_t secondsToday = _clock.timeInfo.tm_hour * 3600 + _clock.timeInfo.tm_min * 60 + _clock.timeInfo.tm_sec;
+        time_t midnight = now + (86400 - secondsToday);
+        _clock.recomputeAt = (transition < midnight) ? transition : midnight;
+        _clock.second = now;
+        _clock.zone = _posixString;
+        return;
+    }
+    
+    //-- Incremental: the day did not change, only carry seconds into minutes and hours
+    int32_t seconds = _clock.timeInfo.tm_hour * 3600 + _clock.timeInfo.tm_min * 60 + _clock.timeInfo.tm_sec + (int32_t)delta;
+    _clock.timeInfo.tm_hour = seconds / 3600;
+    _clock.timeInfo.tm_min  = (seconds / 60) % 60;
+    _clock.timeInfo.tm_sec  = seconds % 60;
+    _clock.second = now;
+    
+    char* fields[2] = { _clock.time, _clock.dateTime + 11 };
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        char* p = fields[i];
+        p[0] = '0' + _clock.timeInfo.tm_hour / 10;
+        p[1] = '0' + _clock.timeInfo.tm_hour % 10;
+        p[3] = '0' + _clock.timeInfo.tm_min / 10;
+        p[4] = '0' + _clock.timeInfo.tm_min % 10;
+        p[6] = '0' + _clock.timeInfo.tm_sec / 10;
+        p[7] = '0' + _clock.timeInfo.tm_sec % 10;
+    }
+
+} //  Networking::updateClockCache()
+
+/**
+ * Gets the cached local time (ntpStart() timezone) as a tm structure.
+ * Valid until the next call; recalculated at most once per second.
+ * 
+ * @return The broken-down local time
+ */
+const struct tm& Networking::ntpCachedTm()
+{
+    updateClockCache();
+    return _clock.timeInfo;
+}
+
+/**
+ * Gets the cached local date in YYYY-MM-DD format.
+ * 
+ * @return The date string, or nullptr if no timezone is set
+ */
+const char* Networking::ntpCachedDate()
+{
+    if (!_posixString)
+    {
+        return nullptr;
+    }
+    updateClockCache();
+    return _clock.date;
+}
+
+/**
+ * Gets the cached local time in HH:MM:SS format.
+ * 
+ * @return The time string, or nullptr if no timezone is set
+ */
+const char* Networking::ntpCachedTime()
+{
+    if (!_posixString)
+    {
+        return nullptr;
+    }
+    updateClockCache();
+    return _clock.time;
+}
+
+/**
+ * Gets the cached local date and time in YYYY-MM-DD HH:MM:SS format.
+ * 
+ * @return The date and time string, or nullptr if no timezone is set
+ */
+const char* Networking::ntpCachedDateTime()
+{
+    if (!_posixString)
+    {
+        return nullptr;
+    }
+    updateClockCache();
+    return _clock.dateTime;
 }
 
 /**
@@ -902,5 +3608,8 @@ struct tm Networking::ntpGetTmStruct(const char* posixString)
         return empty;
     }
     
-    return *localtime(&now);
+    struct tm timeInfo;
+    ntpLocalTime(now, posixString, &timeInfo);
+    return timeInfo;
 }
+#endif
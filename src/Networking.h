@@ -1,11 +1,15 @@
 #pragma once
 
+//-- Services compiled out of small builds, see "Compile-time configuration" in the README:
+//--   -DNETWORKING_NO_OTA     no ArduinoOTA push updates (pull and multicast OTA stay opt-in)
+//--   -DNETWORKING_NO_MDNS    no mDNS responder, custom services or peer browsing
+//--   -DNETWORKING_NO_TELNET  no telnet server, commands over the serial port only
+//--   -DNETWORKING_NO_NTP     no ntpStart()/ntpGet*(), the disciplined clock and the timezone cache
+
 #ifdef ESP8266
     #include <ESP8266WiFi.h>
-    #include <ESP8266mDNS.h>
 #else
     #include <WiFi.h>
-    #include <ESPmDNS.h>
 #endif
 
 #ifdef USE_ASYNC_WIFIMANAGER
@@ -16,45 +20,108 @@
     #include <WiFiManager.h>  // https://github.com/tzapu/WiFiManager
 #endif
 
+#ifndef NETWORKING_NO_NTP
+  #include "PosixTimeZone.h"
+  #include "NtpFormat.h"
+#endif
+#include "BinaryLog.h"
+#include "HttpStatus.h"
+#include "UdpLog.h"
+#include "BootLog.h"
+#include "PullOTA.h"
+#include "MulticastOTA.h"
+#include "CommandShell.h"
+#ifndef NETWORKING_NO_MDNS
+  #include "MdnsServices.h"
+#endif
+#include "Metrics.h"
+#include "MultiStream.h"
+#ifdef NETWORKING_PROFILE_LOOP
+  #include "LoopProfiler.h"
+#endif
 #include <StreamString.h>
-#include <ArduinoOTA.h>
+#ifndef NETWORKING_NO_OTA
+  #include <ArduinoOTA.h>
+#endif
 #include <functional>
+#include <new>
+#include <atomic>
 
 //#define WIFI_RECONNECT_INTERVAL 10000  // 10 seconds
-#define WIFI_RECONNECT_MAX_ATTEMPTS 5  // Maximum retries before restart
-
-class MultiStream : public Stream
-{
-  private:
-    Stream* _serial;
-    WiFiClient* _telnetClient;
-    static const size_t BUFFER_SIZE = 512; //256;
-    uint8_t _buffer[BUFFER_SIZE];
-    size_t _bufferIndex;
-    
-    // Add a flag to track if we're in a critical section
-    bool _inCriticalSection;
-
-    void flushBuffer();
-
-  public:
-    MultiStream(Stream* serial, WiFiClient* telnetClient);
-    
-    virtual size_t write(uint8_t c) override;
-    virtual size_t write(const uint8_t* buffer, size_t size) override;
-    
-    virtual int available() override { return _serial->available(); }
-    virtual int read() override { return _serial->read(); }
-    virtual int peek() override { return _serial->peek(); }
-    virtual void flush() override;
-    
-    // Add methods to control critical sections
-    void beginCriticalSection();
-    void endCriticalSection();
+#ifndef NTP_TZ_CACHE_SIZE
+  #define NTP_TZ_CACHE_SIZE 4          // Number of parsed timezones kept by the ntpGet* methods
+#endif
+#ifndef NETWORKING_BINLOG_PORT
+  #define NETWORKING_BINLOG_PORT 24    // Binary log channel, next to telnet (23)
+#endif
+#ifndef NETWORKING_UDPLOG_PORT
+  #define NETWORKING_UDPLOG_PORT 514   // UDP log sink, the syslog port
+#endif
+#ifndef NETWORKING_LOG_LEVEL
+  #define NETWORKING_LOG_LEVEL 3       // Default log() level: 1 error, 2 warn, 3 info, 4 debug, 5 verbose
+#endif
+#ifndef NETWORKING_LOG_TAGS
+  #define NETWORKING_LOG_TAGS 8        // Tags with their own log level
+#endif
+#ifndef NETWORKING_RSSI_HISTORY
+  #define NETWORKING_RSSI_HISTORY 30   // RSSI samples kept for "stats", one every 10 seconds
+#endif
+#ifndef NTP_MAX_SERVERS
+  #define NTP_MAX_SERVERS 3            // NTP servers passed to SNTP (both cores support 3)
+#endif
+#ifndef NTP_SYNC_MIN_INTERVAL
+  #define NTP_SYNC_MIN_INTERVAL 300000UL    // Fastest NTP resync (5 minutes)
+#endif
+#ifndef NTP_SYNC_MAX_INTERVAL
+  #define NTP_SYNC_MAX_INTERVAL 14400000UL  // Slowest NTP resync (4 hours)
+#endif
+#ifndef NTP_TARGET_ACCURACY_US
+  #define NTP_TARGET_ACCURACY_US 1000       // Resync faster when the clock is off by more
+#endif
+//-- -DNETWORKING_PROFILE_LOOP times the stages of loop(), see printProfile()
+#ifdef NETWORKING_PROFILE_LOOP
+  #define NETWORKING_PROFILE_MARK(stage) _profiler.mark(stage)
+#else
+  #define NETWORKING_PROFILE_MARK(stage)
+#endif
+#ifndef NETWORKING_POLL_OTA_MS
+  #define NETWORKING_POLL_OTA_MS 20       // ArduinoOTA.handle() cadence, 0 polls on every loop()
+#endif
+#ifndef NETWORKING_POLL_MDNS_MS
+  #define NETWORKING_POLL_MDNS_MS 20      // MDNS.update() cadence (ESP8266)
+#endif
+#ifndef NETWORKING_POLL_TELNET_MS
+  #define NETWORKING_POLL_TELNET_MS 10    // Telnet accept, disconnect and command input
+#endif
+#ifndef NETWORKING_POLL_BINLOG_MS
+  #define NETWORKING_POLL_BINLOG_MS 5     // Binary log collector
+#endif
+#ifndef NETWORKING_POLL_BOOST_MS
+  #define NETWORKING_POLL_BOOST_MS 2000   // Telnet is polled on every loop() this long after input
+#endif
+#ifndef NETWORKING_TASK_CORE
+  #define NETWORKING_TASK_CORE 0          // runInTask() defaults (ESP32): core, priority, stack bytes
+#endif
+#ifndef NETWORKING_TASK_PRIORITY
+  #define NETWORKING_TASK_PRIORITY 1
+#endif
+#ifndef NETWORKING_TASK_STACK
+  #define NETWORKING_TASK_STACK 8192
+#endif
+#ifndef NETWORKING_OTA_PROGRESS_PERCENT
+  #define NETWORKING_OTA_PROGRESS_PERCENT 10  // OTA progress is reported every this many percent...
+#endif
+#ifndef NETWORKING_OTA_PROGRESS_MS
+  #define NETWORKING_OTA_PROGRESS_MS 1000     // ...or after this many ms, see setOTAProgressGranularity()
+#endif
+#ifndef WIFI_RECONNECT_MAX_ATTEMPTS
+  #define WIFI_RECONNECT_MAX_ATTEMPTS 5  // Default retries before restart, see setReconnectPolicy()
+#endif
 
-    using Print::write;
-};
 
+//-- Logs only when the level is enabled, the arguments are not evaluated otherwise
+#define NETWORKING_LOG(network, level, tag, ...) \
+    do { if ((network)->isLogEnabled(Networking::level)) (network)->log(Networking::level, tag, __VA_ARGS__); } while (0)
 
 class Networking 
 {
@@ -62,9 +129,12 @@ class Networking
     const char* _hostname;
     int _resetWiFiPin;
     Stream* _serial;
-    WiFiServer* _telnetServer;
-    WiFiClient _telnetClient;
-    MultiStream* _multiStream;
+    MultiStream* _multiStream;          // Constructed in _streamStorage by setupCommon()
+    alignas(MultiStream) uint8_t _streamStorage[sizeof(MultiStream)];
+    #ifndef NETWORKING_NO_TELNET
+    WiFiServer* _telnetServer;          // Constructed in _telnetStorage by setupCommon()
+    alignas(WiFiServer) uint8_t _telnetStorage[sizeof(WiFiServer)];
+    #endif
     static const int TELNET_PORT = 23;
     
     #ifdef ESP8266
@@ -73,47 +143,361 @@ class Networking
     static const int OTA_PORT = 3232;
     #endif
 
+    static const char* formatIP(const IPAddress& ip, char* buffer, size_t size);
+    #ifndef NETWORKING_NO_MDNS
     void setupMDNS();
+    #endif
+    #ifndef NETWORKING_NO_OTA
     void setupOTA();
+    #endif
     void setupWiFiEvents();  // New method for setting up WiFi events
+    void setupCommon(const char* hostname, int resetWiFiPin, HardwareSerial& serial, long serialSpeed
+                   , std::function<void()> wifiCallback, const FlushPolicy& flushPolicy);
+    void startServices();
+    void startPortal();
+    void handleState();
     
     // WiFi event tracking variables
     bool _isReconnecting;    // Flag to track if we're in the process of reconnecting
-    int _reconnectAttempts;  // Counter for reconnection attempts
+    uint16_t _reconnectAttempts;  // Counter for reconnection attempts
     unsigned long _lastReconnectAttempt; // Timestamp of last reconnect attempt
+    bool _manualReconnect;   // Non-blocking reconnectWiFi() waiting for a result
+
+  public:
+    //-- What to do when the reconnect attempts are exhausted
+    enum ReconnectAction : uint8_t { RECONNECT_RESTART, RECONNECT_KEEP_TRYING };
+
+  private:
+    //-- Reconnect scheduler (jittered exponential backoff, driven from loop())
+    volatile bool _wifiLost; // Set by the disconnect event handler
+    bool _reconnectActive;
+    unsigned long _wifiLostAt;
+    uint32_t _reconnectDelay;
+    uint16_t _maxReconnectAttempts;
+    uint32_t _reconnectBaseDelay;
+    uint32_t _reconnectMaxDelay;
+    std::function<ReconnectAction(uint16_t, uint32_t)> _onReconnectFailed;
+
+    uint32_t nextReconnectDelay(uint16_t attempt) const;
+    void handleReconnect();
+
+    //-- Fast reconnect: cached BSSID, channel and lease in RTC memory
+    bool _fastReconnect;
+    bool _fastAttempt;       // Current connection attempt uses the cache
+    bool _wifiCacheDirty;    // Got a (new) IP, save the cache from loop()
+    unsigned long _connectStarted;
+    static const unsigned long FAST_CONNECT_TIMEOUT = 2000; // Fall back to scan + DHCP after 2 seconds
+
+    void connectWiFi();
+    static bool loadCredentials(char* ssid, char* psk);
+    void dropWiFi();
+    void checkFastConnect();
+    void saveWiFiCache();
     
     std::function<void()> _onStartOTA;
     std::function<void()> _onProgressOTA;
+    std::function<void(uint32_t, uint32_t)> _onProgressBytesOTA;
     std::function<void()> _onEndOTA;
     std::function<void()> _onWiFiPortalStart;
 
+    BinaryLog* _binaryLog;
+    HttpStatus* _httpStatus;
+    UdpLog* _udpLog;
+    BootLog* _bootLog;
+    void startBootLog();
+
+    //-- Pull-mode OTA, created by startPullOTA()
+    PullOTA*    _pullOTA;
+    const char* _pullCACert;
+    bool        _pullReboot;
+
+    //-- Progress of the running (or last) update, ArduinoOTA, pull or multicast
+    uint8_t     _otaStep;         // Report every this many percent, 0 never
+    uint16_t    _otaInterval;     // ...or after this many ms, 0 never
+    uint8_t     _otaPercent;      // Percentage of the last report
+    uint8_t     _otaMilestone;    // Last 20% step passed to doAtProgressOTA()
+    uint32_t    _otaStarted;
+    uint32_t    _otaReported;     // millis() of the last report
+    uint32_t    _otaBytes;
+    uint32_t    _otaElapsed;      // ms the last update took, 0 while running
+
+    //-- Multicast OTA receiver, created by enableMulticastOTA()
+    MulticastOTA* _multicastOTA;
+    bool          _multicastReboot;
+
+    void setupPullOTA();
+    void setupMulticastOTA();
+    void startHttpStatus();
+    void startOTAProgress();
+    void reportOTAProgress(uint32_t done, uint32_t total);
+    void endOTAProgress();
+
     #ifdef USE_ASYNC_WIFIMANAGER
     AsyncWebServer* _webServer;
     DNSServer* _dnsServer;
     #endif
 
+  public:
+    //-- State kept in RTC memory across deep sleep and software resets
+    struct RtcState
+    {
+      uint32_t crc;        // CRC32 over the rest of the struct
+      uint32_t magic;
+      uint8_t  bssid[6];
+      uint8_t  channel;
+      uint8_t  flags;
+      uint32_t ip;
+      uint32_t gateway;
+      uint32_t subnet;
+      uint32_t dns1;
+      uint32_t dns2;
+      uint32_t epoch;       // Wall clock when going to sleep
+      uint16_t epochMillis;
+      uint16_t reserved;
+      uint32_t sleepMs;     // Requested sleep time
+      uint32_t lastNtpSync; // Epoch of the last NTP sync
+      char     posix[48];   // Timezone
+    };
+
+  private:
+    static const uint32_t RTC_MAGIC = 0x4E455431; // "NET1"
+    static const uint8_t  RTC_WIFI_VALID  = 0x01;
+    static const uint8_t  RTC_TIME_VALID  = 0x02;
+    static const uint8_t  RTC_MAINTENANCE = 0x04;
+    RtcState _rtc;
+
+    //-- Burst (deep sleep duty cycle) profile
+    bool _burst;
+    bool _maintenance;
+    bool _timeRestored;
+    bool _servicesEnabled;   // MDNS, OTA and telnet are running
+
+    bool loadRtcState();
+    void saveRtcState();
+    void restoreTime();
+    void handleServices();
+
+  public:
+    //-- Connection states, beginAsync() moves through these from loop()
+    enum State : uint8_t { IDLE, CONNECTING, PORTAL, CONNECTED, SERVICES_UP };
+
+  private:
+    State _state;
+    bool _async;
+    unsigned long _stateSince;
+    std::function<void(State, State)> _onStateChange;
+    static const unsigned long WIFI_CONNECT_TIMEOUT = 10000;  // 10 seconds before the portal starts
+    static const unsigned long WIFI_PORTAL_TIMEOUT = 240000;  // 4 minutes before a restart
+    #ifdef USE_ASYNC_WIFIMANAGER
+    AsyncWiFiManager* _wifiManager;
+    #else
+    ::WiFiManager* _wifiManager;
+    #endif
+
+    void setState(State state);
+
   public:
     Networking();
     ~Networking();
 
-    Stream* begin(const char* hostname, int resetWiFiPin, HardwareSerial& serial, long serialSpeed, std::function<void()> wifiCallback = nullptr);
+    Stream* begin(const char* hostname, int resetWiFiPin, HardwareSerial& serial, long serialSpeed, std::function<void()> wifiCallback = nullptr
+                , const FlushPolicy& flushPolicy = FlushPolicy());
+    Stream* beginAsync(const char* hostname, int resetWiFiPin, HardwareSerial& serial, long serialSpeed, std::function<void()> wifiCallback = nullptr
+                     , const FlushPolicy& flushPolicy = FlushPolicy());
+    Stream* beginBurst(const char* hostname, int maintenancePin, HardwareSerial& serial, long serialSpeed);
     void loop();
+    #ifndef ESP8266
+    bool runInTask(BaseType_t core = NETWORKING_TASK_CORE, UBaseType_t priority = NETWORKING_TASK_PRIORITY
+                 , uint32_t stackSize = NETWORKING_TASK_STACK);
+    bool isRunningInTask() const { return _task != nullptr; }
+    #endif
+    State getState() const { return _state; }
+    static const char* getStateName(State state);
+    void doAtStateChange(std::function<void(State, State)> callback);
+    MultiStream* getMultiStream() const { return _multiStream; }
     
+    void setFastReconnect(bool enable);
+
+    // Deep sleep duty cycle
+    bool isMaintenanceWake() const { return _maintenance; }
+    void requestMaintenanceWake();
+    void sleepFor(uint32_t ms);
+
     // IP address methods
     IPAddress getIPAddress() const;
     String getIPAddressString() const;
+    const char* getIPAddressString(char* buffer, size_t size) const;
+    const char* getStatusString(char* buffer, size_t size) const;
+    static uint32_t getAllocationCount();
     bool isConnected() const;
 
     void reconnectWiFi();
+    void setReconnectPolicy(uint16_t maxAttempts, uint32_t baseDelayMs = 1000, uint32_t maxDelayMs = 60000);
+    void doAtReconnectFailed(std::function<ReconnectAction(uint16_t, uint32_t)> callback);
     void doAtStartOTA(std::function<void()> callback);
     void doAtProgressOTA(std::function<void()> callback);
+    void doAtProgressOTA(std::function<void(uint32_t, uint32_t)> callback);
+    void setOTAProgressGranularity(uint8_t percent, uint16_t intervalMs);
+    uint32_t getOTABytesPerSecond() const;
     void doAtEndOTA(std::function<void()> callback);
+
+    // Pull-mode OTA over HTTP(S), also the "update" telnet command
+    bool startPullOTA(const char* url, const char* sha256 = nullptr, bool reboot = true);
+    void setPullOTACACert(const char* pem);
+    void cancelPullOTA();
+    PullOTA* getPullOTA() { return _pullOTA; }
+
+    // Multicast OTA: one sender (ota_multicast.py) updates every listening device at once
+    bool enableMulticastOTA(const char* key = nullptr, bool reboot = true);
+    void disableMulticastOTA();
+    MulticastOTA* getMulticastOTA() { return _multicastOTA; }
     void doAtWiFiPortalStart(std::function<void()> callback);
 
+    //-- Log levels of log() and the binary log channel
+    enum LogLevel : uint8_t { LEVEL_NONE, LEVEL_ERROR, LEVEL_WARN, LEVEL_INFO, LEVEL_DEBUG, LEVEL_VERBOSE };
+
+    // Logging: text to Serial and Telnet, binary records to a collector
+    void log(LogLevel level, const char* tag, const char* format, ...) __attribute__((format(printf, 4, 5)));
+    void enableBinaryLog(uint16_t port = NETWORKING_BINLOG_PORT);
+    BinaryLog* getBinaryLog() { return _binaryLog; }
+    void enableUdpLog(const IPAddress& host, uint16_t port = NETWORKING_UDPLOG_PORT, UdpLog::Format format = UdpLog::SYSLOG);
+    void disableUdpLog();
+    UdpLog* getUdpLog() { return _udpLog; }
+    void enableBootLog();
+    BootLog* getBootLog() { return _bootLog; }
+
+    // Log filtering, checked before anything is formatted (also with the "log" telnet command)
+    bool isLogEnabled(LogLevel level) const { return level != LEVEL_NONE && level <= _logMaxLevel; }
+    void setLogLevel(LogLevel level);
+    bool setLogLevel(const char* tag, LogLevel level);
+    LogLevel getLogLevel(const char* tag = nullptr) const;
+    void setSerialLogLevel(LogLevel level);
+    void setTelnetLogLevel(LogLevel level);
+    void setBinaryLogLevel(LogLevel level);
+    static const char* getLogLevelName(LogLevel level);
+
+  private:
+    LogLevel _logLevel;          // Level of tags without their own level
+    LogLevel _serialLogLevel;
+    LogLevel _telnetLogLevel;
+    LogLevel _binaryLogLevel;
+    LogLevel _logMaxLevel;       // Highest level any sink can show, the cheap first check
+    struct LogTag
+    {
+      char     tag[12];
+      LogLevel level;
+    };
+    LogTag  _logTags[NETWORKING_LOG_TAGS];
+    uint8_t _logTagCount;
+
+    void updateLogMaxLevel();
+    static bool parseLogLevel(const char* name, LogLevel& level);
+
+    //-- Commands typed in a telnet session or on the serial port
+    static_assert(SHELL_MAX_SOURCES > MULTISTREAM_MAX_CLIENTS, "SHELL_MAX_SOURCES must cover the telnet sessions and serial");
+    static const uint8_t SERIAL_SOURCE = MULTISTREAM_MAX_CLIENTS;
+    CommandShell _shell;
+    bool         _serialCommands;
+
+    #ifndef NETWORKING_NO_MDNS
+    //-- Custom mDNS services, TXT records and the peer cache
+    MdnsServices _mdns;
+    #endif
+
+    void setupCommands();
+    void handleCommands(bool telnet);
+    void commandLog(char* args, Print& out);
+
+    //-- Built-in metrics, registered in this order
+    enum MetricId : uint8_t
+    {
+      METRIC_SERIAL_BYTES, METRIC_TELNET_BYTES, METRIC_OVERFLOW_BYTES, METRIC_DROPPED_BYTES,
+      METRIC_FLUSH_US, METRIC_LOOP_US, METRIC_WIFI_LOST, METRIC_RECONNECT_ATTEMPTS, METRIC_RECONNECT_MS,
+      METRIC_RSSI, METRIC_NTP_OFFSET_US, METRIC_NTP_SYNCS, METRIC_FREE_HEAP, METRIC_UPTIME_S,
+      METRIC_OTA_BYTES_PER_S
+    };
+    static const unsigned long RSSI_SAMPLE_INTERVAL = 10000;
+    Metrics       _metrics;
+    int8_t        _rssiHistory[NETWORKING_RSSI_HISTORY];
+    uint8_t       _rssiCount;
+    uint8_t       _rssiNext;
+    unsigned long _lastRssiSample;
+
+    void setupMetrics();
+    void updateMetrics();
+    void sampleRssi();
+    void commandStats(char* args, Print& out);
+
+    #ifdef NETWORKING_PROFILE_LOOP
+      //-- Stages of loop(), added in this order
+      enum ProfileStage : uint8_t
+      {
+        PROFILE_STATE, PROFILE_WIFI, PROFILE_OTA, PROFILE_MDNS, PROFILE_TELNET,
+        PROFILE_COMMANDS, PROFILE_BINLOG, PROFILE_NTP, PROFILE_DRAIN, PROFILE_LOOP
+      };
+      LoopProfiler _profiler;
+      void setupProfiler();
+    #endif
+
+  public:
+    //-- Services polled by loop(), each at its own interval
+    enum PollService : uint8_t { POLL_OTA, POLL_MDNS, POLL_TELNET, POLL_BINLOG, POLL_COUNT };
+
+  private:
+    struct ServicePoll
+    {
+      uint16_t interval;      // ms between polls, 0 is every loop()
+      uint32_t next;          // millis() of the next poll
+      uint32_t boostUntil;    // Polled on every loop() until then
+      bool     boosted;
+    };
+    ServicePoll _polls[POLL_COUNT];
+    uint32_t    _nextPollDue;  // Earliest next poll, the "nothing due" fast path
+
+    bool pollDue(PollService service, uint32_t now);
+    void updateNextPoll(uint32_t now);
+
+  public:
+    // Service poll scheduling
+    void setPollInterval(PollService service, uint16_t intervalMs);
+    uint16_t getPollInterval(PollService service) const;
+    void boostPoll(PollService service, uint32_t durationMs = NETWORKING_POLL_BOOST_MS);
+
+    // Loop profiler (-DNETWORKING_PROFILE_LOOP, also the "profile" telnet command)
+    void printProfile(Print& out);
+    void resetProfile();
+
+    // Metrics (also the "stats" telnet command)
+    Metrics& getMetrics() { return _metrics; }
+    void printStats(Print& out, bool compact = false);
+
+    // HTTP /metrics (Prometheus) and /log/tail, from the registry and the log ring
+    void enableHttpStatus(uint16_t port = HTTP_STATUS_PORT);
+    HttpStatus* getHttpStatus() { return _httpStatus; }
+
+    #ifndef NETWORKING_NO_MDNS
+    // mDNS: custom services and TXT records (announced when changed), background browsing
+    bool addMDNSService(const char* service, const char* proto, uint16_t port);
+    bool setMDNSTxt(const char* service, const char* proto, const char* key, const char* value);
+    bool setMDNSTxt(const char* service, const char* proto, const char* key, int32_t value);
+    bool browseMDNS(const char* service, const char* proto, uint32_t intervalMs = MDNS_BROWSE_MS);
+    MdnsServices& getMDNS() { return _mdns; }
+    #endif
+
+    // Command shell
+    bool addCommand(const char* name, const char* help, CommandShell::Handler handler);
+    void setSerialCommands(bool enable);
+
+  public:
+    bool ntpIsValid() const;
+
+    #ifndef NETWORKING_NO_NTP
     // NTP Methods
     bool ntpStart(const char* posixString, const char** ntpServers = nullptr);
-    bool ntpIsValid() const;
     time_t ntpGetEpoch(const char* posixString = nullptr);
+    int64_t ntpGetEpochMicros();
+    int32_t ntpGetDrift() const;
+    unsigned long ntpGetSyncInterval() const;
     const char* ntpGetDate(const char* posixString = nullptr);
     const char* ntpGetDateDMY(const char* posixString = nullptr);
     const char* ntpGetTime(const char* posixString = nullptr);
@@ -121,18 +505,114 @@ class Networking
     const char* ntpGetDateTimeDMY(const char* posixString = nullptr);
     struct tm ntpGetTmStruct(const char* posixString = nullptr);
 
+    // Reentrant NTP formatting into a caller provided buffer
+    const char* ntpGetDate(char* buffer, size_t size, const char* posixString = nullptr);
+    const char* ntpGetDateDMY(char* buffer, size_t size, const char* posixString = nullptr);
+    const char* ntpGetTime(char* buffer, size_t size, const char* posixString = nullptr);
+    const char* ntpGetDateTime(char* buffer, size_t size, const char* posixString = nullptr);
+    const char* ntpGetDateTimeDMY(char* buffer, size_t size, const char* posixString = nullptr);
+    const char* ntpFormat(char* buffer, size_t size, const NtpFormat& format, const char* posixString = nullptr);
+
+    // Per-second cached wall clock in the ntpStart() timezone (not reentrant)
+    const struct tm& ntpCachedTm();
+    const char* ntpCachedDate();
+    const char* ntpCachedTime();
+    const char* ntpCachedDateTime();
+    void ntpLocalTime(time_t epoch, const char* posixString, struct tm* result);
+
   private:
     const char* _posixString;
     unsigned long _lastNtpSync;
-    static const unsigned long NTP_SYNC_INTERVAL = 3600000; // 1 hour in milliseconds
-    
+    static const unsigned long NTP_SYNC_INTERVAL = 3600000; // 1 hour in milliseconds (restored clock after deep sleep)
+    static const int64_t NTP_STEP_THRESHOLD = 500000;       // Offsets above this (us) are stepped, not slewed
+    static const int32_t NTP_SLEW_PPM = 500;                // Max rate an offset is slewed in
+    const char*   _ntpServers[NTP_MAX_SERVERS];
+    unsigned long _ntpSyncInterval;
+
+    //-- Microsecond clock: the 64 bit local timer, corrected by the NTP samples
+    struct NtpDiscipline
+    {
+      int64_t baseLocal;    // Local timer (us) at the last correction
+      int64_t baseEpoch;    // Epoch (us) at baseLocal
+      int64_t sampleLocal;  // Previous NTP sample, for the drift measurement
+      int64_t sampleEpoch;
+      int64_t slew;         // Offset (us) still to be applied
+      int32_t driftPpb;     // Local timer frequency error, parts per billion
+      bool    driftValid;
+      bool    valid;
+    };
+    NtpDiscipline _ntpClock;
+
+    //-- Written by the SNTP callback, handled in loop()
+    volatile bool _ntpSampleReady;
+    int64_t       _ntpSampleLocal;
+    int64_t       _ntpSampleEpoch;
+
+    static int64_t ntpLocalMicros();
+    int64_t ntpExtrapolate(int64_t local) const;
+    void ntpConfigure();
+    void ntpHandleSample();
+    void ntpSample(int64_t epochMicros);
+
+    //-- Parsed timezones, so local time never needs setenv("TZ")/tzset()
+    struct TzCacheEntry
+    {
+      char          posix[48];
+      PosixTimeZone zone;
+    };
+    TzCacheEntry  _tzCache[NTP_TZ_CACHE_SIZE];
+    uint8_t       _tzCacheNext;
+    PosixTimeZone _tzScratch;
+    #ifndef ESP8266
+    //-- Guards the timezone cache, the caller-buffer overloads run on any task
+    portMUX_TYPE  _tzLock = portMUX_INITIALIZER_UNLOCKED;
+    #endif
+
+    PosixTimeZone* ntpFindTimeZone(const char* posixString);
+
+    //-- Wall clock cache, recalculated when the second rolls over
+    struct ClockCache
+    {
+      time_t        second;       // Epoch second the fields are valid for
+      time_t        recomputeAt;  // Next local midnight or DST transition (UTC)
+      unsigned long validUntil;   // millis() of the next second boundary
+      const char*   zone;
+      struct tm     timeInfo;
+      char          date[11];
+      char          time[9];
+      char          dateTime[20];
+    };
+    ClockCache _clock;
+
+    void updateClockCache();
+    #endif
+
+  private:
+    // Static instance pointer for callbacks
+    static Networking* _instance;
+
     // Static event handlers (needed for ESP8266)
     #ifdef ESP8266
     static void _onStationModeConnected(const WiFiEventStationModeConnected& event);
     static void _onStationModeDisconnected(const WiFiEventStationModeDisconnected& event);
     static void _onStationModeGotIP(const WiFiEventStationModeGotIP& event);
     
-    // Static instance pointer for callbacks
-    static Networking* _instance;
+    WiFiEventHandler _connectedHandler;
+    WiFiEventHandler _disconnectedHandler;
+    WiFiEventHandler _gotIPHandler;
+    #endif
+
+    #ifndef ESP8266
+    //-- WiFi events seen by the system event task, printed by loop()
+    static const uint8_t WIFI_FLAG_STARTED      = 0x01;
+    static const uint8_t WIFI_FLAG_CONNECTED    = 0x02;
+    static const uint8_t WIFI_FLAG_DISCONNECTED = 0x04;
+    static const uint8_t WIFI_FLAG_GOT_IP       = 0x08;
+    std::atomic<uint8_t> _wifiEvents;
+    void reportWiFiEvents();
+
+    //-- The task started by runInTask(), the only one that runs loop() then
+    TaskHandle_t _task;
+    static void taskLoop(void* parameter);
     #endif
 };
@@ -0,0 +1,125 @@
+#include "NtpFormat.h"
+
+static const char* const DAY_NAMES   = "SunMonTueWedThuFriSat";
+static const char* const MONTH_NAMES = "JanFebMarAprMayJunJulAugSepOctNovDec";
+static const char* const CONVERSIONS = "YymdeHIMSjLpab";
+
+/**
+ * Compiles a pattern into fields.
+ * Literal text is stored in segments of 8 characters, so a pattern that
+ * needs more than 20 fields is rejected (isValid() returns false, format()
+ * writes nothing).
+ *
+ * @param pattern The strftime()-like pattern, e.g. "%Y-%m-%d %H:%M:%S.%L"
+ */
+NtpFormat::NtpFormat(const char* pattern)
+    : _count(0), _valid(true)
+{
+    const char* p = pattern ? pattern : "";
+
+    while (*p)
+    {
+        if (*p == '%' && p[1] != 0 && strchr(CONVERSIONS, p[1]))
+        {
+            if (_count >= MAX_FIELDS)
+            {
+                _valid = false;
+                break;
+            }
+            _fields[_count].code   = p[1];
+            _fields[_count].length = 0;
+            _count++;
+            p += 2;
+            continue;
+        }
+
+        //-- Literal text, "%%" becomes "%" and an unknown conversion is kept as it is
+        Field* field = (_count > 0) ? &_fields[_count - 1] : nullptr;
+        if (!field || field->code != 0 || field->length >= MAX_SEGMENT)
+        {
+            if (_count >= MAX_FIELDS)
+            {
+                _valid = false;
+                break;
+            }
+            field = &_fields[_count++];
+            field->code   = 0;
+            field->length = 0;
+        }
+        field->text[field->length++] = *p;
+        p += (*p == '%' && p[1] == '%') ? 2 : 1;
+    }
+
+    if (!_valid)
+    {
+        _count = 0;
+    }
+}
+
+/**
+ * Formats a broken-down time.
+ *
+ * @param buffer The buffer to write to, always NUL terminated
+ * @param size The size of the buffer
+ * @param timeInfo The time to format
+ * @param millis Milliseconds for %L
+ * @return The number of characters written (without the NUL)
+ */
+size_t NtpFormat::format(char* buffer, size_t size, const struct tm& timeInfo, uint16_t millis) const
+{
+    if (!buffer || size == 0)
+    {
+        return 0;
+    }
+
+    size_t pos = 0;
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        const Field& field = _fields[i];
+        char   digits[4];
+        const char* text = digits;
+        size_t length = 2;
+        int    value = -1;
+
+        switch (field.code)
+        {
+            case 0:   text = field.text; length = field.length; break;
+            case 'Y': value = timeInfo.tm_year + 1900; length = 4; break;
+            case 'y': value = timeInfo.tm_year % 100; break;
+            case 'm': value = timeInfo.tm_mon + 1; break;
+            case 'd': value = timeInfo.tm_mday; break;
+            case 'e': value = timeInfo.tm_mday; break;
+            case 'H': value = timeInfo.tm_hour; break;
+            case 'I': value = (timeInfo.tm_hour % 12) ? (timeInfo.tm_hour % 12) : 12; break;
+            case 'M': value = timeInfo.tm_min; break;
+            case 'S': value = timeInfo.tm_sec; break;
+            case 'j': value = timeInfo.tm_yday + 1; length = 3; break;
+            case 'L': value = millis % 1000; length = 3; break;
+            case 'p': text = (timeInfo.tm_hour < 12) ? "AM" : "PM"; break;
+            case 'a': text = &DAY_NAMES[(timeInfo.tm_wday % 7) * 3]; length = 3; break;
+            case 'b': text = &MONTH_NAMES[(timeInfo.tm_mon % 12) * 3]; length = 3; break;
+            default:  length = 0; break;
+        }
+
+        if (value >= 0)
+        {
+            for (size_t d = length; d > 0; d--)
+            {
+                digits[d - 1] = '0' + (value % 10);
+                value /= 10;
+            }
+            if (field.code == 'e' && digits[0] == '0')
+            {
+                digits[0] = ' ';
+            }
+        }
+
+        for (size_t c = 0; c < length && pos < size - 1; c++)
+        {
+            buffer[pos++] = text[c];
+        }
+    }
+
+    buffer[pos] = 0;
+    return pos;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <Arduino.h>
+#include <time.h>
+
+/**
+ * A strftime()-like pattern compiled once into a list of fields, so
+ * timestamps can be formatted in a hot path without parsing the pattern,
+ * allocating or taking locks. All output goes to the caller's buffer,
+ * which makes format() reentrant.
+ *
+ * Supported: %Y %y %m %d %e %H %I %M %S %p %j %a %b %L (milliseconds) and %%.
+ * Any other character, and any other conversion ("%X"), is copied as text.
+ */
+class NtpFormat
+{
+  private:
+    static const uint8_t MAX_FIELDS  = 20;
+    static const uint8_t MAX_SEGMENT = 8;   // Literal text per field, a longer run takes several
+
+    struct Field
+    {
+      char    code;       // Conversion character, 0 for literal text
+      uint8_t length;     // Literal text: characters in text
+      char    text[MAX_SEGMENT];
+    };
+
+    Field   _fields[MAX_FIELDS];
+    uint8_t _count;
+    bool    _valid;
+
+  public:
+    explicit NtpFormat(const char* pattern);
+
+    bool isValid() const { return _valid; }
+    size_t format(char* buffer, size_t size, const struct tm& timeInfo, uint16_t millis = 0) const;
+};
@@ -0,0 +1,420 @@
+#include "PosixTimeZone.h"
+
+/**
+ * Constructor for the PosixTimeZone class.
+ * An unparsed timezone behaves as UTC.
+ */
+PosixTimeZone::PosixTimeZone()
+    : _valid(false), _hasDst(false), _stdOffset(0), _dstOffset(0),
+      _start(), _end(), _cachedYear(INT32_MIN), _startUtc(0), _endUtc(0), _alwaysDst(false)
+{
+}
+
+/**
+ * Skips a timezone name: alphabetic ("CET") or quoted ("<+0530>").
+ *
+ * @param p Parse position, advanced past the name
+ * @return True if a name was found
+ */
+bool PosixTimeZone::parseName(const char*& p)
+{
+    const char* begin = p;
+    if (*p == '<')
+    {
+        while (*p && *p != '>')
+        {
+            p++;
+        }
+        if (*p != '>')
+        {
+            return false;
+        }
+        p++;
+        return true;
+    }
+    while ((*p >= 'A' && *p <= 'Z') || (*p >= 'a' && *p <= 'z'))
+    {
+        p++;
+    }
+    return (p - begin) >= 3;
+}
+
+/**
+ * Parses [+|-]hh[:mm[:ss]] into seconds.
+ *
+ * @param p Parse position, advanced past the time
+ * @param seconds The parsed value
+ * @return True if a time was found
+ */
+bool PosixTimeZone::parseTime(const char*& p, int32_t& seconds)
+{
+    int32_t sign = 1;
+    if (*p == '+' || *p == '-')
+    {
+        sign = (*p == '-') ? -1 : 1;
+        p++;
+    }
+    if (*p < '0' || *p > '9')
+    {
+        return false;
+    }
+
+    int32_t parts[3] = { 0, 0, 0 };
+    for (int i = 0; i < 3; i++)
+    {
+        while (*p >= '0' && *p <= '9')
+        {
+            parts[i] = parts[i] * 10 + (*p++ - '0');
+        }
+        if (*p != ':' || i == 2)
+        {
+            break;
+        }
+        p++;
+    }
+    seconds = sign * (parts[0] * 3600 + parts[1] * 60 + parts[2]);
+    return true;
+}
+
+/**
+ * Parses a DST rule: Mm.w.d, Jn or n, optionally followed by /time.
+ *
+ * @param p Parse position, advanced past the rule
+ * @param rule The parsed rule
+ * @return True if the rule is valid
+ */
+bool PosixTimeZone::parseRule(const char*& p, Rule& rule)
+{
+    rule.time = 7200;  // Default 02:00:00
+    if (*p == 'M')
+    {
+        p++;
+        int values[3] = { 0, 0, 0 };
+        for (int i = 0; i < 3; i++)
+        {
+            if (*p < '0' || *p > '9')
+            {
+                return false;
+            }
+            while (*p >= '0' && *p <= '9')
+            {
+                values[i] = values[i] * 10 + (*p++ - '0');
+            }
+            if (i < 2)
+            {
+                if (*p != '.')
+                {
+                    return false;
+                }
+                p++;
+            }
+        }
+        if (values[0] < 1 || values[0] > 12 || values[1] < 1 || values[1] > 5 || values[2] > 6)
+        {
+            return false;
+        }
+        rule.type  = 'M';
+        rule.month = values[0];
+        rule.week  = values[1];
+        rule.wday  = values[2];
+    }
+    else
+    {
+        rule.type = 'N';
+        if (*p == 'J')
+        {
+            rule.type = 'J';
+            p++;
+        }
+        if (*p < '0' || *p > '9')
+        {
+            return false;
+        }
+        int day = 0;
+        while (*p >= '0' && *p <= '9')
+        {
+            day = day * 10 + (*p++ - '0');
+        }
+        if (day > 365 || (rule.type == 'J' && day < 1))
+        {
+            return false;
+        }
+        rule.day = day;
+    }
+
+    if (*p == '/')
+    {
+        p++;
+        return parseTime(p, rule.time);
+    }
+    return true;
+}
+
+/**
+ * Parses a POSIX timezone string, e.g. "CET-1CEST,M3.5.0,M10.5.0/3".
+ * A DST zone without rules gets the US rules (M3.2.0,M11.1.0) like newlib.
+ *
+ * @param posixString The timezone string
+ * @return True if the string could be parsed
+ */
+bool PosixTimeZone::parse(const char* posixString)
+{
+    _valid = false;
+    _hasDst = false;
+    _stdOffset = 0;
+    _cachedYear = INT32_MIN;
+    _alwaysDst = false;
+    if (!posixString)
+    {
+        return false;
+    }
+
+    const char* p = posixString;
+    int32_t offset;
+    if (!parseName(p) || !parseTime(p, offset))
+    {
+        return false;
+    }
+    //-- POSIX offsets are west of UTC, "CET-1" is UTC+1
+    _stdOffset = -offset;
+    _dstOffset = _stdOffset + 3600;
+
+    if (*p == 0)
+    {
+        _valid = true;
+        return true;
+    }
+
+    if (!parseName(p))
+    {
+        return false;
+    }
+    if (*p != ',' && *p != 0)
+    {
+        if (!parseTime(p, offset))
+        {
+            return false;
+        }
+        _dstOffset = -offset;
+    }
+
+    if (*p == 0)
+    {
+        const char* usRules = ",M3.2.0,M11.1.0";
+        p = usRules;
+    }
+    if (*p++ != ',' || !parseRule(p, _start) || *p++ != ',' || !parseRule(p, _end))
+    {
+        return false;
+    }
+
+    _hasDst = true;
+    _valid = true;
+    return true;
+}
+
+/**
+ * Converts a civil date to days since 1970-01-01.
+ *
+ * @param year The year (e.g. 2025)
+ * @param month The month (1..12)
+ * @param day The day of the month (1..31)
+ * @return Days since the epoch
+ */
+int32_t PosixTimeZone::daysFromCivil(int32_t year, uint32_t month, uint32_t day)
+{
+    year -= (month <= 2);
+    const int32_t  era = (year >= 0 ? year : year - 399) / 400;
+    const uint32_t yoe = (uint32_t)(year - era * 400);
+    const uint32_t doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    const uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int32_t)doe - 719468;
+}
+
+/**
+ * Fills the date fields of a tm structure from days since 1970-01-01.
+ * Sets tm_year, tm_mon, tm_mday, tm_wday and tm_yday.
+ *
+ * @param days Days since the epoch
+ * @param result The structure to fill
+ */
+void PosixTimeZone::civilFromDays(int32_t days, struct tm* result)
+{
+    int32_t z = days + 719468;
+    const int32_t  era = (z >= 0 ? z : z - 146096) / 146097;
+    const uint32_t doe = (uint32_t)(z - era * 146097);
+    const uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const uint32_t mp  = (5 * doy + 2) / 153;
+    const uint32_t d   = doy - (153 * mp + 2) / 5 + 1;
+    const uint32_t m   = (mp < 10) ? mp + 3 : mp - 9;
+    const int32_t  y   = (int32_t)yoe + era * 400 + (m <= 2);
+
+    result->tm_year = y - 1900;
+    result->tm_mon  = m - 1;
+    result->tm_mday = d;
+    result->tm_wday = ((days % 7) + 11) % 7;   // 1970-01-01 was a Thursday
+    result->tm_yday = days - daysFromCivil(y, 1, 1);
+}
+
+/**
+ * Calculates when a rule fires in a year, in the local time before the transition.
+ *
+ * @param year The year
+ * @param rule The rule
+ * @return Local seconds since the epoch
+ */
+time_t PosixTimeZone::ruleToLocal(int32_t year, const Rule& rule)
+{
+    int32_t day;
+    if (rule.type == 'M')
+    {
+        //-- First matching weekday of the month, then the n-th week (5 = last)
+        int32_t first = daysFromCivil(year, rule.month, 1);
+        int32_t firstWday = ((first % 7) + 11) % 7;
+        day = first + (rule.wday - firstWday + 7) % 7 + (rule.week - 1) * 7;
+        uint32_t nextMonth = (rule.month == 12) ? 1 : rule.month + 1;
+        int32_t  nextFirst = daysFromCivil(rule.month == 12 ? year + 1 : year, nextMonth, 1);
+        while (day >= nextFirst)
+        {
+            day -= 7;
+        }
+    }
+    else
+    {
+        day = daysFromCivil(year, 1, 1) + rule.day;
+        if (rule.type == 'J')
+        {
+            //-- Jn never counts February 29th
+            bool leap = (year % 4 == 0 && year % 100 != 0) || (year % 400 == 0);
+            day -= 1;
+            if (leap && rule.day >= 60)
+            {
+                day += 1;
+            }
+        }
+    }
+    return (time_t)day * 86400 + rule.time;
+}
+
+/**
+ * Calculates and caches the DST start and end (UTC) of a year.
+ * A DST period of a whole year or more is permanent DST, as in the
+ * "0/0,J365/25" rules zic writes for it.
+ *
+ * @param year The year
+ */
+void PosixTimeZone::updateTransitions(int32_t year)
+{
+    _startUtc = ruleToLocal(year, _start) - _stdOffset;
+    _endUtc   = ruleToLocal(year, _end) - _dstOffset;
+    int32_t days = daysFromCivil(year + 1, 1, 1) - daysFromCivil(year, 1, 1);
+    _alwaysDst  = (_endUtc - _startUtc >= (time_t)days * 86400);
+    _cachedYear = year;
+}
+
+/**
+ * Gets the offset from UTC that applies at a moment.
+ *
+ * @param utc The moment (seconds since the epoch)
+ * @param isDst Optional, set to true when daylight saving time applies
+ * @return Seconds to add to UTC to get local time
+ */
+int32_t PosixTimeZone::getOffset(time_t utc, bool* isDst)
+{
+    bool dst = false;
+    if (_hasDst)
+    {
+        //-- The transitions are cached per year of local standard time
+        time_t  local = utc + _stdOffset;
+        int32_t days  = (int32_t)(local / 86400) - ((local % 86400) < 0 ? 1 : 0);
+        struct tm date;
+        civilFromDays(days, &date);
+        if (date.tm_year + 1900 != _cachedYear)
+        {
+            updateTransitions(date.tm_year + 1900);
+        }
+
+        if (_alwaysDst)
+        {
+            dst = true;
+        }
+        else if (_startUtc < _endUtc)
+        {
+            dst = (utc >= _startUtc && utc < _endUtc);
+        }
+        else
+        {
+            //-- Southern hemisphere: DST spans the new year
+            dst = !(utc >= _endUtc && utc < _startUtc);
+        }
+    }
+    if (isDst)
+    {
+        *isDst = dst;
+    }
+    return dst ? _dstOffset : _stdOffset;
+}
+
+/**
+ * Gets the next DST transition after a moment.
+ *
+ * @param utc The moment (seconds since the epoch)
+ * @return The UTC time of the next transition, or a far future time without DST
+ */
+time_t PosixTimeZone::getNextTransition(time_t utc)
+{
+    if (!_hasDst)
+    {
+        return (time_t)INT32_MAX;
+    }
+
+    //-- Make sure the transitions of this year are cached
+    getOffset(utc);
+    time_t next = (time_t)INT32_MAX;
+    if (_alwaysDst)
+    {
+        return next;
+    }
+    if (_startUtc > utc && _startUtc < next)
+    {
+        next = _startUtc;
+    }
+    if (_endUtc > utc && _endUtc < next)
+    {
+        next = _endUtc;
+    }
+    if (next == (time_t)INT32_MAX)
+    {
+        //-- Both passed, the first one of next year
+        time_t start = ruleToLocal(_cachedYear + 1, _start) - _stdOffset;
+        time_t end   = ruleToLocal(_cachedYear + 1, _end) - _dstOffset;
+        next = (start < end) ? start : end;
+    }
+    return next;
+}
+
+/**
+ * Converts UTC to broken-down local time without touching the environment.
+ *
+ * @param utc The moment (seconds since the epoch)
+ * @param result The structure to fill
+ */
+void PosixTimeZone::toLocal(time_t utc, struct tm* result)
+{
+    bool dst;
+    time_t  local = utc + getOffset(utc, &dst);
+    int32_t days  = (int32_t)(local / 86400);
+    int32_t secs  = (int32_t)(local % 86400);
+    if (secs < 0)
+    {
+        secs += 86400;
+        days -= 1;
+    }
+
+    civilFromDays(days, result);
+    result->tm_hour  = secs / 3600;
+    result->tm_min   = (secs / 60) % 60;
+    result->tm_sec   = secs % 60;
+    result->tm_isdst = dst ? 1 : 0;
+}
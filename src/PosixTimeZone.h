@@ -0,0 +1,56 @@
+#pragma once
+
+#include <Arduino.h>
+#include <time.h>
+
+/**
+ * A POSIX timezone string ("CET-1CEST,M3.5.0,M10.5.0/3") parsed once into
+ * offsets and DST rules, so local time can be calculated without setenv("TZ")
+ * and tzset(). The DST transitions of the current year are cached, which makes
+ * a conversion a few compares and a days-to-date calculation.
+ */
+class PosixTimeZone
+{
+  private:
+    struct Rule
+    {
+      uint8_t  type;      // 'M' (month.week.day), 'J' (Julian 1..365, no leap day) or 'N' (0..365)
+      uint8_t  month;
+      uint8_t  week;
+      uint8_t  wday;
+      uint16_t day;
+      int32_t  time;      // Seconds after local midnight
+    };
+
+    bool    _valid;
+    bool    _hasDst;
+    int32_t _stdOffset;   // Seconds east of UTC (local = utc + offset)
+    int32_t _dstOffset;
+    Rule    _start;
+    Rule    _end;
+
+    //-- Transitions of the cached year, as UTC
+    int32_t _cachedYear;
+    time_t  _startUtc;
+    time_t  _endUtc;
+    bool    _alwaysDst;   // The DST period covers the cached year ("EST5EDT,0/0,J365/25")
+
+    static bool parseName(const char*& p);
+    static bool parseTime(const char*& p, int32_t& seconds);
+    static bool parseRule(const char*& p, Rule& rule);
+    static time_t ruleToLocal(int32_t year, const Rule& rule);
+    void updateTransitions(int32_t year);
+
+  public:
+    PosixTimeZone();
+
+    bool parse(const char* posixString);
+    bool isValid() const { return _valid; }
+
+    int32_t getOffset(time_t utc, bool* isDst = nullptr);
+    time_t getNextTransition(time_t utc);
+    void toLocal(time_t utc, struct tm* result);
+
+    static int32_t daysFromCivil(int32_t year, uint32_t month, uint32_t day);
+    static void civilFromDays(int32_t days, struct tm* result);
+};
@@ -0,0 +1,753 @@
+#include "PullOTA.h"
+
+/**
+ * Constructor for the PullOTA class.
+ */
+PullOTA::PullOTA()
+    : _state(IDLE), _client(nullptr), _clientSecure(false), _secure(false), _caCert(nullptr),
+      #ifdef ESP8266
+      _trustAnchors(nullptr),
+      #endif
+      _host(), _path(), _port(80), _expected(), _verify(false), _sha(),
+      _received(0), _total(0), _skip(0), _updateStarted(false), _retries(0), _redirects(0),
+      _retryAt(0), _lastData(0), _status(0), _redirect(false), _line(), _lineLength(0),
+      _chunked(false), _chunkState(CHUNK_SIZE), _chunkLeft(0), _header(), _headerLength(0),
+      _decoder(nullptr), _compressed(false), _imageSize(0), _imageWritten(0), _error(nullptr),
+      _onStart(nullptr), _onProgress(nullptr), _onEnd(nullptr)
+{
+}
+
+/**
+ * Destructor for the PullOTA class, aborts a running download.
+ */
+PullOTA::~PullOTA()
+{
+    cancel();
+    if (_client)
+    {
+        delete _client;
+    }
+    if (_decoder)
+    {
+        delete _decoder;
+    }
+    #ifdef ESP8266
+    if (_trustAnchors)
+    {
+        delete _trustAnchors;
+    }
+    #endif
+}
+
+/**
+ * Starts downloading and flashing an image; handle() does the work.
+ *
+ * @param url http:// or https:// URL of the firmware image
+ * @param sha256 Expected SHA-256 of the image as 64 hex digits, nullptr to skip the check
+ * @return False if a download is running or the URL or hash can't be parsed
+ */
+bool PullOTA::begin(const char* url, const char* sha256)
+{
+    if (isActive() || !parseUrl(url))
+    {
+        return false;
+    }
+    _verify = (sha256 != nullptr);
+    if (_verify && !Sha256::parseHex(sha256, _expected))
+    {
+        return false;
+    }
+    _sha.reset();
+    _received      = 0;
+    _total         = 0;
+    _skip          = 0;
+    _updateStarted = false;
+    _headerLength  = 0;
+    _compressed    = false;
+    _imageSize     = 0;
+    _imageWritten  = 0;
+    _retries       = 0;
+    _redirects     = 0;
+    _retryAt       = millis();
+    _error         = nullptr;
+    _state         = CONNECTING;
+    return true;
+}
+
+/**
+ * Stops a running download; nothing that was flashed gets activated.
+ */
+void PullOTA::cancel()
+{
+    if (isActive())
+    {
+        fail("Cancelled");
+    }
+}
+
+/**
+ * Splits an http:// or https:// URL in host, port and path.
+ *
+ * @param url The URL
+ * @return False if it isn't a (short enough) http(s) URL
+ */
+bool PullOTA::parseUrl(const char* url)
+{
+    bool secure;
+    if (strncmp(url, "http://", 7) == 0)
+    {
+        secure = false;
+        url += 7;
+    }
+    else if (strncmp(url, "https://", 8) == 0)
+    {
+        secure = true;
+        url += 8;
+    }
+    else
+    {
+        return false;
+    }
+
+    size_t hostLength = strcspn(url, ":/");
+    if (hostLength == 0 || hostLength >= sizeof(_host))
+    {
+        return false;
+    }
+    const char* path = strchr(url, '/');
+    if (!path)
+    {
+        path = "/";
+    }
+    if (strlen(path) >= sizeof(_path))
+    {
+        return false;
+    }
+
+    uint16_t port = secure ? 443 : 80;
+    if (url[hostLength] == ':')
+    {
+        port = (uint16_t)atoi(url + hostLength + 1);
+        if (port == 0)
+        {
+            return false;
+        }
+    }
+    memcpy(_host, url, hostLength);
+    _host[hostLength] = 0;
+    strcpy(_path, path);
+    _port   = port;
+    _secure = secure;
+    return true;
+}
+
+/**
+ * Drives the download: connects, parses the response headers and flashes
+ * the body as it arrives. Returns when no data is waiting, or after
+ * PULL_OTA_BUDGET_MS. Call it from loop().
+ */
+void PullOTA::handle()
+{
+    switch (_state)
+    {
+        case CONNECTING:
+            if ((int32_t)(millis() - _retryAt) < 0)
+            {
+                return;
+            }
+            if (connect())
+            {
+                _state = HEADERS;
+            }
+            else
+            {
+                dropped();
+            }
+            return;
+
+        case HEADERS:
+            while (_state == HEADERS && readLine())
+            {
+                if (!parseHeader())
+                {
+                    return;
+                }
+            }
+            if (_state == HEADERS && !_client->available())
+            {
+                if (!_client->connected() || millis() - _lastData > PULL_OTA_TIMEOUT)
+                {
+                    dropped();
+                }
+            }
+            return;
+
+        case BODY:
+            readBody();
+            return;
+
+        default:
+            return;
+    }
+
+} //  PullOTA::handle()
+
+/**
+ * Opens the connection and sends the request, with a Range header when
+ * resuming.
+ *
+ * @return False if the connection failed
+ */
+bool PullOTA::connect()
+{
+    //-- (Re)create the client when the scheme changed
+    if (_client && _clientSecure != _secure)
+    {
+        delete _client;
+        _client = nullptr;
+    }
+    if (!_client)
+    {
+        if (_secure)
+        {
+            WiFiClientSecure* secure = new WiFiClientSecure();
+            if (_caCert)
+            {
+                #ifdef ESP8266
+                    if (!_trustAnchors)
+                    {
+                        _trustAnchors = new BearSSL::X509List(_caCert);
+                    }
+                    secure->setTrustAnchors(_trustAnchors);
+                #else
+                    secure->setCACert(_caCert);
+                #endif
+            }
+            else
+            {
+                //-- Without a CA the SHA-256 is what guards the image
+                secure->setInsecure();
+            }
+            _client = secure;
+        }
+        else
+        {
+            _client = new WiFiClient();
+        }
+        _clientSecure = _secure;
+    }
+
+    if (!_client->connect(_host, _port))
+    {
+        return false;
+    }
+
+    //-- The image buffer is free until the body starts, build the request in it
+    char*  request = (char*)_buffer;
+    size_t length  = snprintf(request, sizeof(_buffer), "GET %s HTTP/1.1\r\nHost: %s", _path, _host);
+    if (_port != (_secure ? 443 : 80))
+    {
+        length += snprintf(request + length, sizeof(_buffer) - length, ":%u", _port);
+    }
+    length += snprintf(request + length, sizeof(_buffer) - length
+                     , "\r\nUser-Agent: esp-networking\r\nConnection: close\r\n");
+    if (_received > 0)
+    {
+        length += snprintf(request + length, sizeof(_buffer) - length, "Range: bytes=%lu-\r\n"
+                         , (unsigned long)_received);
+    }
+    length += snprintf(request + length, sizeof(_buffer) - length, "\r\n");
+    _client->write((const uint8_t*)request, length);
+
+    _status     = 0;
+    _redirect   = false;
+    _lineLength = 0;
+    _chunked    = false;
+    _chunkState = CHUNK_SIZE;
+    _chunkLeft  = 0;
+    _lastData   = millis();
+    return true;
+}
+
+/**
+ * Reads what is available into the line buffer until a line is complete.
+ * The CR is dropped, a line longer than the buffer is cut off.
+ *
+ * @return True if _line holds a complete line
+ */
+bool PullOTA::readLine()
+{
+    while (_client->available() > 0)
+    {
+        int c = _client->read();
+        if (c < 0)
+        {
+            break;
+        }
+        _lastData = millis();
+        if (c == '\n')
+        {
+            _line[_lineLength] = 0;
+            _lineLength = 0;
+            return true;
+        }
+        if (c != '\r' && _lineLength < sizeof(_line) - 1)
+        {
+            _line[_lineLength++] = (char)c;
+        }
+    }
+    return false;
+}
+
+/**
+ * Handles the status line or a header line in _line.
+ *
+ * @return False if the download failed
+ */
+bool PullOTA::parseHeader()
+{
+    if (_status == 0)
+    {
+        const char* code = strchr(_line, ' ');
+        _status = code ? atoi(code + 1) : 0;
+        if (_status < 100)
+        {
+            fail("Bad HTTP response");
+            return false;
+        }
+        return true;
+    }
+    if (_line[0] == 0)
+    {
+        return startBody();
+    }
+
+    char* value = strchr(_line, ':');
+    if (!value)
+    {
+        return true;
+    }
+    *value++ = 0;
+    while (*value == ' ')
+    {
+        value++;
+    }
+
+    if (strcasecmp(_line, "Content-Length") == 0 && _status == 200)
+    {
+        uint32_t length = strtoul(value, nullptr, 10);
+        if (_total > 0 && length != _total)
+        {
+            fail("Image changed on the server");
+            return false;
+        }
+        _total = length;
+    }
+    else if (strcasecmp(_line, "Content-Range") == 0 && _status == 206)
+    {
+        //-- bytes <first>-<last>/<size>
+        const char* range = strchr(value, ' ');
+        const char* size  = strchr(value, '/');
+        uint32_t first = range ? strtoul(range + 1, nullptr, 10) : 0;
+        uint32_t total = (size && size[1] != '*') ? strtoul(size + 1, nullptr, 10) : 0;
+        if (first != _received || (_total > 0 && total != _total))
+        {
+            fail("Unexpected Content-Range");
+            return false;
+        }
+        _total = total;
+    }
+    else if (strcasecmp(_line, "Transfer-Encoding") == 0)
+    {
+        _chunked = (strncasecmp(value, "chunked", 7) == 0);
+    }
+    else if (strcasecmp(_line, "Location") == 0 && _status >= 300 && _status < 400)
+    {
+        //-- An absolute URL, or a path on the same server
+        if (value[0] == '/')
+        {
+            _redirect = strlen(value) < sizeof(_path);
+            if (_redirect)
+            {
+                strcpy(_path, value);
+            }
+        }
+        else
+        {
+            _redirect = parseUrl(value);
+        }
+    }
+    return true;
+
+} //  PullOTA::parseHeader()
+
+/**
+ * Acts on the status once the headers are complete: follows a redirect,
+ * starts (or continues) the update and moves on to the body.
+ *
+ * @return False if the download failed or is redirected
+ */
+bool PullOTA::startBody()
+{
+    if (_status >= 300 && _status < 400)
+    {
+        if (!_redirect || _redirects >= MAX_REDIRECTS)
+        {
+            fail("Redirect not followed");
+            return false;
+        }
+        _redirects++;
+        _client->stop();
+        _retryAt = millis();
+        _state   = CONNECTING;
+        return false;
+    }
+    if (_status == 200 && _received > 0)
+    {
+        //-- The server ignored the Range, skip what has been flashed already
+        _skip = _received;
+    }
+    else if (_status != 200 && _status != 206)
+    {
+        fail("HTTP error");
+        return false;
+    }
+
+    _state = BODY;
+    return true;
+}
+
+/**
+ * Looks at the first bytes of the download and starts the update: a
+ * compressed image announces its size and window in its header, a plain
+ * one is as large as the download. Until the header is complete the bytes
+ * are kept in _header.
+ *
+ * @param data The downloaded bytes, advanced past what is used here
+ * @param size Their number, reduced accordingly
+ * @return False if the update can't start
+ */
+bool PullOTA::startUpdate(const uint8_t*& data, size_t& size)
+{
+    static const uint8_t MAGIC[4] = { 'H', 'S', 'O', 'T' };
+
+    //-- Collect the header; the first byte that differs from the magic means a plain image
+    bool magic = true;
+    while (magic && size > 0 && _headerLength < HEADER_SIZE)
+    {
+        uint8_t c = *data++;
+        size--;
+        magic = (_headerLength >= sizeof(MAGIC) || c == MAGIC[_headerLength]);
+        _header[_headerLength++] = c;
+    }
+    bool whole = (_total > 0 && _received >= _total);
+    if (magic && _headerLength < HEADER_SIZE && !whole)
+    {
+        return true;   // Wait for the rest of the header
+    }
+
+    _compressed = magic && _headerLength == HEADER_SIZE;
+    if (_compressed)
+    {
+        _imageSize = (uint32_t)_header[8] | ((uint32_t)_header[9] << 8)
+                   | ((uint32_t)_header[10] << 16) | ((uint32_t)_header[11] << 24);
+        if (!_decoder)
+        {
+            _decoder = new HeatshrinkDecoder();
+        }
+        if (!_decoder->begin(_header[4], _header[5], [this](const uint8_t* out, size_t length) { return flash(out, length); }))
+        {
+            fail("Unsupported compression window");
+            return false;
+        }
+    }
+    else
+    {
+        _imageSize = _total;
+    }
+
+    size_t updateSize = _imageSize;
+    if (updateSize == 0)
+    {
+        #ifdef ESP8266
+            fail("Image size unknown");
+            return false;
+        #else
+            updateSize = UPDATE_SIZE_UNKNOWN;
+        #endif
+    }
+    if (!Update.begin(updateSize, U_FLASH))
+    {
+        fail("Not enough space for the image");
+        return false;
+    }
+    _updateStarted = true;
+    if (_onStart)
+    {
+        _onStart();
+    }
+
+    //-- Bytes of a plain image that were held back to look for the header
+    return _compressed || flash(_header, _headerLength);
+
+} //  PullOTA::startUpdate()
+
+/**
+ * Reads and flashes body data, decoding chunked transfer encoding.
+ * A connection that closes or stays silent for PULL_OTA_TIMEOUT before the
+ * image is complete is resumed.
+ */
+void PullOTA::readBody()
+{
+    uint32_t start    = millis();
+    bool     progress = false;
+
+    while (_state == BODY && millis() - start < PULL_OTA_BUDGET_MS && _client->available() > 0)
+    {
+        progress = true;
+        if (_chunked && _chunkState != CHUNK_DATA)
+        {
+            if (!readLine())
+            {
+                break;
+            }
+            if (_chunkState == CHUNK_CRLF)
+            {
+                _chunkState = CHUNK_SIZE;
+            }
+            else if (_chunkState == CHUNK_SIZE)
+            {
+                _chunkLeft  = strtoul(_line, nullptr, 16);
+                _chunkState = (_chunkLeft > 0) ? CHUNK_DATA : CHUNK_DONE;
+                if (_chunkState == CHUNK_DONE)
+                {
+                    finish();
+                    return;
+                }
+            }
+            continue;
+        }
+
+        size_t wanted = PULL_OTA_CHUNK_SIZE;
+        if (_chunked && _chunkLeft < wanted)
+        {
+            wanted = _chunkLeft;
+        }
+        int got = _client->read(_buffer, wanted);
+        if (got <= 0)
+        {
+            break;
+        }
+        _lastData = millis();
+        if (_chunked)
+        {
+            _chunkLeft -= got;
+            if (_chunkLeft == 0)
+            {
+                _chunkState = CHUNK_CRLF;
+            }
+        }
+        if (!writeImage(_buffer, got))
+        {
+            return;
+        }
+        if (_total > 0 && _received >= _total)
+        {
+            finish();
+            return;
+        }
+    }
+
+    if (_state != BODY || progress)
+    {
+        return;
+    }
+    if (!_client->connected())
+    {
+        //-- Without a length or chunks the end of the connection is the end of the image
+        if (_total == 0 && !_chunked)
+        {
+            finish();
+        }
+        else
+        {
+            dropped();
+        }
+    }
+    else if (millis() - _lastData > PULL_OTA_TIMEOUT)
+    {
+        dropped();
+    }
+
+} //  PullOTA::readBody()
+
+/**
+ * Hashes downloaded data and flashes it, through the decoder for a
+ * compressed image.
+ *
+ * @param data The bytes
+ * @param size The number of bytes
+ * @return False if flashing failed
+ */
+bool PullOTA::writeImage(const uint8_t* data, size_t size)
+{
+    if (_skip > 0)
+    {
+        size_t skipped = (size < _skip) ? size : _skip;
+        _skip -= skipped;
+        data  += skipped;
+        size  -= skipped;
+        if (size == 0)
+        {
+            return true;
+        }
+    }
+    if (_total > 0 && size > _total - _received)
+    {
+        size = _total - _received;
+    }
+    _sha.update(data, size);
+    _received += size;
+    _retries   = 0;
+
+    if (!_updateStarted && !startUpdate(data, size))
+    {
+        return false;
+    }
+    if (!_updateStarted || size == 0)
+    {
+        return true;
+    }
+    if (_compressed)
+    {
+        return _decoder->decode(data, size);
+    }
+    return flash(data, size);
+}
+
+/**
+ * Writes image bytes (decompressed if needed) to flash.
+ *
+ * @param data The bytes
+ * @param size The number of bytes
+ * @return False if flashing failed
+ */
+bool PullOTA::flash(const uint8_t* data, size_t size)
+{
+    if (size == 0)
+    {
+        return true;
+    }
+    if (_imageSize > 0 && size > _imageSize - _imageWritten)
+    {
+        fail("Image larger than announced");
+        return false;
+    }
+    if (Update.write((uint8_t*)data, size) != size)
+    {
+        fail("Flash write failed");
+        return false;
+    }
+    _imageWritten += size;
+    if (_onProgress)
+    {
+        _onProgress(_imageWritten, _imageSize);
+    }
+    return true;
+}
+
+/**
+ * Checks the image and activates it.
+ */
+void PullOTA::finish()
+{
+    _client->stop();
+    if ((_total > 0 && _received != _total) || (_imageSize > 0 && _imageWritten != _imageSize))
+    {
+        fail("Image incomplete");
+        return;
+    }
+    if (_verify)
+    {
+        uint8_t digest[Sha256::DIGEST_SIZE];
+        _sha.finish(digest);
+        if (memcmp(digest, _expected, sizeof(digest)) != 0)
+        {
+            fail("SHA-256 mismatch");
+            return;
+        }
+    }
+    if (!Update.end(true))
+    {
+        _updateStarted = false;
+        fail("Activating the image failed");
+        return;
+    }
+    _updateStarted = false;
+    _state = FINISHED;
+    if (_onEnd)
+    {
+        _onEnd(true);
+    }
+}
+
+/**
+ * The connection failed or dropped: retry with a growing delay, resuming
+ * where the image stopped, until PULL_OTA_RETRIES attempts in a row made
+ * no progress.
+ */
+void PullOTA::dropped()
+{
+    _client->stop();
+    if (_retries >= PULL_OTA_RETRIES)
+    {
+        fail("Connection lost");
+        return;
+    }
+    _retries++;
+    _retryAt = millis() + (1000UL << _retries);
+    _state   = CONNECTING;
+}
+
+/**
+ * Gives up: the partly written image is discarded.
+ *
+ * @param error What went wrong, see getError()
+ */
+void PullOTA::fail(const char* error)
+{
+    if (_client)
+    {
+        _client->stop();
+    }
+    abortUpdate();
+    _error = error;
+    _state = FAILED;
+    if (_onEnd)
+    {
+        _onEnd(false);
+    }
+}
+
+/**
+ * Discards a started update without activating it.
+ */
+void PullOTA::abortUpdate()
+{
+    if (!_updateStarted)
+    {
+        return;
+    }
+    _updateStarted = false;
+    #ifdef ESP8266
+        //-- The Updater has no abort(): end() refuses an incomplete image, and a
+        //-- complete one (rejected by the SHA-256) is refused through its MD5 check
+        if (Update.remaining() == 0)
+        {
+            Update.setMD5("00000000000000000000000000000000");
+        }
+        Update.end(false);
+    #else
+        Update.abort();
+    #endif
+}
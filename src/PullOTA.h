@@ -0,0 +1,132 @@
+#pragma once
+
+#ifdef ESP8266
+    #include <ESP8266WiFi.h>
+    #include <Updater.h>
+#else
+    #include <WiFi.h>
+    #include <Update.h>
+#endif
+#include <WiFiClientSecure.h>
+#include <functional>
+#include "Sha256.h"
+#include "HeatshrinkDecoder.h"
+
+#ifndef PULL_OTA_CHUNK_SIZE
+  #define PULL_OTA_CHUNK_SIZE 1024     // Bytes read and flashed per step, the only image buffer
+#endif
+#ifndef PULL_OTA_RETRIES
+  #define PULL_OTA_RETRIES 5           // Resume attempts without progress before giving up
+#endif
+#ifndef PULL_OTA_TIMEOUT
+  #define PULL_OTA_TIMEOUT 10000       // ms without data before the connection counts as dropped
+#endif
+#ifndef PULL_OTA_BUDGET_MS
+  #define PULL_OTA_BUDGET_MS 20        // Longest time handle() spends reading per call
+#endif
+
+/**
+ * Pull-mode firmware update: downloads an image over HTTP or HTTPS and
+ * flashes it while it streams in, PULL_OTA_CHUNK_SIZE bytes at a time.
+ * A dropped connection is resumed with a Range request where it stopped,
+ * and a SHA-256 computed over the stream is checked before the new image
+ * is activated. Driven from handle(), which never waits for data.
+ * Chunked transfer encoding and up to three redirects are followed.
+ * An image made with ota_compress.py (heatshrink, "HSOT" header) is
+ * decompressed on the fly; progress then counts decompressed bytes.
+ */
+class PullOTA
+{
+  public:
+    enum State : uint8_t { IDLE, CONNECTING, HEADERS, BODY, FINISHED, FAILED };
+
+  private:
+    enum ChunkState : uint8_t { CHUNK_SIZE, CHUNK_DATA, CHUNK_CRLF, CHUNK_DONE };
+
+    static const uint8_t MAX_REDIRECTS = 3;
+
+    State       _state;
+    WiFiClient* _client;
+    bool        _clientSecure;   // Type of _client, a redirect may switch scheme
+    bool        _secure;
+    const char* _caCert;
+    #ifdef ESP8266
+    BearSSL::X509List* _trustAnchors;
+    #endif
+    char        _host[64];
+    char        _path[192];
+    uint16_t    _port;
+
+    uint8_t     _expected[Sha256::DIGEST_SIZE];
+    bool        _verify;
+    Sha256      _sha;
+
+    uint32_t    _received;       // Downloaded bytes (compressed size for a compressed image)
+    uint32_t    _total;          // Download size, 0 while unknown
+    uint32_t    _skip;           // Bytes to discard when a server ignored the Range
+    bool        _updateStarted;
+    uint8_t     _retries;
+    uint8_t     _redirects;
+    uint32_t    _retryAt;
+    uint32_t    _lastData;
+
+    int         _status;
+    bool        _redirect;       // Got a usable Location header
+    char        _line[256];      // Header or chunk size line
+    uint16_t    _lineLength;
+    bool        _chunked;
+    ChunkState  _chunkState;
+    uint32_t    _chunkLeft;
+
+    //-- Compressed image: 'H' 'S' 'O' 'T', window bits, lookahead bits, 2 reserved, size (LE)
+    static const size_t HEADER_SIZE = 12;
+    uint8_t     _header[HEADER_SIZE];
+    uint8_t     _headerLength;
+    HeatshrinkDecoder* _decoder; // Created for the first compressed image
+    bool        _compressed;
+    uint32_t    _imageSize;      // Size of the flashed image, 0 while unknown
+    uint32_t    _imageWritten;
+
+    uint8_t     _buffer[PULL_OTA_CHUNK_SIZE];
+    const char* _error;
+
+    std::function<void()> _onStart;
+    std::function<void(uint32_t, uint32_t)> _onProgress;
+    std::function<void(bool)> _onEnd;
+
+    bool parseUrl(const char* url);
+    bool connect();
+    bool readLine();
+    bool parseHeader();
+    bool startBody();
+    void readBody();
+    bool writeImage(const uint8_t* data, size_t size);
+    bool startUpdate(const uint8_t*& data, size_t& size);
+    bool flash(const uint8_t* data, size_t size);
+    void finish();
+    void dropped();
+    void fail(const char* error);
+    void abortUpdate();
+
+  public:
+    PullOTA();
+    ~PullOTA();
+
+    bool begin(const char* url, const char* sha256 = nullptr);
+    void handle();
+    void cancel();
+    void setCACert(const char* pem) { _caCert = pem; }
+
+    void onStart(std::function<void()> callback) { _onStart = callback; }
+    void onProgress(std::function<void(uint32_t, uint32_t)> callback) { _onProgress = callback; }
+    void onEnd(std::function<void(bool)> callback) { _onEnd = callback; }
+
+    State getState() const { return _state; }
+    bool isActive() const { return _state == CONNECTING || _state == HEADERS || _state == BODY; }
+    uint32_t getReceived() const { return _received; }
+    uint32_t getTotal() const { return _total; }
+    uint32_t getImageWritten() const { return _imageWritten; }
+    uint32_t getImageSize() const { return _imageSize; }
+    bool isCompressed() const { return _compressed; }
+    const char* getError() const { return _error; }
+};
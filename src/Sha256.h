@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Incremental SHA-256 (FIPS 180-4), for checking a firmware image while it
+ * streams in. Portable, needs no TLS library; 104 bytes of state.
+ */
+class Sha256
+{
+  public:
+    static const size_t DIGEST_SIZE = 32;
+
+  private:
+    uint32_t _state[8];
+    uint64_t _length;        // Bytes hashed so far
+    uint8_t  _block[64];
+    uint8_t  _blockLength;
+
+    void transform(const uint8_t* block);
+
+  public:
+    Sha256() { reset(); }
+
+    void reset();
+    void update(const uint8_t* data, size_t size);
+    void finish(uint8_t digest[DIGEST_SIZE]);
+
+    static bool parseHex(const char* hex, uint8_t digest[DIGEST_SIZE]);
+    static void hmac(const uint8_t* key, size_t keyLength, const uint8_t* data, size_t size, uint8_t mac[DIGEST_SIZE]);
+};
@@ -0,0 +1,178 @@
+#include "UdpLog.h"
+
+/**
+ * Constructor for the UdpLog class.
+ *
+ * @param host The collector
+ * @param port Its UDP port (514 for syslog)
+ * @param format RAW or SYSLOG
+ */
+UdpLog::UdpLog(const IPAddress& host, uint16_t port, Format format)
+    : _udp(), _host(host), _port(port), _format(format), _hostname(nullptr),
+      _sequence(1), _datagrams(0), _failed(0), _dropped(0), _pending(), _pendingLength(0)
+{
+}
+
+/**
+ * Formats what goes in front of the lines of a datagram.
+ *
+ * @param header Destination
+ * @param size Room at the destination
+ * @param firstByte The first byte of the line (SYSLOG)
+ * @param levelByte The byte after it, the level of a "[E][tag] ..." line
+ * @return The length of the header
+ */
+size_t UdpLog::formatHeader(char* header, size_t size, uint8_t firstByte, uint8_t levelByte)
+{
+    const char* hostname = (_hostname && *_hostname) ? _hostname : "-";
+    int length;
+    if (_format == RAW)
+    {
+        length = snprintf(header, size, "#%lu %s\n", (unsigned long)_sequence, hostname);
+    }
+    else
+    {
+        //-- Severity: error 3, warning 4, informational 6, debug 7
+        uint8_t severity = 6;
+        if (firstByte == '[')
+        {
+            switch (levelByte)
+            {
+                case 'E': severity = 3; break;
+                case 'W': severity = 4; break;
+                case 'D':
+                case 'V': severity = 7; break;
+                default:  break;
+            }
+        }
+        length = snprintf(header, size, "<%u>1 - %s - - - [meta sequenceId=\"%lu\"] "
+                        , (unsigned)(UDPLOG_SYSLOG_FACILITY * 8 + severity), hostname, (unsigned long)_sequence);
+    }
+    return (length > 0 && (size_t)length < size) ? length : 0;
+}
+
+/**
+ * Sends one datagram from the front of the output, which may be split in
+ * two (the ring wrapping around): as many complete lines as fit (RAW) or
+ * the first line (SYSLOG). A line that doesn't fit a datagram on its own
+ * is split; an unfinished shorter one is left for later.
+ *
+ * @param first The oldest bytes
+ * @param firstLength Their number
+ * @param second The bytes after them, nullptr if none
+ * @param secondLength Their number
+ * @param complete The bytes end with a line, also without a line end
+ * @return The number of bytes used, 0 if there is no complete line yet
+ */
+size_t UdpLog::sendLines(const uint8_t* first, size_t firstLength, const uint8_t* second, size_t secondLength
+                       , bool complete)
+{
+    size_t total = firstLength + secondLength;
+    if (total == 0)
+    {
+        return 0;
+    }
+    auto at = [&](size_t i) -> uint8_t { return (i < firstLength) ? first[i] : second[i - firstLength]; };
+
+    char   header[96];
+    size_t headerLength = formatHeader(header, sizeof(header), at(0), (total > 1) ? at(1) : 0);
+    size_t room         = UDPLOG_PAYLOAD_SIZE - headerLength;
+    size_t limit        = (total < room) ? total : room;
+
+    //-- Up to the last line end that fits, or the first one for syslog ('\r' ends progress lines)
+    size_t cut = 0;
+    for (size_t i = 0; i < limit; i++)
+    {
+        if (at(i) == '\n' || at(i) == '\r')
+        {
+            cut = i + 1;
+            if (_format == SYSLOG)
+            {
+                break;
+            }
+        }
+    }
+    if (cut == 0)
+    {
+        if (total < room && !complete)
+        {
+            return 0;
+        }
+        cut = limit;
+    }
+
+    //-- A syslog message carries no line end, an empty one isn't sent
+    size_t length = cut;
+    if (_format == SYSLOG)
+    {
+        while (length > 0 && (at(length - 1) == '\n' || at(length - 1) == '\r'))
+        {
+            length--;
+        }
+        if (length == 0)
+        {
+            return cut;
+        }
+    }
+
+    bool sent = false;
+    if (_udp.beginPacket(_host, _port))
+    {
+        size_t part = (length < firstLength) ? length : firstLength;
+        _udp.write((const uint8_t*)header, headerLength);
+        _udp.write(first, part);
+        if (length > part)
+        {
+            _udp.write(second, length - part);
+        }
+        sent = _udp.endPacket();
+    }
+    if (sent)
+    {
+        _datagrams++;
+    }
+    else
+    {
+        _failed++;
+    }
+    _sequence++;
+    return cut;
+
+} //  UdpLog::sendLines()
+
+/**
+ * Takes output written outside ring buffer mode and sends the complete
+ * lines in it; what the flush policy released together goes out together.
+ *
+ * @param data The bytes
+ * @param size Their number
+ */
+void UdpLog::write(const uint8_t* data, size_t size)
+{
+    while (size > 0)
+    {
+        size_t chunk = sizeof(_pending) - _pendingLength;
+        if (chunk > size)
+        {
+            chunk = size;
+        }
+        memcpy(_pending + _pendingLength, data, chunk);
+        _pendingLength += chunk;
+        data += chunk;
+        size -= chunk;
+        flush();
+    }
+}
+
+/**
+ * Sends the complete lines written so far, an unfinished line is kept.
+ */
+void UdpLog::flush()
+{
+    size_t used;
+    while (_pendingLength > 0 && (used = sendLines(_pending, _pendingLength)) > 0)
+    {
+        memmove(_pending, _pending + used, _pendingLength - used);
+        _pendingLength -= used;
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#ifdef ESP8266
+    #include <ESP8266WiFi.h>
+#else
+    #include <WiFi.h>
+#endif
+#include <WiFiUdp.h>
+
+#ifndef UDPLOG_PAYLOAD_SIZE
+  #define UDPLOG_PAYLOAD_SIZE 1400     // Largest datagram, fits a 1500 byte MTU with IP and UDP headers
+#endif
+#ifndef UDPLOG_SYSLOG_FACILITY
+  #define UDPLOG_SYSLOG_FACILITY 16    // local0
+#endif
+
+/**
+ * Fire-and-forget log output over UDP, next to (or instead of) telnet:
+ * no connection state, no retransmits, so a bad link costs datagrams
+ * instead of stalling the output. MultiStream feeds it the same bytes as
+ * the telnet clients; only complete lines are sent (a line longer than a
+ * datagram is split).
+ *
+ * RAW    datagrams of as many lines as fit, after a "#<sequence> <hostname>\n"
+ *        header line
+ * SYSLOG one RFC 5424 message per line (RFC 5426 transport), the
+ *        sequence in [meta sequenceId], the severity from the "[E]"..."[V]"
+ *        prefix of Networking::log() lines
+ * Every datagram takes the next sequence number, also when sending it
+ * failed, so a collector sees every loss as a gap.
+ */
+class UdpLog
+{
+  public:
+    enum Format : uint8_t { RAW, SYSLOG };
+
+  private:
+    WiFiUDP     _udp;
+    IPAddress   _host;
+    uint16_t    _port;
+    Format      _format;
+    const char* _hostname;
+    uint32_t    _sequence;
+    uint32_t    _datagrams;      // Handed to the stack
+    uint32_t    _failed;         // Not sent, no route or no buffer
+    uint32_t    _dropped;        // Bytes skipped because they could not be sent in time
+
+    //-- Lines written outside ring buffer mode, assembled until a datagram is full
+    uint8_t     _pending[UDPLOG_PAYLOAD_SIZE];
+    size_t      _pendingLength;
+
+    size_t formatHeader(char* header, size_t size, uint8_t firstByte, uint8_t levelByte);
+
+  public:
+    UdpLog(const IPAddress& host, uint16_t port, Format format);
+
+    void setHostname(const char* hostname) { _hostname = hostname; }
+    size_t sendLines(const uint8_t* first, size_t firstLength, const uint8_t* second = nullptr, size_t secondLength = 0
+                   , bool complete = false);
+    void write(const uint8_t* data, size_t size);
+    void flush();
+    void addDropped(uint32_t bytes) { _dropped += bytes; }
+
+    const IPAddress& getHost() const { return _host; }
+    uint16_t getPort() const { return _port; }
+    Format getFormat() const { return _format; }
+    uint32_t getSequence() const { return _sequence; }
+    uint32_t getDatagrams() const { return _datagrams; }
+    uint32_t getFailed() const { return _failed; }
+    uint32_t getDropped() const { return _dropped; }
+};
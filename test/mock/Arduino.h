@@ -0,0 +1,108 @@
+#pragma once
+
+//-- Host stand-in for the Arduino core, just enough for the portable sources
+//-- and the native test suites (pio test -e native)
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#define IRAM_ATTR
+#define RTC_NOINIT_ATTR
+
+//-- The clock only moves when a test moves it
+inline uint32_t mockMillis = 0;
+inline uint32_t mockMicros = 0;
+
+inline uint32_t millis() { return mockMillis; }
+inline uint32_t micros() { return mockMicros; }
+inline void delay(uint32_t ms) { mockMillis += ms; mockMicros += ms * 1000; }
+inline void yield() {}
+
+class String
+{
+  private:
+    std::string _value;
+
+  public:
+    String(const char* value = "") : _value(value ? value : "") {}
+    const char* c_str() const { return _value.c_str(); }
+    size_t length() const { return _value.size(); }
+};
+
+class Print
+{
+  public:
+    virtual ~Print() {}
+
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size)
+    {
+        size_t written = 0;
+        while (size-- && write(*buffer++))
+        {
+            written++;
+        }
+        return written;
+    }
+    size_t write(const char* text) { return text ? write((const uint8_t*)text, strlen(text)) : 0; }
+    size_t write(const char* buffer, size_t size) { return write((const uint8_t*)buffer, size); }
+    virtual int availableForWrite() { return 0; }
+    virtual void flush() {}
+
+    size_t print(const char* text) { return write(text); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(long value) { return printf("%ld", value); }
+    size_t print(unsigned long value) { return printf("%lu", value); }
+    size_t print(int value) { return print((long)value); }
+    size_t print(unsigned int value) { return print((unsigned long)value); }
+    size_t println() { return print("\r\n"); }
+    template <typename T>
+    size_t println(T value) { size_t n = print(value); return n + println(); }
+
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)))
+    {
+        char buffer[256];
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+        if (length < 0)
+        {
+            return 0;
+        }
+        return write((const uint8_t*)buffer, ((size_t)length < sizeof(buffer)) ? length : sizeof(buffer) - 1);
+    }
+};
+
+class Stream : public Print
+{
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+};
+
+//-- RTC user memory and the reset reason, as the ESP8266 core has them
+class EspClass
+{
+  public:
+    uint32_t rtcMemory[128];
+
+    bool rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size)
+    {
+        memcpy(data, &rtcMemory[offset], size);
+        return true;
+    }
+    bool rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size)
+    {
+        memcpy(&rtcMemory[offset], data, size);
+        return true;
+    }
+    String getResetReason() { return String("Software/System restart"); }
+};
+inline EspClass ESP;
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+
+class IPAddress
+{
+  private:
+    uint8_t _bytes[4];
+
+  public:
+    IPAddress() : _bytes() {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : _bytes{ a, b, c, d } {}
+    uint8_t operator[](int index) const { return _bytes[index]; }
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * A serial port: what is written collects in output, read() takes from
+ * input. room is the free space in the UART buffer that
+ * availableForWrite() reports, a write never takes more.
+ */
+class MockStream : public Stream
+{
+  public:
+    std::string output;
+    std::string input;
+    int         room    = 1 << 20;
+    uint32_t    writes  = 0;
+    uint32_t    flushes = 0;
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override
+    {
+        if (size > (size_t)room)
+        {
+            size = room;
+        }
+        output.append((const char*)buffer, size);
+        room -= size;
+        writes++;
+        return size;
+    }
+    int availableForWrite() override { return room; }
+    void flush() override { flushes++; }
+
+    int available() override { return (int)input.size(); }
+    int read() override
+    {
+        if (input.empty())
+        {
+            return -1;
+        }
+        uint8_t c = input[0];
+        input.erase(0, 1);
+        return c;
+    }
+    int peek() override { return input.empty() ? -1 : (uint8_t)input[0]; }
+
+    using Print::write;
+};
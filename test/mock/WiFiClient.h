@@ -0,0 +1,61 @@
+#pragma once
+
+#include <Arduino.h>
+#include <memory>
+
+/**
+ * A telnet session: a handle to a socket, copies share it like the
+ * core's WiFiClient. A test reads what was sent from socket->sent and
+ * limits the free socket space with socket->room.
+ */
+class WiFiClient : public Stream
+{
+  public:
+    struct Socket
+    {
+      std::string sent;
+      std::string input;
+      bool        connected = true;
+      int         room      = 1 << 20;
+    };
+    std::shared_ptr<Socket> socket;
+
+    WiFiClient() {}
+    explicit WiFiClient(const std::shared_ptr<Socket>& socket) : socket(socket) {}
+
+    operator bool() const { return socket != nullptr; }
+    uint8_t connected() { return socket && socket->connected; }
+    void stop() { socket.reset(); }
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override
+    {
+        if (!connected())
+        {
+            return 0;
+        }
+        if (size > (size_t)socket->room)
+        {
+            size = socket->room;
+        }
+        socket->sent.append((const char*)buffer, size);
+        socket->room -= size;
+        return size;
+    }
+    int availableForWrite() override { return connected() ? socket->room : 0; }
+
+    int available() override { return socket ? (int)socket->input.size() : 0; }
+    int read() override
+    {
+        if (!available())
+        {
+            return -1;
+        }
+        uint8_t c = socket->input[0];
+        socket->input.erase(0, 1);
+        return c;
+    }
+    int peek() override { return available() ? (uint8_t)socket->input[0] : -1; }
+
+    using Print::write;
+};
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <ESP8266WiFi.h>
+#include <vector>
+
+//-- Keeps every datagram that was sent
+class WiFiUDP
+{
+  private:
+    std::string _packet;
+
+  public:
+    std::vector<std::string> datagrams;
+
+    int beginPacket(const IPAddress&, uint16_t) { _packet.clear(); return 1; }
+    size_t write(const uint8_t* buffer, size_t size) { _packet.append((const char*)buffer, size); return size; }
+    int endPacket() { datagrams.push_back(_packet); return 1; }
+};
@@ -0,0 +1,136 @@
+#include <unity.h>
+#include <MockStream.h>
+#include "CommandShell.h"
+
+//-- Line parsing with telnet negotiation, backspace and line ends, and dispatch
+
+static CommandShell* shell = nullptr;
+static MockStream*   in    = nullptr;
+static MockStream*   out   = nullptr;
+static std::string   lastArgs;
+static int           calls = 0;
+
+void setUp()
+{
+    shell = new CommandShell();
+    in    = new MockStream();
+    out   = new MockStream();
+    lastArgs.clear();
+    calls = 0;
+    shell->addCommand("echo", "echo <text>", [](char* args, Print& reply)
+    {
+        lastArgs = args;
+        calls++;
+        reply.print(args);
+    });
+}
+
+void tearDown()
+{
+    delete shell;
+    delete in;
+    delete out;
+}
+
+static void feed(const std::string& bytes, uint8_t source = 0)
+{
+    in->input += bytes;
+    shell->process(source, *in, *out);
+}
+
+void test_runs_a_command_with_arguments()
+{
+    feed("echo  hello world\r\n");
+    TEST_ASSERT_EQUAL(1, calls);
+    TEST_ASSERT_EQUAL_STRING("hello world", lastArgs.c_str());
+    TEST_ASSERT_EQUAL_STRING("hello world", out->output.c_str());
+}
+
+void test_line_ends_count_once()
+{
+    feed("echo a\r\necho b\recho c\r");
+    feed(std::string("\0echo d\n\n", 9));
+    TEST_ASSERT_EQUAL(4, calls);
+    TEST_ASSERT_EQUAL_STRING("d", lastArgs.c_str());
+}
+
+void test_partial_line_waits_for_its_end()
+{
+    feed("ech");
+    TEST_ASSERT_EQUAL(0, calls);
+    feed("o split\n");
+    TEST_ASSERT_EQUAL(1, calls);
+    TEST_ASSERT_EQUAL_STRING("split", lastArgs.c_str());
+}
+
+void test_sources_keep_their_own_line()
+{
+    feed("echo fr", 0);
+    feed("echo other\n", 1);
+    TEST_ASSERT_EQUAL_STRING("other", lastArgs.c_str());
+    feed("om zero\n", 0);
+    TEST_ASSERT_EQUAL_STRING("from zero", lastArgs.c_str());
+}
+
+void test_backspace()
+{
+    feed("echo abx\x08" "c\x7f" "d\n");
+    TEST_ASSERT_EQUAL_STRING("abd", lastArgs.c_str());
+}
+
+void test_negotiation_is_refused_and_stripped()
+{
+    //-- IAC WILL ECHO, IAC DO SUPPRESS-GO-AHEAD, IAC WONT LINEMODE in the middle of a line
+    feed("ec\xff\xfb\x01ho\xff\xfd\x03 x\xff\xfc\x22y\n");
+    TEST_ASSERT_EQUAL_STRING("xy", lastArgs.c_str());
+    TEST_ASSERT_TRUE(out->output.compare(0, 6, "\xff\xfe\x01\xff\xfc\x03") == 0);
+}
+
+void test_subnegotiation_is_skipped()
+{
+    //-- IAC SB NAWS 0 80 0 24 IAC SE, an IAC IAC inside does not end it
+    feed(std::string("echo \xff\xfa\x1f\x00\x50\xff\xff\x00\x18\xff\xf0ok\n", 19));
+    TEST_ASSERT_EQUAL_STRING("ok", lastArgs.c_str());
+    TEST_ASSERT_EQUAL_STRING("ok", out->output.c_str());
+}
+
+void test_interrupt_drops_the_line()
+{
+    feed("echo lost\xff\xf4" "echo kept\n");
+    TEST_ASSERT_EQUAL(1, calls);
+    TEST_ASSERT_EQUAL_STRING("kept", lastArgs.c_str());
+}
+
+void test_unknown_command_and_help()
+{
+    feed("nope\n");
+    TEST_ASSERT_EQUAL_STRING("Unknown command: nope (try help)\r\n", out->output.c_str());
+    out->output.clear();
+    feed("help\n");
+    TEST_ASSERT_EQUAL_STRING("help\r\necho - echo <text>\r\n", out->output.c_str());
+}
+
+void test_long_line_is_cut_off()
+{
+    //-- process() reads 2 * SHELL_LINE_SIZE bytes per call at most
+    feed("echo " + std::string(200, 'x') + "\n");
+    TEST_ASSERT_EQUAL(0, calls);
+    feed("");
+    TEST_ASSERT_EQUAL(SHELL_LINE_SIZE - 1 - 5, lastArgs.size());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_runs_a_command_with_arguments);
+    RUN_TEST(test_line_ends_count_once);
+    RUN_TEST(test_partial_line_waits_for_its_end);
+    RUN_TEST(test_sources_keep_their_own_line);
+    RUN_TEST(test_backspace);
+    RUN_TEST(test_negotiation_is_refused_and_stripped);
+    RUN_TEST(test_subnegotiation_is_skipped);
+    RUN_TEST(test_interrupt_drops_the_line);
+    RUN_TEST(test_unknown_command_and_help);
+    RUN_TEST(test_long_line_is_cut_off);
+    return UNITY_END();
+}
@@ -0,0 +1,185 @@
+#include <unity.h>
+#include <string>
+#include <vector>
+#include "HeatshrinkDecoder.h"
+
+//-- Round trips through an encoder that writes the stream like ota_compress.py
+
+void setUp() {}
+void tearDown() {}
+
+class BitWriter
+{
+  private:
+    uint8_t _byte  = 0;
+    uint8_t _count = 0;
+
+  public:
+    std::vector<uint8_t> out;
+
+    void put(uint32_t value, uint8_t bits)
+    {
+        for (int shift = bits - 1; shift >= 0; shift--)
+        {
+            _byte = (_byte << 1) | ((value >> shift) & 1);
+            if (++_count == 8)
+            {
+                out.push_back(_byte);
+                _byte  = 0;
+                _count = 0;
+            }
+        }
+    }
+
+    std::vector<uint8_t> finish()
+    {
+        if (_count)
+        {
+            out.push_back(_byte << (8 - _count));
+        }
+        return out;
+    }
+};
+
+//-- Greedy LZSS, the longest match in the window
+static std::vector<uint8_t> compress(const std::string& data, uint8_t windowBits, uint8_t lookaheadBits)
+{
+    size_t window    = (size_t)1 << windowBits;
+    size_t maxLength = (size_t)1 << lookaheadBits;
+    size_t minLength = (1 + windowBits + lookaheadBits) / 9 + 1;
+    BitWriter writer;
+    size_t i = 0;
+    while (i < data.size())
+    {
+        size_t bestLength   = 0;
+        size_t bestDistance = 0;
+        for (size_t distance = 1; distance <= window && distance <= i; distance++)
+        {
+            size_t length = 0;
+            while (length < maxLength && i + length < data.size() && data[i - distance + length] == data[i + length])
+            {
+                length++;
+            }
+            if (length > bestLength)
+            {
+                bestLength   = length;
+                bestDistance = distance;
+            }
+        }
+        if (bestLength >= minLength)
+        {
+            writer.put(0, 1);
+            writer.put(bestDistance - 1, windowBits);
+            writer.put(bestLength - 1, lookaheadBits);
+            i += bestLength;
+        }
+        else
+        {
+            writer.put(1, 1);
+            writer.put((uint8_t)data[i], 8);
+            i++;
+        }
+    }
+    return writer.finish();
+}
+
+static std::string sampleText()
+{
+    std::string text;
+    for (int i = 0; i < 200; i++)
+    {
+        text += "Networking:: line " + std::to_string(i % 17) + " aaaaaaaaaaaaaaaa ";
+        text += (char)(i * 37);
+    }
+    return text;
+}
+
+static std::string decompress(const std::vector<uint8_t>& stream, uint8_t windowBits, uint8_t lookaheadBits, size_t piece)
+{
+    HeatshrinkDecoder decoder;
+    std::string output;
+    TEST_ASSERT_TRUE(decoder.begin(windowBits, lookaheadBits, [&output](const uint8_t* data, size_t size)
+    {
+        output.append((const char*)data, size);
+        return true;
+    }));
+    for (size_t offset = 0; offset < stream.size(); offset += piece)
+    {
+        size_t size = (stream.size() - offset < piece) ? stream.size() - offset : piece;
+        TEST_ASSERT_TRUE(decoder.decode(&stream[offset], size));
+    }
+    return output;
+}
+
+void test_round_trip()
+{
+    std::string text = sampleText();
+    std::vector<uint8_t> stream = compress(text, 11, 4);
+    TEST_ASSERT_TRUE(stream.size() < text.size());
+    TEST_ASSERT_TRUE(decompress(stream, 11, 4, stream.size()) == text);
+}
+
+void test_round_trip_in_small_pieces()
+{
+    std::string text = sampleText();
+    std::vector<uint8_t> stream = compress(text, 8, 4);
+    TEST_ASSERT_TRUE(decompress(stream, 8, 4, 1) == text);
+    TEST_ASSERT_TRUE(decompress(stream, 8, 4, 7) == text);
+}
+
+void test_window_sizes()
+{
+    std::string text = sampleText();
+    const uint8_t settings[][2] = { { 4, 3 }, { 10, 5 }, { 12, 4 } };
+    for (const auto& setting : settings)
+    {
+        std::vector<uint8_t> stream = compress(text, setting[0], setting[1]);
+        TEST_ASSERT_TRUE(decompress(stream, setting[0], setting[1], 64) == text);
+    }
+}
+
+void test_overlapping_reference()
+{
+    //-- A run is one literal and a reference to itself
+    std::string text(300, 'x');
+    std::vector<uint8_t> stream = compress(text, 8, 4);
+    TEST_ASSERT_TRUE(stream.size() < 40);
+    TEST_ASSERT_TRUE(decompress(stream, 8, 4, 3) == text);
+}
+
+void test_unsupported_parameters()
+{
+    HeatshrinkDecoder decoder;
+    TEST_ASSERT_FALSE(decoder.begin(3, 3, nullptr));
+    TEST_ASSERT_FALSE(decoder.begin(HEATSHRINK_MAX_WINDOW_BITS + 1, 4, nullptr));
+    TEST_ASSERT_FALSE(decoder.begin(8, 8, nullptr));
+    TEST_ASSERT_FALSE(decoder.begin(8, 2, nullptr));
+}
+
+void test_sink_stops_decoding()
+{
+    std::string text = sampleText();
+    std::vector<uint8_t> stream = compress(text, 11, 4);
+    HeatshrinkDecoder decoder;
+    size_t received = 0;
+    decoder.begin(11, 4, [&received](const uint8_t*, size_t size)
+    {
+        received += size;
+        return false;
+    });
+    TEST_ASSERT_FALSE(decoder.decode(stream.data(), stream.size()));
+    TEST_ASSERT_TRUE(received > 0);
+    TEST_ASSERT_TRUE(received < text.size());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_round_trip_in_small_pieces);
+    RUN_TEST(test_window_sizes);
+    RUN_TEST(test_overlapping_reference);
+    RUN_TEST(test_unsupported_parameters);
+    RUN_TEST(test_sink_stops_decoding);
+    return UNITY_END();
+}
@@ -0,0 +1,309 @@
+#include <unity.h>
+#include <MockStream.h>
+#include "MultiStream.h"
+
+//-- MultiStream in direct and ring buffer mode against a mock serial port
+//-- and telnet session: wrap-around, per-sink read cursors, writeTo()
+
+static const size_t RING_SIZE = MULTISTREAM_RING_SIZE;
+
+static MockStream*  serial = nullptr;
+static MultiStream* multi  = nullptr;
+static std::shared_ptr<WiFiClient::Socket> session;
+
+void setUp()
+{
+    serial  = new MockStream();
+    multi   = new MultiStream(serial);
+    session = std::make_shared<WiFiClient::Socket>();
+    multi->addClient(WiFiClient(session));
+}
+
+void tearDown()
+{
+    delete multi;
+    delete serial;
+    session.reset();
+}
+
+//-- A line of exactly 'length' bytes that differs for every 'number'
+static std::string makeLine(uint32_t number, size_t length)
+{
+    char head[16];
+    snprintf(head, sizeof(head), "%05u ", (unsigned)number);
+    std::string line(head);
+    while (line.size() < length - 1)
+    {
+        line += (char)('a' + (number + line.size()) % 26);
+    }
+    return line + "\n";
+}
+
+static size_t writeString(const std::string& text)
+{
+    return multi->write((const uint8_t*)text.data(), text.size());
+}
+
+void test_direct_write_reaches_both_sinks()
+{
+    multi->print("hello\n");
+    TEST_ASSERT_EQUAL_STRING("hello\n", serial->output.c_str());
+    TEST_ASSERT_EQUAL_STRING("hello\n", session->sent.c_str());
+    TEST_ASSERT_EQUAL(6, multi->getSerialBytes());
+    TEST_ASSERT_EQUAL(6, multi->getTelnetBytes());
+}
+
+void test_direct_coalesce_bytes_waits_for_threshold()
+{
+    multi->setFlushPolicy(FlushPolicy::coalesceBytes(16));
+    uint32_t flushes = serial->flushes;
+    writeString("0123456789");
+    TEST_ASSERT_EQUAL(0, serial->output.size());
+    writeString("0123456789");
+    TEST_ASSERT_EQUAL(20, serial->output.size());
+    TEST_ASSERT_EQUAL(20, session->sent.size());
+    TEST_ASSERT_EQUAL(flushes, serial->flushes);
+}
+
+void test_direct_coalesce_fills_a_segment()
+{
+    multi->setFlushPolicy(FlushPolicy::coalesceBytes());
+    std::string first(MULTISTREAM_SEGMENT_SIZE - 100, 'x');
+    writeString(first);
+    TEST_ASSERT_EQUAL(0, serial->writes);
+    writeString(std::string(100, 'y'));
+    TEST_ASSERT_EQUAL(1, serial->writes);
+    TEST_ASSERT_EQUAL(MULTISTREAM_SEGMENT_SIZE, serial->output.size());
+}
+
+void test_direct_manual_flush()
+{
+    multi->setFlushPolicy(FlushPolicy::manual());
+    multi->print("queued\n");
+    TEST_ASSERT_EQUAL(0, serial->output.size());
+    multi->flush();
+    TEST_ASSERT_EQUAL_STRING("queued\n", serial->output.c_str());
+}
+
+void test_direct_output_reaches_the_boot_log()
+{
+    BootLog log;
+    log.begin();
+    multi->setBootLog(&log);
+    multi->println("println line");
+    multi->print("print text\n");
+    multi->printf("printf line %d\n", 1);
+    multi->setBootLog(nullptr);
+
+    //-- What the next boot finds in RTC memory
+    BootLog next;
+    next.begin();
+    MockStream previous;
+    next.printPrevious(previous);
+    TEST_ASSERT_TRUE(previous.output.find("println line\r\nprint text\nprintf line 1\n") != std::string::npos);
+}
+
+void test_ring_write_waits_for_drain()
+{
+    multi->setRingBufferMode(true);
+    multi->print("line\n");
+    TEST_ASSERT_EQUAL(0, serial->output.size());
+    multi->drain();
+    TEST_ASSERT_EQUAL_STRING("line\n", serial->output.c_str());
+    TEST_ASSERT_EQUAL_STRING("line\n", session->sent.c_str());
+}
+
+void test_ring_wraps_around()
+{
+    multi->setRingBufferMode(true);
+    std::string expected;
+    for (uint32_t i = 0; i < 3 * RING_SIZE / 50; i++)
+    {
+        std::string line = makeLine(i, 50);
+        TEST_ASSERT_EQUAL(line.size(), writeString(line));
+        expected += line;
+        multi->drain();
+    }
+    TEST_ASSERT_TRUE(expected.size() > 2 * RING_SIZE);
+    TEST_ASSERT_TRUE(serial->output == expected);
+    TEST_ASSERT_TRUE(session->sent == expected);
+    TEST_ASSERT_EQUAL(0, multi->getOverflowBytes());
+}
+
+void test_ring_full_rejects_whole_chunks()
+{
+    multi->setRingBufferMode(true);
+    serial->room = 0;
+    std::string accepted;
+    uint32_t rejected = 0;
+    for (uint32_t i = 0; i < RING_SIZE / 30 + 5; i++)
+    {
+        std::string line = makeLine(i, 30);
+        if (writeString(line) == line.size())
+        {
+            accepted += line;
+        }
+        else
+        {
+            rejected += line.size();
+        }
+        multi->drain();
+    }
+    TEST_ASSERT_TRUE(rejected > 0);
+    TEST_ASSERT_EQUAL(rejected, multi->getOverflowBytes());
+
+    serial->room = 1 << 20;
+    multi->drain();
+    TEST_ASSERT_TRUE(serial->output == accepted);
+}
+
+void test_ring_sinks_have_their_own_cursor()
+{
+    multi->setRingBufferMode(true);
+    session->room = 10;
+    std::string text = makeLine(1, 40) + makeLine(2, 40);
+    writeString(text);
+    multi->drain();
+    TEST_ASSERT_TRUE(serial->output == text);
+    TEST_ASSERT_EQUAL(10, session->sent.size());
+
+    //-- The session catches up from where it stopped, also across the end of the ring
+    session->room = 1 << 20;
+    multi->drain();
+    TEST_ASSERT_TRUE(session->sent == text);
+}
+
+void test_ring_slow_session_is_skipped_forward()
+{
+    multi->setRingBufferMode(true);
+    session->room = 0;
+    size_t written = 0;
+    for (uint32_t i = 0; written <= RING_SIZE / 2; i++)
+    {
+        written += writeString(makeLine(i, 64));
+        multi->drain();
+    }
+    TEST_ASSERT_EQUAL(0, session->sent.size());
+    TEST_ASSERT_TRUE(multi->getDroppedBytes(0) > 0);
+    TEST_ASSERT_EQUAL(multi->getDroppedBytes(0), multi->getDroppedBytes());
+    TEST_ASSERT_EQUAL(written, serial->output.size());
+}
+
+void test_writeto_bypasses_the_ring_when_caught_up()
+{
+    multi->setRingBufferMode(true);
+    multi->writeTo(MultiStream::SINK_TELNET, (const uint8_t*)"telnet\n", 7);
+    TEST_ASSERT_EQUAL_STRING("telnet\n", session->sent.c_str());
+    TEST_ASSERT_EQUAL(0, serial->output.size());
+    multi->drain();
+    TEST_ASSERT_EQUAL(0, serial->output.size());
+}
+
+void test_writeto_queues_for_a_sink_that_is_behind()
+{
+    multi->setRingBufferMode(true);
+    serial->room = 0;
+    multi->print("both\n");
+    multi->drain();
+    TEST_ASSERT_EQUAL_STRING("both\n", session->sent.c_str());
+
+    //-- Serial is behind: nothing is dropped and each sink keeps its order
+    TEST_ASSERT_EQUAL(7, multi->writeTo(MultiStream::SINK_SERIAL, (const uint8_t*)"serial\n", 7));
+    TEST_ASSERT_EQUAL(7, multi->writeTo(MultiStream::SINK_TELNET, (const uint8_t*)"telnet\n", 7));
+    multi->print("after\n");
+    serial->room = 1 << 20;
+    multi->drain();
+    TEST_ASSERT_EQUAL_STRING("both\nserial\nafter\n", serial->output.c_str());
+    TEST_ASSERT_EQUAL_STRING("both\ntelnet\nafter\n", session->sent.c_str());
+    TEST_ASSERT_EQUAL(0, multi->getOverflowBytes());
+
+    //-- Every range was passed, so writes bypass the ring again
+    multi->writeTo(MultiStream::SINK_SERIAL, (const uint8_t*)"direct\n", 7);
+    TEST_ASSERT_EQUAL_STRING("both\nserial\nafter\ndirect\n", serial->output.c_str());
+}
+
+void test_writeto_counts_overflow_when_the_range_table_is_full()
+{
+    multi->setRingBufferMode(true);
+    serial->room = 0;
+    multi->print("x\n");
+    for (int i = 0; i < MULTISTREAM_SINK_RANGES; i++)
+    {
+        TEST_ASSERT_EQUAL(2, multi->writeTo(MultiStream::SINK_TELNET, (const uint8_t*)"t\n", 2));
+    }
+    TEST_ASSERT_EQUAL(0, multi->writeTo(MultiStream::SINK_TELNET, (const uint8_t*)"t\n", 2));
+    TEST_ASSERT_EQUAL(2, multi->getOverflowBytes());
+}
+
+void test_history_survives_a_printf_that_does_not_fit()
+{
+    multi->setRingBufferMode(true);
+    std::string written;
+    for (uint32_t i = 0; i < RING_SIZE / 64; i++)
+    {
+        std::string line = makeLine(i, 64);
+        written += line;
+        writeString(line);
+        multi->drain();
+    }
+
+    //-- Fill the ring up to 200 bytes with serial stuck, then a longer printf() is rejected
+    serial->room = 0;
+    for (uint32_t i = 0; i < (RING_SIZE - 200) / 8; i++)
+    {
+        std::string line = makeLine(i, 8);
+        written += line;
+        writeString(line);
+    }
+    char big[301];
+    memset(big, 'z', 300);
+    big[300] = 0;
+    TEST_ASSERT_EQUAL(0, multi->printf("%s\n", big));
+
+    uint32_t position = multi->getHistoryStart(RING_SIZE);
+    uint32_t end      = multi->getHistoryEnd();
+    std::string history(end - position, 0);
+    size_t copied = multi->copyHistory(position, end, (uint8_t*)&history[0], history.size());
+    history.resize(copied);
+    TEST_ASSERT_TRUE(copied > 0);
+    TEST_ASSERT_TRUE(written.compare(written.size() - copied, copied, history) == 0);
+}
+
+void test_printf_in_the_ring()
+{
+    multi->setRingBufferMode(true);
+    TEST_ASSERT_EQUAL(12, multi->printf("value %d!\n", 1234));
+    multi->drain();
+    TEST_ASSERT_EQUAL_STRING("value 1234!\n", serial->output.c_str());
+    TEST_ASSERT_EQUAL(0, multi->getTruncatedPrints());
+}
+
+void test_leaving_ring_mode_sends_the_rest()
+{
+    multi->setRingBufferMode(true);
+    multi->print("pending\n");
+    multi->setRingBufferMode(false);
+    TEST_ASSERT_EQUAL_STRING("pending\n", serial->output.c_str());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_direct_write_reaches_both_sinks);
+    RUN_TEST(test_direct_coalesce_bytes_waits_for_threshold);
+    RUN_TEST(test_direct_coalesce_fills_a_segment);
+    RUN_TEST(test_direct_manual_flush);
+    RUN_TEST(test_direct_output_reaches_the_boot_log);
+    RUN_TEST(test_ring_write_waits_for_drain);
+    RUN_TEST(test_ring_wraps_around);
+    RUN_TEST(test_ring_full_rejects_whole_chunks);
+    RUN_TEST(test_ring_sinks_have_their_own_cursor);
+    RUN_TEST(test_ring_slow_session_is_skipped_forward);
+    RUN_TEST(test_writeto_bypasses_the_ring_when_caught_up);
+    RUN_TEST(test_writeto_queues_for_a_sink_that_is_behind);
+    RUN_TEST(test_writeto_counts_overflow_when_the_range_table_is_full);
+    RUN_TEST(test_history_survives_a_printf_that_does_not_fit);
+    RUN_TEST(test_printf_in_the_ring);
+    RUN_TEST(test_leaving_ring_mode_sends_the_rest);
+    return UNITY_END();
+}
@@ -0,0 +1,90 @@
+#include <unity.h>
+#include "NtpFormat.h"
+
+//-- Compiled strftime()-like patterns
+
+static struct tm moment;
+
+void setUp()
+{
+    //-- Tuesday 2024-03-05 13:04:09, day 65 of the year
+    memset(&moment, 0, sizeof(moment));
+    moment.tm_year = 124;
+    moment.tm_mon  = 2;
+    moment.tm_mday = 5;
+    moment.tm_hour = 13;
+    moment.tm_min  = 4;
+    moment.tm_sec  = 9;
+    moment.tm_wday = 2;
+    moment.tm_yday = 64;
+}
+
+void tearDown() {}
+
+static std::string format(const char* pattern, uint16_t millis = 0, size_t size = 128)
+{
+    NtpFormat compiled(pattern);
+    char buffer[128];
+    size_t length = compiled.format(buffer, size, moment, millis);
+    TEST_ASSERT_EQUAL(strlen(buffer), length);
+    return std::string(buffer);
+}
+
+void test_conversions()
+{
+    TEST_ASSERT_EQUAL_STRING("2024-03-05 13:04:09.042", format("%Y-%m-%d %H:%M:%S.%L", 42).c_str());
+    TEST_ASSERT_EQUAL_STRING("24 01PM 065", format("%y %I%p %j").c_str());
+    TEST_ASSERT_EQUAL_STRING("Tue Mar  5", format("%a %b %e").c_str());
+    TEST_ASSERT_EQUAL_STRING("100%", format("100%%").c_str());
+}
+
+void test_twelve_hour_clock()
+{
+    moment.tm_hour = 0;
+    TEST_ASSERT_EQUAL_STRING("12AM", format("%I%p").c_str());
+    moment.tm_hour = 12;
+    TEST_ASSERT_EQUAL_STRING("12PM", format("%I%p").c_str());
+}
+
+void test_unknown_conversion_is_copied()
+{
+    TEST_ASSERT_EQUAL_STRING("%X 13 %Q", format("%X %H %Q").c_str());
+    TEST_ASSERT_EQUAL_STRING("50%", format("50%").c_str());
+}
+
+void test_long_literal_text()
+{
+    const char* pattern = "The time in the office right now is %H:%M, have a nice day";
+    NtpFormat compiled(pattern);
+    TEST_ASSERT_TRUE(compiled.isValid());
+    TEST_ASSERT_EQUAL_STRING("The time in the office right now is 13:04, have a nice day", format(pattern).c_str());
+}
+
+void test_too_many_fields_is_invalid()
+{
+    NtpFormat compiled("%H%M%S%H%M%S%H%M%S%H%M%S%H%M%S%H%M%S%H%M%S");
+    TEST_ASSERT_FALSE(compiled.isValid());
+    char buffer[16] = "untouched";
+    TEST_ASSERT_EQUAL(0, compiled.format(buffer, sizeof(buffer), moment));
+    TEST_ASSERT_EQUAL_STRING("", buffer);
+}
+
+void test_output_is_cut_off_at_the_buffer()
+{
+    TEST_ASSERT_EQUAL_STRING("2024-03", format("%Y-%m-%d", 0, 8).c_str());
+    NtpFormat compiled("%H");
+    char buffer[4];
+    TEST_ASSERT_EQUAL(0, compiled.format(buffer, 0, moment));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_conversions);
+    RUN_TEST(test_twelve_hour_clock);
+    RUN_TEST(test_unknown_conversion_is_copied);
+    RUN_TEST(test_long_literal_text);
+    RUN_TEST(test_too_many_fields_is_invalid);
+    RUN_TEST(test_output_is_cut_off_at_the_buffer);
+    return UNITY_END();
+}
@@ -0,0 +1,149 @@
+#include <unity.h>
+#include "PosixTimeZone.h"
+
+//-- Offsets and transitions of the README zones, checked against tzdata
+
+void setUp() {}
+void tearDown() {}
+
+//-- UTC seconds of a civil date and time
+static time_t utc(int32_t year, uint32_t month, uint32_t day, int hour = 0, int minute = 0)
+{
+    return (time_t)PosixTimeZone::daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60;
+}
+
+void test_civil_days_round_trip()
+{
+    TEST_ASSERT_EQUAL(0, PosixTimeZone::daysFromCivil(1970, 1, 1));
+    TEST_ASSERT_EQUAL(19782, PosixTimeZone::daysFromCivil(2024, 2, 29));
+    for (int32_t days = -800; days < 60000; days += 37)
+    {
+        struct tm date;
+        PosixTimeZone::civilFromDays(days, &date);
+        TEST_ASSERT_EQUAL(days, PosixTimeZone::daysFromCivil(date.tm_year + 1900, date.tm_mon + 1, date.tm_mday));
+    }
+}
+
+void test_utc_without_rules()
+{
+    PosixTimeZone zone;
+    TEST_ASSERT_TRUE(zone.parse("UTC0"));
+    bool dst = true;
+    TEST_ASSERT_EQUAL(0, zone.getOffset(utc(2024, 7, 1), &dst));
+    TEST_ASSERT_FALSE(dst);
+    TEST_ASSERT_EQUAL(INT32_MAX, zone.getNextTransition(utc(2024, 7, 1)));
+}
+
+void test_invalid_strings()
+{
+    PosixTimeZone zone;
+    TEST_ASSERT_FALSE(zone.parse(nullptr));
+    TEST_ASSERT_FALSE(zone.parse(""));
+    TEST_ASSERT_FALSE(zone.parse("CET"));
+    TEST_ASSERT_FALSE(zone.parse("CET-1CEST,M13.5.0,M10.5.0/3"));
+    TEST_ASSERT_FALSE(zone.parse("CET-1CEST,M3.5.0"));
+    TEST_ASSERT_FALSE(zone.isValid());
+}
+
+void test_central_europe()
+{
+    PosixTimeZone zone;
+    TEST_ASSERT_TRUE(zone.parse("CET-1CEST,M3.5.0,M10.5.0/3"));
+    bool dst;
+    TEST_ASSERT_EQUAL(3600, zone.getOffset(utc(2024, 3, 31, 0, 59), &dst));
+    TEST_ASSERT_FALSE(dst);
+    TEST_ASSERT_EQUAL(7200, zone.getOffset(utc(2024, 3, 31, 1, 0), &dst));
+    TEST_ASSERT_TRUE(dst);
+    TEST_ASSERT_EQUAL(7200, zone.getOffset(utc(2024, 10, 27, 0, 59)));
+    TEST_ASSERT_EQUAL(3600, zone.getOffset(utc(2024, 10, 27, 1, 0)));
+    TEST_ASSERT_EQUAL(utc(2024, 3, 31, 1), zone.getNextTransition(utc(2024, 1, 1)));
+    TEST_ASSERT_EQUAL(utc(2024, 10, 27, 1), zone.getNextTransition(utc(2024, 6, 1)));
+    TEST_ASSERT_EQUAL(utc(2025, 3, 30, 1), zone.getNextTransition(utc(2024, 12, 1)));
+}
+
+void test_us_eastern_and_default_rules()
+{
+    PosixTimeZone zone;
+    TEST_ASSERT_TRUE(zone.parse("EST5EDT,M3.2.0,M11.1.0"));
+    TEST_ASSERT_EQUAL(-5 * 3600, zone.getOffset(utc(2024, 3, 10, 6, 59)));
+    TEST_ASSERT_EQUAL(-4 * 3600, zone.getOffset(utc(2024, 3, 10, 7, 0)));
+    TEST_ASSERT_EQUAL(-4 * 3600, zone.getOffset(utc(2024, 11, 3, 5, 59)));
+    TEST_ASSERT_EQUAL(-5 * 3600, zone.getOffset(utc(2024, 11, 3, 6, 0)));
+
+    //-- Without rules the US rules apply, like newlib
+    PosixTimeZone bare;
+    TEST_ASSERT_TRUE(bare.parse("EST5EDT"));
+    TEST_ASSERT_EQUAL(-4 * 3600, bare.getOffset(utc(2024, 7, 1)));
+}
+
+void test_southern_hemisphere()
+{
+    PosixTimeZone zone;
+    TEST_ASSERT_TRUE(zone.parse("AEST-10AEDT,M10.1.0,M4.1.0/3"));
+    bool dst;
+    TEST_ASSERT_EQUAL(11 * 3600, zone.getOffset(utc(2024, 1, 15), &dst));
+    TEST_ASSERT_TRUE(dst);
+    TEST_ASSERT_EQUAL(10 * 3600, zone.getOffset(utc(2024, 7, 1), &dst));
+    TEST_ASSERT_FALSE(dst);
+    TEST_ASSERT_EQUAL(utc(2024, 4, 6, 16), zone.getNextTransition(utc(2024, 3, 1)));
+    TEST_ASSERT_EQUAL(utc(2024, 10, 5, 16), zone.getNextTransition(utc(2024, 7, 1)));
+}
+
+void test_quoted_names_and_julian_days()
+{
+    PosixTimeZone zone;
+    TEST_ASSERT_TRUE(zone.parse("<+0530>-5:30"));
+    TEST_ASSERT_EQUAL(5 * 3600 + 1800, zone.getOffset(utc(2024, 7, 1)));
+
+    //-- J60 is March 1st, also in a leap year
+    PosixTimeZone julian;
+    TEST_ASSERT_TRUE(julian.parse("XXX0YYY,J60/0,J300/0"));
+    TEST_ASSERT_EQUAL(0, julian.getOffset(utc(2024, 2, 29, 23)));
+    TEST_ASSERT_EQUAL(3600, julian.getOffset(utc(2024, 3, 1, 0)));
+}
+
+void test_permanent_dst()
+{
+    //-- zic writes this for a zone on DST all year
+    PosixTimeZone zone;
+    TEST_ASSERT_TRUE(zone.parse("EST5EDT,0/0,J365/25"));
+    bool dst;
+    const time_t moments[] = { utc(2023, 1, 1, 0), utc(2023, 12, 31, 23, 59), utc(2024, 1, 1, 4, 59)
+                             , utc(2024, 1, 1, 5), utc(2024, 2, 29, 12), utc(2024, 12, 31, 23, 30) };
+    for (time_t moment : moments)
+    {
+        TEST_ASSERT_EQUAL(-4 * 3600, zone.getOffset(moment, &dst));
+        TEST_ASSERT_TRUE(dst);
+    }
+    TEST_ASSERT_EQUAL(INT32_MAX, zone.getNextTransition(utc(2024, 6, 1)));
+}
+
+void test_to_local()
+{
+    PosixTimeZone zone;
+    zone.parse("CET-1CEST,M3.5.0,M10.5.0/3");
+    struct tm local;
+    zone.toLocal(utc(2024, 7, 14, 22, 30), &local);
+    TEST_ASSERT_EQUAL(124, local.tm_year);
+    TEST_ASSERT_EQUAL(6, local.tm_mon);
+    TEST_ASSERT_EQUAL(15, local.tm_mday);
+    TEST_ASSERT_EQUAL(0, local.tm_hour);
+    TEST_ASSERT_EQUAL(30, local.tm_min);
+    TEST_ASSERT_EQUAL(1, local.tm_isdst);
+    TEST_ASSERT_EQUAL(1, local.tm_wday);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_civil_days_round_trip);
+    RUN_TEST(test_utc_without_rules);
+    RUN_TEST(test_invalid_strings);
+    RUN_TEST(test_central_europe);
+    RUN_TEST(test_us_eastern_and_default_rules);
+    RUN_TEST(test_southern_hemisphere);
+    RUN_TEST(test_quoted_names_and_julian_days);
+    RUN_TEST(test_permanent_dst);
+    RUN_TEST(test_to_local);
+    return UNITY_END();
+}
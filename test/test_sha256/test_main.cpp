@@ -0,0 +1,108 @@
+#include <unity.h>
+#include <string.h>
+#include "Sha256.h"
+
+//-- FIPS 180-4 and RFC 4231 test vectors
+
+void setUp() {}
+void tearDown() {}
+
+static void assertDigest(const char* expected, const uint8_t digest[Sha256::DIGEST_SIZE])
+{
+    uint8_t parsed[Sha256::DIGEST_SIZE];
+    TEST_ASSERT_TRUE(Sha256::parseHex(expected, parsed));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(parsed, digest, Sha256::DIGEST_SIZE);
+}
+
+static void assertHash(const char* expected, const char* message)
+{
+    Sha256  sha;
+    uint8_t digest[Sha256::DIGEST_SIZE];
+    sha.update((const uint8_t*)message, strlen(message));
+    sha.finish(digest);
+    assertDigest(expected, digest);
+}
+
+void test_short_messages()
+{
+    assertHash("e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855", "");
+    assertHash("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", "abc");
+}
+
+void test_two_blocks()
+{
+    assertHash("248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"
+             , "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq");
+}
+
+void test_million_a_in_uneven_pieces()
+{
+    uint8_t piece[997];
+    memset(piece, 'a', sizeof(piece));
+    Sha256 sha;
+    size_t left = 1000000;
+    while (left > 0)
+    {
+        size_t size = (left < sizeof(piece)) ? left : sizeof(piece);
+        sha.update(piece, size);
+        left -= size;
+    }
+    uint8_t digest[Sha256::DIGEST_SIZE];
+    sha.finish(digest);
+    assertDigest("cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0", digest);
+}
+
+void test_reset_starts_over()
+{
+    Sha256 sha;
+    sha.update((const uint8_t*)"garbage", 7);
+    sha.reset();
+    sha.update((const uint8_t*)"abc", 3);
+    uint8_t digest[Sha256::DIGEST_SIZE];
+    sha.finish(digest);
+    assertDigest("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", digest);
+}
+
+void test_hmac()
+{
+    uint8_t mac[Sha256::DIGEST_SIZE];
+
+    uint8_t key1[20];
+    memset(key1, 0x0b, sizeof(key1));
+    Sha256::hmac(key1, sizeof(key1), (const uint8_t*)"Hi There", 8, mac);
+    assertDigest("b0344c61d8db38535ca8afceaf0bf12b881dc200c9833da726e9376c2e32cff7", mac);
+
+    const char* data2 = "what do ya want for nothing?";
+    Sha256::hmac((const uint8_t*)"Jefe", 4, (const uint8_t*)data2, strlen(data2), mac);
+    assertDigest("5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843", mac);
+
+    //-- A key longer than a block is hashed first
+    uint8_t key6[131];
+    memset(key6, 0xaa, sizeof(key6));
+    const char* data6 = "Test Using Larger Than Block-Size Key - Hash Key First";
+    Sha256::hmac(key6, sizeof(key6), (const uint8_t*)data6, strlen(data6), mac);
+    assertDigest("60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54", mac);
+}
+
+void test_parse_hex()
+{
+    uint8_t digest[Sha256::DIGEST_SIZE];
+    TEST_ASSERT_TRUE(Sha256::parseHex("BA7816BF8F01CFEA414140DE5DAE2223B00361A396177A9CB410FF61F20015AD", digest));
+    TEST_ASSERT_EQUAL(0xba, digest[0]);
+    TEST_ASSERT_EQUAL(0xad, digest[31]);
+    TEST_ASSERT_FALSE(Sha256::parseHex(nullptr, digest));
+    TEST_ASSERT_FALSE(Sha256::parseHex("ba7816bf", digest));
+    TEST_ASSERT_FALSE(Sha256::parseHex("ga7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", digest));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_short_messages);
+    RUN_TEST(test_two_blocks);
+    RUN_TEST(test_million_a_in_uneven_pieces);
+    RUN_TEST(test_reset_starts_over);
+    RUN_TEST(test_hmac);
+    RUN_TEST(test_parse_hex);
+    return UNITY_END();
+}
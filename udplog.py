@@ -0,0 +1,47 @@
+#!/usr/bin/env python3
+#
+# Prints the log lines of devices sending raw UDP log datagrams
+# (Networking::enableUdpLog(host, port, UdpLog::RAW)) and reports lost
+# datagrams per device.
+#
+#   python3 udplog.py [--port 5514]
+#
+# Every datagram starts with a "#<sequence> <hostname>" line, the rest
+# are complete log lines.
+
+import argparse
+import socket
+import time
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Collect raw UDP log datagrams")
+    parser.add_argument("--port", type=int, default=5514)
+    parser.add_argument("--bind", default="", help="local address to listen on")
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind((args.bind, args.port))
+    expected = {}   # address -> next sequence number
+    lost = {}
+    while True:
+        packet, address = sock.recvfrom(2048)
+        header, _, body = packet.partition(b"\n")
+        if not header.startswith(b"#"):
+            continue
+        fields = header[1:].decode(errors="replace").split(" ", 1)
+        sequence = int(fields[0])
+        name = fields[1] if len(fields) > 1 else address[0]
+        if address in expected and sequence < expected[address]:
+            print("%s %-16s -- restarted" % (time.strftime("%H:%M:%S"), name))
+        elif address in expected and sequence > expected[address]:
+            gap = sequence - expected[address]
+            lost[address] = lost.get(address, 0) + gap
+            print("%s %-16s -- %d datagram(s) lost (%d in total)" % (time.strftime("%H:%M:%S"), name, gap, lost[address]))
+        expected[address] = sequence + 1
+        for line in body.decode(errors="replace").replace("\r\n", "\n").replace("\r", "\n").splitlines():
+            print("%s %-16s %s" % (time.strftime("%H:%M:%S"), name, line))
+
+
+if __name__ == "__main__":
+    main()